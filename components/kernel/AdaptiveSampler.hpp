@@ -0,0 +1,99 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+using namespace std::chrono;
+
+namespace farmhub::kernel {
+
+/**
+ * @brief Decides how often to sample a slowly changing, positive signal, like light level,
+ * that only matters when it crosses one of a few thresholds.
+ *
+ * The signal is assumed to change by at most a factor of `maxChangePerMinute` per minute.
+ * From the distance to the nearest threshold on a logarithmic scale we know how long it takes
+ * the signal to reach it at the earliest; we sample a few times within that period, and at
+ * `minInterval` when close.
+ *
+ * Intervals are `minInterval` times a power of two, so sampling jobs stay aligned with each other,
+ * and only need to be rescheduled when the signal moves a whole step closer or further.
+ */
+class AdaptiveSampler {
+public:
+    struct Band {
+        double low;
+        double high;
+
+        bool contains(double value) const {
+            return value >= low && value < high;
+        }
+    };
+
+    AdaptiveSampler(microseconds minInterval, microseconds maxInterval, double maxChangePerMinute = 2.0, double floor = 0.1)
+        : minInterval(minInterval)
+        , maxInterval(std::max(minInterval, maxInterval))
+        , maxLogRatePerSecond(std::log(maxChangePerMinute) / 60.0)
+        , floor(floor) {
+    }
+
+    void setThresholds(std::vector<double> thresholds) {
+        std::sort(thresholds.begin(), thresholds.end());
+        this->thresholds = thresholds;
+    }
+
+    /**
+     * @brief How long to wait before taking the next sample when the signal is at `value`.
+     */
+    microseconds nextInterval(double value) const {
+        if (thresholds.empty() || std::isnan(value)) {
+            return minInterval;
+        }
+        double distance = std::numeric_limits<double>::max();
+        for (auto threshold : thresholds) {
+            distance = std::min(distance, std::abs(std::log(clamp(value) / clamp(threshold))));
+        }
+        // Sample at least this many times before the signal could reach the threshold
+        constexpr double SAMPLES_BEFORE_CROSSING = 4;
+        auto earliestCrossing = duration<double>(distance / maxLogRatePerSecond / SAMPLES_BEFORE_CROSSING);
+
+        auto interval = minInterval;
+        while (interval * 2 <= earliestCrossing && interval * 2 <= maxInterval) {
+            interval *= 2;
+        }
+        return interval;
+    }
+
+    /**
+     * @brief The thresholds directly below and above `value`; the signal leaving it is worth a look.
+     */
+    Band bandAround(double value) const {
+        Band band { 0, std::numeric_limits<double>::infinity() };
+        for (auto threshold : thresholds) {
+            if (threshold <= value) {
+                band.low = threshold;
+            } else {
+                band.high = threshold;
+                break;
+            }
+        }
+        return band;
+    }
+
+private:
+    double clamp(double value) const {
+        return std::max(value, floor);
+    }
+
+    const microseconds minInterval;
+    const microseconds maxInterval;
+    const double maxLogRatePerSecond;
+    // Signal levels below this are treated as this, so darkness isn't infinitely far from any threshold
+    const double floor;
+    std::vector<double> thresholds;
+};
+
+}    // namespace farmhub::kernel
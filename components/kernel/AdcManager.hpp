@@ -0,0 +1,296 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include <esp_adc/adc_cali.h>
+#include <esp_adc/adc_cali_scheme.h>
+#include <esp_adc/adc_oneshot.h>
+#include <soc/soc_caps.h>
+
+#if SOC_ADC_DMA_SUPPORTED
+#include <esp_adc/adc_continuous.h>
+#endif
+
+#include <AnalogFilter.hpp>
+#include <BootClock.hpp>
+#include <Concurrent.hpp>
+#include <Log.hpp>
+#include <Pin.hpp>
+
+using namespace std::chrono;
+
+namespace farmhub::kernel {
+
+class AnalogChannel;
+using AnalogChannelPtr = std::shared_ptr<AnalogChannel>;
+
+class AnalogChannel {
+public:
+    AnalogChannel(InternalPinPtr pin, adc_channel_t channel, AnalogCalibration calibration, bool continuous)
+        : pin(pin)
+        , channel(channel)
+        , calibration(std::move(calibration))
+        , continuous(continuous)
+        , oneshot(continuous ? nullptr : std::make_unique<AnalogPin>(pin)) {
+    }
+
+    const std::string& getName() const {
+        return pin->getName();
+    }
+
+private:
+    const InternalPinPtr pin;
+    const adc_channel_t channel;
+    const AnalogCalibration calibration;
+    // Whether the channel can be sampled in continuous mode
+    const bool continuous;
+    // Used to sample the channel otherwise
+    const std::unique_ptr<AnalogPin> oneshot;
+
+    friend class AdcManager;
+};
+
+/**
+ * @brief Takes filtered, calibrated readings of analog inputs.
+ *
+ * Each reading is the filtered mean of a burst of samples (see `AnalogFilter`). Channels on ADC1 are
+ * sampled together in continuous mode: the conversions run into DMA while the calling task blocks,
+ * and the burst is over in a few milliseconds. Other channels (ADC2 is shared with the radio) are
+ * sampled one at a time in oneshot mode.
+ *
+ * Raw values are converted using the ADC calibration burnt into eFuse; chips without one use the
+ * nominal 3.3 V full scale.
+ */
+class AdcManager {
+public:
+    static constexpr size_t DEFAULT_SAMPLES_PER_CHANNEL = 64;
+    static constexpr uint32_t DEFAULT_SAMPLE_FREQUENCY = 20 * 1000;
+
+    AdcManager(size_t samplesPerChannel = DEFAULT_SAMPLES_PER_CHANNEL, uint32_t sampleFrequency = DEFAULT_SAMPLE_FREQUENCY)
+        : samplesPerChannel(samplesPerChannel)
+        , sampleFrequency(sampleFrequency) {
+    }
+
+    ~AdcManager() {
+#if SOC_ADC_DMA_SUPPORTED
+        if (continuousHandle != nullptr) {
+            ESP_ERROR_CHECK(adc_continuous_deinit(continuousHandle));
+        }
+#endif
+    }
+
+    AnalogChannelPtr registerChannel(InternalPinPtr pin) {
+        Lock lock(mutex);
+        auto it = channels.find(pin->getGpio());
+        if (it != channels.end()) {
+            return it->second;
+        }
+
+        adc_unit_t unit;
+        adc_channel_t channel;
+        ESP_ERROR_CHECK(adc_oneshot_io_to_channel(pin->getGpio(), &unit, &channel));
+        auto calibration = createCalibration(unit, channel);
+#if SOC_ADC_DMA_SUPPORTED
+        bool continuous = unit == ADC_UNIT_1;
+#else
+        bool continuous = false;
+#endif
+        LOGI("Registering analog channel on pin %s (ADC%d channel %d, %s, %s mode)",
+            pin->getName().c_str(), static_cast<int>(unit) + 1, static_cast<int>(channel),
+            calibration.isCalibrated() ? "calibrated" : "uncalibrated",
+            continuous ? "continuous" : "oneshot");
+        auto analogChannel = std::make_shared<AnalogChannel>(pin, channel, calibration, continuous);
+        channels[pin->getGpio()] = analogChannel;
+        return analogChannel;
+    }
+
+    std::optional<AnalogReading> read(const AnalogChannelPtr& channel) {
+        return readAll({ channel }).front();
+    }
+
+    /**
+     * @brief Read several distinct channels at once.
+     */
+    std::vector<std::optional<AnalogReading>> readAll(const std::vector<AnalogChannelPtr>& channels) {
+        Lock lock(mutex);
+        std::vector<std::optional<AnalogReading>> readings(channels.size());
+
+        std::vector<uint8_t> burstChannels;
+        std::vector<size_t> burstIndices;
+        for (size_t i = 0; i < channels.size(); i++) {
+            const auto& channel = channels[i];
+            if (channel->continuous) {
+                burstChannels.push_back(channel->channel);
+                burstIndices.push_back(i);
+            } else {
+                readings[i] = readOneshot(*channel);
+            }
+        }
+
+        if (!burstChannels.empty()) {
+            AnalogBurst burst(burstChannels, samplesPerChannel);
+            acquireContinuous(burst, burstChannels);
+            for (size_t i = 0; i < burstIndices.size(); i++) {
+                auto index = burstIndices[i];
+                readings[index] = filter.apply(burst.samplesAt(i), channels[index]->calibration);
+            }
+        }
+        return readings;
+    }
+
+private:
+    static constexpr adc_atten_t ATTENUATION = ADC_ATTEN_DB_12;
+
+    static AnalogCalibration createCalibration(adc_unit_t unit, adc_channel_t channel) {
+        adc_cali_handle_t handle = nullptr;
+        esp_err_t err = ESP_ERR_NOT_SUPPORTED;
+#if ADC_CALI_SCHEME_CURVE_FITTING_SUPPORTED
+        adc_cali_curve_fitting_config_t config = {
+            .unit_id = unit,
+            .chan = channel,
+            .atten = ATTENUATION,
+            .bitwidth = ADC_BITWIDTH_DEFAULT,
+        };
+        err = adc_cali_create_scheme_curve_fitting(&config, &handle);
+#elif ADC_CALI_SCHEME_LINE_FITTING_SUPPORTED
+        adc_cali_line_fitting_config_t config = {
+            .unit_id = unit,
+            .atten = ATTENUATION,
+            .bitwidth = ADC_BITWIDTH_DEFAULT,
+        };
+        err = adc_cali_create_scheme_line_fitting(&config, &handle);
+#endif
+        if (err != ESP_OK) {
+            LOGW("No calibration for ADC%d channel %d, using nominal conversion: %s",
+                static_cast<int>(unit) + 1, static_cast<int>(channel), esp_err_to_name(err));
+            return AnalogCalibration::nominal(3300, 4096);
+        }
+        auto converter = [handle](int raw) -> std::optional<double> {
+            int millivolts;
+            if (adc_cali_raw_to_voltage(handle, raw, &millivolts) != ESP_OK) {
+                return std::nullopt;
+            }
+            return millivolts;
+        };
+        return AnalogCalibration(converter, true);
+    }
+
+    std::optional<AnalogReading> readOneshot(const AnalogChannel& channel) {
+        std::vector<uint16_t> samples;
+        samples.reserve(samplesPerChannel);
+        for (size_t i = 0; i < samplesPerChannel; i++) {
+            auto value = channel.oneshot->analogRead();
+            if (value.has_value()) {
+                samples.push_back(value.value());
+            }
+        }
+        if (samples.size() < samplesPerChannel) {
+            LOGD("Got only %d of %d samples from pin %s",
+                static_cast<int>(samples.size()), static_cast<int>(samplesPerChannel), channel.getName().c_str());
+        }
+        return filter.apply(samples, channel.calibration);
+    }
+
+    void acquireContinuous([[maybe_unused]] AnalogBurst& burst, [[maybe_unused]] const std::vector<uint8_t>& burstChannels) {
+#if SOC_ADC_DMA_SUPPORTED
+        if (continuousHandle == nullptr) {
+            adc_continuous_handle_cfg_t handleConfig = {
+                .max_store_buf_size = FRAME_SIZE * 4,
+                .conv_frame_size = FRAME_SIZE,
+                .flags = {
+                    .flush_pool = true,
+                },
+            };
+            ESP_ERROR_CHECK(adc_continuous_new_handle(&handleConfig, &continuousHandle));
+        }
+
+        std::vector<adc_digi_pattern_config_t> patterns;
+        for (auto channel : burstChannels) {
+            patterns.push_back({
+                .atten = ATTENUATION,
+                .channel = channel,
+                .unit = ADC_UNIT_1,
+                .bit_width = SOC_ADC_DIGI_MAX_BITWIDTH,
+            });
+        }
+        adc_continuous_config_t config = {
+            .pattern_num = static_cast<uint32_t>(patterns.size()),
+            .adc_pattern = patterns.data(),
+            .sample_freq_hz = sampleFrequency,
+            .conv_mode = ADC_CONV_SINGLE_UNIT_1,
+            .format = OUTPUT_FORMAT,
+        };
+        ESP_ERROR_CHECK(adc_continuous_config(continuousHandle, &config));
+
+        // Allow twice the time the conversions should take
+        auto expected = microseconds(1'000'000 * samplesPerChannel * burstChannels.size() / sampleFrequency);
+        auto deadline = boot_clock::now() + 2 * expected + 10ms;
+
+        ESP_ERROR_CHECK(adc_continuous_start(continuousHandle));
+        while (!burst.isComplete()) {
+            auto remaining = duration_cast<milliseconds>(deadline - boot_clock::now());
+            if (remaining <= 0ms) {
+                LOGD("Timed out waiting for ADC conversions");
+                break;
+            }
+            uint32_t length = 0;
+            esp_err_t err = adc_continuous_read(continuousHandle, frame.data(), frame.size(), &length, remaining.count());
+            if (err != ESP_OK) {
+                LOGD("Failed to read ADC conversions: %s",
+                    esp_err_to_name(err));
+                break;
+            }
+            for (uint32_t offset = 0; offset + SOC_ADC_DIGI_RESULT_BYTES <= length; offset += SOC_ADC_DIGI_RESULT_BYTES) {
+                auto* result = reinterpret_cast<const adc_digi_output_data_t*>(&frame[offset]);
+                burst.add(getChannel(result), getData(result));
+            }
+        }
+        ESP_ERROR_CHECK(adc_continuous_stop(continuousHandle));
+        // Don't let conversions left in the pool end up in the next burst
+        ESP_ERROR_CHECK(adc_continuous_flush_pool(continuousHandle));
+#endif
+    }
+
+#if SOC_ADC_DMA_SUPPORTED
+    static constexpr uint32_t FRAME_SIZE = 256;
+
+#if CONFIG_IDF_TARGET_ESP32 || CONFIG_IDF_TARGET_ESP32S2
+    static constexpr adc_digi_output_format_t OUTPUT_FORMAT = ADC_DIGI_OUTPUT_FORMAT_TYPE1;
+
+    static uint8_t getChannel(const adc_digi_output_data_t* result) {
+        return result->type1.channel;
+    }
+
+    static uint16_t getData(const adc_digi_output_data_t* result) {
+        return result->type1.data;
+    }
+#else
+    static constexpr adc_digi_output_format_t OUTPUT_FORMAT = ADC_DIGI_OUTPUT_FORMAT_TYPE2;
+
+    static uint8_t getChannel(const adc_digi_output_data_t* result) {
+        return result->type2.channel;
+    }
+
+    static uint16_t getData(const adc_digi_output_data_t* result) {
+        return result->type2.data;
+    }
+#endif
+
+    adc_continuous_handle_t continuousHandle = nullptr;
+    std::array<uint8_t, FRAME_SIZE> frame;
+#endif
+
+    const size_t samplesPerChannel;
+    const uint32_t sampleFrequency;
+    const AnalogFilter filter;
+
+    Mutex mutex;
+    std::map<gpio_num_t, AnalogChannelPtr> channels;
+};
+
+}    // namespace farmhub::kernel
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <vector>
+
+namespace farmhub::kernel {
+
+struct AnalogReading {
+    double millivolts;
+    // Mean raw ADC code; thanks to oversampling it has a fractional part, too
+    double raw;
+    // Number of samples averaged
+    size_t samples;
+};
+
+/**
+ * @brief Converts raw ADC codes to millivolts.
+ *
+ * Calibration schemes only convert whole codes, so the fractional part of an oversampled
+ * reading is interpolated between the neighbouring codes instead of being thrown away.
+ */
+class AnalogCalibration {
+public:
+    using Converter = std::function<std::optional<double>(int raw)>;
+
+    /**
+     * @brief Nominal linear conversion, for when the chip has no calibration data.
+     */
+    static AnalogCalibration nominal(double fullScaleMillivolts, int codes) {
+        auto converter = [fullScaleMillivolts, codes](int raw) -> std::optional<double> {
+            return raw * fullScaleMillivolts / codes;
+        };
+        return AnalogCalibration(converter, false);
+    }
+
+    AnalogCalibration(Converter converter, bool calibrated)
+        : converter(std::move(converter))
+        , calibrated(calibrated) {
+    }
+
+    std::optional<double> toMillivolts(double raw) const {
+        int low = static_cast<int>(std::floor(raw));
+        auto lowMillivolts = converter(low);
+        double fraction = raw - low;
+        if (!lowMillivolts.has_value() || fraction == 0) {
+            return lowMillivolts;
+        }
+        auto highMillivolts = converter(low + 1);
+        if (!highMillivolts.has_value()) {
+            return lowMillivolts;
+        }
+        return *lowMillivolts + fraction * (*highMillivolts - *lowMillivolts);
+    }
+
+    bool isCalibrated() const {
+        return calibrated;
+    }
+
+private:
+    Converter converter;
+    bool calibrated;
+};
+
+/**
+ * @brief Combines a burst of raw samples of a channel into a single reading.
+ *
+ * Averaging N samples reduces random noise by a factor of sqrt(N). Before averaging, the highest
+ * and lowest `trim` fraction of the samples are dropped, so that the occasional spike, e.g. when
+ * the radio transmits, doesn't pull the mean.
+ */
+class AnalogFilter {
+public:
+    static constexpr double DEFAULT_TRIM = 0.125;
+
+    explicit AnalogFilter(double trim = DEFAULT_TRIM)
+        : trim(std::clamp(trim, 0.0, 0.45)) {
+    }
+
+    /**
+     * @brief Filter the samples and convert the result. Samples are reordered in place.
+     */
+    std::optional<AnalogReading> apply(std::vector<uint16_t>& samples, const AnalogCalibration& calibration) const {
+        if (samples.empty()) {
+            return std::nullopt;
+        }
+        std::sort(samples.begin(), samples.end());
+        auto dropped = static_cast<size_t>(samples.size() * trim);
+        auto kept = samples.size() - 2 * dropped;
+        uint64_t sum = 0;
+        for (size_t i = dropped; i < dropped + kept; i++) {
+            sum += samples[i];
+        }
+        double raw = static_cast<double>(sum) / kept;
+        auto millivolts = calibration.toMillivolts(raw);
+        if (!millivolts.has_value()) {
+            return std::nullopt;
+        }
+        return AnalogReading { *millivolts, raw, kept };
+    }
+
+private:
+    const double trim;
+};
+
+/**
+ * @brief Collects samples of a few distinct channels, as they arrive interleaved from continuous conversion.
+ */
+class AnalogBurst {
+public:
+    AnalogBurst(std::vector<uint8_t> channels, size_t samplesPerChannel)
+        : channels(std::move(channels))
+        , samplesPerChannel(samplesPerChannel)
+        , samples(this->channels.size()) {
+        for (auto& channelSamples : samples) {
+            channelSamples.reserve(samplesPerChannel);
+        }
+    }
+
+    /**
+     * @brief Add a sample; samples of channels we don't collect, or have enough of already, are ignored.
+     */
+    void add(uint8_t channel, uint16_t raw) {
+        for (size_t i = 0; i < channels.size(); i++) {
+            if (channels[i] == channel) {
+                if (samples[i].size() < samplesPerChannel) {
+                    samples[i].push_back(raw);
+                }
+                return;
+            }
+        }
+    }
+
+    bool isComplete() const {
+        return std::all_of(samples.begin(), samples.end(), [this](const auto& channelSamples) {
+            return channelSamples.size() >= samplesPerChannel;
+        });
+    }
+
+    /**
+     * @brief Samples of the channel at `index` in the list of channels we collect.
+     */
+    std::vector<uint16_t>& samplesAt(size_t index) {
+        return samples[index];
+    }
+
+private:
+    const std::vector<uint8_t> channels;
+    const size_t samplesPerChannel;
+    std::vector<std::vector<uint16_t>> samples;
+};
+
+}    // namespace farmhub::kernel
@@ -0,0 +1,274 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include <Memory.hpp>
+
+namespace farmhub::kernel {
+
+/**
+ * @brief Counts allocation requests, and how many of them had to be served from the heap.
+ */
+struct ArenaStats {
+    std::atomic<uint32_t> requests { 0 };
+    std::atomic<uint32_t> heapAllocations { 0 };
+};
+
+/**
+ * @brief A bump allocator over a fixed buffer.
+ *
+ * Allocating only moves the top of the arena, and all memory is given back at once via `reset()`.
+ * Freeing or resizing the most recent block happens in place, which covers how ArduinoJson grows
+ * strings and trims slot pools. Requests that don't fit are passed on to the heap.
+ *
+ * An arena is used by a single task at a time; only the stats are shared.
+ */
+class BumpArena {
+public:
+    BumpArena(size_t capacity, ArenaStats& stats, MemoryPlacement placement = MemoryPlacement::Internal, MemoryTag& bufferTag = MemoryTag::untagged())
+        : capacity(alignUp(capacity))
+        , placement(placement)
+        , buffer(this->capacity == 0
+                  ? nullptr
+                  : static_cast<uint8_t*>(Memory::allocate(this->capacity, placement, bufferTag)))
+        , stats(stats) {
+        if (this->capacity > 0 && buffer == nullptr) {
+            throw std::bad_alloc();
+        }
+    }
+
+    BumpArena(const BumpArena&) = delete;
+    BumpArena& operator=(const BumpArena&) = delete;
+
+    ~BumpArena() {
+        Memory::free(buffer);
+    }
+
+    void* allocate(size_t size) {
+        stats.requests++;
+        size_t needed = HEADER + alignUp(size);
+        if (needed > capacity - top) {
+            stats.heapAllocations++;
+            return Memory::allocate(size, placement, *tag);
+        }
+        last = top;
+        top += needed;
+        highWater = std::max(highWater, top);
+        return place(last, size);
+    }
+
+    void deallocate(void* ptr) {
+        if (ptr == nullptr) {
+            return;
+        }
+        if (!contains(ptr)) {
+            Memory::free(ptr);
+            return;
+        }
+        if (isLast(ptr)) {
+            top = last;
+            last = NONE;
+        }
+    }
+
+    void* reallocate(void* ptr, size_t size) {
+        if (ptr == nullptr) {
+            return allocate(size);
+        }
+        if (!contains(ptr)) {
+            stats.requests++;
+            stats.heapAllocations++;
+            return Memory::reallocate(ptr, size, placement, *tag);
+        }
+
+        size_t oldSize = sizeOf(ptr);
+        if (isLast(ptr) && HEADER + alignUp(size) <= capacity - last) {
+            // Grow or shrink the top block in place
+            stats.requests++;
+            top = last + HEADER + alignUp(size);
+            highWater = std::max(highWater, top);
+            return place(last, size);
+        }
+        if (size <= oldSize) {
+            // Shrinking a block further down; the tail is reclaimed on reset
+            stats.requests++;
+            return ptr;
+        }
+
+        void* moved = allocate(size);
+        if (moved != nullptr) {
+            std::memcpy(moved, ptr, oldSize);
+        }
+        deallocate(ptr);
+        return moved;
+    }
+
+    /**
+     * @brief Release every block allocated from the arena.
+     *
+     * Blocks that overflowed to the heap must be freed individually before this.
+     */
+    void reset() {
+        top = 0;
+        last = NONE;
+        tag = &MemoryTag::untagged();
+    }
+
+    /**
+     * @brief Account blocks that overflow to the heap to the given tag, until the next reset.
+     */
+    void setTag(MemoryTag& tag) {
+        this->tag = &tag;
+    }
+
+    bool contains(const void* ptr) const {
+        auto address = static_cast<const uint8_t*>(ptr);
+        return address >= base() && address < base() + capacity;
+    }
+
+    size_t getCapacity() const {
+        return capacity;
+    }
+
+    size_t getUsed() const {
+        return top;
+    }
+
+    size_t getHighWater() const {
+        return highWater;
+    }
+
+private:
+    static constexpr size_t ALIGNMENT = alignof(std::max_align_t);
+    static constexpr size_t NONE = SIZE_MAX;
+
+    static constexpr size_t alignUp(size_t size) {
+        return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    }
+
+    // Each block is preceded by its size so it can be copied when it needs to move
+    static constexpr size_t HEADER = (sizeof(size_t) + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+
+    uint8_t* base() const {
+        return buffer;
+    }
+
+    void* place(size_t offset, size_t size) {
+        uint8_t* block = base() + offset;
+        *reinterpret_cast<size_t*>(block) = size;
+        return block + HEADER;
+    }
+
+    size_t sizeOf(const void* ptr) const {
+        return *reinterpret_cast<const size_t*>(static_cast<const uint8_t*>(ptr) - HEADER);
+    }
+
+    bool isLast(const void* ptr) const {
+        return last != NONE && ptr == base() + last + HEADER;
+    }
+
+    const size_t capacity;
+    const MemoryPlacement placement;
+    uint8_t* const buffer;
+    ArenaStats& stats;
+
+    size_t top = 0;
+    size_t last = NONE;
+    size_t highWater = 0;
+    MemoryTag* tag = &MemoryTag::untagged();
+};
+
+/**
+ * @brief A fixed set of arenas handed out for the duration of a single operation.
+ *
+ * When every arena is in use (e.g. a command handler publishing while the log and telemetry tasks
+ * also publish), the lease falls back to an empty arena that serves everything from the heap.
+ */
+class ArenaPool {
+public:
+    class Lease {
+    public:
+        Lease(ArenaPool& pool, size_t index, MemoryTag& tag)
+            : pool(pool)
+            , index(index)
+            , heapOnly(0, pool.stats, pool.placement) {
+            get().setTag(tag);
+        }
+
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+
+        ~Lease() {
+            if (index != NO_ARENA) {
+                pool.release(index);
+            }
+        }
+
+        BumpArena& get() {
+            return index == NO_ARENA
+                ? heapOnly
+                : *pool.arenas[index];
+        }
+
+    private:
+        ArenaPool& pool;
+        const size_t index;
+        // Capacity of zero, so it costs nothing when not needed
+        BumpArena heapOnly;
+    };
+
+    ArenaPool(size_t count, size_t capacity, MemoryPlacement placement = MemoryPlacement::Internal, MemoryTag& bufferTag = MemoryTag::untagged())
+        : placement(placement)
+        , inUse(std::make_unique<std::atomic<bool>[]>(count)) {
+        for (size_t i = 0; i < count; i++) {
+            arenas.emplace_back(std::make_unique<BumpArena>(capacity, stats, placement, bufferTag));
+        }
+    }
+
+    /**
+     * @brief Lease an arena; blocks that overflow it are accounted to `tag`.
+     */
+    Lease acquire(MemoryTag& tag = MemoryTag::untagged()) {
+        for (size_t i = 0; i < arenas.size(); i++) {
+            bool expected = false;
+            if (inUse[i].compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+                return { *this, i, tag };
+            }
+        }
+        return { *this, NO_ARENA, tag };
+    }
+
+    const ArenaStats& getStats() const {
+        return stats;
+    }
+
+    size_t getHighWater() const {
+        size_t highWater = 0;
+        for (auto& arena : arenas) {
+            highWater = std::max(highWater, arena->getHighWater());
+        }
+        return highWater;
+    }
+
+private:
+    static constexpr size_t NO_ARENA = SIZE_MAX;
+
+    void release(size_t index) {
+        arenas[index]->reset();
+        inUse[index].store(false, std::memory_order_release);
+    }
+
+    ArenaStats stats;
+    const MemoryPlacement placement;
+    std::vector<std::unique_ptr<BumpArena>> arenas;
+    const std::unique_ptr<std::atomic<bool>[]> inUse;
+};
+
+}    // namespace farmhub::kernel
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <string>
+
+#include <Log.hpp>
+
+namespace farmhub::kernel {
+
+/**
+ * @brief Replace the contents of the file, creating its parent directories as needed.
+ *
+ * The contents are written to a temporary file first, and then renamed over the original, so on a file system
+ * with atomic renames like LittleFS, a power cut leaves either the old or the new contents, but never a mix.
+ * Returns the number of bytes written, or zero if the file was left as it was.
+ *
+ * Works with `FileSystem`, or anything else with the same file operations.
+ */
+template <typename TFileSystem>
+size_t writeAtomically(TFileSystem& fs, const std::string& path, const std::string& contents) {
+    for (size_t separator = path.find('/', 1); separator != std::string::npos; separator = path.find('/', separator + 1)) {
+        if (!fs.makeDirectory(path.substr(0, separator))) {
+            return 0;
+        }
+    }
+    std::string tempPath = path + ".tmp";
+    size_t bytesWritten = fs.write(tempPath, contents.c_str(), contents.size());
+    if (bytesWritten != contents.size()) {
+        LOGTE(Tag::FS, "Failed to write %s (%u of %u bytes written)",
+            tempPath.c_str(), bytesWritten, contents.size());
+        fs.remove(tempPath);
+        return 0;
+    }
+    if (!fs.rename(tempPath, path)) {
+        fs.remove(tempPath);
+        return 0;
+    }
+    return bytesWritten;
+}
+
+}    // namespace farmhub::kernel
@@ -5,8 +5,9 @@
 
 #include <esp_sleep.h>
 
-#include <MovingAverage.hpp>
+#include <Scheduler.hpp>
 #include <ShutdownManager.hpp>
+#include <Statistics.hpp>
 #include <Task.hpp>
 #include <Telemetry.hpp>
 #include <drivers/BatteryDriver.hpp>
@@ -31,16 +32,17 @@ class BatteryManager : public TelemetryProvider {
 public:
     BatteryManager(
         std::shared_ptr<BatteryDriver> battery,
-        std::shared_ptr<ShutdownManager> shutdownManager)
+        std::shared_ptr<ShutdownManager> shutdownManager,
+        std::shared_ptr<Scheduler> scheduler)
         : battery(battery)
         , shutdownManager(shutdownManager) {
-        Task::loop("battery", 2560, [this](Task& task) {
-            checkBatteryVoltage(task);
+        scheduler->schedule("battery", LOW_POWER_CHECK_INTERVAL, LOW_POWER_CHECK_TOLERANCE, [this]() {
+            checkBatteryVoltage();
         });
     }
 
     float getVoltage() {
-        return batteryVoltage.getAverage();
+        return batteryVoltage.getMean();
     }
 
     void populateTelemetry(JsonObject& json) override {
@@ -51,11 +53,11 @@ public:
     }
 
 private:
-    void checkBatteryVoltage(Task& task) {
-        task.delayUntil(LOW_POWER_CHECK_INTERVAL);
+    void checkBatteryVoltage() {
         auto currentVoltage = battery->getVoltage();
-        batteryVoltage.record(currentVoltage);
-        auto voltage = batteryVoltage.getAverage();
+        // Drop glitches (e.g. from motors starting) so they cannot trigger a shutdown
+        batteryVoltage.record(voltageOutliers.filter(currentVoltage));
+        auto voltage = batteryVoltage.getMean();
 
         if (voltage != 0.0 && voltage < battery->parameters.shutdownThreshold) {
             LOGI("Battery voltage low (%.2f V < %.2f), starting shutdown process, will go to deep sleep in %lld seconds",
@@ -73,14 +75,21 @@ private:
     const std::shared_ptr<BatteryDriver> battery;
     const std::shared_ptr<ShutdownManager> shutdownManager;
 
-    MovingAverage<double> batteryVoltage { 5 };
+    HampelFilter<double, 5> voltageOutliers;
+    MovingMean<double, 5> batteryVoltage;
 
     /**
      * @brief How often we check the battery voltage while in operation.
      *
-     * We use a prime number to avoid synchronizing with other tasks.
+     * The scheduler aligns wakeups to multiples of the period, so we use a round number
+     * to share wakeups with other periodic jobs.
      */
-    static constexpr auto LOW_POWER_CHECK_INTERVAL = 10313ms;
+    static constexpr auto LOW_POWER_CHECK_INTERVAL = 10s;
+
+    /**
+     * @brief How late a battery check can be to share a wakeup with other jobs.
+     */
+    static constexpr auto LOW_POWER_CHECK_TOLERANCE = 5s;
 
     /**
      * @brief Time to wait for shutdown process to finish before going to deep sleep.
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <optional>
+#include <vector>
+
+using namespace std::chrono;
+
+namespace farmhub::kernel {
+
+/**
+ * @brief Plays blink patterns on any number of LEDs, driven by whoever calls `advance()`.
+ *
+ * A pattern is a list of durations: positive ones keep the LED on, negative ones keep it off,
+ * and the list repeats. A single-element pattern, or a duration of `milliseconds::max()`, is a
+ * steady state that needs no further updates.
+ *
+ * Times are measured as time since boot. The sequencer itself keeps no clock and does no locking;
+ * see `BlinkEngine` for the timer-driven backend.
+ */
+class BlinkSequencer {
+public:
+    using Output = std::function<void(bool on)>;
+    using Time = microseconds;
+
+    size_t add(Output output) {
+        leds.emplace_back().output = output;
+        return leds.size() - 1;
+    }
+
+    /**
+     * @brief Start playing the pattern from its first step right away.
+     *
+     * Setting the pattern that's already playing does not restart it.
+     */
+    template <typename Iterator>
+    void setPattern(size_t index, Iterator begin, Iterator end, Time now) {
+        auto& led = leds[index];
+        if (led.started && std::equal(begin, end, led.pattern.begin(), led.pattern.end())) {
+            return;
+        }
+        // Reuses the capacity of the previous pattern
+        led.pattern.assign(begin, end);
+        led.started = true;
+        led.cursor = 0;
+        apply(led, now);
+    }
+
+    /**
+     * @brief Take every step that is due by `now`.
+     *
+     * @return when `advance()` should be called next, if ever.
+     */
+    std::optional<Time> advance(Time now) {
+        for (auto& led : leds) {
+            if (led.deadline.has_value() && *led.deadline <= now) {
+                led.cursor = (led.cursor + 1) % led.pattern.size();
+                apply(led, *led.deadline, now);
+            }
+        }
+        return nextDeadline();
+    }
+
+    std::optional<Time> nextDeadline() const {
+        std::optional<Time> next;
+        for (const auto& led : leds) {
+            if (led.deadline.has_value() && (!next.has_value() || *led.deadline < *next)) {
+                next = led.deadline;
+            }
+        }
+        return next;
+    }
+
+private:
+    struct Led {
+        Output output;
+        std::vector<milliseconds> pattern;
+        size_t cursor = 0;
+        bool started = false;
+        std::optional<Time> deadline;
+    };
+
+    static void apply(Led& led, Time now) {
+        apply(led, now, now);
+    }
+
+    /**
+     * @param scheduled when the step was supposed to start; following steps are timed from there to avoid drift.
+     */
+    static void apply(Led& led, Time scheduled, Time now) {
+        if (led.pattern.empty()) {
+            led.output(false);
+            led.deadline.reset();
+            return;
+        }
+        auto step = led.pattern[led.cursor];
+        led.output(step > milliseconds::zero());
+
+        auto length = step < milliseconds::zero() ? -step : step;
+        if (led.pattern.size() == 1 || length == milliseconds::max()) {
+            led.deadline.reset();
+            return;
+        }
+        auto next = scheduled + duration_cast<Time>(length);
+        // If we fell behind by more than a step (e.g. the timer was held up), restart timing from now
+        led.deadline = next > now
+            ? next
+            : now + duration_cast<Time>(length);
+    }
+
+    std::vector<Led> leds;
+};
+
+}    // namespace farmhub::kernel
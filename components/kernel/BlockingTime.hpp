@@ -0,0 +1,48 @@
+#pragma once
+
+#include <chrono>
+
+#include <BootClock.hpp>
+
+using namespace std::chrono;
+
+namespace farmhub::kernel {
+
+/**
+ * @brief Accumulates how long the current task spends waiting in delays and on queues.
+ *
+ * Task loops use this to leave waiting out of the time measured for an iteration.
+ */
+class BlockingTime {
+public:
+    /**
+     * @brief Counts the time until it goes out of scope as blocked; put one around each blocking call.
+     */
+    class Scope {
+    public:
+        Scope()
+            : start(boot_clock::now()) {
+        }
+
+        ~Scope() {
+            blocked += duration_cast<microseconds>(boot_clock::now() - start);
+        }
+
+    private:
+        const time_point<boot_clock> start;
+    };
+
+    /**
+     * @brief Time the current task spent blocked since the previous call.
+     */
+    static microseconds take() {
+        auto result = blocked;
+        blocked = microseconds::zero();
+        return result;
+    }
+
+private:
+    static inline thread_local microseconds blocked { 0 };
+};
+
+}    // namespace farmhub::kernel
@@ -1,7 +1,12 @@
 #pragma once
 
 #include <chrono>
+
+#ifdef FARMHUB_SIMULATION
+#include <VirtualClock.hpp>
+#else
 #include <esp_timer.h>
+#endif
 
 namespace farmhub::kernel {
 
@@ -9,6 +14,7 @@ namespace farmhub::kernel {
  *  @brief Monotonic clock based on ESP's esp_timer_get_time()
  *
  *  Time returned has the property of only increasing at a uniform rate.
+ *  In simulation builds it follows the virtual clock instead.
  */
 struct boot_clock {
     typedef std::chrono::microseconds duration;
@@ -19,7 +25,11 @@ struct boot_clock {
     static constexpr bool is_steady = true;
 
     static time_point now() noexcept {
+#ifdef FARMHUB_SIMULATION
+        return time_point(VirtualClock::sinceBoot());
+#else
         return time_point(duration(esp_timer_get_time()));
+#endif
     }
 
     static time_point zero() noexcept {
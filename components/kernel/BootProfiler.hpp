@@ -0,0 +1,207 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include <esp_attr.h>
+#include <esp_system.h>
+
+#include <ArduinoJson.h>
+
+#include <BootClock.hpp>
+#include <Log.hpp>
+#include <State.hpp>
+
+using namespace std::chrono;
+
+namespace farmhub::kernel {
+
+/**
+ * @brief Times the phases of booting, and remembers the last few boots across restarts.
+ *
+ * Each boot is recorded into RTC memory as it progresses, so even if a boot never finishes
+ * (e.g. it crashed or was reset by the watchdog), the next boot can report which phase it got stuck in.
+ */
+class BootProfiler {
+public:
+    /**
+     * @brief Start recording the boot; time spent before `app_main()` is recorded as the "startup" phase.
+     */
+    static void init() {
+        restoreHistory();
+        current = &history.records[history.next];
+        history.next = (history.next + 1) % HISTORY_SIZE;
+        std::memset(current, 0, sizeof(BootRecord));
+        current->resetReason = esp_reset_reason();
+        phaseStart = boot_clock::zero();
+        phase("startup");
+    }
+
+    /**
+     * @brief End the current phase and start a new one.
+     */
+    static void phase(const char* name) {
+        startPhase(name, false);
+    }
+
+    /**
+     * @brief Wait for the state to be set, recording the wait as a phase of its own.
+     */
+    static void await(const State& state) {
+        startPhase(state.getName().c_str(), true);
+        auto start = boot_clock::now();
+        state.awaitSet();
+        LOGD("Waited %lld ms for state '%s'",
+            duration_cast<milliseconds>(boot_clock::now() - start).count(), state.getName().c_str());
+    }
+
+    /**
+     * @brief End the last phase; the boot is complete.
+     */
+    static void finish() {
+        if (current == nullptr) {
+            return;
+        }
+        endPhase();
+        current->complete = true;
+        LOGI("Boot phases:");
+        for (uint8_t i = 0; i < current->phaseCount; i++) {
+            const auto& phase = current->phases[i];
+            LOGI(" - %s%s: %lu ms", phase.waited ? "waiting for " : "", phase.name, phase.durationMs);
+        }
+    }
+
+    /**
+     * @brief Report the phases of this boot, and a summary of earlier boots.
+     */
+    static void report(JsonObject json) {
+        if (current == nullptr) {
+            return;
+        }
+        json["total"] = current->totalMs;
+        auto phasesJson = json["phases"].to<JsonArray>();
+        for (uint8_t i = 0; i < current->phaseCount; i++) {
+            const auto& phase = current->phases[i];
+            auto phaseJson = phasesJson.add<JsonObject>();
+            phaseJson["name"] = phase.name;
+            phaseJson["duration"] = phase.durationMs;
+            if (phase.waited) {
+                phaseJson["waited"] = true;
+            }
+        }
+
+        // Earlier boots, most recent first; only the slowest phase to keep the message small
+        auto historyJson = json["history"].to<JsonArray>();
+        for (size_t age = 1; age < HISTORY_SIZE; age++) {
+            const auto& record = history.records[(history.next + HISTORY_SIZE - 1 - age) % HISTORY_SIZE];
+            if (record.phaseCount == 0) {
+                break;
+            }
+            auto recordJson = historyJson.add<JsonObject>();
+            recordJson["reset"] = record.resetReason;
+            recordJson["total"] = record.totalMs;
+            recordJson["complete"] = record.complete;
+            // For incomplete boots the last phase is where it got stuck
+            const auto& slowest = record.complete
+                ? *std::max_element(record.phases, record.phases + record.phaseCount, [](const auto& a, const auto& b) {
+                      return a.durationMs < b.durationMs;
+                  })
+                : record.phases[record.phaseCount - 1];
+            recordJson["slowest"] = slowest.name;
+            recordJson["slowest-duration"] = slowest.durationMs;
+        }
+    }
+
+private:
+    struct BootPhase {
+        char name[15];
+        bool waited;
+        uint32_t durationMs;
+    };
+
+    struct BootRecord {
+        uint32_t resetReason;
+        uint32_t totalMs;
+        uint8_t phaseCount;
+        bool complete;
+        BootPhase phases[16];
+    };
+
+    static constexpr size_t HISTORY_SIZE = 4;
+    static constexpr uint32_t MAGIC = 0xB0075EED;
+    // Bump when the layout of the history changes, so a firmware update doesn't misread the old one
+    static constexpr uint32_t VERSION = 2;
+
+    struct BootHistory {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t size;
+        uint32_t next;
+        BootRecord records[HISTORY_SIZE];
+    };
+
+    /**
+     * @brief Make sure the history left in RTC memory can be trusted, or start a new one.
+     *
+     * After power loss RTC memory holds garbage, and after an update it might hold a history
+     * recorded by a different firmware.
+     */
+    static void restoreHistory() {
+        if (history.magic != MAGIC || history.version != VERSION || history.size != sizeof(BootHistory) || history.next >= HISTORY_SIZE) {
+            LOGD("No valid boot history found, starting a new one");
+            std::memset(&history, 0, sizeof(history));
+            history.magic = MAGIC;
+            history.version = VERSION;
+            history.size = sizeof(BootHistory);
+            return;
+        }
+        // The header checking out doesn't mean every record survived, e.g. a reset while one was written
+        for (auto& record : history.records) {
+            if (record.phaseCount > std::size(record.phases)) {
+                LOGW("Boot history record has %u phases, only %u are kept",
+                    record.phaseCount, std::size(record.phases));
+                record.phaseCount = std::size(record.phases);
+            }
+            for (auto& phase : record.phases) {
+                phase.name[sizeof(phase.name) - 1] = '\0';
+            }
+        }
+    }
+
+    static void startPhase(const char* name, bool waited) {
+        if (current == nullptr) {
+            return;
+        }
+        endPhase();
+        if (current->phaseCount == std::size(current->phases)) {
+            LOGW("Too many boot phases, not recording '%s'", name);
+            return;
+        }
+        auto& phase = current->phases[current->phaseCount++];
+        std::strncpy(phase.name, name, sizeof(phase.name) - 1);
+        phase.name[sizeof(phase.name) - 1] = '\0';
+        phase.waited = waited;
+        phase.durationMs = 0;
+    }
+
+    static void endPhase() {
+        auto now = boot_clock::now();
+        if (current->phaseCount > 0) {
+            current->phases[current->phaseCount - 1].durationMs = duration_cast<milliseconds>(now - phaseStart).count();
+        }
+        current->totalMs = duration_cast<milliseconds>(now.time_since_epoch()).count();
+        phaseStart = now;
+    }
+
+    // Survives restarts, but not power loss
+    static BootHistory history;
+    static BootRecord* current;
+    static time_point<boot_clock> phaseStart;
+};
+
+RTC_NOINIT_ATTR BootProfiler::BootHistory BootProfiler::history;
+BootProfiler::BootRecord* BootProfiler::current = nullptr;
+time_point<boot_clock> BootProfiler::phaseStart;
+
+}    // namespace farmhub::kernel
@@ -1,8 +1,14 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+
+#include <BootClock.hpp>
+#include <Log.hpp>
 #include <Named.hpp>
 #include <mqtt/MqttRoot.hpp>
 
+using namespace std::chrono;
 using namespace farmhub::kernel::mqtt;
 
 namespace farmhub::kernel {
@@ -14,7 +20,27 @@ protected:
         , mqttRoot(mqttRoot) {
     }
 
+    /**
+     * @brief Note that the component took a sample; the first one is logged and published
+     * with how long after boot it happened, to keep track of how quickly sensors come online.
+     */
+    void recordSample() {
+        if (firstSampleRecorded.exchange(true)) {
+            return;
+        }
+        auto sinceBoot = duration_cast<milliseconds>(boot_clock::now().time_since_epoch());
+        LOGI("First sample from '%s' %lld ms after boot",
+            name.c_str(), sinceBoot.count());
+        // Samples are taken from scheduler jobs, often before the network is up; don't wait for delivery
+        mqttRoot->publish("events/first-sample", [sinceBoot](JsonObject& json) {
+            json["after"] = sinceBoot.count();
+        }, Retention::NoRetain, QoS::AtLeastOnce, ticks::zero());
+    }
+
     std::shared_ptr<MqttRoot> mqttRoot;
+
+private:
+    std::atomic<bool> firstSampleRecorded { false };
 };
 
 }    // namespace farmhub::kernel
@@ -8,7 +8,9 @@
 #include <freertos/FreeRTOS.h>
 
 #include <Time.hpp>
+#include <BlockingTime.hpp>
 #include <BootClock.hpp>
+#include <Memory.hpp>
 
 using namespace std::chrono;
 
@@ -41,8 +43,15 @@ protected:
 template <typename TMessage>
 class Queue : public BaseQueue {
 public:
-    Queue(const std::string& name, size_t capacity = 16)
-        : BaseQueue(name, sizeof(TMessage*), capacity) {
+    /**
+     * @param placement where queued messages are allocated; use `MemoryPlacement::Large` for queues
+     * of large messages that are never touched from an ISR.
+     * @param tag the subsystem queued messages are accounted to.
+     */
+    Queue(const std::string& name, size_t capacity = 16, MemoryPlacement placement = MemoryPlacement::Internal, MemoryTag& tag = MemoryTag::untagged())
+        : BaseQueue(name, sizeof(TMessage*), capacity)
+        , placement(placement)
+        , tag(tag) {
     }
 
     template <typename... Args>
@@ -60,12 +69,22 @@ public:
     template <typename... Args>
     requires std::constructible_from<TMessage, Args...>
     bool offerIn(ticks timeout, Args&&... args) {
-        TMessage* copy = new TMessage(std::forward<Args>(args)...);
-        bool sentWithoutDropping = xQueueSend(this->queue, &copy, timeout.count()) == pdTRUE;
+        void* memory = Memory::allocate(sizeof(TMessage), placement, tag);
+        if (memory == nullptr) {
+            printf("Out of memory in queue '%s', dropping message\n",
+                this->name.c_str());
+            return false;
+        }
+        TMessage* copy = new (memory) TMessage(std::forward<Args>(args)...);
+        bool sentWithoutDropping;
+        {
+            BlockingTime::Scope blocking;
+            sentWithoutDropping = xQueueSend(this->queue, &copy, timeout.count()) == pdTRUE;
+        }
         if (!sentWithoutDropping) {
             printf("Overflow in queue '%s', dropping message\n",
                 this->name.c_str());
-            delete copy;
+            destroy(copy);
         }
         return sentWithoutDropping;
     }
@@ -137,17 +156,31 @@ public:
 
     bool pollIn(ticks timeout, MessageHandler handler) {
         TMessage* message;
-        if (!xQueueReceive(this->queue, &message, timeout.count())) {
+        bool received;
+        {
+            BlockingTime::Scope blocking;
+            received = xQueueReceive(this->queue, &message, timeout.count());
+        }
+        if (!received) {
             return false;
         }
         handler(*message);
-        delete message;
+        destroy(message);
         return true;
     }
 
     void clear() override {
         this->drain([](const TMessage& message) {});
     }
+
+private:
+    static void destroy(TMessage* message) {
+        message->~TMessage();
+        Memory::free(message);
+    }
+
+    const MemoryPlacement placement;
+    MemoryTag& tag;
 };
 
 template <typename TMessage>
@@ -166,7 +199,11 @@ public:
     }
 
     bool offerIn(ticks timeout, const TMessage message) {
-        bool sentWithoutDropping = xQueueSend(this->queue, &message, timeout.count()) == pdTRUE;
+        bool sentWithoutDropping;
+        {
+            BlockingTime::Scope blocking;
+            sentWithoutDropping = xQueueSend(this->queue, &message, timeout.count()) == pdTRUE;
+        }
         if (!sentWithoutDropping) {
             printf("Overflow in queue '%s', dropping message",
                 this->name.c_str());
@@ -206,7 +243,12 @@ public:
 
     std::optional<TMessage> pollIn(ticks timeout) {
         TMessage message;
-        if (xQueueReceive(this->queue, &message, timeout.count())) {
+        bool received;
+        {
+            BlockingTime::Scope blocking;
+            received = xQueueReceive(this->queue, &message, timeout.count());
+        }
+        if (received) {
             return message;
         }
         return std::nullopt;
@@ -9,6 +9,7 @@
 #include <ArduinoJson.h>
 
 #include <FileSystem.hpp>
+#include <JsonArena.hpp>
 
 using std::list;
 using std::ref;
@@ -57,9 +58,17 @@ private:
     std::string value;
 };
 
+/**
+ * @brief JSON documents used to load and store configuration are accounted to `config`.
+ */
+ArduinoJson::Allocator* configJsonAllocator() {
+    static TaggedJsonAllocator allocator(MemoryTag::get("config"));
+    return &allocator;
+}
+
 bool convertToJson(const JsonAsString& src, JsonVariant dst) {
     const std::string& stringValue = src.get();
-    JsonDocument doc;
+    JsonDocument doc(configJsonAllocator());
     DeserializationError error = deserializeJson(doc, stringValue);
 
     if (error) {
@@ -80,7 +89,7 @@ bool convertFromJson(JsonVariantConst src, JsonAsString& dst) {
 class ConfigurationEntry {
 public:
     void loadFromString(const std::string& json) {
-        JsonDocument jsonDocument;
+        JsonDocument jsonDocument(configJsonAllocator());
         DeserializationError error = deserializeJson(jsonDocument, json);
         if (error == DeserializationError::EmptyInput) {
             return;
@@ -297,7 +306,7 @@ public:
                 throw ConfigurationException("Cannot open config file " + path);
             }
 
-            JsonDocument json;
+            JsonDocument json(configJsonAllocator());
             DeserializationError error = deserializeJson(json, contents.value());
             switch (error.code()) {
                 case DeserializationError::Code::Ok:
@@ -344,7 +353,7 @@ public:
     }
 
     std::string toString(bool includeDefaults = true) {
-        JsonDocument json;
+        JsonDocument json(configJsonAllocator());
         auto root = json.to<JsonObject>();
         store(root, includeDefaults);
         std::string jsonString;
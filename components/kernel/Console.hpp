@@ -20,10 +20,18 @@ class ConsoleProvider {
 public:
     static void init(std::shared_ptr<Queue<LogRecord>> logRecords, Level recordedLevel) {
         ConsoleProvider::logRecords = logRecords;
-        ConsoleProvider::recordedLevel = recordedLevel;
+        Log::setDefaultPublishLevel(recordedLevel);
         ConsoleProvider::originalVprintf = esp_log_set_vprintf(ConsoleProvider::processLogFunc);
     }
 
+    /**
+     * @brief Log records queued for publishing are accounted to `log`.
+     */
+    static MemoryTag& memoryTag() {
+        static MemoryTag& tag = MemoryTag::get("log");
+        return tag;
+    }
+
 private:
     static int processLogFunc(const char* format, va_list args) {
         std::string message = renderMessage(format, args);
@@ -55,8 +63,12 @@ private:
 
     static int processLogLine(const std::string& message) {
         Level level = getLevel(message);
-        if (level <= recordedLevel) {
-            logRecords->offer(level, message);
+        TagLevels tagLevels = Log::getLevels(getTag(message));
+        if (level <= tagLevels.mqtt) {
+            logRecords->offer(level, LargeString(message.data(), message.size(), LargeAllocator<char>(memoryTag())));
+        }
+        if (level > tagLevels.console) {
+            return 0;
         }
 
         int count = 0;
@@ -143,9 +155,24 @@ private:
         }
     }
 
+    /**
+     * @brief Extract the tag from a message formatted like 'X (timestamp) tag: ...'.
+     */
+    static std::string getTag(const std::string& message) {
+        auto tagStart = message.find(") ");
+        if (tagStart == std::string::npos) {
+            return "";
+        }
+        tagStart += 2;
+        auto tagEnd = message.find(": ", tagStart);
+        if (tagEnd == std::string::npos) {
+            return "";
+        }
+        return message.substr(tagStart, tagEnd - tagStart);
+    }
+
     static vprintf_like_t originalVprintf;
     static std::shared_ptr<Queue<LogRecord>> logRecords;
-    static Level recordedLevel;
     static std::mutex bufferMutex;
     static constexpr size_t BUFFER_SIZE = 128;
     static char buffer[];
@@ -156,7 +183,6 @@ private:
 
 vprintf_like_t ConsoleProvider::originalVprintf;
 std::shared_ptr<Queue<LogRecord>> ConsoleProvider::logRecords;
-Level ConsoleProvider::recordedLevel;
 std::mutex ConsoleProvider::bufferMutex;
 char ConsoleProvider::buffer[BUFFER_SIZE];
 std::mutex ConsoleProvider::partialMessageMutex;
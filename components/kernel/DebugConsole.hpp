@@ -3,6 +3,7 @@
 #include <esp_private/esp_clk.h>
 
 #include <BatteryManager.hpp>
+#include <Scheduler.hpp>
 #include <Strings.hpp>
 #include <drivers/RtcDriver.hpp>
 #include <drivers/WiFiDriver.hpp>
@@ -14,13 +15,12 @@ namespace farmhub::kernel {
 #ifdef FARMHUB_DEBUG
 class DebugConsole {
 public:
-    DebugConsole(const std::shared_ptr<BatteryManager> battery, const std::shared_ptr<WiFiDriver> wifi)
+    DebugConsole(const std::shared_ptr<BatteryManager> battery, const std::shared_ptr<WiFiDriver> wifi, const std::shared_ptr<Scheduler> scheduler)
         : battery(battery)
         , wifi(wifi) {
         status.reserve(256);
-        Task::loop("console", 3072, 1, [this](Task& task) {
+        scheduler->schedule("console", 250ms, [this]() {
             printStatus();
-            task.delayUntilAtLeast(250ms);
         });
     }
 
@@ -0,0 +1,418 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <functional>
+#include <stdint.h>
+
+#include <mbedtls/sha256.h>
+
+#include <Inflater.hpp>
+
+namespace farmhub::kernel {
+
+enum class DeltaPatchResult {
+    Ok,
+    InvalidHeader,
+    SourceMismatch,
+    SourceReadFailed,
+    CorruptPatch,
+    TargetWriteFailed,
+    Incomplete,
+    TargetMismatch,
+};
+
+inline const char* toString(DeltaPatchResult result) {
+    switch (result) {
+        case DeltaPatchResult::Ok:
+            return "ok";
+        case DeltaPatchResult::InvalidHeader:
+            return "invalid header";
+        case DeltaPatchResult::SourceMismatch:
+            return "source mismatch";
+        case DeltaPatchResult::SourceReadFailed:
+            return "source read failed";
+        case DeltaPatchResult::CorruptPatch:
+            return "corrupt patch";
+        case DeltaPatchResult::TargetWriteFailed:
+            return "target write failed";
+        case DeltaPatchResult::Incomplete:
+            return "incomplete";
+        case DeltaPatchResult::TargetMismatch:
+            return "target mismatch";
+        default:
+            return "unknown";
+    }
+}
+
+/**
+ * @brief Applies a binary delta patch as a stream, reading the source and writing the target in small blocks.
+ *
+ * Patches are produced by `make-delta.py` from bsdiff's control, diff and extra streams. The format is:
+ *
+ * - Header: `FHD2`, source size, target size (little-endian `uint32_t`s), SHA-256 of the source, SHA-256 of the target.
+ * - Records, as a single zlib stream with a window of at most 8 kB (see `Inflater`): diff length, extra length
+ *   (`uint32_t`), seek (`int32_t`), followed by the diff and extra bytes. Each diff byte is added to the next
+ *   source byte; extra bytes are copied as is; then the source position is moved by seek.
+ *
+ * Diff bytes are mostly zero, so before compression they are encoded as runs: a varint `n`, followed by
+ * `n >> 1` literal diff bytes if `n` is odd, or standing for `n >> 1` zero bytes (i.e. unchanged source bytes)
+ * if `n` is even. This keeps long unchanged stretches from filling the small compression window.
+ *
+ * The source is hashed before the first byte is written, so a patch meant for a different firmware
+ * is rejected up front. `finish()` checks the hash of everything written against the expected target.
+ */
+class DeltaPatch {
+public:
+    using SourceReader = std::function<bool(size_t offset, uint8_t* buffer, size_t length)>;
+    using TargetWriter = std::function<bool(const uint8_t* data, size_t length)>;
+
+    DeltaPatch(SourceReader readSource, TargetWriter writeTarget)
+        : readSource(readSource)
+        , writeTarget(writeTarget) {
+        mbedtls_sha256_init(&targetHash);
+        mbedtls_sha256_starts(&targetHash, 0);
+    }
+
+    ~DeltaPatch() {
+        mbedtls_sha256_free(&targetHash);
+    }
+
+    DeltaPatch(const DeltaPatch&) = delete;
+    DeltaPatch& operator=(const DeltaPatch&) = delete;
+
+    /**
+     * @brief Feed the next part of the patch; parts can be of any size.
+     */
+    DeltaPatchResult feed(const uint8_t* data, size_t length) {
+        if (result != DeltaPatchResult::Ok) {
+            return result;
+        }
+        // The header is not compressed, so the source is checked before anything is decompressed
+        if (state == State::Header) {
+            size_t consumed = consume(data, length);
+            data += consumed;
+            length -= consumed;
+        }
+        if (length > 0 && result == DeltaPatchResult::Ok) {
+            auto status = inflater.inflate(data, length, [this](const uint8_t* records, size_t recordsLength) {
+                while (recordsLength > 0 && result == DeltaPatchResult::Ok) {
+                    size_t consumed = consume(records, recordsLength);
+                    records += consumed;
+                    recordsLength -= consumed;
+                }
+                return result == DeltaPatchResult::Ok;
+            });
+            if (status == Inflater::Status::Failed) {
+                fail(DeltaPatchResult::CorruptPatch);
+            }
+        }
+        return result;
+    }
+
+    /**
+     * @brief Flush the remaining output, and check that we produced exactly the expected target.
+     */
+    DeltaPatchResult finish() {
+        if (result != DeltaPatchResult::Ok) {
+            return result;
+        }
+        if (inflater.getStatus() != Inflater::Status::Done || state != State::Control || targetWritten + outputLength != targetSize) {
+            return fail(DeltaPatchResult::Incomplete);
+        }
+        if (!flushOutput()) {
+            return result;
+        }
+        std::array<uint8_t, 32> digest;
+        mbedtls_sha256_finish(&targetHash, digest.data());
+        if (std::memcmp(digest.data(), header.data() + TARGET_HASH_OFFSET, digest.size()) != 0) {
+            return fail(DeltaPatchResult::TargetMismatch);
+        }
+        return result;
+    }
+
+    /**
+     * @brief Feed the whole patch from a stream, then finish.
+     *
+     * @param readPatch reads the next part of the patch into the buffer, and returns the number of bytes read,
+     *     zero at the end of the stream, or a negative number on error (like `esp_http_client_read()`).
+     */
+    DeltaPatchResult apply(std::function<int(uint8_t* buffer, size_t length)> readPatch) {
+        std::array<uint8_t, 1024> buffer;
+        while (true) {
+            int bytesRead = readPatch(buffer.data(), buffer.size());
+            if (bytesRead < 0) {
+                return fail(DeltaPatchResult::Incomplete);
+            }
+            if (bytesRead == 0) {
+                return finish();
+            }
+            if (feed(buffer.data(), bytesRead) != DeltaPatchResult::Ok) {
+                return result;
+            }
+        }
+    }
+
+    bool isHeaderComplete() const {
+        return state != State::Header;
+    }
+
+    size_t getSourceSize() const {
+        return sourceSize;
+    }
+
+    size_t getTargetSize() const {
+        return targetSize;
+    }
+
+    size_t getTargetWritten() const {
+        return targetWritten;
+    }
+
+    static constexpr size_t HEADER_SIZE = 4 + 4 + 4 + 32 + 32;
+
+private:
+    enum class State {
+        Header,
+        Control,
+        DiffRun,
+        DiffLiteral,
+        Extra,
+    };
+
+    size_t consume(const uint8_t* data, size_t length) {
+        switch (state) {
+            case State::Header: {
+                size_t count = std::min(length, HEADER_SIZE - headerLength);
+                std::memcpy(header.data() + headerLength, data, count);
+                headerLength += count;
+                if (headerLength == HEADER_SIZE) {
+                    processHeader();
+                }
+                return count;
+            }
+            case State::Control: {
+                size_t count = std::min(length, CONTROL_SIZE - controlLength);
+                std::memcpy(control.data() + controlLength, data, count);
+                controlLength += count;
+                if (controlLength == CONTROL_SIZE) {
+                    controlLength = 0;
+                    diffRemaining = readUint32(control.data());
+                    extraRemaining = readUint32(control.data() + 4);
+                    seek = static_cast<int32_t>(readUint32(control.data() + 8));
+                    if (targetWritten + outputLength + diffRemaining + extraRemaining > targetSize) {
+                        fail(DeltaPatchResult::CorruptPatch);
+                    } else {
+                        nextSection();
+                    }
+                }
+                return count;
+            }
+            case State::DiffRun: {
+                uint8_t byte = data[0];
+                if (runShift > 28) {
+                    fail(DeltaPatchResult::CorruptPatch);
+                    return 1;
+                }
+                run |= static_cast<uint32_t>(byte & 0x7F) << runShift;
+                runShift += 7;
+                if ((byte & 0x80) == 0) {
+                    processRun();
+                }
+                return 1;
+            }
+            case State::DiffLiteral: {
+                size_t count = std::min({ length, literalRemaining, OUTPUT_BUFFER_SIZE - outputLength });
+                if (!readSourceInto(output.data() + outputLength, count)) {
+                    return count;
+                }
+                for (size_t i = 0; i < count; i++) {
+                    output[outputLength + i] += data[i];
+                }
+                produce(count);
+                literalRemaining -= count;
+                diffRemaining -= count;
+                if (literalRemaining == 0) {
+                    nextSection();
+                }
+                return count;
+            }
+            case State::Extra: {
+                size_t count = std::min({ length, extraRemaining, OUTPUT_BUFFER_SIZE - outputLength });
+                std::memcpy(output.data() + outputLength, data, count);
+                produce(count);
+                extraRemaining -= count;
+                if (extraRemaining == 0) {
+                    nextSection();
+                }
+                return count;
+            }
+            default:
+                fail(DeltaPatchResult::CorruptPatch);
+                return length;
+        }
+    }
+
+    void processHeader() {
+        if (std::memcmp(header.data(), MAGIC, 4) != 0) {
+            fail(DeltaPatchResult::InvalidHeader);
+            return;
+        }
+        sourceSize = readUint32(header.data() + 4);
+        targetSize = readUint32(header.data() + 8);
+
+        // Make sure the patch was made against what we are running
+        mbedtls_sha256_context sourceHash;
+        mbedtls_sha256_init(&sourceHash);
+        mbedtls_sha256_starts(&sourceHash, 0);
+        for (size_t offset = 0; offset < sourceSize; offset += OUTPUT_BUFFER_SIZE) {
+            size_t count = std::min(OUTPUT_BUFFER_SIZE, sourceSize - offset);
+            if (!readSource(offset, output.data(), count)) {
+                mbedtls_sha256_free(&sourceHash);
+                fail(DeltaPatchResult::SourceReadFailed);
+                return;
+            }
+            mbedtls_sha256_update(&sourceHash, output.data(), count);
+        }
+        std::array<uint8_t, 32> digest;
+        mbedtls_sha256_finish(&sourceHash, digest.data());
+        mbedtls_sha256_free(&sourceHash);
+        if (std::memcmp(digest.data(), header.data() + SOURCE_HASH_OFFSET, digest.size()) != 0) {
+            fail(DeltaPatchResult::SourceMismatch);
+            return;
+        }
+        state = State::Control;
+    }
+
+    void processRun() {
+        size_t runLength = run >> 1;
+        bool literal = (run & 1) != 0;
+        run = 0;
+        runShift = 0;
+        if (runLength == 0 || runLength > diffRemaining) {
+            fail(DeltaPatchResult::CorruptPatch);
+            return;
+        }
+        if (literal) {
+            literalRemaining = runLength;
+            state = State::DiffLiteral;
+            return;
+        }
+        // Unchanged bytes are copied from the source without any further input
+        diffRemaining -= runLength;
+        while (runLength > 0) {
+            size_t count = std::min(runLength, OUTPUT_BUFFER_SIZE - outputLength);
+            if (!readSourceInto(output.data() + outputLength, count)) {
+                return;
+            }
+            produce(count);
+            runLength -= count;
+        }
+        nextSection();
+    }
+
+    void nextSection() {
+        if (diffRemaining > 0) {
+            state = State::DiffRun;
+        } else if (extraRemaining > 0) {
+            state = State::Extra;
+        } else {
+            // Record done
+            int64_t newSourcePosition = static_cast<int64_t>(sourcePosition) + seek;
+            if (newSourcePosition < 0 || newSourcePosition > static_cast<int64_t>(sourceSize)) {
+                fail(DeltaPatchResult::CorruptPatch);
+                return;
+            }
+            sourcePosition = newSourcePosition;
+            seek = 0;
+            state = State::Control;
+        }
+    }
+
+    bool readSourceInto(uint8_t* buffer, size_t length) {
+        if (sourcePosition + length > sourceSize) {
+            fail(DeltaPatchResult::CorruptPatch);
+            return false;
+        }
+        if (!readSource(sourcePosition, buffer, length)) {
+            fail(DeltaPatchResult::SourceReadFailed);
+            return false;
+        }
+        sourcePosition += length;
+        return true;
+    }
+
+    void produce(size_t length) {
+        outputLength += length;
+        if (outputLength == OUTPUT_BUFFER_SIZE) {
+            flushOutput();
+        }
+    }
+
+    bool flushOutput() {
+        if (outputLength == 0) {
+            return true;
+        }
+        mbedtls_sha256_update(&targetHash, output.data(), outputLength);
+        if (!writeTarget(output.data(), outputLength)) {
+            fail(DeltaPatchResult::TargetWriteFailed);
+            return false;
+        }
+        targetWritten += outputLength;
+        outputLength = 0;
+        return true;
+    }
+
+    DeltaPatchResult fail(DeltaPatchResult error) {
+        if (result == DeltaPatchResult::Ok) {
+            result = error;
+        }
+        return result;
+    }
+
+    static uint32_t readUint32(const uint8_t* data) {
+        return static_cast<uint32_t>(data[0])
+            | (static_cast<uint32_t>(data[1]) << 8)
+            | (static_cast<uint32_t>(data[2]) << 16)
+            | (static_cast<uint32_t>(data[3]) << 24);
+    }
+
+    static constexpr const char* MAGIC = "FHD2";
+    static constexpr size_t SOURCE_HASH_OFFSET = 12;
+    static constexpr size_t TARGET_HASH_OFFSET = 44;
+    static constexpr size_t CONTROL_SIZE = 12;
+    // Matches the flash sector size, so OTA writes happen in whole sectors
+    static constexpr size_t OUTPUT_BUFFER_SIZE = 4096;
+
+    const SourceReader readSource;
+    const TargetWriter writeTarget;
+
+    DeltaPatchResult result = DeltaPatchResult::Ok;
+    State state = State::Header;
+
+    std::array<uint8_t, HEADER_SIZE> header;
+    size_t headerLength = 0;
+    size_t sourceSize = 0;
+    size_t targetSize = 0;
+
+    std::array<uint8_t, CONTROL_SIZE> control;
+    size_t controlLength = 0;
+    size_t diffRemaining = 0;
+    size_t extraRemaining = 0;
+    int32_t seek = 0;
+
+    uint32_t run = 0;
+    int runShift = 0;
+    size_t literalRemaining = 0;
+
+    Inflater inflater;
+
+    size_t sourcePosition = 0;
+    std::array<uint8_t, OUTPUT_BUFFER_SIZE> output;
+    size_t outputLength = 0;
+    size_t targetWritten = 0;
+    mbedtls_sha256_context targetHash;
+};
+
+}    // namespace farmhub::kernel
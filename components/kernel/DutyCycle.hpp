@@ -0,0 +1,189 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+
+#include <Log.hpp>
+
+using namespace std::chrono;
+using namespace std::chrono_literals;
+
+namespace farmhub::kernel {
+
+/**
+ * @brief What the duty cycle remembers between wakes; kept in RTC memory that survives deep sleep.
+ */
+struct DutyCycleState {
+    uint32_t magic;
+    // Cycles completed since the last cold boot
+    uint32_t cycles;
+    // Cycles cut short because they ran out of the awake budget
+    uint32_t overruns;
+    uint32_t lastAwakeMs;
+    uint64_t totalAwakeMs;
+    uint64_t totalSleepMs;
+};
+
+enum class WakeKind {
+    // Power-on, reset, crash, or anything else that lost the RTC state
+    Cold,
+    // Woken by the duty cycle timer with the RTC state intact
+    Warm,
+};
+
+/**
+ * @brief Runs the device in cycles: wake, sample, publish, then deep sleep until the next cycle.
+ *
+ * The time spent awake is counted against the cycle length, so cycles start at a steady pace
+ * regardless of how long each wake took. A wake that doesn't finish within the awake budget
+ * (e.g. because the network is down) is cut short, so a bad network can't drain the battery.
+ *
+ * Time and sleep are injected: on the device they are `boot_clock` and `esp_deep_sleep()`,
+ * on a host they can be a `VirtualSleepClock` to simulate many cycles in an instant.
+ */
+class DutyCycle {
+public:
+    DutyCycle(
+        milliseconds cycle,
+        milliseconds awakeBudget,
+        DutyCycleState& state,
+        std::function<milliseconds()> awakeFor,
+        std::function<void(milliseconds)> sleep)
+        : cycle(cycle)
+        , awakeBudget(std::min(awakeBudget, cycle))
+        , state(state)
+        , awakeFor(awakeFor)
+        , sleepFor(sleep) {
+    }
+
+    /**
+     * @brief Restore the state of the previous cycle if there is one; call once after waking up.
+     */
+    WakeKind wake(bool wokenByTimer) {
+        if (wokenByTimer && state.magic == MAGIC) {
+            wakeKind = WakeKind::Warm;
+        } else {
+            state = DutyCycleState { .magic = MAGIC };
+            wakeKind = WakeKind::Cold;
+        }
+        LOGD("Duty cycle %s wake, %lu cycles completed so far",
+            wakeKind == WakeKind::Warm ? "warm" : "cold", state.cycles);
+        return wakeKind;
+    }
+
+    WakeKind getWakeKind() const {
+        return wakeKind;
+    }
+
+    /**
+     * @brief How much longer we can stay awake in this cycle.
+     */
+    milliseconds getRemainingBudget() const {
+        return std::max(awakeBudget - awakeFor(), 0ms);
+    }
+
+    /**
+     * @brief End the cycle and go to sleep until the next one is due.
+     *
+     * On the device this does not return; the next cycle starts with a fresh boot.
+     */
+    void sleep() {
+        auto awake = awakeFor();
+        bool overrun = awake >= awakeBudget;
+        auto sleepDuration = std::max(cycle - awake, MIN_SLEEP);
+
+        state.cycles++;
+        if (overrun) {
+            state.overruns++;
+        }
+        state.lastAwakeMs = awake.count();
+        state.totalAwakeMs += awake.count();
+        state.totalSleepMs += sleepDuration.count();
+
+        if (overrun) {
+            LOGW("Awake budget of %lld ms exceeded, going to sleep for %lld ms",
+                awakeBudget.count(), sleepDuration.count());
+        } else {
+            LOGI("Cycle done in %lld ms, going to sleep for %lld ms",
+                awake.count(), sleepDuration.count());
+        }
+        sleepFor(sleepDuration);
+    }
+
+    const DutyCycleState& getState() const {
+        return state;
+    }
+
+    const milliseconds cycle;
+    const milliseconds awakeBudget;
+
+    /**
+     * @brief Sleep at least this much even if the cycle overran, so we don't spin awake.
+     */
+    static constexpr milliseconds MIN_SLEEP = 1s;
+
+private:
+    static constexpr uint32_t MAGIC = 0xD07C7C1E;
+
+    DutyCycleState& state;
+    const std::function<milliseconds()> awakeFor;
+    const std::function<void(milliseconds)> sleepFor;
+    WakeKind wakeKind = WakeKind::Cold;
+};
+
+/**
+ * @brief Estimates the charge used from the time spent awake and asleep.
+ */
+struct DutyCycleEnergy {
+    // Average current while awake, with WiFi on
+    double awakeCurrentMa;
+    // Current in deep sleep, including whatever stays powered on the board
+    double sleepCurrentUa;
+
+    double chargeMah(milliseconds awake, milliseconds asleep) const {
+        return (awakeCurrentMa * awake.count() + sleepCurrentUa / 1000.0 * asleep.count()) / 3600000.0;
+    }
+
+    double chargePerCycleMah(const DutyCycleState& state) const {
+        if (state.cycles == 0) {
+            return 0;
+        }
+        return chargeMah(milliseconds(state.totalAwakeMs), milliseconds(state.totalSleepMs)) / state.cycles;
+    }
+
+    double averageCurrentMa(const DutyCycleState& state) const {
+        auto total = state.totalAwakeMs + state.totalSleepMs;
+        if (total == 0) {
+            return 0;
+        }
+        return chargeMah(milliseconds(state.totalAwakeMs), milliseconds(state.totalSleepMs)) * 3600000.0 / total;
+    }
+};
+
+/**
+ * @brief Virtual time for simulating duty cycles on a host: work advances the clock, and sleeping
+ * jumps ahead instead of waiting, then starts the next wake with the RTC state intact.
+ */
+class VirtualSleepClock {
+public:
+    milliseconds awakeFor() const {
+        return now - wokeAt;
+    }
+
+    void work(milliseconds duration) {
+        now += duration;
+    }
+
+    void sleep(milliseconds duration) {
+        now += duration;
+        wokeAt = now;
+        sleeps++;
+    }
+
+    milliseconds now = 0ms;
+    milliseconds wokeAt = 0ms;
+    uint32_t sleeps = 0;
+};
+
+}    // namespace farmhub::kernel
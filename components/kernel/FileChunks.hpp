@@ -0,0 +1,173 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <esp_rom_crc.h>
+#include <mbedtls/sha256.h>
+
+#include <Log.hpp>
+
+namespace farmhub::kernel {
+
+struct FileChunk {
+    // Size of the whole file
+    size_t fileSize;
+    std::vector<uint8_t> data;
+    // CRC-32 of the data (as in zlib)
+    uint32_t crc;
+    bool eof;
+};
+
+struct ChunkWriteResult {
+    // Empty if the chunk was accepted
+    std::string error;
+    // Where the next chunk should start; where to resend from if the chunk was rejected
+    size_t expectedOffset = 0;
+    // SHA-256 of the received file, once the last chunk arrived
+    std::optional<std::string> sha256;
+
+    static ChunkWriteResult accepted(size_t expectedOffset, std::optional<std::string> sha256 = std::nullopt) {
+        return { "", expectedOffset, sha256 };
+    }
+
+    static ChunkWriteResult rejected(const std::string& error, size_t expectedOffset) {
+        return { error, expectedOffset, std::nullopt };
+    }
+
+    bool isAccepted() const {
+        return error.empty();
+    }
+};
+
+/**
+ * @brief Moves files in chunks small enough to fit a single MQTT message.
+ *
+ * Uploaded chunks must arrive in order. They are collected in a ".part" file, which only replaces
+ * the target once the last chunk arrived and the hash of the whole file matches. A chunk that
+ * doesn't start where the previous one ended is rejected along with the offset to resend from,
+ * and a chunk at offset zero starts the upload over.
+ *
+ * Works with `FileSystem`, or anything else with the same file operations.
+ */
+template <typename TFileSystem>
+class FileChunkTransfer {
+public:
+    /**
+     * @brief Largest chunk transferred in one message; base64 encoded it still fits the 2 kB MQTT buffer.
+     */
+    static constexpr size_t MAX_CHUNK_SIZE = 1024;
+
+    explicit FileChunkTransfer(std::shared_ptr<TFileSystem> fs)
+        : fs(fs) {
+    }
+
+    /**
+     * @brief Read at most `length` bytes (and no more than a chunk) from `offset`, or nothing if there is no such file.
+     */
+    std::optional<FileChunk> read(const std::string& path, size_t offset, size_t length) {
+        FILE* file = fs->open(path, "r");
+        if (file == nullptr) {
+            return std::nullopt;
+        }
+        size_t fileSize = fs->size(path);
+        std::vector<uint8_t> data(std::min(length, MAX_CHUNK_SIZE));
+        size_t bytesRead = 0;
+        if (fseek(file, offset, SEEK_SET) == 0) {
+            bytesRead = fread(data.data(), 1, data.size(), file);
+        }
+        fclose(file);
+        data.resize(bytesRead);
+        uint32_t crc = crc32(data);
+        return FileChunk {
+            .fileSize = fileSize,
+            .data = std::move(data),
+            .crc = crc,
+            .eof = offset + bytesRead >= fileSize,
+        };
+    }
+
+    /**
+     * @brief SHA-256 of the file as a hex string, read in small blocks to keep memory use bounded.
+     */
+    std::optional<std::string> hash(const std::string& path) {
+        FILE* file = fs->open(path, "r");
+        if (file == nullptr) {
+            return std::nullopt;
+        }
+        mbedtls_sha256_context context;
+        mbedtls_sha256_init(&context);
+        mbedtls_sha256_starts(&context, 0);
+        uint8_t buffer[256];
+        size_t bytesRead;
+        while ((bytesRead = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+            mbedtls_sha256_update(&context, buffer, bytesRead);
+        }
+        fclose(file);
+        uint8_t digest[32];
+        mbedtls_sha256_finish(&context, digest);
+        mbedtls_sha256_free(&context);
+
+        char hex[2 * sizeof(digest) + 1];
+        for (size_t i = 0; i < sizeof(digest); i++) {
+            snprintf(hex + 2 * i, 3, "%02x", digest[i]);
+        }
+        return std::string(hex);
+    }
+
+    /**
+     * @brief Write the chunk at `offset`; the CRC is checked when given, the hash of the whole file with the last chunk.
+     */
+    ChunkWriteResult write(const std::string& path, size_t offset, const std::vector<uint8_t>& data, std::optional<uint32_t> crc, bool last, const std::string& sha256) {
+        std::string partPath = path + ".part";
+        size_t expectedOffset = offset == 0 ? 0 : fs->size(partPath);
+        if (offset != expectedOffset) {
+            return ChunkWriteResult::rejected("Unexpected offset", expectedOffset);
+        }
+        if (data.size() > MAX_CHUNK_SIZE) {
+            return ChunkWriteResult::rejected("Chunk too large", offset);
+        }
+        if (crc.has_value() && *crc != crc32(data)) {
+            return ChunkWriteResult::rejected("CRC mismatch", offset);
+        }
+
+        FILE* file = fs->open(partPath, offset == 0 ? "w" : "a");
+        if (file == nullptr) {
+            return ChunkWriteResult::rejected("Cannot open file", offset);
+        }
+        size_t written = fwrite(data.data(), 1, data.size(), file);
+        fclose(file);
+        if (written != data.size()) {
+            // Whatever did get written is kept, the sender can carry on from there
+            return ChunkWriteResult::rejected("Write failed", fs->size(partPath));
+        }
+
+        if (!last) {
+            return ChunkWriteResult::accepted(offset + written);
+        }
+        auto hash = this->hash(partPath);
+        if (!hash.has_value() || *hash != sha256) {
+            LOGW("Hash mismatch for %s, discarding upload", path.c_str());
+            fs->remove(partPath);
+            return ChunkWriteResult::rejected("Hash mismatch", 0);
+        }
+        if (!fs->rename(partPath, path)) {
+            return ChunkWriteResult::rejected("Cannot rename file", offset + written);
+        }
+        LOGI("Received %s (%u bytes)", path.c_str(), offset + written);
+        return ChunkWriteResult::accepted(offset + written, hash);
+    }
+
+    static uint32_t crc32(const std::vector<uint8_t>& data) {
+        return esp_rom_crc32_le(0, data.data(), data.size());
+    }
+
+private:
+    const std::shared_ptr<TFileSystem> fs;
+};
+
+}    // namespace farmhub::kernel
@@ -2,15 +2,33 @@
 
 #include <dirent.h>
 #include <expected>
+#include <list>
 #include <stdio.h>
 #include <sys/stat.h>
 
 #include <esp_spiffs.h>
 
+#include <AtomicFile.hpp>
+
+#ifdef FARMHUB_LITTLEFS
+#include <esp_littlefs.h>
+#include <nvs.h>
+
+#include <FileSystemMigration.hpp>
+#endif
+
 namespace farmhub::kernel {
 
 static constexpr const char* PARTITION = "data";
 
+/**
+ * @brief The file system on the data partition.
+ *
+ * By default this is SPIFFS. When built with `FARMHUB_LITTLEFS`, LittleFS is used instead,
+ * which supports real directories, long file names and atomic renames. A partition still
+ * holding SPIFFS from earlier firmware is migrated to LittleFS on first boot; see `FileSystemMigration`.
+ * If the files can't be staged for the migration, the partition stays SPIFFS for the time being.
+ */
 class FileSystem {
 public:
     bool exists(const std::string& path) const {
@@ -18,6 +36,11 @@ public:
         return stat(resolve(path).c_str(), &fileStat) == 0;
     }
 
+    bool isDirectory(const std::string& path) const {
+        struct stat fileStat;
+        return stat(resolve(path).c_str(), &fileStat) == 0 && S_ISDIR(fileStat.st_mode);
+    }
+
     FILE* open(const std::string& path, const char* mode) const {
         return fopen(resolve(path).c_str(), mode);
     }
@@ -41,7 +64,16 @@ public:
         return result;
     }
 
+    /**
+     * @brief Replace the contents of the file.
+     *
+     * With LittleFS the contents are written to a temporary file first, and then renamed over
+     * the original, so a power cut leaves either the old or the new contents, but never a mix.
+     */
     size_t writeAll(const std::string& path, const std::string& contents) const {
+        if (littleFs) {
+            return writeAtomically(*this, path, contents);
+        }
         return write(path, contents.c_str(), contents.size());
     }
 
@@ -79,6 +111,37 @@ public:
         return unlink(resolve(path).c_str());
     }
 
+    /**
+     * @brief Move the file to a new path, replacing the target if it exists.
+     *
+     * The replacement is atomic with LittleFS; SPIFFS cannot rename over an existing file,
+     * so there the target is removed first.
+     */
+    bool rename(const std::string& from, const std::string& to) const {
+        if (!littleFs && exists(to)) {
+            remove(to);
+        }
+        if (::rename(resolve(from).c_str(), resolve(to).c_str()) != 0) {
+            LOGTE(Tag::FS, "Failed to rename %s to %s", from.c_str(), to.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Create the directory if it doesn't exist yet; a no-op on SPIFFS, where paths are flat.
+     */
+    bool makeDirectory(const std::string& path) const {
+        if (!littleFs || isDirectory(path)) {
+            return true;
+        }
+        if (mkdir(resolve(path).c_str(), 0755) != 0) {
+            LOGTE(Tag::FS, "Failed to create directory: %s", path.c_str());
+            return false;
+        }
+        return true;
+    }
+
     bool readDir(const std::string& path, std::function<void(const std::string&, size_t)> callback) const {
         DIR* dir = opendir(resolve(path).c_str());
         if (dir == nullptr) {
@@ -98,32 +161,43 @@ public:
         return true;
     }
 
+    /**
+     * @brief List every file under the directory, including those in subdirectories, with paths relative to it.
+     *
+     * SPIFFS has no directories, so there this lists the same names as `readDir()`.
+     */
+    bool readDirRecursive(const std::string& path, std::function<void(const std::string&, size_t)> callback) const {
+        return readDirRecursive(path, "", callback);
+    }
+
     static bool format() {
-        esp_err_t ret = esp_spiffs_format("data");
+#ifdef FARMHUB_LITTLEFS
+        esp_err_t ret = esp_littlefs_format(PARTITION);
+#else
+        esp_err_t ret = esp_spiffs_format(PARTITION);
+#endif
         if (ret == ESP_OK) {
-            LOGTV(Tag::FS, "SPIFFS partition '%s' formatted successfully", PARTITION);
+            LOGTV(Tag::FS, "%s partition '%s' formatted successfully", TYPE, PARTITION);
             return true;
         } else {
-            LOGTE(Tag::FS, "Error formatting SPIFFS partition '%s': %s\n", PARTITION, esp_err_to_name(ret));
+            LOGTE(Tag::FS, "Error formatting %s partition '%s': %s\n", TYPE, PARTITION, esp_err_to_name(ret));
             return false;
         }
     }
 
     FileSystem()
         : mountPoint("/" + std::string(PARTITION)) {
-        esp_vfs_spiffs_conf_t conf = {
-            .base_path = mountPoint.c_str(),
-            .partition_label = PARTITION,
-            .max_files = 5,
-            .format_if_mount_failed = false
-        };
-        esp_err_t ret = esp_vfs_spiffs_register(&conf);
+#ifdef FARMHUB_LITTLEFS
+        esp_err_t ret = mountOrMigrate();
+#else
+        esp_err_t ret = mountSpiffs();
+#endif
 
         switch (ret) {
             case ESP_OK: {
-                LOGTI(Tag::FS, "SPIFFS partition '%s' mounted successfully", PARTITION);
-                readDir("/", [](const std::string& name, size_t size) {
-                    LOGTI(Tag::FS, " - %s (%u bytes)", name.c_str(), size);
+                LOGTI(Tag::FS, "%s partition '%s' mounted successfully", getType(), PARTITION);
+                readDirRecursive("/", [](const std::string& path, size_t size) {
+                    LOGTI(Tag::FS, " - %s (%u bytes)", path.c_str(), size);
                 });
                 break;
             }
@@ -131,20 +205,269 @@ public:
                 LOGTE(Tag::FS, "Failed to mount partition '%s'", PARTITION);
                 break;
             case ESP_ERR_NOT_FOUND:
-                LOGTE(Tag::FS, "Failed to find SPIFFS partition '%s'", PARTITION);
+                LOGTE(Tag::FS, "Failed to find %s partition '%s'", getType(), PARTITION);
                 break;
             default:
-                LOGTE(Tag::FS, "Failed to initialize SPIFFS partition '%s' (%s)", PARTITION, esp_err_to_name(ret));
+                LOGTE(Tag::FS, "Failed to initialize %s partition '%s' (%s)", getType(), PARTITION, esp_err_to_name(ret));
                 break;
         }
     }
 
 private:
+#ifdef FARMHUB_LITTLEFS
+    static constexpr const char* TYPE = "LittleFS";
+#else
+    static constexpr const char* TYPE = "SPIFFS";
+#endif
+
+    const char* getType() const {
+        return littleFs ? "LittleFS" : "SPIFFS";
+    }
+
+    bool readDirRecursive(const std::string& path, const std::string& prefix, std::function<void(const std::string&, size_t)> callback) const {
+        std::list<std::string> subdirectories;
+        bool success = readDir(path, [&](const std::string& name, size_t size) {
+            std::string fullPath = path.ends_with("/")
+                ? (path + name)
+                : (path + "/" + name);
+            if (isDirectory(fullPath)) {
+                subdirectories.push_back(name);
+            } else {
+                callback(prefix + name, size);
+            }
+        });
+        for (const auto& subdirectory : subdirectories) {
+            std::string fullPath = path.ends_with("/")
+                ? (path + subdirectory)
+                : (path + "/" + subdirectory);
+            success &= readDirRecursive(fullPath, prefix + subdirectory + "/", callback);
+        }
+        return success;
+    }
+
+    esp_err_t mountSpiffs() {
+        esp_vfs_spiffs_conf_t conf = {
+            .base_path = mountPoint.c_str(),
+            .partition_label = PARTITION,
+            .max_files = 5,
+            .format_if_mount_failed = false
+        };
+        return esp_vfs_spiffs_register(&conf);
+    }
+
+#ifdef FARMHUB_LITTLEFS
+    esp_err_t mountLittleFs() {
+        esp_vfs_littlefs_conf_t conf = {
+            .base_path = mountPoint.c_str(),
+            .partition_label = PARTITION,
+            .format_if_mount_failed = false,
+        };
+        return esp_vfs_littlefs_register(&conf);
+    }
+
+    /**
+     * @brief Mount LittleFS, migrating the partition if it still holds SPIFFS from earlier firmware.
+     */
+    esp_err_t mountOrMigrate() {
+        esp_err_t ret = ESP_FAIL;
+        FileSystemMigration migration(
+            std::make_shared<NvsMigrationStaging>(),
+            [&]() {
+                ret = mountLittleFs();
+                littleFs = ret == ESP_OK;
+                return littleFs;
+            },
+            [&]() {
+                esp_littlefs_format(PARTITION);
+                ret = mountLittleFs();
+                littleFs = ret == ESP_OK;
+                return littleFs;
+            },
+            [this]() {
+                return readSpiffs();
+            },
+            [this](const MigratedFile& file) {
+                return writeAll(file.path, file.contents) == file.contents.size();
+            });
+        switch (migration.run()) {
+            case MigrationResult::Mounted:
+                return ESP_OK;
+            case MigrationResult::KeptOld:
+                return mountSpiffs();
+            default:
+                return ret == ESP_OK ? ESP_FAIL : ret;
+        }
+    }
+
+    /**
+     * @brief Read every file into memory, if the partition holds SPIFFS.
+     *
+     * The data partition only holds a few small configuration files, so keeping them in memory is fine.
+     */
+    std::optional<std::list<MigratedFile>> readSpiffs() {
+        if (mountSpiffs() != ESP_OK) {
+            return std::nullopt;
+        }
+        std::list<MigratedFile> files;
+        readDir("/", [&](const std::string& name, size_t size) {
+            // SPIFFS is flat, but names can contain slashes
+            std::string path = "/" + name;
+            auto contents = readAll(path);
+            if (contents.has_value()) {
+                files.push_back({ path, contents.value() });
+            } else {
+                LOGTE(Tag::FS, "Failed to read %s, it will be lost", path.c_str());
+            }
+        });
+        esp_vfs_spiffs_unregister(PARTITION);
+        return files;
+    }
+
+    /**
+     * @brief Stages migrated files in NVS, which has a partition of its own.
+     */
+    class NvsMigrationStaging : public MigrationStaging {
+    public:
+        std::optional<size_t> getCompleted() override {
+            uint32_t count = 0;
+            // Opening read-only doesn't create the namespace when nothing was ever staged
+            esp_err_t err = withHandle(NVS_READONLY, [&](nvs_handle_t handle) {
+                return nvs_get_u32(handle, COMPLETED_KEY, &count);
+            });
+            if (err != ESP_OK) {
+                return std::nullopt;
+            }
+            return count;
+        }
+
+        bool stage(size_t index, const MigratedFile& file) override {
+            return withHandle(NVS_READWRITE, [&](nvs_handle_t handle) {
+                esp_err_t err = nvs_set_str(handle, key(PATH_PREFIX, index).c_str(), file.path.c_str());
+                // Empty files only have their path staged
+                if (err == ESP_OK && !file.contents.empty()) {
+                    err = nvs_set_blob(handle, key(CONTENTS_PREFIX, index).c_str(), file.contents.data(), file.contents.size());
+                }
+                if (err == ESP_OK) {
+                    err = nvs_commit(handle);
+                }
+                return err;
+            }) == ESP_OK;
+        }
+
+        std::optional<MigratedFile> load(size_t index) override {
+            MigratedFile file;
+            esp_err_t err = withHandle(NVS_READONLY, [&](nvs_handle_t handle) {
+                std::string pathKey = key(PATH_PREFIX, index);
+                size_t length = 0;
+                esp_err_t err = nvs_get_str(handle, pathKey.c_str(), nullptr, &length);
+                if (err != ESP_OK) {
+                    return err;
+                }
+                // Length includes the terminating zero
+                file.path.resize(length);
+                err = nvs_get_str(handle, pathKey.c_str(), file.path.data(), &length);
+                if (err != ESP_OK) {
+                    return err;
+                }
+                file.path.resize(length - 1);
+
+                std::string contentsKey = key(CONTENTS_PREFIX, index);
+                err = nvs_get_blob(handle, contentsKey.c_str(), nullptr, &length);
+                if (err == ESP_ERR_NVS_NOT_FOUND) {
+                    return ESP_OK;
+                }
+                if (err != ESP_OK) {
+                    return err;
+                }
+                file.contents.resize(length);
+                return nvs_get_blob(handle, contentsKey.c_str(), file.contents.data(), &length);
+            });
+            if (err != ESP_OK) {
+                LOGTE(Tag::FS, "Failed to load staged file #%u: %s", index, esp_err_to_name(err));
+                return std::nullopt;
+            }
+            return file;
+        }
+
+        bool complete(size_t count) override {
+            return withHandle(NVS_READWRITE, [&](nvs_handle_t handle) {
+                esp_err_t err = nvs_set_u32(handle, COMPLETED_KEY, count);
+                if (err != ESP_OK) {
+                    return err;
+                }
+                return nvs_commit(handle);
+            }) == ESP_OK;
+        }
+
+        bool markMigrated() override {
+            esp_err_t err = withHandle(NVS_READWRITE, [&](nvs_handle_t handle) {
+                return eraseMarker(handle);
+            });
+            if (err != ESP_OK) {
+                LOGTE(Tag::FS, "Failed to remove migration marker: %s", esp_err_to_name(err));
+                return false;
+            }
+            return true;
+        }
+
+        bool clear() override {
+            esp_err_t err = withHandle(NVS_READWRITE, [&](nvs_handle_t handle) {
+                // Remove the marker first, so that losing power halfway doesn't leave half of the files looking staged
+                esp_err_t err = eraseMarker(handle);
+                if (err != ESP_OK) {
+                    return err;
+                }
+                err = nvs_erase_all(handle);
+                if (err != ESP_OK) {
+                    return err;
+                }
+                return nvs_commit(handle);
+            });
+            if (err != ESP_OK) {
+                LOGTE(Tag::FS, "Failed to clear staged files: %s", esp_err_to_name(err));
+                return false;
+            }
+            return true;
+        }
+
+    private:
+        static esp_err_t eraseMarker(nvs_handle_t handle) {
+            esp_err_t err = nvs_erase_key(handle, COMPLETED_KEY);
+            if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
+                return err;
+            }
+            return nvs_commit(handle);
+        }
+
+        static esp_err_t withHandle(nvs_open_mode_t mode, std::function<esp_err_t(nvs_handle_t)> action) {
+            nvs_handle_t handle;
+            esp_err_t err = nvs_open(NAMESPACE, mode, &handle);
+            if (err != ESP_OK) {
+                return err;
+            }
+            err = action(handle);
+            nvs_close(handle);
+            return err;
+        }
+
+        static std::string key(char prefix, size_t index) {
+            return prefix + std::to_string(index);
+        }
+
+        static constexpr const char* NAMESPACE = "fs-migration";
+        static constexpr const char* COMPLETED_KEY = "completed";
+        static constexpr char PATH_PREFIX = 'p';
+        static constexpr char CONTENTS_PREFIX = 'c';
+    };
+#endif
+
     std::string resolve(const std::string& path) const {
         return mountPoint + path;
     }
 
     const std::string mountPoint;
+    // Whether the partition is mounted as LittleFS; otherwise, even with FARMHUB_LITTLEFS before it's migrated, it's SPIFFS
+    bool littleFs = false;
 };
 
 }    // namespace farmhub::kernel
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <memory>
+#include <optional>
+#include <string>
+
+#include <Log.hpp>
+
+namespace farmhub::kernel {
+
+struct MigratedFile {
+    std::string path;
+    std::string contents;
+};
+
+/**
+ * @brief Keeps the files being migrated outside the partition being reformatted.
+ */
+class MigrationStaging {
+public:
+    virtual ~MigrationStaging() = default;
+
+    /**
+     * @brief Number of files staged, or nothing if staging hasn't been completed.
+     */
+    virtual std::optional<size_t> getCompleted() = 0;
+
+    virtual bool stage(size_t index, const MigratedFile& file) = 0;
+
+    virtual std::optional<MigratedFile> load(size_t index) = 0;
+
+    /**
+     * @brief Mark staging complete; until this succeeds, staged files are ignored.
+     */
+    virtual bool complete(size_t count) = 0;
+
+    /**
+     * @brief Undo `complete()` in a single step, so the staged files are not migrated again.
+     */
+    virtual bool markMigrated() = 0;
+
+    /**
+     * @brief Throw away the staged files; it must first undo `complete()`.
+     */
+    virtual bool clear() = 0;
+};
+
+enum class MigrationResult {
+    // The new file system is mounted
+    Mounted,
+    // The old file system could not be staged, and was left as it was
+    KeptOld,
+    // Neither file system could be mounted
+    Failed,
+};
+
+/**
+ * @brief Moves the data partition's files to a new file system that has to be formatted over the old one.
+ *
+ * Every file is staged in another partition first, and the partition is only formatted once staging
+ * is complete. Staged files are then written to the new file system, and staging is cleared. Every step
+ * can be repeated, so when power is lost in the middle, the next boot simply carries on: if staging
+ * completed, the staged files are written again (formatting the partition first if that didn't finish),
+ * otherwise the old file system is still untouched. Once the files are written, the migration is marked
+ * done before the staged files are cleared, so files changed later are never overwritten by stale copies.
+ */
+class FileSystemMigration {
+public:
+    FileSystemMigration(
+        std::shared_ptr<MigrationStaging> staging,
+        std::function<bool()> mountNew,
+        std::function<bool()> formatNew,
+        std::function<std::optional<std::list<MigratedFile>>()> readOld,
+        std::function<bool(const MigratedFile&)> writeNew)
+        : staging(staging)
+        , mountNew(mountNew)
+        , formatNew(formatNew)
+        , readOld(readOld)
+        , writeNew(writeNew) {
+    }
+
+    MigrationResult run() {
+        auto staged = staging->getCompleted();
+        if (staged.has_value()) {
+            LOGTW(Tag::FS, "Resuming interrupted migration of %u files", *staged);
+            // Formatting might not have finished
+            if (!mountNew() && !formatNew()) {
+                return MigrationResult::Failed;
+            }
+            return restore(*staged);
+        }
+
+        if (mountNew()) {
+            return MigrationResult::Mounted;
+        }
+
+        auto files = readOld();
+        if (!files.has_value()) {
+            LOGTW(Tag::FS, "Partition holds neither the old nor the new file system, formatting");
+            return formatNew() ? MigrationResult::Mounted : MigrationResult::Failed;
+        }
+
+        LOGTI(Tag::FS, "Migrating %u files", files->size());
+        if (!stage(*files)) {
+            LOGTE(Tag::FS, "Failed to stage files for migration, keeping the old file system");
+            staging->clear();
+            return MigrationResult::KeptOld;
+        }
+        if (!formatNew()) {
+            return MigrationResult::Failed;
+        }
+        return restore(files->size());
+    }
+
+private:
+    bool stage(const std::list<MigratedFile>& files) {
+        // Get rid of anything left over from an earlier, unfinished attempt
+        if (!staging->clear()) {
+            return false;
+        }
+        size_t index = 0;
+        for (const auto& file : files) {
+            if (!staging->stage(index++, file)) {
+                LOGTE(Tag::FS, "Failed to stage %s (%u bytes)", file.path.c_str(), file.contents.size());
+                return false;
+            }
+        }
+        return staging->complete(files.size());
+    }
+
+    MigrationResult restore(size_t count) {
+        for (size_t index = 0; index < count; index++) {
+            auto file = staging->load(index);
+            if (!file.has_value()) {
+                LOGTE(Tag::FS, "Failed to load staged file #%u, it will be lost", index);
+                continue;
+            }
+            if (!writeNew(*file)) {
+                LOGTE(Tag::FS, "Failed to migrate %s", file->path.c_str());
+            } else {
+                LOGTD(Tag::FS, "Migrated %s (%u bytes)", file->path.c_str(), file->contents.size());
+            }
+        }
+        if (!staging->markMigrated()) {
+            // The files are in place, but the next boot will write them again
+            LOGTE(Tag::FS, "Failed to mark the migration done, staged files will be migrated again");
+            return MigrationResult::Mounted;
+        }
+        if (!staging->clear()) {
+            // They don't count anymore, and are cleared before staging anything again
+            LOGTW(Tag::FS, "Failed to clear staged files");
+        }
+        return MigrationResult::Mounted;
+    }
+
+    const std::shared_ptr<MigrationStaging> staging;
+    const std::function<bool()> mountNew;
+    const std::function<bool()> formatNew;
+    const std::function<std::optional<std::list<MigratedFile>>()> readOld;
+    const std::function<bool(const MigratedFile&)> writeNew;
+};
+
+}    // namespace farmhub::kernel
@@ -1,25 +1,48 @@
 #pragma once
 
+#include <algorithm>
+#include <cstdlib>
+#include <memory>
 #include <string>
+#include <strings.h>
 
 #include <ArduinoJson.h>
 
 #include <esp_crt_bundle.h>
 #include <esp_http_client.h>
-#include <esp_https_ota.h>
+#include <esp_ota_ops.h>
 
+#include <DeltaPatch.hpp>
 #include <FileSystem.hpp>
 #include <Log.hpp>
+#include <Memory.hpp>
+#include <ResumableDownload.hpp>
 #include <Watchdog.hpp>
 #include <drivers/WiFiDriver.hpp>
 
 namespace farmhub::kernel {
 
+/**
+ * @brief Updates the firmware from a URL after a restart.
+ *
+ * The URL either points to a full firmware image, or, for delta updates, to a patch made
+ * with `make-delta.py` against the currently running firmware. Patches are applied while
+ * being downloaded, reading the running partition and writing the inactive one; see `DeltaPatch`.
+ *
+ * Full images are downloaded with `ResumableDownload`: progress is kept in `update.json`, so when
+ * the connection drops the download is resumed with a range request, even after a reboot.
+ * Attempts are recorded in `update.json` before they start, and the file is removed once the update
+ * succeeds, or after `MAX_ATTEMPTS` attempts, even if the attempts crashed the device.
+ *
+ * Only the first attempt after a reboot is made while booting; if it fails, the rest of the attempts
+ * are made in the background with backoff, so that a flaky connection doesn't hold up the device.
+ */
 class HttpUpdater {
 public:
-    static void startUpdate(const std::string& url, std::shared_ptr<FileSystem> fs) {
+    static void startUpdate(const std::string& url, bool delta, std::shared_ptr<FileSystem> fs) {
         JsonDocument doc;
         doc["url"] = url;
+        doc["delta"] = delta;
         std::string content;
         serializeJson(doc, content);
         fs->writeAll(HttpUpdater::UPDATE_FILE, content);
@@ -40,47 +63,118 @@ public:
         auto contents = fs->readAll(UPDATE_FILE);
         if (!contents.has_value()) {
             LOGE("Failed to read update file");
+            return;
         }
         JsonDocument doc;
         auto error = deserializeJson(doc, contents.value());
-        int deleteError = fs->remove(UPDATE_FILE);
-        if (deleteError) {
-            LOGE("Failed to delete update file");
-            return;
-        }
-
         if (error) {
             LOGE("Failed to parse update.json: %s", error.c_str());
+            removeUpdateFile(fs);
             return;
         }
-        std::string url = doc["url"];
-        if (url.empty()) {
+        DownloadProgress progress {
+            .url = doc["url"] | "",
+            .etag = doc["etag"] | "",
+            .written = doc["written"].as<size_t>(),
+            .size = doc["size"].as<size_t>(),
+            .sha256 = doc["sha256"] | "",
+            .attempts = doc["attempts"].as<uint32_t>(),
+        };
+        bool delta = doc["delta"] | false;
+        if (progress.url.empty()) {
             LOGE("Update command contains empty url");
+            removeUpdateFile(fs);
+            return;
+        }
+        if (progress.attempts >= MAX_ATTEMPTS) {
+            LOGE("Update failed %lu times, giving up", progress.attempts);
+            removeUpdateFile(fs);
+            return;
+        }
+
+        // Shared with the task retrying the update in the background
+        auto updater = std::shared_ptr<HttpUpdater>(new HttpUpdater(fs, watchdog, delta));
+        LOGI("Updating from version %s via %s from URL %s (%lu attempts so far)",
+            farmhubVersion, delta ? "delta patch" : "full image", progress.url.c_str(), progress.attempts);
+
+        LOGD("Waiting for network...");
+        if (!wifi->getNetworkReady().awaitSet(15s)) {
+            LOGW("Network not ready, will retry update in the background");
+        } else if (!updater->performPendingHttpUpdate(progress, 1)) {
             return;
         }
 
-        HttpUpdater updater(watchdog);
-        updater.performPendingHttpUpdate(url, wifi);
+        Task::run("update", 8192, [updater, wifi, progress](Task&) mutable {
+            auto backoff = ResumableDownload::backoffAfter(std::max<uint32_t>(progress.attempts, 1));
+            LOGI("Retrying update in %lld ms", backoff.count());
+            Task::delay(backoff);
+            wifi->getNetworkReady().awaitSet();
+            updater->performPendingHttpUpdate(progress, MAX_ATTEMPTS_PER_BOOT - 1);
+        });
     }
 
     static constexpr const char* UPDATE_FILE = "/update.json";
 
+    // Failed attempts before the update is abandoned, counted across reboots
+    static constexpr uint32_t MAX_ATTEMPTS = 12;
+    // Attempts made after each reboot, the first one while booting, the rest in the background
+    static constexpr uint32_t MAX_ATTEMPTS_PER_BOOT = 4;
+
 private:
-    HttpUpdater(std::shared_ptr<Watchdog> watchdog)
-        : watchdog(watchdog) {
+    HttpUpdater(std::shared_ptr<FileSystem> fs, std::shared_ptr<Watchdog> watchdog, bool delta)
+        : fs(fs)
+        , watchdog(watchdog)
+        , delta(delta) {
     }
 
-    void performPendingHttpUpdate(const std::string& url, std::shared_ptr<WiFiDriver> wifi) {
-        LOGI("Updating from version %s via URL %s",
-            farmhubVersion, url.c_str());
+    static void removeUpdateFile(std::shared_ptr<FileSystem> fs) {
+        if (fs->remove(UPDATE_FILE) != 0) {
+            LOGE("Failed to delete update file");
+        }
+    }
 
-        LOGD("Waiting for network...");
-        if (!wifi->getNetworkReady().awaitSet(15s)) {
-            LOGE("Network not ready, aborting update");
-            return;
+    void persistProgress(const DownloadProgress& progress) {
+        JsonDocument doc;
+        doc["url"] = progress.url;
+        doc["delta"] = delta;
+        doc["etag"] = progress.etag;
+        doc["written"] = progress.written;
+        doc["size"] = progress.size;
+        doc["sha256"] = progress.sha256;
+        doc["attempts"] = progress.attempts;
+        std::string content;
+        serializeJson(doc, content);
+        fs->writeAll(UPDATE_FILE, content);
+    }
+
+    /**
+     * @brief Makes up to `maxAttemptsInRun` attempts at the update, and reboots if it succeeds.
+     *
+     * @return whether there's any point in trying again.
+     */
+    bool performPendingHttpUpdate(DownloadProgress& progress, uint32_t maxAttemptsInRun) {
+        esp_err_t ret = delta
+            ? performDeltaUpdateWithRetries(progress, maxAttemptsInRun)
+            : performFullUpdate(progress, maxAttemptsInRun);
+        if (ret == ESP_OK) {
+            removeUpdateFile(fs);
+            LOGI("Update succeeded, rebooting in 5 seconds...");
+            Task::delay(5s);
+            esp_restart();
+        } else if (ret == ESP_ERR_INVALID_VERSION || progress.attempts >= MAX_ATTEMPTS) {
+            LOGE("Update failed (%s), giving up",
+                esp_err_to_name(ret));
+            removeUpdateFile(fs);
+            return false;
+        } else {
+            LOGE("Update failed (%s), will retry",
+                esp_err_to_name(ret));
         }
+        return true;
+    }
 
-        esp_http_client_config_t httpConfig = {
+    esp_http_client_config_t createHttpConfig(const std::string& url) {
+        return {
             .url = url.c_str(),
             .event_handler = httpEventHandler,
             // Additional buffers to fit headers
@@ -91,19 +185,249 @@ private:
             .crt_bundle_attach = esp_crt_bundle_attach,
             .keep_alive_enable = true,
         };
-        esp_https_ota_config_t otaConfig = {
-            .http_config = &httpConfig,
-        };
-        esp_err_t ret = esp_https_ota(&otaConfig);
-        if (ret == ESP_OK) {
-            LOGI("Update succeeded, rebooting in 5 seconds...");
-            Task::delay(5s);
-            esp_restart();
-        } else {
-            LOGE("Update failed (%s), continuing with regular boot",
-                esp_err_to_name(ret));
-            return;
+    }
+
+    /**
+     * @brief Writes the downloaded image to the next OTA partition, resuming where a previous attempt left off.
+     */
+    class OtaPartitionTarget : public DownloadTarget {
+    public:
+        OtaPartitionTarget(const esp_partition_t* partition)
+            : partition(partition) {
+        }
+
+        ~OtaPartitionTarget() override {
+            abort();
         }
+
+        bool begin(size_t offset) override {
+            abort();
+            esp_err_t ret = offset == 0
+                ? esp_ota_begin(partition, OTA_WITH_SEQUENTIAL_WRITES, &handle)
+                : esp_ota_resume(partition, OTA_WITH_SEQUENTIAL_WRITES, offset, &handle);
+            if (ret != ESP_OK) {
+                LOGE("Failed to start writing partition '%s' at %u: %s",
+                    partition->label, offset, esp_err_to_name(ret));
+                handle = 0;
+                return false;
+            }
+            return true;
+        }
+
+        bool write(const uint8_t* data, size_t length) override {
+            return esp_ota_write(handle, data, length) == ESP_OK;
+        }
+
+        bool read(size_t offset, uint8_t* buffer, size_t length) override {
+            return esp_partition_read(partition, offset, buffer, length) == ESP_OK;
+        }
+
+        bool finish() override {
+            // Validates the image as well
+            esp_err_t ret = esp_ota_end(handle);
+            handle = 0;
+            if (ret != ESP_OK) {
+                LOGE("Downloaded image is not valid: %s",
+                    esp_err_to_name(ret));
+                return false;
+            }
+            return true;
+        }
+
+    private:
+        void abort() {
+            if (handle != 0) {
+                esp_ota_abort(handle);
+                handle = 0;
+            }
+        }
+
+        const esp_partition_t* partition;
+        esp_ota_handle_t handle = 0;
+    };
+
+    class HttpConnection : public DownloadConnection {
+    public:
+        HttpConnection(HttpUpdater& updater, const std::string& url, size_t offset, const std::string& etag)
+            : updater(updater) {
+            updater.responseEtag.clear();
+            updater.responseContentRange.clear();
+            auto httpConfig = updater.createHttpConfig(url);
+            client = esp_http_client_init(&httpConfig);
+            if (client == nullptr) {
+                return;
+            }
+            if (offset > 0) {
+                esp_http_client_set_header(client, "Range", ("bytes=" + std::to_string(offset) + "-").c_str());
+                if (!etag.empty()) {
+                    esp_http_client_set_header(client, "If-Range", etag.c_str());
+                }
+            }
+            if (esp_http_client_open(client, 0) != ESP_OK) {
+                return;
+            }
+            int64_t contentLength = esp_http_client_fetch_headers(client);
+            status = esp_http_client_get_status_code(client);
+            if (status == 200 && contentLength > 0) {
+                size = contentLength;
+            } else if (status == 206) {
+                // Content-Range: bytes <start>-<end>/<size>
+                auto separator = updater.responseContentRange.find('/');
+                if (separator != std::string::npos) {
+                    size = std::strtoul(updater.responseContentRange.c_str() + separator + 1, nullptr, 10);
+                }
+            }
+        }
+
+        ~HttpConnection() override {
+            if (client != nullptr) {
+                esp_http_client_close(client);
+                esp_http_client_cleanup(client);
+            }
+        }
+
+        int getStatus() override {
+            return status;
+        }
+
+        std::string getEtag() override {
+            return updater.responseEtag;
+        }
+
+        size_t getSize() override {
+            return size;
+        }
+
+        int read(uint8_t* buffer, size_t length) override {
+            return esp_http_client_read(client, reinterpret_cast<char*>(buffer), length);
+        }
+
+    private:
+        HttpUpdater& updater;
+        esp_http_client_handle_t client = nullptr;
+        int status = -1;
+        size_t size = 0;
+    };
+
+    esp_err_t performFullUpdate(DownloadProgress& progress, uint32_t maxAttemptsInRun) {
+        const esp_partition_t* updatePartition = esp_ota_get_next_update_partition(nullptr);
+        if (updatePartition == nullptr) {
+            LOGE("No OTA partition to write the update to");
+            return ESP_ERR_NOT_FOUND;
+        }
+        auto target = std::make_shared<OtaPartitionTarget>(updatePartition);
+        ResumableDownload download(
+            [this](const std::string& url, size_t offset, const std::string& etag) {
+                return std::make_unique<HttpConnection>(*this, url, offset, etag);
+            },
+            target,
+            [this](const DownloadProgress& progress) {
+                persistProgress(progress);
+            },
+            [](milliseconds delay) {
+                Task::delay(delay);
+            },
+            MAX_ATTEMPTS,
+            maxAttemptsInRun);
+        if (download.run(progress) != DownloadResult::Complete) {
+            return ESP_FAIL;
+        }
+        LOGI("Downloaded %u bytes to partition '%s'",
+            progress.written, updatePartition->label);
+        return esp_ota_set_boot_partition(updatePartition);
+    }
+
+    /**
+     * @brief Patches can't be resumed, as the patch engine's state isn't persisted; they are small though,
+     * so we simply retry them from the start with backoff.
+     */
+    esp_err_t performDeltaUpdateWithRetries(DownloadProgress& progress, uint32_t maxAttemptsInRun) {
+        for (uint32_t attemptsInRun = 0;; attemptsInRun++) {
+            // Count the attempt up front, so it counts even if it crashes the device
+            progress.attempts++;
+            persistProgress(progress);
+            esp_err_t ret = performDeltaUpdate(progress.url);
+            if (ret == ESP_OK || ret == ESP_ERR_INVALID_VERSION) {
+                return ret;
+            }
+            if (progress.attempts >= MAX_ATTEMPTS || attemptsInRun + 1 >= maxAttemptsInRun) {
+                return ret;
+            }
+            auto backoff = ResumableDownload::backoffAfter(progress.attempts);
+            LOGI("Retrying delta update in %lld ms", backoff.count());
+            Task::delay(backoff);
+        }
+    }
+
+    esp_err_t performDeltaUpdate(const std::string& url) {
+        const esp_partition_t* runningPartition = esp_ota_get_running_partition();
+        const esp_partition_t* updatePartition = esp_ota_get_next_update_partition(nullptr);
+        if (updatePartition == nullptr) {
+            LOGE("No OTA partition to write the update to");
+            return ESP_ERR_NOT_FOUND;
+        }
+
+        auto httpConfig = createHttpConfig(url);
+        esp_http_client_handle_t client = esp_http_client_init(&httpConfig);
+        if (client == nullptr) {
+            return ESP_FAIL;
+        }
+        esp_err_t ret = esp_http_client_open(client, 0);
+        if (ret != ESP_OK) {
+            esp_http_client_cleanup(client);
+            return ret;
+        }
+        esp_http_client_fetch_headers(client);
+        int statusCode = esp_http_client_get_status_code(client);
+        if (statusCode != 200) {
+            LOGE("Failed to download delta patch, status code: %d", statusCode);
+            esp_http_client_close(client);
+            esp_http_client_cleanup(client);
+            return ESP_FAIL;
+        }
+
+        esp_ota_handle_t otaHandle;
+        ret = esp_ota_begin(updatePartition, OTA_WITH_SEQUENTIAL_WRITES, &otaHandle);
+        if (ret != ESP_OK) {
+            esp_http_client_close(client);
+            esp_http_client_cleanup(client);
+            return ret;
+        }
+
+        // The patch engine holds a sector-sized output buffer and the decompressor's window, keep it off the stack and out of internal RAM
+        auto patch = Memory::make<DeltaPatch>(
+            MemoryPlacement::Large,
+            MemoryTag::get("ota"),
+            [runningPartition](size_t offset, uint8_t* buffer, size_t length) {
+                return esp_partition_read(runningPartition, offset, buffer, length) == ESP_OK;
+            },
+            [otaHandle](const uint8_t* data, size_t length) {
+                return esp_ota_write(otaHandle, data, length) == ESP_OK;
+            });
+        auto result = patch->apply([client](uint8_t* buffer, size_t length) {
+            return esp_http_client_read(client, reinterpret_cast<char*>(buffer), length);
+        });
+        esp_http_client_close(client);
+        esp_http_client_cleanup(client);
+
+        if (result != DeltaPatchResult::Ok) {
+            LOGE("Failed to apply delta patch (%s) after writing %u of %u bytes",
+                toString(result), patch->getTargetWritten(), patch->getTargetSize());
+            esp_ota_abort(otaHandle);
+            // Retrying won't help if the patch is not for the firmware we are running
+            return result == DeltaPatchResult::SourceMismatch || result == DeltaPatchResult::InvalidHeader
+                ? ESP_ERR_INVALID_VERSION
+                : ESP_FAIL;
+        }
+        LOGI("Delta patch applied, %u bytes written to partition '%s' from %u bytes downloaded",
+            patch->getTargetWritten(), updatePartition->label, downloaded);
+
+        // Validates the image as well
+        ret = esp_ota_end(otaHandle);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        return esp_ota_set_boot_partition(updatePartition);
     }
 
     static esp_err_t httpEventHandler(esp_http_client_event_t* event) {
@@ -125,6 +449,11 @@ private:
                 break;
             case HTTP_EVENT_ON_HEADER:
                 LOGV("HTTP header: %s: %s", event->header_key, event->header_value);
+                if (strcasecmp(event->header_key, "ETag") == 0) {
+                    responseEtag = event->header_value;
+                } else if (strcasecmp(event->header_key, "Content-Range") == 0) {
+                    responseContentRange = event->header_value;
+                }
                 break;
             case HTTP_EVENT_ON_DATA: {
                 LOGD("HTTP data: %d bytes", event->data_len);
@@ -151,8 +480,12 @@ private:
         return ESP_OK;
     }
 
+    const std::shared_ptr<FileSystem> fs;
     const std::shared_ptr<Watchdog> watchdog;
+    const bool delta;
     size_t downloaded = 0;
+    std::string responseEtag;
+    std::string responseContentRange;
 
     static constexpr const size_t DOWNLOAD_NOTIFICATION_BATCH = 128 * 1024;
 };
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include <sdkconfig.h>
+
+#if CONFIG_IDF_TARGET_LINUX
+#include <zlib.h>
+#else
+#include <miniz.h>
+#endif
+
+namespace farmhub::kernel {
+
+/**
+ * @brief Streaming decompression of zlib data compressed with a window of at most `WINDOW_SIZE` bytes.
+ *
+ * On the device this uses the tinfl decompressor in ROM, decompressing into a circular buffer the size
+ * of the window; streams needing a larger window are rejected by the zlib header. There is no ROM on the
+ * linux target, so zlib stands in for it there.
+ */
+class Inflater {
+public:
+    static constexpr int WINDOW_BITS = 13;
+    static constexpr size_t WINDOW_SIZE = 1 << WINDOW_BITS;
+
+    enum class Status {
+        NeedsInput,
+        Done,
+        Failed,
+    };
+
+    Inflater() {
+#if CONFIG_IDF_TARGET_LINUX
+        if (inflateInit2(&stream, WINDOW_BITS) != Z_OK) {
+            status = Status::Failed;
+        }
+#else
+        tinfl_init(&decompressor);
+#endif
+    }
+
+    ~Inflater() {
+#if CONFIG_IDF_TARGET_LINUX
+        inflateEnd(&stream);
+#endif
+    }
+
+    Inflater(const Inflater&) = delete;
+    Inflater& operator=(const Inflater&) = delete;
+
+    /**
+     * @brief Decompress the next part of the stream, passing decompressed data to `output` as it is produced.
+     *
+     * Stops with `Failed` if `output` returns false, or if there is data after the end of the stream.
+     */
+    template <typename TOutput>
+    Status inflate(const uint8_t* data, size_t length, TOutput output) {
+        while (status == Status::NeedsInput) {
+#if CONFIG_IDF_TARGET_LINUX
+            stream.next_in = const_cast<uint8_t*>(data);
+            stream.avail_in = length;
+            stream.next_out = window.data();
+            stream.avail_out = window.size();
+            int ret = ::inflate(&stream, Z_NO_FLUSH);
+            size_t consumed = length - stream.avail_in;
+            size_t produced = window.size() - stream.avail_out;
+            bool moreOutput = stream.avail_out == 0;
+            if (ret == Z_STREAM_END) {
+                status = Status::Done;
+            } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+                status = Status::Failed;
+            }
+            if (produced > 0 && !output(window.data(), produced)) {
+                status = Status::Failed;
+            }
+#else
+            size_t consumed = length;
+            size_t produced = WINDOW_SIZE - windowPosition;
+            tinfl_status ret = tinfl_decompress(&decompressor, data, &consumed,
+                window.data(), window.data() + windowPosition, &produced,
+                TINFL_FLAG_PARSE_ZLIB_HEADER | TINFL_FLAG_HAS_MORE_INPUT);
+            bool moreOutput = ret == TINFL_STATUS_HAS_MORE_OUTPUT;
+            if (ret == TINFL_STATUS_DONE) {
+                status = Status::Done;
+            } else if (ret < TINFL_STATUS_DONE) {
+                status = Status::Failed;
+            }
+            if (produced > 0 && !output(window.data() + windowPosition, produced)) {
+                status = Status::Failed;
+            }
+            // Back references are resolved against the circular window
+            windowPosition = (windowPosition + produced) & (WINDOW_SIZE - 1);
+#endif
+            data += consumed;
+            length -= consumed;
+            if (status == Status::Done && length > 0) {
+                status = Status::Failed;
+            }
+            if (length == 0 && !moreOutput) {
+                break;
+            }
+        }
+        return status;
+    }
+
+    Status getStatus() const {
+        return status;
+    }
+
+private:
+    Status status = Status::NeedsInput;
+#if CONFIG_IDF_TARGET_LINUX
+    z_stream stream {};
+#else
+    tinfl_decompressor decompressor;
+    size_t windowPosition = 0;
+#endif
+    std::array<uint8_t, WINDOW_SIZE> window;
+};
+
+}    // namespace farmhub::kernel
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <functional>
+#include <string>
+
+#include <ArduinoJson.h>
+
+#include <Concurrent.hpp>
+#include <Statistics.hpp>
+
+namespace farmhub::kernel {
+
+/**
+ * @brief A measurement sampled more often than telemetry is published.
+ *
+ * Samples are aggregated between publishes; each publish reports the mean of the interval
+ * under the measurement's own key (like a single reading was reported before), and the
+ * count, min, max, mean, median and 95th percentile under `<key>-stats`.
+ */
+class IntervalMetric {
+public:
+    explicit IntervalMetric(const std::string& key)
+        : key(key)
+        , statsKey(key + "-stats") {
+    }
+
+    void record(double value) {
+        Lock lock(mutex);
+        stats.record(value);
+    }
+
+    /**
+     * @brief Report the interval since the previous report, and start a new one.
+     *
+     * Nothing is reported if there were no samples in the interval.
+     */
+    void report(JsonObject& json) {
+        IntervalSummary<double> summary;
+        {
+            Lock lock(mutex);
+            summary = stats.take();
+        }
+        if (summary.count == 0) {
+            return;
+        }
+        json[key] = summary.mean;
+        auto statsJson = json[statsKey].to<JsonObject>();
+        statsJson["count"] = summary.count;
+        statsJson["min"] = summary.min;
+        statsJson["max"] = summary.max;
+        statsJson["mean"] = summary.mean;
+        statsJson["p50"] = summary.p50;
+        statsJson["p95"] = summary.p95;
+    }
+
+private:
+    const std::string key;
+    const std::string statsKey;
+    Mutex mutex;
+    IntervalStats<double> stats;
+};
+
+/**
+ * @brief Takes the samples for a sensor's interval metrics, making sure no interval is reported without one.
+ *
+ * Samples are normally taken on a schedule, but a short wake (e.g. when duty cycling) can be over
+ * before the first one is due; if nothing was sampled since the previous report, a sample is taken
+ * right before reporting instead.
+ */
+class IntervalSampler {
+public:
+    explicit IntervalSampler(std::function<void()> sampleFn)
+        : sampleFn(sampleFn) {
+    }
+
+    void sample() {
+        Lock lock(mutex);
+        sampleFn();
+        sampled = true;
+    }
+
+    void report(const std::function<void()>& reportFn) {
+        Lock lock(mutex);
+        if (!sampled) {
+            sampleFn();
+        }
+        reportFn();
+        sampled = false;
+    }
+
+private:
+    const std::function<void()> sampleFn;
+    Mutex mutex;
+    bool sampled = false;
+};
+
+}    // namespace farmhub::kernel
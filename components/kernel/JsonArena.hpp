@@ -0,0 +1,105 @@
+#pragma once
+
+#include <ArduinoJson.h>
+
+#include <Arena.hpp>
+
+namespace farmhub::kernel {
+
+/**
+ * @brief Scratch memory for the JSON documents of a single operation, like a publish or a command.
+ *
+ * Leases an arena from a shared pool and releases it, reset, when it goes out of scope.
+ * Anything that doesn't fit the arena is accounted to `tag`. Must outlive the documents that use it:
+ *
+ * ```cpp
+ * JsonArena arena(memoryTag);
+ * JsonDocument doc(arena.allocator());
+ * ```
+ */
+class JsonArena {
+public:
+    explicit JsonArena(MemoryTag& tag = MemoryTag::untagged())
+        : lease(pool().acquire(tag))
+        , adapter(lease.get()) {
+    }
+
+    ArduinoJson::Allocator* allocator() {
+        return &adapter;
+    }
+
+    /**
+     * @brief Allocations requested by JSON documents so far, and how many of those hit the heap.
+     */
+    static const ArenaStats& getStats() {
+        return pool().getStats();
+    }
+
+    static size_t getHighWater() {
+        return pool().getHighWater();
+    }
+
+    // Enough for a publish, a command with its response, and the log and telemetry tasks at the same time
+    static constexpr size_t ARENA_COUNT = 4;
+    static constexpr size_t ARENA_SIZE = 2048;
+
+private:
+    class Adapter : public ArduinoJson::Allocator {
+    public:
+        explicit Adapter(BumpArena& arena)
+            : arena(arena) {
+        }
+
+        void* allocate(size_t size) override {
+            return arena.allocate(size);
+        }
+
+        void deallocate(void* ptr) override {
+            arena.deallocate(ptr);
+        }
+
+        void* reallocate(void* ptr, size_t newSize) override {
+            return arena.reallocate(ptr, newSize);
+        }
+
+    private:
+        BumpArena& arena;
+    };
+
+    static ArenaPool& pool() {
+        static ArenaPool pool(ARENA_COUNT, ARENA_SIZE, MemoryPlacement::Large, MemoryTag::get("json-arena"));
+        return pool;
+    }
+
+    ArenaPool::Lease lease;
+    Adapter adapter;
+};
+
+/**
+ * @brief Heap allocator for long-lived JSON documents, accounted to a memory tag.
+ */
+class TaggedJsonAllocator : public ArduinoJson::Allocator {
+public:
+    explicit TaggedJsonAllocator(MemoryTag& tag, MemoryPlacement placement = MemoryPlacement::Internal)
+        : tag(tag)
+        , placement(placement) {
+    }
+
+    void* allocate(size_t size) override {
+        return Memory::allocate(size, placement, tag);
+    }
+
+    void deallocate(void* ptr) override {
+        Memory::free(ptr);
+    }
+
+    void* reallocate(void* ptr, size_t newSize) override {
+        return Memory::reallocate(ptr, newSize, placement, tag);
+    }
+
+private:
+    MemoryTag& tag;
+    const MemoryPlacement placement;
+};
+
+}    // namespace farmhub::kernel
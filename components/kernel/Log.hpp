@@ -1,11 +1,17 @@
 #pragma once
 
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <mutex>
 #include <string>
 
 #include <ArduinoJson.h>
 
 #include <esp_log.h>
 
+#include <Memory.hpp>
+
 namespace farmhub::kernel {
 
 enum class Level {
@@ -20,13 +26,13 @@ enum class Level {
 
 struct LogRecord {
     const Level level;
-    const std::string message;
+    const LargeString message;
 };
 
 class Tag {
 public:
     //
-    // When adding elements here, make sure to also list them in Log::init()
+    // When adding elements here, make sure to also list them in Log::TAGS
     //
     static constexpr const char* FARMHUB = "farmhub";
     static constexpr const char* FS = "farmhub:fs";
@@ -40,26 +46,64 @@ public:
     static constexpr const char* WIFI = "farmhub:wifi";
 };
 
-#define LOGTE(tag, format, ...) ESP_LOG_LEVEL_LOCAL(ESP_LOG_ERROR, tag, format, ##__VA_ARGS__)
-#define LOGTW(tag, format, ...) ESP_LOG_LEVEL_LOCAL(ESP_LOG_WARN, tag, format, ##__VA_ARGS__)
-#define LOGTI(tag, format, ...) ESP_LOG_LEVEL_LOCAL(ESP_LOG_INFO, tag, format, ##__VA_ARGS__)
-#define LOGTD(tag, format, ...) ESP_LOG_LEVEL_LOCAL(ESP_LOG_DEBUG, tag, format, ##__VA_ARGS__)
-#define LOGTV(tag, format, ...) ESP_LOG_LEVEL_LOCAL(ESP_LOG_VERBOSE, tag, format, ##__VA_ARGS__)
-
-#define LOGE(format, ...) LOGTE(Tag::FARMHUB, format, ##__VA_ARGS__)
-#define LOGW(format, ...) LOGTW(Tag::FARMHUB, format, ##__VA_ARGS__)
-#define LOGI(format, ...) LOGTI(Tag::FARMHUB, format, ##__VA_ARGS__)
-#define LOGD(format, ...) LOGTD(Tag::FARMHUB, format, ##__VA_ARGS__)
-#define LOGV(format, ...) LOGTV(Tag::FARMHUB, format, ##__VA_ARGS__)
+#define FARMHUB_LOG_LEVEL_NONE 0
+#define FARMHUB_LOG_LEVEL_ERROR 2
+#define FARMHUB_LOG_LEVEL_WARNING 3
+#define FARMHUB_LOG_LEVEL_INFO 4
+#define FARMHUB_LOG_LEVEL_DEBUG 5
+#define FARMHUB_LOG_LEVEL_VERBOSE 6
 
+// Build-time floor for logging: anything more verbose than this is compiled out completely.
+// Release builds keep debug logging so it can be enabled at runtime via the `log-level` command.
 #ifndef FARMHUB_LOG_LEVEL
 #ifdef FARMHUB_DEBUG
+#define FARMHUB_LOG_LEVEL FARMHUB_LOG_LEVEL_VERBOSE
+#else
 #define FARMHUB_LOG_LEVEL FARMHUB_LOG_LEVEL_DEBUG
+#endif
+#endif
+
+// Keep discarded statements type-checked (and their arguments "used") without generating any code
+#define FARMHUB_LOG_DISCARD(tag, format, ...) \
+    do {                                      \
+        if (false) {                          \
+            printf(format, ##__VA_ARGS__);    \
+        }                                     \
+    } while (0)
+
+// We bypass LOG_LOCAL_LEVEL (CONFIG_LOG_MAXIMUM_LEVEL) here, FARMHUB_LOG_LEVEL is our own floor
+#if FARMHUB_LOG_LEVEL >= FARMHUB_LOG_LEVEL_ERROR
+#define LOGTE(tag, format, ...) ESP_LOG_LEVEL(ESP_LOG_ERROR, tag, format, ##__VA_ARGS__)
+#else
+#define LOGTE(tag, format, ...) FARMHUB_LOG_DISCARD(tag, format, ##__VA_ARGS__)
+#endif
+#if FARMHUB_LOG_LEVEL >= FARMHUB_LOG_LEVEL_WARNING
+#define LOGTW(tag, format, ...) ESP_LOG_LEVEL(ESP_LOG_WARN, tag, format, ##__VA_ARGS__)
+#else
+#define LOGTW(tag, format, ...) FARMHUB_LOG_DISCARD(tag, format, ##__VA_ARGS__)
+#endif
+#if FARMHUB_LOG_LEVEL >= FARMHUB_LOG_LEVEL_INFO
+#define LOGTI(tag, format, ...) ESP_LOG_LEVEL(ESP_LOG_INFO, tag, format, ##__VA_ARGS__)
+#else
+#define LOGTI(tag, format, ...) FARMHUB_LOG_DISCARD(tag, format, ##__VA_ARGS__)
+#endif
+#if FARMHUB_LOG_LEVEL >= FARMHUB_LOG_LEVEL_DEBUG
+#define LOGTD(tag, format, ...) ESP_LOG_LEVEL(ESP_LOG_DEBUG, tag, format, ##__VA_ARGS__)
 #else
-#define FARMHUB_LOG_LEVEL FARMHUB_LOG_LEVEL_INFO
+#define LOGTD(tag, format, ...) FARMHUB_LOG_DISCARD(tag, format, ##__VA_ARGS__)
 #endif
+#if FARMHUB_LOG_LEVEL >= FARMHUB_LOG_LEVEL_VERBOSE
+#define LOGTV(tag, format, ...) ESP_LOG_LEVEL(ESP_LOG_VERBOSE, tag, format, ##__VA_ARGS__)
+#else
+#define LOGTV(tag, format, ...) FARMHUB_LOG_DISCARD(tag, format, ##__VA_ARGS__)
 #endif
 
+#define LOGE(format, ...) LOGTE(Tag::FARMHUB, format, ##__VA_ARGS__)
+#define LOGW(format, ...) LOGTW(Tag::FARMHUB, format, ##__VA_ARGS__)
+#define LOGI(format, ...) LOGTI(Tag::FARMHUB, format, ##__VA_ARGS__)
+#define LOGD(format, ...) LOGTD(Tag::FARMHUB, format, ##__VA_ARGS__)
+#define LOGV(format, ...) LOGTV(Tag::FARMHUB, format, ##__VA_ARGS__)
+
 bool convertToJson(const Level& src, JsonVariant dst) {
     return dst.set(static_cast<int>(src));
 }
@@ -67,6 +111,24 @@ void convertFromJson(JsonVariantConst src, Level& dst) {
     dst = static_cast<Level>(src.as<int>());
 }
 
+/**
+ * @brief Log levels for a single tag: what gets printed to the console, and what gets published via MQTT.
+ */
+struct TagLevels {
+    Level console;
+    Level mqtt;
+};
+
+bool convertToJson(const TagLevels& src, JsonVariant dst) {
+    dst["console"] = src.console;
+    dst["mqtt"] = src.mqtt;
+    return true;
+}
+void convertFromJson(JsonVariantConst src, TagLevels& dst) {
+    dst.console = src["console"].as<Level>();
+    dst.mqtt = src["mqtt"].as<Level>();
+}
+
 class Log {
 public:
     static void init() {
@@ -76,15 +138,104 @@ public:
 #endif
 
         for (const char* tag : TAGS) {
-#ifdef FARMHUB_DEBUG
-            esp_log_level_set(tag, ESP_LOG_DEBUG);
-#else
-            esp_log_level_set(tag, ESP_LOG_INFO);
-#endif
+            applyLevels(tag, getLevels(tag));
+        }
+    }
+
+    /**
+     * @brief Set the level at which messages without a specific override are published via MQTT.
+     */
+    static void setDefaultPublishLevel(Level level) {
+        {
+            std::lock_guard<std::mutex> lock(levelsMutex);
+            defaultLevels.mqtt = level;
+        }
+        for (const char* tag : TAGS) {
+            applyLevels(tag, getLevels(tag));
+        }
+    }
+
+    /**
+     * @brief Override the console and MQTT levels for the given tag at runtime.
+     *
+     * Levels more verbose than the build-time floor (`FARMHUB_LOG_LEVEL`) are clamped.
+     */
+    static TagLevels setLevels(const std::string& tag, TagLevels levels) {
+        levels.console = clamp(levels.console);
+        levels.mqtt = clamp(levels.mqtt);
+        {
+            std::lock_guard<std::mutex> lock(levelsMutex);
+            overrides[tag] = levels;
+        }
+        applyLevels(tag.c_str(), levels);
+        return levels;
+    }
+
+    /**
+     * @brief Remove the override for the given tag, reverting to the default levels.
+     */
+    static void resetLevels(const std::string& tag) {
+        {
+            std::lock_guard<std::mutex> lock(levelsMutex);
+            overrides.erase(tag);
+        }
+        applyLevels(tag.c_str(), getLevels(tag));
+    }
+
+    static TagLevels getLevels(const std::string& tag) {
+        std::lock_guard<std::mutex> lock(levelsMutex);
+        auto it = overrides.find(tag);
+        if (it != overrides.end()) {
+            return it->second;
+        }
+        return isKnownTag(tag)
+            ? defaultLevels
+            // Let ESP-IDF decide what to print for tags we don't manage
+            : TagLevels { Level::Verbose, defaultLevels.mqtt };
+    }
+
+    static void forEachTag(std::function<void(const std::string&, const TagLevels&)> callback) {
+        std::map<std::string, TagLevels> levels;
+        for (const char* tag : TAGS) {
+            levels.emplace(tag, getLevels(tag));
+        }
+        {
+            std::lock_guard<std::mutex> lock(levelsMutex);
+            for (auto& [tag, tagLevels] : overrides) {
+                levels[tag] = tagLevels;
+            }
+        }
+        for (auto& [tag, tagLevels] : levels) {
+            callback(tag, tagLevels);
         }
     }
 
+    static constexpr Level getBuildLevel() {
+        return static_cast<Level>(FARMHUB_LOG_LEVEL);
+    }
+
 private:
+    static Level clamp(Level level) {
+        return std::min(level, getBuildLevel());
+    }
+
+    static void applyLevels(const char* tag, const TagLevels& levels) {
+        // ESP-IDF filters before we get to see the message, so let through whatever either sink needs
+        esp_log_level_set(tag, toEspLevel(std::max(levels.console, levels.mqtt)));
+    }
+
+    static esp_log_level_t toEspLevel(Level level) {
+        return level == Level::None
+            ? ESP_LOG_NONE
+            : static_cast<esp_log_level_t>(static_cast<int>(level) - 1);
+    }
+
+    static bool isKnownTag(const std::string& tag) {
+        return std::any_of(std::begin(TAGS), std::end(TAGS), [&](const char* knownTag) {
+            return tag == knownTag;
+        });
+    }
+
     static constexpr const char* TAGS[] = {
         Tag::FARMHUB,
         Tag::FS,
@@ -97,6 +248,18 @@ private:
         Tag::RTC,
         Tag::WIFI,
     };
+
+    static std::mutex levelsMutex;
+    static TagLevels defaultLevels;
+    static std::map<std::string, TagLevels> overrides;
 };
 
+std::mutex Log::levelsMutex;
+#ifdef FARMHUB_DEBUG
+TagLevels Log::defaultLevels { Level::Debug, Level::Info };
+#else
+TagLevels Log::defaultLevels { Level::Info, Level::Info };
+#endif
+std::map<std::string, TagLevels> Log::overrides;
+
 }    // namespace farmhub::kernel
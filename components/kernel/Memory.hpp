@@ -0,0 +1,299 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <utility>
+
+#include <esp_heap_caps.h>
+#include <sdkconfig.h>
+
+namespace farmhub::kernel {
+
+/**
+ * @brief Where a buffer should live.
+ *
+ * Internal RAM is scarce and is needed for task stacks, DMA and anything touched from an ISR or while
+ * the flash cache is disabled. Large buffers that are only used from tasks, like queued MQTT messages,
+ * JSON documents and log lines, can live in SPIRAM instead on boards that have it.
+ */
+enum class MemoryPlacement {
+    Internal,
+    // Prefer SPIRAM when available, fall back to internal RAM otherwise
+    Large,
+};
+
+/**
+ * @brief Accounts for the memory a subsystem allocates through `Memory`, like `mqtt`, `log` or `peripherals/<name>`.
+ *
+ * Tags are created on first use and live forever, so they can be held by reference.
+ */
+class MemoryTag {
+public:
+    static MemoryTag& get(const std::string& name) {
+        std::lock_guard<std::mutex> lock(tagsMutex);
+        auto it = std::find_if(tags.begin(), tags.end(), [&](const MemoryTag& tag) { return tag.name == name; });
+        if (it != tags.end()) {
+            return *it;
+        }
+        return tags.emplace_back(name);
+    }
+
+    static MemoryTag& untagged() {
+        static MemoryTag& tag = get("untagged");
+        return tag;
+    }
+
+    static void forEach(const std::function<void(const MemoryTag&)>& callback) {
+        // Tags are never removed, but the callback may create new ones, so don't hold the lock while calling it
+        std::list<const MemoryTag*> snapshot;
+        {
+            std::lock_guard<std::mutex> lock(tagsMutex);
+            for (const auto& tag : tags) {
+                snapshot.push_back(&tag);
+            }
+        }
+        for (auto tag : snapshot) {
+            callback(*tag);
+        }
+    }
+
+    explicit MemoryTag(const std::string& name)
+        : name(name) {
+    }
+
+    const std::string& getName() const {
+        return name;
+    }
+
+    size_t getLiveBytes() const {
+        return liveBytes;
+    }
+
+    size_t getPeakBytes() const {
+        return peakBytes;
+    }
+
+    uint32_t getAllocations() const {
+        return allocations;
+    }
+
+    uint32_t getFrees() const {
+        return frees;
+    }
+
+private:
+    void recordAllocation(size_t size) {
+        allocations++;
+        size_t live = liveBytes += size;
+        size_t peak = peakBytes;
+        while (live > peak && !peakBytes.compare_exchange_weak(peak, live)) { }
+    }
+
+    void recordFree(size_t size) {
+        frees++;
+        liveBytes -= size;
+    }
+
+    const std::string name;
+    std::atomic<size_t> liveBytes { 0 };
+    std::atomic<size_t> peakBytes { 0 };
+    std::atomic<uint32_t> allocations { 0 };
+    std::atomic<uint32_t> frees { 0 };
+
+    static std::mutex tagsMutex;
+    static std::list<MemoryTag> tags;
+
+    friend class Memory;
+};
+
+// Inline, as several test translation units include this via Concurrent.hpp and Log.hpp
+inline std::mutex MemoryTag::tagsMutex;
+inline std::list<MemoryTag> MemoryTag::tags;
+
+/**
+ * @brief Allocations placed according to a `MemoryPlacement` and accounted to a `MemoryTag`.
+ *
+ * Each block carries a small header recording its size and tag, so it can be freed without either.
+ */
+class Memory {
+public:
+    static void* allocate(size_t size, MemoryPlacement placement, MemoryTag& tag = MemoryTag::untagged()) {
+        void* block = allocateRaw(HEADER + size, placement);
+        if (block == nullptr) {
+            return nullptr;
+        }
+        auto header = new (block) Header { &tag, size };
+        tag.recordAllocation(size);
+        return payloadOf(header);
+    }
+
+    /**
+     * @brief Resize a block; it stays accounted to its original tag, `tag` only applies when `ptr` is null.
+     */
+    static void* reallocate(void* ptr, size_t size, MemoryPlacement placement, MemoryTag& tag = MemoryTag::untagged()) {
+        if (ptr == nullptr) {
+            return allocate(size, placement, tag);
+        }
+        Header* header = headerOf(ptr);
+        MemoryTag& owner = *header->tag;
+        size_t oldSize = header->size;
+        void* block = reallocateRaw(header, HEADER + size, placement);
+        if (block == nullptr) {
+            return nullptr;
+        }
+        header = static_cast<Header*>(block);
+        header->size = size;
+        owner.recordFree(oldSize);
+        owner.recordAllocation(size);
+        return payloadOf(header);
+    }
+
+    static void free(void* ptr) {
+        if (ptr == nullptr) {
+            return;
+        }
+        Header* header = headerOf(ptr);
+        header->tag->recordFree(header->size);
+        freeRaw(header);
+    }
+
+    /**
+     * @brief Whether SPIRAM was found and added to the heap; with `CONFIG_SPIRAM_IGNORE_NOTFOUND` a board may lack it.
+     */
+    static bool hasSpiram() {
+#ifdef CONFIG_SPIRAM
+        return heap_caps_get_total_size(MALLOC_CAP_SPIRAM) > 0;
+#else
+        return false;
+#endif
+    }
+
+    template <typename T>
+    struct Deleter {
+        void operator()(T* ptr) const {
+            ptr->~T();
+            Memory::free(ptr);
+        }
+    };
+
+    template <typename T>
+    using unique_ptr = std::unique_ptr<T, Deleter<T>>;
+
+    /**
+     * @brief Like `std::make_unique()`, but with the object placed according to `placement`.
+     */
+    template <typename T, typename... Args>
+    static unique_ptr<T> make(MemoryPlacement placement, MemoryTag& tag, Args&&... args) {
+        void* memory = allocate(sizeof(T), placement, tag);
+        if (memory == nullptr) {
+            throw std::bad_alloc();
+        }
+        return unique_ptr<T>(new (memory) T(std::forward<Args>(args)...));
+    }
+
+private:
+    struct alignas(std::max_align_t) Header {
+        MemoryTag* tag;
+        size_t size;
+    };
+
+    static constexpr size_t HEADER = sizeof(Header);
+
+    static Header* headerOf(void* ptr) {
+        return reinterpret_cast<Header*>(static_cast<uint8_t*>(ptr) - HEADER);
+    }
+
+    static void* payloadOf(Header* header) {
+        return reinterpret_cast<uint8_t*>(header) + HEADER;
+    }
+
+    static void* allocateRaw(size_t size, [[maybe_unused]] MemoryPlacement placement) {
+#ifdef CONFIG_SPIRAM
+        if (placement == MemoryPlacement::Large) {
+            return heap_caps_malloc_prefer(size, 2, LARGE_CAPS, INTERNAL_CAPS);
+        }
+        return heap_caps_malloc(size, INTERNAL_CAPS);
+#else
+        return std::malloc(size);
+#endif
+    }
+
+    static void* reallocateRaw(void* ptr, size_t size, [[maybe_unused]] MemoryPlacement placement) {
+#ifdef CONFIG_SPIRAM
+        if (placement == MemoryPlacement::Large) {
+            return heap_caps_realloc_prefer(ptr, size, 2, LARGE_CAPS, INTERNAL_CAPS);
+        }
+        return heap_caps_realloc(ptr, size, INTERNAL_CAPS);
+#else
+        return std::realloc(ptr, size);
+#endif
+    }
+
+    static void freeRaw(void* ptr) {
+#ifdef CONFIG_SPIRAM
+        heap_caps_free(ptr);
+#else
+        std::free(ptr);
+#endif
+    }
+
+#ifdef CONFIG_SPIRAM
+    static constexpr uint32_t LARGE_CAPS = MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT;
+    static constexpr uint32_t INTERNAL_CAPS = MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT;
+#endif
+};
+
+/**
+ * @brief Standard allocator for containers holding large, task-only data.
+ */
+template <typename T>
+struct LargeAllocator {
+    using value_type = T;
+
+    LargeAllocator() = default;
+
+    explicit LargeAllocator(MemoryTag& tag)
+        : tag(&tag) {
+    }
+
+    template <typename U>
+    LargeAllocator(const LargeAllocator<U>& other) noexcept
+        : tag(other.tag) {
+    }
+
+    T* allocate(size_t count) {
+        void* memory = Memory::allocate(count * sizeof(T), MemoryPlacement::Large, *tag);
+        if (memory == nullptr) {
+            throw std::bad_alloc();
+        }
+        return static_cast<T*>(memory);
+    }
+
+    void deallocate(T* ptr, size_t) noexcept {
+        Memory::free(ptr);
+    }
+
+    // Blocks remember their own tag, so any instance can free memory allocated by any other
+    template <typename U>
+    bool operator==(const LargeAllocator<U>&) const noexcept {
+        return true;
+    }
+
+    MemoryTag* tag = &MemoryTag::untagged();
+};
+
+/**
+ * @brief String for payloads and log lines; short strings still fit inline without allocating.
+ */
+using LargeString = std::basic_string<char, std::char_traits<char>, LargeAllocator<char>>;
+
+}    // namespace farmhub::kernel
@@ -1,32 +1,196 @@
 #pragma once
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 #include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <unordered_map>
 
 #include <nvs.h>
 #include <nvs_flash.h>
 
 #include <ArduinoJson.h>
+#include <BootClock.hpp>
 #include <Concurrent.hpp>
+#include <Task.hpp>
+
+using namespace std::chrono;
 
 namespace farmhub::kernel {
 
 /**
- * @brief Thread-safe NVS store for JSON serializable objects.
+ * @brief An NVS namespace that is opened once and kept open, shared by every store using it.
  */
-class NvsStore {
+class NvsNamespace {
 public:
-    NvsStore(const std::string& name)
+    static std::shared_ptr<NvsNamespace> open(const std::string& name) {
+        std::lock_guard<std::mutex> lock(namespacesMutex);
+        auto it = namespaces.find(name);
+        if (it != namespaces.end()) {
+            return it->second;
+        }
+        auto ns = std::shared_ptr<NvsNamespace>(new NvsNamespace(name));
+        namespaces.emplace(name, ns);
+        return ns;
+    }
+
+    /**
+     * @brief Run the action with a read-only handle; it fails with `ESP_ERR_NVS_NOT_FOUND` until something is written.
+     */
+    esp_err_t withReadHandle(std::function<esp_err_t(nvs_handle_t)> action) {
+        Lock lock(mutex);
+        // A read-write handle can read, too
+        if (readWriteHandle != 0) {
+            return action(readWriteHandle);
+        }
+        if (readOnlyHandle == 0) {
+            esp_err_t err = nvs_open(name.c_str(), NVS_READONLY, &readOnlyHandle);
+            if (err != ESP_OK) {
+                // The namespace doesn't exist until the first write
+                if (err != ESP_ERR_NVS_NOT_FOUND) {
+                    LOGTW(Tag::NVS, "failed to open NVS namespace '%s' for reading: %s",
+                        name.c_str(), esp_err_to_name(err));
+                }
+                readOnlyHandle = 0;
+                return err;
+            }
+        }
+        return action(readOnlyHandle);
+    }
+
+    esp_err_t withWriteHandle(std::function<esp_err_t(nvs_handle_t)> action) {
+        Lock lock(mutex);
+        if (readWriteHandle == 0) {
+            esp_err_t err = nvs_open(name.c_str(), NVS_READWRITE, &readWriteHandle);
+            if (err != ESP_OK) {
+                LOGTW(Tag::NVS, "failed to open NVS namespace '%s': %s",
+                    name.c_str(), esp_err_to_name(err));
+                readWriteHandle = 0;
+                return err;
+            }
+        }
+        return action(readWriteHandle);
+    }
+
+    const std::string name;
+
+private:
+    NvsNamespace(const std::string& name)
         : name(name) {
     }
 
+    Mutex mutex;
+    nvs_handle_t readOnlyHandle = 0;
+    nvs_handle_t readWriteHandle = 0;
+
+    static std::mutex namespacesMutex;
+    static std::unordered_map<std::string, std::shared_ptr<NvsNamespace>> namespaces;
+};
+
+// Inline, as several components include this header
+inline std::mutex NvsNamespace::namespacesMutex;
+inline std::unordered_map<std::string, std::shared_ptr<NvsNamespace>> NvsNamespace::namespaces;
+
+class NvsStore;
+
+/**
+ * @brief Flushes write-behind stores once their window passes, on a task of its own.
+ *
+ * Flash writes block for a long time, so they must not run in the esp_timer task,
+ * which other timers (like the status LED's) need to keep running.
+ */
+class NvsFlusher {
+public:
+    static NvsFlusher& instance() {
+        // Only started once a write-behind store is first written to
+        static NvsFlusher flusher;
+        return flusher;
+    }
+
+    /**
+     * @brief Flush the store at `deadline`, unless it is already due earlier.
+     */
+    void schedule(NvsStore* store, time_point<boot_clock> deadline) {
+        {
+            Lock lock(mutex);
+            auto [it, inserted] = deadlines.try_emplace(store, deadline);
+            if (!inserted) {
+                it->second = std::min(it->second, deadline);
+            }
+        }
+        wakeup.overwrite(true);
+    }
+
+    /**
+     * @brief Forget about the store, waiting for it to finish if it is being flushed right now.
+     */
+    void cancel(NvsStore* store) {
+        Lock flushLock(flushMutex);
+        Lock lock(mutex);
+        deadlines.erase(store);
+    }
+
+private:
+    NvsFlusher()
+        : wakeup("nvs-flush:wakeup", 1) {
+        Task::loop("nvs-flush", 4096, [this](Task& task) {
+            flushDueStores();
+        });
+    }
+
+    void flushDueStores();
+
+    // Held while flushing, so a store can't be destroyed in the middle of it
+    Mutex flushMutex;
+    Mutex mutex;
+    std::unordered_map<NvsStore*, time_point<boot_clock>> deadlines;
+    CopyQueue<bool> wakeup;
+};
+
+/**
+ * @brief Thread-safe NVS store for JSON serializable objects and trivially copyable binary values.
+ *
+ * With a non-zero write-behind window, writes and removals are kept in memory and flushed together
+ * (with a single commit) by `NvsFlusher` once the window passes, so repeated writes to the same key only
+ * hit flash once. Writes that fail to flush are kept and retried after another window.
+ * Reads see pending writes. Call `flush()` before shutting down to not lose pending writes.
+ *
+ * Reads use a read-only handle, so looking up keys in a namespace never written to doesn't create it.
+ */
+class NvsStore {
+public:
+    NvsStore(const std::string& name, milliseconds writeBehind = milliseconds::zero())
+        : name(name)
+        , ns(NvsNamespace::open(name))
+        , writeBehind(writeBehind) {
+    }
+
+    ~NvsStore() {
+        if (writeBehind > milliseconds::zero()) {
+            NvsFlusher::instance().cancel(this);
+        }
+        writePending();
+    }
+
     bool contains(const std::string& key) {
         return contains(key.c_str());
     }
 
     bool contains(const char* key) {
-        return withPreferences(true, [&](nvs_handle_t handle) {
-            size_t length = 0;
-            esp_err_t err = nvs_get_str(handle, key, nullptr, &length);
+        {
+            Lock lock(pendingMutex);
+            auto it = pendingWrites.find(key);
+            if (it != pendingWrites.end()) {
+                return it->second.type != PendingWrite::Type::Removal;
+            }
+        }
+        return ns->withReadHandle([&](nvs_handle_t handle) {
+            nvs_type_t type;
+            esp_err_t err = nvs_find_key(handle, key, &type);
             switch (err) {
                 case ESP_OK:
                 case ESP_ERR_NVS_NOT_FOUND:
@@ -46,33 +210,45 @@ public:
 
     template <typename T>
     bool get(const char* key, T& value) {
-        return withPreferences(true, [&](nvs_handle_t handle) {
-            size_t length = 0;
-            esp_err_t err = nvs_get_str(handle, key, nullptr, &length);
-            if (err != ESP_OK) {
-                LOGTV(Tag::NVS, "get(%s) = failed to read: %s", key, esp_err_to_name(err));
-                return err;
+        std::string json;
+        if (!readPending(key, PendingWrite::Type::Json, json)) {
+            if (isRemovalPending(key)) {
+                return false;
             }
+            esp_err_t err = ns->withReadHandle([&](nvs_handle_t handle) {
+                size_t length = 0;
+                esp_err_t err = nvs_get_str(handle, key, nullptr, &length);
+                if (err != ESP_OK) {
+                    LOGTV(Tag::NVS, "get(%s) = failed to read: %s", key, esp_err_to_name(err));
+                    return err;
+                }
 
-            char json[length];
-            err = nvs_get_str(handle, key, json, &length);
+                // Length includes the terminating zero
+                json.resize(length);
+                err = nvs_get_str(handle, key, json.data(), &length);
+                if (err != ESP_OK) {
+                    LOGTE(Tag::NVS, "get(%s) = failed to read: %s", key, esp_err_to_name(err));
+                    return err;
+                }
+                json.resize(length - 1);
+                return ESP_OK;
+            });
             if (err != ESP_OK) {
-                LOGTE(Tag::NVS, "get(%s) = failed to read: %s", key, esp_err_to_name(err));
-                return err;
+                return false;
             }
+        }
 
-            LOGTV(Tag::NVS, "get(%s) = %s", key, json);
+        LOGTV(Tag::NVS, "get(%s) = %s", key, json.c_str());
 
-            JsonDocument jsonDocument;
-            DeserializationError jsonError = deserializeJson(jsonDocument, json);
-            if (jsonError) {
-                LOGTE(Tag::NVS, "get(%s) = invalid JSON: %s", key, jsonError.c_str());
-                return ESP_FAIL;
-            }
+        JsonDocument jsonDocument;
+        DeserializationError jsonError = deserializeJson(jsonDocument, json);
+        if (jsonError) {
+            LOGTE(Tag::NVS, "get(%s) = invalid JSON: %s", key, jsonError.c_str());
+            return false;
+        }
 
-            value = jsonDocument.as<T>();
-            return ESP_OK;
-        }) == ESP_OK;
+        value = jsonDocument.as<T>();
+        return true;
     }
 
     template <typename T>
@@ -82,22 +258,82 @@ public:
 
     template <typename T>
     bool set(const char* key, const T& value) {
-        return withPreferences(false, [&](nvs_handle_t handle) {
-            JsonDocument jsonDocument;
-            jsonDocument.set(value);
-            std::string jsonString;
-            serializeJson(jsonDocument, jsonString);
+        JsonDocument jsonDocument;
+        jsonDocument.set(value);
+        std::string jsonString;
+        serializeJson(jsonDocument, jsonString);
+
+        LOGTV(Tag::NVS, "set(%s) = %s", key, jsonString.c_str());
+        return write(key, PendingWrite::Type::Json, std::move(jsonString));
+    }
 
-            LOGTV(Tag::NVS, "set(%s) = %s", key, jsonString.c_str());
+    /**
+     * @brief Read a binary value stored with `setBinary()`.
+     *
+     * Fails if the stored value was written with a different version or size, so
+     * changing the layout of `T` only requires bumping the version.
+     */
+    template <typename T>
+        requires std::is_trivially_copyable_v<T>
+    bool getBinary(const std::string& key, T& value, uint16_t version = 0) {
+        return getBinary(key.c_str(), value, version);
+    }
 
-            esp_err_t err = nvs_set_str(handle, key, jsonString.c_str());
+    template <typename T>
+        requires std::is_trivially_copyable_v<T>
+    bool getBinary(const char* key, T& value, uint16_t version = 0) {
+        std::string blob;
+        if (!readPending(key, PendingWrite::Type::Binary, blob)) {
+            if (isRemovalPending(key)) {
+                return false;
+            }
+            esp_err_t err = ns->withReadHandle([&](nvs_handle_t handle) {
+                size_t length = sizeof(BlobHeader) + sizeof(T);
+                blob.resize(length);
+                esp_err_t err = nvs_get_blob(handle, key, blob.data(), &length);
+                if (err != ESP_OK) {
+                    LOGTV(Tag::NVS, "getBinary(%s) = failed to read: %s", key, esp_err_to_name(err));
+                    return err;
+                }
+                blob.resize(length);
+                return ESP_OK;
+            });
             if (err != ESP_OK) {
-                LOGTE(Tag::NVS, "set(%s) = failed to write: %s", key, esp_err_to_name(err));
-                return err;
+                return false;
             }
+        }
 
-            return nvs_commit(handle);
-        }) == ESP_OK;
+        BlobHeader header;
+        if (blob.size() != sizeof(BlobHeader) + sizeof(T)) {
+            LOGTW(Tag::NVS, "getBinary(%s) = size mismatch: %d != %d", key, blob.size(), sizeof(BlobHeader) + sizeof(T));
+            return false;
+        }
+        std::memcpy(&header, blob.data(), sizeof(BlobHeader));
+        if (header.version != version || header.size != sizeof(T)) {
+            LOGTW(Tag::NVS, "getBinary(%s) = version mismatch: %d != %d", key, header.version, version);
+            return false;
+        }
+        std::memcpy(&value, blob.data() + sizeof(BlobHeader), sizeof(T));
+        LOGTV(Tag::NVS, "getBinary(%s) = %d bytes (version %d)", key, sizeof(T), version);
+        return true;
+    }
+
+    template <typename T>
+        requires std::is_trivially_copyable_v<T>
+    bool setBinary(const std::string& key, const T& value, uint16_t version = 0) {
+        return setBinary(key.c_str(), value, version);
+    }
+
+    template <typename T>
+        requires std::is_trivially_copyable_v<T>
+    bool setBinary(const char* key, const T& value, uint16_t version = 0) {
+        BlobHeader header { version, sizeof(T) };
+        std::string blob(sizeof(BlobHeader) + sizeof(T), '\0');
+        std::memcpy(blob.data(), &header, sizeof(BlobHeader));
+        std::memcpy(blob.data() + sizeof(BlobHeader), &value, sizeof(T));
+
+        LOGTV(Tag::NVS, "setBinary(%s) = %d bytes (version %d)", key, sizeof(T), version);
+        return write(key, PendingWrite::Type::Binary, std::move(blob));
     }
 
     bool remove(const std::string& key) {
@@ -105,49 +341,173 @@ public:
     }
 
     bool remove(const char* key) {
-        return withPreferences(false, [&](nvs_handle_t handle) {
-            LOGTV(Tag::NVS, "remove(%s)", key);
-            esp_err_t err = nvs_erase_key(handle, key);
+        LOGTV(Tag::NVS, "remove(%s)", key);
+        return write(key, PendingWrite::Type::Removal, "");
+    }
+
+    /**
+     * @brief Write pending values to flash; if that fails, they are retried after the write-behind window.
+     */
+    bool flush() {
+        if (writePending()) {
+            return true;
+        }
+        if (writeBehind > milliseconds::zero()) {
+            NvsFlusher::instance().schedule(this, boot_clock::now() + writeBehind);
+        }
+        return false;
+    }
+
+private:
+    struct BlobHeader {
+        uint16_t version;
+        uint16_t size;
+    };
+
+    struct PendingWrite {
+        enum class Type {
+            Json,
+            Binary,
+            Removal,
+        };
+
+        Type type;
+        std::string data;
+    };
+
+    bool readPending(const char* key, PendingWrite::Type type, std::string& data) {
+        Lock lock(pendingMutex);
+        auto it = pendingWrites.find(key);
+        if (it == pendingWrites.end() || it->second.type != type) {
+            return false;
+        }
+        data = it->second.data;
+        return true;
+    }
+
+    bool isRemovalPending(const char* key) {
+        Lock lock(pendingMutex);
+        auto it = pendingWrites.find(key);
+        return it != pendingWrites.end() && it->second.type == PendingWrite::Type::Removal;
+    }
+
+    bool write(const char* key, PendingWrite::Type type, std::string&& data) {
+        if (writeBehind > milliseconds::zero()) {
+            bool wasEmpty;
+            {
+                Lock lock(pendingMutex);
+                wasEmpty = pendingWrites.empty();
+                pendingWrites[key] = PendingWrite { type, std::move(data) };
+            }
+            // Not under pendingMutex, as the flusher takes that while holding its own lock
+            if (wasEmpty) {
+                NvsFlusher::instance().schedule(this, boot_clock::now() + writeBehind);
+            }
+            return true;
+        }
+
+        return ns->withWriteHandle([&](nvs_handle_t handle) {
+            esp_err_t err = writeToFlash(handle, key, PendingWrite { type, std::move(data) });
             if (err != ESP_OK) {
-                LOGTE(Tag::NVS, "remove(%s) = cannot delete: %s", key, esp_err_to_name(err));
                 return err;
             }
-
             return nvs_commit(handle);
         }) == ESP_OK;
     }
 
-private:
-    esp_err_t withPreferences(bool readOnly, std::function<esp_err_t(nvs_handle_t)> action) {
-        Lock lock(preferencesMutex);
-        LOGTV(Tag::NVS, "%s '%s'", readOnly ? "read" : "write", name.c_str());
-
-        nvs_handle_t handle;
-        esp_err_t err = nvs_open(name.c_str(), readOnly ? NVS_READONLY : NVS_READWRITE, &handle);
-        switch (err) {
-            case ESP_OK:
+    /**
+     * @brief Write pending values to flash, putting them back if that fails.
+     */
+    bool writePending() {
+        std::unordered_map<std::string, PendingWrite> writes;
+        {
+            Lock lock(pendingMutex);
+            writes.swap(pendingWrites);
+        }
+        if (writes.empty()) {
+            return true;
+        }
+        LOGTV(Tag::NVS, "flushing %d pending writes to '%s'", writes.size(), name.c_str());
+        esp_err_t err = ns->withWriteHandle([&](nvs_handle_t handle) {
+            for (const auto& [key, write] : writes) {
+                esp_err_t err = writeToFlash(handle, key.c_str(), write);
+                if (err != ESP_OK) {
+                    return err;
+                }
+            }
+            return nvs_commit(handle);
+        });
+        if (err == ESP_OK) {
+            return true;
+        }
+        LOGTW(Tag::NVS, "failed to flush %d pending writes to '%s': %s",
+            writes.size(), name.c_str(), esp_err_to_name(err));
+        Lock lock(pendingMutex);
+        for (auto& [key, write] : writes) {
+            // Anything written to the key since is newer
+            pendingWrites.try_emplace(key, std::move(write));
+        }
+        return false;
+    }
+
+    static esp_err_t writeToFlash(nvs_handle_t handle, const char* key, const PendingWrite& write) {
+        esp_err_t err;
+        switch (write.type) {
+            case PendingWrite::Type::Json:
+                err = nvs_set_str(handle, key, write.data.c_str());
                 break;
-            case ESP_ERR_NVS_NOT_FOUND:
-                LOGTV(Tag::NVS, "namespace '%s' does not exist yet, nothing to read",
-                    name.c_str());
-                return ESP_ERR_NOT_FOUND;
+            case PendingWrite::Type::Binary:
+                err = nvs_set_blob(handle, key, write.data.data(), write.data.size());
+                break;
+            case PendingWrite::Type::Removal:
+                err = nvs_erase_key(handle, key);
+                // Nothing to remove
+                if (err == ESP_ERR_NVS_NOT_FOUND) {
+                    err = ESP_OK;
+                }
                 break;
             default:
-                LOGTW(Tag::NVS, "failed to open NVS to %s '%s': %s",
-                    readOnly ? "read" : "write", name.c_str(), esp_err_to_name(err));
+                err = ESP_ERR_INVALID_ARG;
                 break;
         }
-
-        esp_err_t result = action(handle);
-        nvs_close(handle);
-
-        LOGTV(Tag::NVS, "finished %s '%s', result: %s",
-            readOnly ? "read" : "write", name.c_str(), esp_err_to_name(result));
-        return result;
+        if (err != ESP_OK) {
+            LOGTE(Tag::NVS, "set(%s) = failed to write: %s", key, esp_err_to_name(err));
+        }
+        return err;
     }
 
-    Mutex preferencesMutex;
     const std::string name;
+    const std::shared_ptr<NvsNamespace> ns;
+    const milliseconds writeBehind;
+
+    Mutex pendingMutex;
+    std::unordered_map<std::string, PendingWrite> pendingWrites;
 };
 
+inline void NvsFlusher::flushDueStores() {
+    ticks timeout = ticks::max();
+    {
+        Lock flushLock(flushMutex);
+        std::list<NvsStore*> due;
+        {
+            Lock lock(mutex);
+            auto now = boot_clock::now();
+            for (auto it = deadlines.begin(); it != deadlines.end();) {
+                if (it->second <= now) {
+                    due.push_back(it->first);
+                    it = deadlines.erase(it);
+                } else {
+                    timeout = std::min(timeout, ceil<ticks>(it->second - now));
+                    it++;
+                }
+            }
+        }
+        // A store failing to flush schedules itself again, which wakes us up right away
+        for (auto* store : due) {
+            store->flush();
+        }
+    }
+    wakeup.pollIn(timeout);
+}
+
 }    // namespace farmhub::kernel
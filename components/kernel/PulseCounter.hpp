@@ -12,6 +12,7 @@
 #include <Log.hpp>
 #include <Pin.hpp>
 #include <PowerManager.hpp>
+#include <PulseRate.hpp>
 
 namespace farmhub::kernel {
 
@@ -23,11 +24,14 @@ class PulseCounterManager;
  * It uses the RTC GPIO matrix to detect rising and falling edges on a GPIO pin.
  * Keeps the device out of light sleep while a pulse is being detected.
  *
+ * Edges are timestamped as they are detected, so besides counting pulses it can also tell
+ * the pulse frequency from the time between them.
  */
 class PulseCounter {
 public:
     PulseCounter(InternalPinPtr pin)
-        : pin(pin) {
+        : pin(pin)
+        , rate(PulseRateMeter::DEFAULT_COUNTING_THRESHOLD, PulseRateMeter::DEFAULT_MAX_PERIOD, now()) {
         auto gpio = pin->getGpio();
 
         // Configure the GPIO pin as an input
@@ -72,6 +76,22 @@ public:
         return count;
     }
 
+    /**
+     * @brief Average pulse frequency in Hz since the last call.
+     */
+    double takeAverageFrequency() {
+        Lock lock(rateMutex);
+        return rate.takeAverage(now());
+    }
+
+    /**
+     * @brief Pulse frequency in Hz based on the latest pulse period.
+     */
+    double getInstantaneousFrequency() {
+        Lock lock(rateMutex);
+        return rate.getInstantaneous(now());
+    }
+
     PinPtr getPin() const {
         return pin;
     }
@@ -82,13 +102,23 @@ private:
         Falling,
     };
 
+    struct Edge {
+        EdgeKind kind;
+        PulseRateMeter::Time time;
+    };
+
+    static PulseRateMeter::Time now() {
+        return duration_cast<PulseRateMeter::Time>(boot_clock::now().time_since_epoch());
+    }
+
     static void IRAM_ATTR interruptHandler(void* arg) {
         auto self = static_cast<PulseCounter*>(arg);
         self->handlePotentialStateChange();
     }
 
     IRAM_ATTR void handlePotentialStateChange() {
-        eventQueue.offerFromISR(takeSample());
+        // Timestamp the edge right away, the task handling it may run a lot later
+        eventQueue.offerFromISR(Edge { takeSample(), now() });
     }
 
     IRAM_ATTR EdgeKind takeSample() {
@@ -139,11 +169,13 @@ private:
             seenNewEdge = false;
             for (auto event = eventQueue.pollIn(timeout); event.has_value(); event = eventQueue.poll()) {
                 auto edge = event.value();
-                if (edge != lastEdge) {
-                    lastEdge = edge;
+                if (edge.kind != lastEdge) {
+                    lastEdge = edge.kind;
                     seenNewEdge = true;
                     if (lastEdge == EdgeKind::Falling) {
                         counter++;
+                        Lock lock(rateMutex);
+                        rate.recordPulse(edge.time);
                     }
                 }
             }
@@ -153,7 +185,10 @@ private:
     const InternalPinPtr pin;
     std::atomic<uint32_t> counter { 0 };
 
-    CopyQueue<EdgeKind> eventQueue { pin->getName(), 16 };
+    Mutex rateMutex;
+    PulseRateMeter rate;
+
+    CopyQueue<Edge> eventQueue { pin->getName(), 16 };
 
     friend class PulseCounterManager;
 };
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+
+using namespace std::chrono;
+using namespace std::chrono_literals;
+
+namespace farmhub::kernel {
+
+/**
+ * @brief Measures the frequency of a pulse train from the timestamps of its pulses.
+ *
+ * Counting pulses in a fixed window is coarse when only a few pulses arrive per window: the result
+ * jumps by a whole pulse's worth either way. At low frequencies we measure the time between pulses
+ * instead (reciprocal counting), which is exact for a steady pulse train no matter how few pulses
+ * there are. At high frequencies, plain counting is just as accurate, and doesn't depend on every
+ * single timestamp.
+ *
+ * Times are measured as time since boot. The meter itself does no locking.
+ */
+class PulseRateMeter {
+public:
+    using Time = microseconds;
+
+    static constexpr uint32_t DEFAULT_COUNTING_THRESHOLD = 32;
+    static constexpr Time DEFAULT_MAX_PERIOD = 60s;
+
+    /**
+     * @param countingThreshold above this many pulses per window, use plain counting.
+     * @param maxPeriod pulses further apart than this are not considered part of the same pulse train.
+     */
+    explicit PulseRateMeter(uint32_t countingThreshold = DEFAULT_COUNTING_THRESHOLD, Time maxPeriod = DEFAULT_MAX_PERIOD, Time start = Time::zero())
+        : countingThreshold(countingThreshold)
+        , maxPeriod(maxPeriod)
+        , windowStart(start) {
+    }
+
+    void recordPulse(Time time) {
+        windowPulses++;
+        if (lastPulse.has_value() && time - *lastPulse <= maxPeriod) {
+            lastPeriod = time - *lastPulse;
+            windowPeriods++;
+            windowPeriodTime += *lastPeriod;
+        } else {
+            // First pulse after a pause: there's no period to measure yet
+            lastPeriod.reset();
+        }
+        lastPulse = time;
+    }
+
+    /**
+     * @brief Pulses recorded since the last call to `takeAverage()`.
+     */
+    uint32_t getWindowPulses() const {
+        return windowPulses;
+    }
+
+    /**
+     * @brief Average frequency in Hz since the last call, and start a new window.
+     */
+    double takeAverage(Time now) {
+        double frequency;
+        auto window = now - windowStart;
+        if (windowPulses >= countingThreshold && window > Time::zero()) {
+            frequency = windowPulses / toSeconds(window);
+        } else if (windowPeriods > 0) {
+            frequency = windowPeriods / toSeconds(windowPeriodTime);
+            // The pulse train may have slowed down or stopped since the last pulse
+            frequency = std::min(frequency, 1.0 / toSeconds(std::max(now - *lastPulse, Time(1))));
+            if (now - *lastPulse > maxPeriod) {
+                frequency = 0;
+            }
+        } else {
+            // A period spanning the whole window is still in progress, or we've stopped
+            frequency = getInstantaneous(now);
+        }
+
+        windowStart = now;
+        windowPulses = 0;
+        windowPeriods = 0;
+        windowPeriodTime = Time::zero();
+        return frequency;
+    }
+
+    /**
+     * @brief Current frequency in Hz based on the last period.
+     *
+     * Once more time has passed since the last pulse than the last period took, the pulse train
+     * must have slowed down, so the frequency falls off accordingly until it reaches zero after `maxPeriod`.
+     */
+    double getInstantaneous(Time now) const {
+        if (!lastPulse.has_value() || !lastPeriod.has_value()) {
+            return 0;
+        }
+        auto sinceLastPulse = now - *lastPulse;
+        if (sinceLastPulse > maxPeriod) {
+            return 0;
+        }
+        return 1.0 / toSeconds(std::max(*lastPeriod, sinceLastPulse));
+    }
+
+private:
+    static double toSeconds(Time time) {
+        return duration_cast<duration<double>>(time).count();
+    }
+
+    const uint32_t countingThreshold;
+    const Time maxPeriod;
+
+    std::optional<Time> lastPulse;
+    std::optional<Time> lastPeriod;
+
+    Time windowStart;
+    uint32_t windowPulses = 0;
+    uint32_t windowPeriods = 0;
+    Time windowPeriodTime = Time::zero();
+};
+
+}    // namespace farmhub::kernel
@@ -1,7 +1,12 @@
 #pragma once
 
+#include <chrono>
+#include <mutex>
+
 #include <driver/ledc.h>
 
+using namespace std::chrono;
+
 namespace farmhub::kernel {
 
 // TODO Figure out what to do with low/high speed modes
@@ -72,18 +77,44 @@ public:
     }
 
     void write(uint32_t value) const {
+        if (fading) {
+            // Duty cannot be changed while the hardware is still fading on the channel
+            ESP_ERROR_CHECK(ledc_fade_stop(timer.speedMode, channel));
+            fading = false;
+        }
         ESP_ERROR_CHECK(ledc_set_duty(timer.speedMode, channel, value));
         ESP_ERROR_CHECK(ledc_update_duty(timer.speedMode, channel));
     }
 
+    /**
+     * @brief Fade from the current duty to `value` over `fadeTime` in hardware; returns right away.
+     */
+    void fadeTo(uint32_t value, milliseconds fadeTime) const {
+        if (fadeTime <= 0ms) {
+            write(value);
+            return;
+        }
+        installFadeService();
+        ESP_ERROR_CHECK(ledc_set_fade_time_and_start(timer.speedMode, channel, value, fadeTime.count(), LEDC_FADE_NO_WAIT));
+        fading = true;
+    }
+
     const std::string& getName() const {
         return pin->getName();
     }
 
 private:
+    static void installFadeService() {
+        static std::once_flag installed;
+        std::call_once(installed, []() {
+            ESP_ERROR_CHECK(ledc_fade_func_install(0));
+        });
+    }
+
     const InternalPinPtr pin;
     const LedcTimer& timer;
     const ledc_channel_t channel;
+    mutable bool fading = false;
 
     friend class PmwManager;
 };
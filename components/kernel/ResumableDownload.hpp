@@ -0,0 +1,334 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include <mbedtls/sha256.h>
+
+#include <Log.hpp>
+
+using namespace std::chrono;
+
+namespace farmhub::kernel {
+
+/**
+ * @brief How far a download got; persisted so it can be resumed after a reboot.
+ */
+struct DownloadProgress {
+    std::string url;
+    // Identifies the version of the resource the bytes written so far came from
+    std::string etag;
+    // Always at a checkpoint, i.e. a multiple of the checkpoint interval
+    size_t written = 0;
+    // Total size of the resource, or zero if not known yet
+    size_t size = 0;
+    // SHA-256 of the first `written` bytes, to check that the target still holds them
+    std::string sha256;
+    // Attempts started so far, including those before reboots
+    uint32_t attempts = 0;
+};
+
+/**
+ * @brief A single HTTP request for the resource.
+ */
+class DownloadConnection {
+public:
+    virtual ~DownloadConnection() = default;
+
+    /**
+     * @brief The HTTP status code: 200 for the whole resource, 206 for the requested range,
+     * or negative if the connection could not be established.
+     */
+    virtual int getStatus() = 0;
+
+    virtual std::string getEtag() = 0;
+
+    /**
+     * @brief Total size of the resource, or zero if not known.
+     */
+    virtual size_t getSize() = 0;
+
+    /**
+     * @brief Read the next part of the body; returns zero at the end, negative when the connection failed.
+     */
+    virtual int read(uint8_t* buffer, size_t length) = 0;
+};
+
+/**
+ * @brief Open a connection requesting the resource starting at `offset` (i.e. `Range: bytes=<offset>-`),
+ * but only if it still has the given ETag (`If-Range`), otherwise the whole resource.
+ */
+typedef std::function<std::unique_ptr<DownloadConnection>(const std::string& url, size_t offset, const std::string& etag)> DownloadConnector;
+
+/**
+ * @brief Where the downloaded bytes go, e.g. an OTA partition.
+ */
+class DownloadTarget {
+public:
+    virtual ~DownloadTarget() = default;
+
+    /**
+     * @brief Prepare to write from `offset`, keeping what was written before it.
+     */
+    virtual bool begin(size_t offset) = 0;
+
+    virtual bool write(const uint8_t* data, size_t length) = 0;
+
+    /**
+     * @brief Read back what was written, to check it before resuming.
+     */
+    virtual bool read(size_t offset, uint8_t* buffer, size_t length) = 0;
+
+    /**
+     * @brief Called at the end of the download; check that what was written is whole and valid, e.g. a firmware image.
+     */
+    virtual bool finish() = 0;
+};
+
+enum class DownloadResult {
+    Complete,
+    Failed,
+    GaveUp,
+};
+
+/**
+ * @brief Downloads a resource, resuming with range requests after the connection drops.
+ *
+ * Progress is checkpointed at every `checkpointInterval` bytes (a multiple of the flash sector size,
+ * so resuming never has to rewrite a partially erased sector). After a failure the download is resumed
+ * from the last checkpoint with exponential backoff between attempts. When the resource changed
+ * (the server ignores the `If-Range` and sends it whole), or the target doesn't hold the checkpointed
+ * bytes anymore, the download starts over.
+ *
+ * When the server doesn't tell the size of the resource (e.g. a chunked response), we can't tell a
+ * truncated download from a complete one; such downloads are not checkpointed, and are only accepted
+ * once the target finds what was written valid.
+ *
+ * Attempts are counted and persisted before they are made, so that attempts that crash or hang
+ * the device count against `maxAttempts`, too.
+ */
+class ResumableDownload {
+public:
+    ResumableDownload(
+        DownloadConnector connect,
+        std::shared_ptr<DownloadTarget> target,
+        std::function<void(const DownloadProgress&)> persist,
+        std::function<void(milliseconds)> delay,
+        uint32_t maxAttempts,
+        uint32_t maxAttemptsPerRun,
+        size_t checkpointInterval = 64 * 1024)
+        : connect(connect)
+        , target(target)
+        , persist(persist)
+        , delay(delay)
+        , maxAttempts(maxAttempts)
+        , maxAttemptsPerRun(maxAttemptsPerRun)
+        , checkpointInterval(checkpointInterval) {
+    }
+
+    DownloadResult run(DownloadProgress& progress) {
+        for (uint32_t attemptsInRun = 0;; attemptsInRun++) {
+            if (progress.attempts >= maxAttempts) {
+                LOGE("Giving up download of %s after %lu attempts",
+                    progress.url.c_str(), progress.attempts);
+                return DownloadResult::GaveUp;
+            }
+            progress.attempts++;
+            persist(progress);
+            switch (attempt(progress)) {
+                case AttemptResult::Complete:
+                    return DownloadResult::Complete;
+                case AttemptResult::Fatal:
+                    return DownloadResult::Failed;
+                case AttemptResult::Retry:
+                    break;
+            }
+            if (progress.attempts >= maxAttempts) {
+                LOGE("Giving up download of %s after %lu attempts",
+                    progress.url.c_str(), progress.attempts);
+                return DownloadResult::GaveUp;
+            }
+            if (attemptsInRun + 1 >= maxAttemptsPerRun) {
+                LOGW("Download of %s interrupted at %u bytes, will resume later",
+                    progress.url.c_str(), progress.written);
+                return DownloadResult::Failed;
+            }
+            auto backoff = backoffAfter(progress.attempts);
+            LOGI("Resuming download of %s from %u bytes in %lld ms",
+                progress.url.c_str(), progress.written, backoff.count());
+            delay(backoff);
+        }
+    }
+
+    static milliseconds backoffAfter(uint32_t attempts) {
+        auto backoff = INITIAL_BACKOFF * (1 << std::min<uint32_t>(attempts - 1, 8));
+        return std::min(backoff, MAX_BACKOFF);
+    }
+
+    static constexpr milliseconds INITIAL_BACKOFF = 5s;
+    static constexpr milliseconds MAX_BACKOFF = 2min;
+
+private:
+    enum class AttemptResult {
+        Complete,
+        Retry,
+        Fatal,
+    };
+
+    class Hash {
+    public:
+        Hash() {
+            mbedtls_sha256_init(&context);
+            mbedtls_sha256_starts(&context, 0);
+        }
+
+        void reset() {
+            mbedtls_sha256_free(&context);
+            mbedtls_sha256_init(&context);
+            mbedtls_sha256_starts(&context, 0);
+        }
+
+        ~Hash() {
+            mbedtls_sha256_free(&context);
+        }
+
+        void update(const uint8_t* data, size_t length) {
+            mbedtls_sha256_update(&context, data, length);
+        }
+
+        std::string hex() const {
+            mbedtls_sha256_context copy;
+            mbedtls_sha256_init(&copy);
+            mbedtls_sha256_clone(&copy, &context);
+            std::array<uint8_t, 32> digest;
+            mbedtls_sha256_finish(&copy, digest.data());
+            mbedtls_sha256_free(&copy);
+            char hex[2 * digest.size() + 1];
+            for (size_t i = 0; i < digest.size(); i++) {
+                snprintf(hex + 2 * i, 3, "%02x", digest[i]);
+            }
+            return std::string(hex);
+        }
+
+    private:
+        mbedtls_sha256_context context;
+    };
+
+    AttemptResult attempt(DownloadProgress& progress) {
+        Hash hash;
+        if (progress.written > 0 && !verifyWritten(progress, hash)) {
+            LOGW("Target does not hold the %u bytes downloaded earlier, starting over",
+                progress.written);
+            startOver(progress, hash);
+        }
+
+        auto connection = connect(progress.url, progress.written, progress.etag);
+        int status = connection->getStatus();
+        if (status == 200) {
+            if (progress.written > 0) {
+                LOGI("Resource changed, starting over");
+                startOver(progress, hash);
+            }
+            progress.etag = connection->getEtag();
+            // Whatever we knew about the size before is no longer relevant
+            progress.size = connection->getSize();
+        } else if (status == 206 && progress.written > 0) {
+            // Continuing where we left off
+            if (connection->getSize() > 0) {
+                progress.size = connection->getSize();
+            }
+        } else if (status >= 400 && status < 500 && status != 408 && status != 429) {
+            LOGE("Download of %s failed with status %d", progress.url.c_str(), status);
+            return AttemptResult::Fatal;
+        } else {
+            LOGW("Download of %s failed with status %d", progress.url.c_str(), status);
+            return AttemptResult::Retry;
+        }
+        bool resumable = progress.size > 0;
+        if (!target->begin(progress.written)) {
+            return AttemptResult::Fatal;
+        }
+
+        DownloadProgress checkpoint = progress;
+        std::array<uint8_t, 1024> buffer;
+        size_t written = progress.written;
+        while (true) {
+            int bytesRead = connection->read(buffer.data(), buffer.size());
+            if (bytesRead < 0) {
+                break;
+            }
+            if (bytesRead == 0) {
+                if (resumable && written != progress.size) {
+                    break;
+                }
+                if (!target->finish()) {
+                    LOGW("Downloaded %u bytes of %s are not valid, starting over",
+                        written, progress.url.c_str());
+                    progress = checkpoint;
+                    startOver(progress, hash);
+                    persist(progress);
+                    return AttemptResult::Retry;
+                }
+                progress = checkpoint;
+                progress.written = written;
+                progress.sha256 = hash.hex();
+                return AttemptResult::Complete;
+            }
+            const uint8_t* data = buffer.data();
+            size_t remaining = bytesRead;
+            while (remaining > 0) {
+                // Split writes at checkpoints
+                size_t nextCheckpoint = (written / checkpointInterval + 1) * checkpointInterval;
+                size_t count = std::min(remaining, nextCheckpoint - written);
+                if (!target->write(data, count)) {
+                    return AttemptResult::Fatal;
+                }
+                hash.update(data, count);
+                written += count;
+                data += count;
+                remaining -= count;
+                if (resumable && written == nextCheckpoint) {
+                    checkpoint.written = written;
+                    checkpoint.sha256 = hash.hex();
+                    persist(checkpoint);
+                }
+            }
+        }
+        progress = checkpoint;
+        return AttemptResult::Retry;
+    }
+
+    bool verifyWritten(const DownloadProgress& progress, Hash& hash) {
+        std::array<uint8_t, 1024> buffer;
+        for (size_t offset = 0; offset < progress.written; offset += buffer.size()) {
+            size_t count = std::min(buffer.size(), progress.written - offset);
+            if (!target->read(offset, buffer.data(), count)) {
+                return false;
+            }
+            hash.update(buffer.data(), count);
+        }
+        return hash.hex() == progress.sha256;
+    }
+
+    static void startOver(DownloadProgress& progress, Hash& hash) {
+        progress.etag.clear();
+        progress.written = 0;
+        progress.size = 0;
+        progress.sha256.clear();
+        hash.reset();
+    }
+
+    const DownloadConnector connect;
+    const std::shared_ptr<DownloadTarget> target;
+    const std::function<void(const DownloadProgress&)> persist;
+    const std::function<void(milliseconds)> delay;
+    const uint32_t maxAttempts;
+    const uint32_t maxAttemptsPerRun;
+    const size_t checkpointInterval;
+};
+
+}    // namespace farmhub::kernel
@@ -0,0 +1,302 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <list>
+#include <memory>
+#include <vector>
+
+#include <BootClock.hpp>
+#include <Concurrent.hpp>
+#include <Task.hpp>
+
+using namespace std::chrono;
+
+namespace farmhub::kernel {
+
+typedef std::function<void()> JobFunction;
+
+/**
+ * @brief A periodic job registered with the scheduler.
+ *
+ * A job becomes due at multiples of its period, but may run anywhere within its tolerance window
+ * after that. This allows the scheduler to coalesce it with other jobs into a single wakeup.
+ */
+class Job {
+public:
+    Job(const std::string& name, microseconds period, microseconds tolerance, JobFunction function)
+        : name(name)
+        , period(period)
+        , tolerance(tolerance)
+        , function(function) {
+    }
+
+    void cancel() {
+        cancelled = true;
+    }
+
+    bool isCancelled() const {
+        return cancelled;
+    }
+
+    /**
+     * @brief Number of times this job was the reason for the scheduler to wake up.
+     */
+    uint32_t getWakeups() const {
+        return wakeups;
+    }
+
+    /**
+     * @brief Number of times this job has run, including runs piggybacking on other jobs' wakeups.
+     */
+    uint32_t getRuns() const {
+        return runs;
+    }
+
+    const std::string name;
+    const microseconds period;
+    const microseconds tolerance;
+
+private:
+    const JobFunction function;
+    std::atomic<bool> cancelled { false };
+    std::atomic<uint32_t> wakeups { 0 };
+    std::atomic<uint32_t> runs { 0 };
+
+    friend class JobQueue;
+    friend class Scheduler;
+};
+
+typedef std::shared_ptr<Job> JobHandle;
+
+/**
+ * @brief Bookkeeping of when jobs are due, without any threading or real clock involved.
+ *
+ * Each job is due at an aligned slot, and must run before the end of its tolerance window.
+ * We wake up at the earliest end of any window, and run every job that is already due at
+ * that point. We only expect a handful of jobs, so a plain vector is good enough.
+ */
+class JobQueue {
+public:
+    struct Entry {
+        time_point<boot_clock> due;
+        JobHandle job;
+
+        time_point<boot_clock> latest() const {
+            return due + job->tolerance;
+        }
+    };
+
+    void add(const JobHandle& job, time_point<boot_clock> now) {
+        entries.push_back({ nextAlignedSlot(now, job->period), job });
+    }
+
+    /**
+     * @brief The latest time we can wake up without missing the tolerance window of any job.
+     */
+    time_point<boot_clock> nextWakeup() const {
+        auto next = time_point<boot_clock>::max();
+        for (const auto& entry : entries) {
+            if (!entry.job->isCancelled()) {
+                next = std::min(next, entry.latest());
+            }
+        }
+        return next;
+    }
+
+    /**
+     * @brief Remove and return all jobs that are due at `now`, if it is time to wake up at all.
+     */
+    std::vector<Entry> takeDue(time_point<boot_clock> now) {
+        std::erase_if(entries, [](const Entry& entry) {
+            return entry.job->isCancelled();
+        });
+
+        std::vector<Entry> due;
+        if (now < nextWakeup()) {
+            return due;
+        }
+        Entry* source = nullptr;
+        for (auto& entry : entries) {
+            if (source == nullptr || entry.latest() < source->latest()) {
+                source = &entry;
+            }
+        }
+        source->job->wakeups++;
+        wakeups++;
+
+        std::erase_if(entries, [&](const Entry& entry) {
+            if (entry.due <= now) {
+                due.push_back(entry);
+                return true;
+            }
+            return false;
+        });
+        return due;
+    }
+
+    /**
+     * @brief Put a job back after it has run; returns how much it missed its next deadline by, if at all.
+     */
+    microseconds reschedule(const Entry& entry, time_point<boot_clock> now) {
+        Entry next { entry.due + entry.job->period, entry.job };
+        microseconds missedBy = microseconds::zero();
+        if (next.latest() < now) {
+            // Skip to the next aligned slot instead of trying to catch up, to stay in sync with other jobs
+            missedBy = duration_cast<microseconds>(now - next.latest());
+            next.due = nextAlignedSlot(now, entry.job->period);
+        }
+        entries.push_back(next);
+        return missedBy;
+    }
+
+    uint32_t getWakeups() const {
+        return wakeups;
+    }
+
+    /**
+     * @brief The earliest time at or after `now` that is a whole multiple of `period` on the boot clock.
+     */
+    static time_point<boot_clock> nextAlignedSlot(time_point<boot_clock> now, microseconds period) {
+        if (period <= microseconds::zero()) {
+            return now;
+        }
+        auto sinceBoot = now.time_since_epoch();
+        auto slots = (sinceBoot + period - microseconds(1)) / period;
+        return time_point<boot_clock>(slots * period);
+    }
+
+private:
+    std::vector<Entry> entries;
+    uint32_t wakeups = 0;
+};
+
+/**
+ * @brief Runs periodic jobs on a shared worker task instead of each job having a task (and a stack) of its own.
+ *
+ * Wakeups are aligned to multiples of the job's period on the boot clock, so jobs with commensurate
+ * periods (e.g. 1 s, 10 s and 1 min) wake the device at the same time. Jobs can also declare a tolerance
+ * window; jobs that are due within each other's windows are batched into a single wakeup. Both reduce
+ * the number of times we need to exit light sleep.
+ *
+ * Shared jobs must be short and must not block for long; long-running jobs should use `scheduleDedicated()`.
+ */
+class Scheduler {
+public:
+    Scheduler(const std::string& name = "scheduler", uint32_t stackSize = 4096)
+        : wakeup(name + ":wakeup", 1) {
+        Task::loop(name, stackSize, [this](Task& task) {
+            runDueJobs();
+        });
+    }
+
+    /**
+     * @brief Run the job periodically on the shared worker task, exactly at aligned slots.
+     */
+    JobHandle schedule(const std::string& name, microseconds period, JobFunction function) {
+        return schedule(name, period, microseconds::zero(), function);
+    }
+
+    /**
+     * @brief Run the job periodically on the shared worker task, at most `tolerance` after each aligned slot.
+     */
+    JobHandle schedule(const std::string& name, microseconds period, microseconds tolerance, JobFunction function) {
+        auto job = std::make_shared<Job>(name, period, tolerance, function);
+        LOGV("Scheduling job '%s' every %lld ms (tolerance %lld ms) on shared worker",
+            name.c_str(),
+            duration_cast<milliseconds>(period).count(),
+            duration_cast<milliseconds>(tolerance).count());
+        {
+            Lock lock(jobsMutex);
+            jobs.add(job, boot_clock::now());
+            registeredJobs.push_back(job);
+        }
+        // Make the worker re-evaluate when it needs to wake up next
+        wakeup.overwrite(true);
+        return job;
+    }
+
+    /**
+     * @brief Run the job periodically on a task of its own, for jobs that take long or block.
+     *
+     * Wakeups are still aligned the same way as for shared jobs.
+     */
+    static JobHandle scheduleDedicated(const std::string& name, microseconds period, uint32_t stackSize, JobFunction function) {
+        auto job = std::make_shared<Job>(name, period, microseconds::zero(), function);
+        LOGV("Scheduling job '%s' every %lld ms on dedicated worker",
+            name.c_str(), duration_cast<milliseconds>(period).count());
+        Task::run(name, stackSize, [job](Task& task) {
+            auto now = boot_clock::now();
+            Task::delay(ceil<ticks>(JobQueue::nextAlignedSlot(now, job->period) - now));
+            task.markWakeTime();
+            while (!job->isCancelled()) {
+                job->wakeups++;
+                job->runs++;
+                job->function();
+                task.delayUntil(duration_cast<ticks>(job->period));
+            }
+        });
+        return job;
+    }
+
+    /**
+     * @brief Number of times the shared worker woke up to run jobs.
+     */
+    uint32_t getWakeups() {
+        Lock lock(jobsMutex);
+        return jobs.getWakeups();
+    }
+
+    void forEachJob(std::function<void(const Job&)> callback) {
+        Lock lock(jobsMutex);
+        std::erase_if(registeredJobs, [](const JobHandle& job) {
+            return job->isCancelled();
+        });
+        for (const auto& job : registeredJobs) {
+            callback(*job);
+        }
+    }
+
+private:
+    void runDueJobs() {
+        std::vector<JobQueue::Entry> due;
+        ticks timeout = ticks::max();
+        {
+            Lock lock(jobsMutex);
+            auto now = boot_clock::now();
+            due = jobs.takeDue(now);
+            if (due.empty()) {
+                auto next = jobs.nextWakeup();
+                if (next != time_point<boot_clock>::max()) {
+                    timeout = ceil<ticks>(next - now);
+                }
+            }
+        }
+
+        if (due.empty()) {
+            wakeup.pollIn(timeout);
+            return;
+        }
+
+        for (const auto& entry : due) {
+            entry.job->runs++;
+            entry.job->function();
+
+            Lock lock(jobsMutex);
+            auto missedBy = jobs.reschedule(entry, boot_clock::now());
+            if (missedBy > microseconds::zero()) {
+                // Like Task::delayUntil(), report when we could not keep up
+                printf("Job '%s' missed deadline by %lld ms\n",
+                    entry.job->name.c_str(), duration_cast<milliseconds>(missedBy).count());
+            }
+        }
+    }
+
+    Mutex jobsMutex;
+    JobQueue jobs;
+    std::list<JobHandle> registeredJobs;
+    CopyQueue<bool> wakeup;
+};
+
+}    // namespace farmhub::kernel
@@ -59,6 +59,10 @@ public:
         while (!awaitSet(ticks::max())) { }
     }
 
+    const std::string& getName() const {
+        return name;
+    }
+
 protected:
     bool constexpr hasAllBits(const EventBits_t bits) const {
         return (bits & eventBits) == eventBits;
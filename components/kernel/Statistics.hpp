@@ -0,0 +1,677 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <concepts>
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <optional>
+#include <vector>
+
+namespace farmhub::kernel {
+
+/**
+ * @brief Fixed-capacity ring of the most recent samples, without heap allocation.
+ *
+ * The capacity is fixed at compile time; the window can be made smaller at runtime,
+ * e.g. to follow configuration.
+ */
+template <typename T, std::size_t Capacity>
+class RingBuffer {
+public:
+    static_assert(Capacity > 0, "Capacity must be positive");
+
+    explicit RingBuffer(std::size_t window = Capacity)
+        : window(std::clamp<std::size_t>(window, 1, Capacity)) {
+    }
+
+    /**
+     * @brief Add a sample; returns the sample that dropped out of the window, if any.
+     */
+    std::optional<T> push(T value) {
+        std::optional<T> evicted;
+        if (count == window) {
+            evicted = items[head];
+        } else {
+            count++;
+        }
+        items[head] = value;
+        head = (head + 1) % window;
+        return evicted;
+    }
+
+    /**
+     * @brief Sample at `index`, counting from the oldest one.
+     */
+    T operator[](std::size_t index) const {
+        return items[(head + window - count + index) % window];
+    }
+
+    T newest() const {
+        return items[(head + window - 1) % window];
+    }
+
+    std::size_t size() const {
+        return count;
+    }
+
+    bool empty() const {
+        return count == 0;
+    }
+
+    bool full() const {
+        return count == window;
+    }
+
+    std::size_t getWindow() const {
+        return window;
+    }
+
+    void clear() {
+        head = 0;
+        count = 0;
+    }
+
+    template <typename F>
+    void forEach(F&& f) const {
+        for (std::size_t i = 0; i < count; i++) {
+            f((*this)[i]);
+        }
+    }
+
+private:
+    std::array<T, Capacity> items {};
+    const std::size_t window;
+    std::size_t head = 0;
+    std::size_t count = 0;
+};
+
+/**
+ * @brief Sum with Neumaier's (improved Kahan) compensation, so adding and removing
+ * samples for a long time does not accumulate rounding errors.
+ */
+template <std::floating_point T>
+class KahanSum {
+public:
+    void add(T value) {
+        T total = sum + value;
+        if (std::abs(sum) >= std::abs(value)) {
+            compensation += (sum - total) + value;
+        } else {
+            compensation += (value - total) + sum;
+        }
+        sum = total;
+    }
+
+    T get() const {
+        return sum + compensation;
+    }
+
+    void reset() {
+        sum = 0;
+        compensation = 0;
+    }
+
+private:
+    T sum = 0;
+    T compensation = 0;
+};
+
+/**
+ * @brief Mean of the last samples in the window.
+ */
+template <std::floating_point T, std::size_t Capacity>
+class MovingMean {
+public:
+    explicit MovingMean(std::size_t window = Capacity)
+        : samples(window) {
+    }
+
+    void record(T value) {
+        auto evicted = samples.push(value);
+        if (evicted.has_value()) {
+            sum.add(-evicted.value());
+        }
+        sum.add(value);
+    }
+
+    /**
+     * @brief Mean of the samples in the window, or zero if there are none.
+     */
+    T getMean() const {
+        return samples.empty() ? T(0) : sum.get() / samples.size();
+    }
+
+    std::size_t getCount() const {
+        return samples.size();
+    }
+
+private:
+    RingBuffer<T, Capacity> samples;
+    KahanSum<T> sum;
+};
+
+/**
+ * @brief Exponentially weighted moving average; the higher `alpha` is, the faster it follows changes.
+ */
+template <std::floating_point T>
+class Ewma {
+public:
+    explicit Ewma(T alpha)
+        : alpha(std::clamp<T>(alpha, 0, 1)) {
+    }
+
+    void record(T value) {
+        if (initialized) {
+            mean += alpha * (value - mean);
+        } else {
+            mean = value;
+            initialized = true;
+        }
+    }
+
+    T getMean() const {
+        return mean;
+    }
+
+private:
+    const T alpha;
+    T mean = 0;
+    bool initialized = false;
+};
+
+/**
+ * @brief Smallest and largest of the last samples in the window.
+ */
+template <typename T, std::size_t Capacity>
+class MovingMinMax {
+public:
+    explicit MovingMinMax(std::size_t window = Capacity)
+        : samples(window) {
+    }
+
+    void record(T value) {
+        samples.push(value);
+    }
+
+    T getMin() const {
+        T result = samples.empty() ? T(0) : samples[0];
+        samples.forEach([&](T value) { result = std::min(result, value); });
+        return result;
+    }
+
+    T getMax() const {
+        T result = samples.empty() ? T(0) : samples[0];
+        samples.forEach([&](T value) { result = std::max(result, value); });
+        return result;
+    }
+
+private:
+    RingBuffer<T, Capacity> samples;
+};
+
+/**
+ * @brief Mean and sample variance of the last samples in the window.
+ *
+ * Computed in two passes over the window when queried, which is exact
+ * even when the spread is tiny compared to the values.
+ */
+template <std::floating_point T, std::size_t Capacity>
+class MovingVariance {
+public:
+    explicit MovingVariance(std::size_t window = Capacity)
+        : samples(window) {
+    }
+
+    void record(T value) {
+        samples.push(value);
+    }
+
+    T getMean() const {
+        KahanSum<T> sum;
+        samples.forEach([&](T value) { sum.add(value); });
+        return samples.empty() ? T(0) : sum.get() / samples.size();
+    }
+
+    T getVariance() const {
+        if (samples.size() < 2) {
+            return 0;
+        }
+        T mean = getMean();
+        KahanSum<T> sum;
+        samples.forEach([&](T value) { sum.add((value - mean) * (value - mean)); });
+        return sum.get() / (samples.size() - 1);
+    }
+
+    T getStdDev() const {
+        return std::sqrt(getVariance());
+    }
+
+private:
+    RingBuffer<T, Capacity> samples;
+};
+
+/**
+ * @brief Median of the first `count` values, reordering them; averages the two middle ones for even counts.
+ */
+template <std::floating_point T, std::size_t Capacity>
+T medianInPlace(std::array<T, Capacity>& values, std::size_t count) {
+    auto middle = values.begin() + count / 2;
+    std::nth_element(values.begin(), middle, values.begin() + count);
+    if (count % 2 == 1) {
+        return *middle;
+    }
+    T upper = *middle;
+    T lower = *std::max_element(values.begin(), middle);
+    return (lower + upper) / 2;
+}
+
+/**
+ * @brief Median of the samples in the ring, using `scratch` to sort a copy of them.
+ *
+ * Filters keep the scratch space as a member, so that filtering doesn't need stack space proportional to the window.
+ */
+template <std::floating_point T, std::size_t Capacity>
+T medianOf(const RingBuffer<T, Capacity>& samples, std::array<T, Capacity>& scratch) {
+    std::size_t count = samples.size();
+    for (std::size_t i = 0; i < count; i++) {
+        scratch[i] = samples[i];
+    }
+    return medianInPlace(scratch, count);
+}
+
+/**
+ * @brief Replaces each sample with the median of the last samples in the window,
+ * removing short spikes while keeping edges sharp.
+ */
+template <std::floating_point T, std::size_t Capacity>
+class MedianFilter {
+public:
+    explicit MedianFilter(std::size_t window = Capacity)
+        : samples(window) {
+    }
+
+    T filter(T value) {
+        samples.push(value);
+        return medianOf(samples, scratch);
+    }
+
+private:
+    RingBuffer<T, Capacity> samples;
+    std::array<T, Capacity> scratch {};
+};
+
+/**
+ * @brief Passes samples through unless they are outliers, which are replaced with the median of the window.
+ *
+ * A sample is an outlier if it is farther from the median than `threshold` times the
+ * median absolute deviation (scaled to match the standard deviation for normal noise).
+ * Outliers stay in the window, so a real step change gets through once it fills half the window.
+ */
+template <std::floating_point T, std::size_t Capacity>
+class HampelFilter {
+public:
+    explicit HampelFilter(std::size_t window = Capacity, T threshold = 3)
+        : samples(window)
+        , threshold(threshold) {
+    }
+
+    T filter(T value) {
+        samples.push(value);
+        if (samples.size() < 3) {
+            return value;
+        }
+        T median = medianOf(samples, scratch);
+        // The deviations reuse the scratch space
+        for (std::size_t i = 0; i < samples.size(); i++) {
+            scratch[i] = std::abs(samples[i] - median);
+        }
+        T mad = MAD_SCALE * medianInPlace(scratch, samples.size());
+        if (std::abs(value - median) > threshold * mad) {
+            outliers++;
+            return median;
+        }
+        return value;
+    }
+
+    /**
+     * @brief Number of samples replaced so far.
+     */
+    std::size_t getOutliers() const {
+        return outliers;
+    }
+
+private:
+    static constexpr T MAD_SCALE = 1.4826;
+
+    RingBuffer<T, Capacity> samples;
+    std::array<T, Capacity> scratch {};
+    const T threshold;
+    std::size_t outliers = 0;
+};
+
+/**
+ * @brief Estimates a quantile of a stream in constant space using the P² algorithm
+ * (Jain & Chlamtac, 1985): five markers track the minimum, the quantile and the maximum,
+ * and are adjusted with parabolic interpolation as samples arrive.
+ *
+ * The estimate is exact for up to five samples.
+ */
+template <std::floating_point T>
+class P2Quantile {
+public:
+    explicit P2Quantile(T quantile)
+        : quantile(std::clamp<T>(quantile, 0, 1))
+        , increments { 0, quantile / 2, quantile, (1 + quantile) / 2, 1 } {
+    }
+
+    void record(T value) {
+        if (count < MARKERS) {
+            heights[count++] = value;
+            if (count == MARKERS) {
+                std::sort(heights.begin(), heights.end());
+                for (std::size_t i = 0; i < MARKERS; i++) {
+                    positions[i] = i;
+                    desired[i] = 4 * increments[i];
+                }
+            }
+            return;
+        }
+        count++;
+
+        // Find the cell the sample falls into, extending the extremes if needed
+        std::size_t cell;
+        if (value < heights[0]) {
+            heights[0] = value;
+            cell = 0;
+        } else if (value >= heights[MARKERS - 1]) {
+            heights[MARKERS - 1] = value;
+            cell = MARKERS - 2;
+        } else {
+            cell = 0;
+            while (value >= heights[cell + 1]) {
+                cell++;
+            }
+        }
+        for (std::size_t i = cell + 1; i < MARKERS; i++) {
+            positions[i]++;
+        }
+        for (std::size_t i = 0; i < MARKERS; i++) {
+            desired[i] += increments[i];
+        }
+
+        // Move the middle markers towards their desired positions
+        for (std::size_t i = 1; i < MARKERS - 1; i++) {
+            T offset = desired[i] - positions[i];
+            if ((offset >= 1 && positions[i + 1] - positions[i] > 1)
+                || (offset <= -1 && positions[i - 1] - positions[i] < -1)) {
+                int direction = offset > 0 ? 1 : -1;
+                T height = parabolic(i, direction);
+                if (heights[i - 1] < height && height < heights[i + 1]) {
+                    heights[i] = height;
+                } else {
+                    heights[i] = linear(i, direction);
+                }
+                positions[i] += direction;
+            }
+        }
+    }
+
+    T get() const {
+        if (count == 0) {
+            return 0;
+        }
+        if (count < MARKERS) {
+            std::array<T, MARKERS> sorted = heights;
+            std::sort(sorted.begin(), sorted.begin() + count);
+            return sorted[static_cast<std::size_t>(std::round(quantile * (count - 1)))];
+        }
+        return heights[2];
+    }
+
+    std::size_t getCount() const {
+        return count;
+    }
+
+    void reset() {
+        count = 0;
+    }
+
+private:
+    static constexpr std::size_t MARKERS = 5;
+
+    T parabolic(std::size_t i, int d) const {
+        T nPrev = positions[i - 1];
+        T n = positions[i];
+        T nNext = positions[i + 1];
+        return heights[i]
+            + d / (nNext - nPrev)
+            * ((n - nPrev + d) * (heights[i + 1] - heights[i]) / (nNext - n)
+                + (nNext - n - d) * (heights[i] - heights[i - 1]) / (n - nPrev));
+    }
+
+    T linear(std::size_t i, int d) const {
+        return heights[i] + d * (heights[i + d] - heights[i]) / (positions[i + d] - positions[i]);
+    }
+
+    const T quantile;
+    const std::array<T, MARKERS> increments;
+    std::array<T, MARKERS> heights {};
+    std::array<T, MARKERS> positions {};
+    std::array<T, MARKERS> desired {};
+    std::size_t count = 0;
+};
+
+/**
+ * @brief Summary of the samples taken during an interval.
+ */
+template <std::floating_point T>
+struct IntervalSummary {
+    std::size_t count;
+    T min;
+    T max;
+    T mean;
+    T p50;
+    T p95;
+};
+
+/**
+ * @brief Aggregates samples taken at a high rate between two publishes, in constant space.
+ */
+template <std::floating_point T>
+class IntervalStats {
+public:
+    void record(T value) {
+        if (count == 0) {
+            min = value;
+            max = value;
+        } else {
+            min = std::min(min, value);
+            max = std::max(max, value);
+        }
+        count++;
+        sum.add(value);
+        median.record(value);
+        p95.record(value);
+    }
+
+    std::size_t getCount() const {
+        return count;
+    }
+
+    IntervalSummary<T> summarize() const {
+        if (count == 0) {
+            return { 0, 0, 0, 0, 0, 0 };
+        }
+        return {
+            .count = count,
+            .min = min,
+            .max = max,
+            .mean = sum.get() / count,
+            .p50 = median.get(),
+            .p95 = p95.get(),
+        };
+    }
+
+    /**
+     * @brief Summarize the interval, and start a new one.
+     */
+    IntervalSummary<T> take() {
+        auto summary = summarize();
+        count = 0;
+        sum.reset();
+        median.reset();
+        p95.reset();
+        return summary;
+    }
+
+private:
+    std::size_t count = 0;
+    T min = 0;
+    T max = 0;
+    KahanSum<T> sum;
+    P2Quantile<T> median { 0.5 };
+    P2Quantile<T> p95 { 0.95 };
+};
+
+/**
+ * @brief A filter stage that can be put in a chain.
+ */
+template <std::floating_point T>
+class SampleFilter {
+public:
+    virtual ~SampleFilter() = default;
+
+    virtual T filter(T value) = 0;
+};
+
+enum class FilterType {
+    Median,
+    Hampel,
+    Mean,
+    Ewma,
+};
+
+/**
+ * @brief Describes a filter stage, typically coming from configuration.
+ */
+struct FilterSpec {
+    FilterType type;
+    // Number of samples for windowed filters, up to MAX_FILTER_WINDOW
+    std::size_t window = 5;
+    // Outlier threshold for Hampel, alpha for EWMA; zero means the default
+    double parameter = 0;
+};
+
+/**
+ * @brief Largest window of configurable filters; filters reserve this much space each.
+ */
+static constexpr std::size_t MAX_FILTER_WINDOW = 32;
+
+/**
+ * @brief Filter stages applied one after the other; empty chains pass samples through.
+ */
+template <std::floating_point T>
+class FilterChain : public SampleFilter<T> {
+public:
+    FilterChain() = default;
+
+    explicit FilterChain(const std::list<FilterSpec>& specs) {
+        for (const auto& spec : specs) {
+            add(spec);
+        }
+    }
+
+    void add(const FilterSpec& spec) {
+        switch (spec.type) {
+            case FilterType::Median:
+                stages.push_back(std::make_unique<MedianStage>(spec.window));
+                break;
+            case FilterType::Hampel:
+                stages.push_back(std::make_unique<HampelStage>(spec.window, spec.parameter > 0 ? spec.parameter : 3));
+                break;
+            case FilterType::Mean:
+                stages.push_back(std::make_unique<MeanStage>(spec.window));
+                break;
+            case FilterType::Ewma:
+                stages.push_back(std::make_unique<EwmaStage>(spec.parameter > 0 ? spec.parameter : 0.2));
+                break;
+        }
+    }
+
+    T filter(T value) override {
+        for (auto& stage : stages) {
+            value = stage->filter(value);
+        }
+        return value;
+    }
+
+    bool empty() const {
+        return stages.empty();
+    }
+
+private:
+    class MedianStage : public SampleFilter<T> {
+    public:
+        explicit MedianStage(std::size_t window)
+            : median(window) {
+        }
+
+        T filter(T value) override {
+            return median.filter(value);
+        }
+
+    private:
+        MedianFilter<T, MAX_FILTER_WINDOW> median;
+    };
+
+    class HampelStage : public SampleFilter<T> {
+    public:
+        HampelStage(std::size_t window, T threshold)
+            : hampel(window, threshold) {
+        }
+
+        T filter(T value) override {
+            return hampel.filter(value);
+        }
+
+    private:
+        HampelFilter<T, MAX_FILTER_WINDOW> hampel;
+    };
+
+    class MeanStage : public SampleFilter<T> {
+    public:
+        explicit MeanStage(std::size_t window)
+            : mean(window) {
+        }
+
+        T filter(T value) override {
+            mean.record(value);
+            return mean.getMean();
+        }
+
+    private:
+        MovingMean<T, MAX_FILTER_WINDOW> mean;
+    };
+
+    class EwmaStage : public SampleFilter<T> {
+    public:
+        explicit EwmaStage(T alpha)
+            : ewma(alpha) {
+        }
+
+        T filter(T value) override {
+            ewma.record(value);
+            return ewma.getMean();
+        }
+
+    private:
+        Ewma<T> ewma;
+    };
+
+    std::vector<std::unique_ptr<SampleFilter<T>>> stages;
+};
+
+}    // namespace farmhub::kernel
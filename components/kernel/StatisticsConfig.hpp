@@ -0,0 +1,61 @@
+#pragma once
+
+#include <algorithm>
+#include <string>
+
+#include <ArduinoJson.h>
+
+#include <Configuration.hpp>
+#include <Statistics.hpp>
+
+namespace farmhub::kernel {
+
+/**
+ * @brief Filters are configured like `{ "type": "hampel", "window": 7, "threshold": 3 }`.
+ */
+bool convertToJson(const FilterSpec& src, JsonVariant dst) {
+    switch (src.type) {
+        case FilterType::Median:
+            dst["type"] = "median";
+            dst["window"] = src.window;
+            break;
+        case FilterType::Hampel:
+            dst["type"] = "hampel";
+            dst["window"] = src.window;
+            if (src.parameter > 0) {
+                dst["threshold"] = src.parameter;
+            }
+            break;
+        case FilterType::Mean:
+            dst["type"] = "mean";
+            dst["window"] = src.window;
+            break;
+        case FilterType::Ewma:
+            dst["type"] = "ewma";
+            if (src.parameter > 0) {
+                dst["alpha"] = src.parameter;
+            }
+            break;
+    }
+    return true;
+}
+
+void convertFromJson(JsonVariantConst src, FilterSpec& dst) {
+    std::string type = src["type"].as<std::string>();
+    if (type == "median") {
+        dst.type = FilterType::Median;
+    } else if (type == "hampel") {
+        dst.type = FilterType::Hampel;
+        dst.parameter = src["threshold"] | 0.0;
+    } else if (type == "mean") {
+        dst.type = FilterType::Mean;
+    } else if (type == "ewma") {
+        dst.type = FilterType::Ewma;
+        dst.parameter = src["alpha"] | 0.0;
+    } else {
+        throw ConfigurationException("Unknown filter type: " + type);
+    }
+    dst.window = std::clamp<size_t>(src["window"] | 5, 1, MAX_FILTER_WINDOW);
+}
+
+}    // namespace farmhub::kernel
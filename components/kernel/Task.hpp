@@ -1,11 +1,17 @@
 #pragma once
 
+#include <atomic>
 #include <chrono>
 #include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
 
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 
+#include <BlockingTime.hpp>
+#include <BootClock.hpp>
 #include <Log.hpp>
 #include <Time.hpp>
 
@@ -19,6 +25,132 @@ class Task;
 
 typedef std::function<void(Task&)> TaskFunction;
 
+/**
+ * @brief Book-keeping for a task created via `Task`.
+ */
+struct TaskRecord {
+    TaskRecord(const std::string& name, uint32_t stackSize, UBaseType_t priority)
+        : name(name)
+        , stackSize(stackSize)
+        , priority(priority) {
+    }
+
+    void recordIteration(microseconds duration) {
+        uint32_t durationUs = duration.count();
+        iterations++;
+        totalLoopTime += durationUs;
+        uint32_t currentMax = maxLoopTime.load();
+        while (durationUs > currentMax && !maxLoopTime.compare_exchange_weak(currentMax, durationUs)) { }
+    }
+
+    const std::string name;
+    const uint32_t stackSize;
+    const UBaseType_t priority;
+    std::atomic<TaskHandle_t> handle { nullptr };
+
+    // Loop statistics since the last sample
+    std::atomic<uint32_t> iterations { 0 };
+    std::atomic<uint64_t> totalLoopTime { 0 };
+    std::atomic<uint32_t> maxLoopTime { 0 };
+
+#ifdef CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    // Run-time counter value at the last sample
+    configRUN_TIME_COUNTER_TYPE lastRunTime = 0;
+#endif
+};
+
+/**
+ * @brief Snapshot of a task's resource usage since the previous sample.
+ */
+struct TaskSample {
+    const std::string& name;
+    uint32_t stackSize;
+    uint32_t stackFree;
+    UBaseType_t priority;
+    // Share of total CPU time in percent, or negative if run-time stats are not enabled
+    float cpuShare;
+    uint32_t iterations;
+    // Time spent in an iteration, not counting delays and waiting on queues
+    microseconds averageLoopTime;
+    microseconds maxLoopTime;
+};
+
+/**
+ * @brief Keeps track of every task created via `Task`, so we can report on their resource usage.
+ */
+class TaskRegistry {
+public:
+    static std::shared_ptr<TaskRecord> add(const std::string& name, uint32_t stackSize, UBaseType_t priority) {
+        auto record = std::make_shared<TaskRecord>(name, stackSize, priority);
+        std::lock_guard<std::mutex> lock(recordsMutex);
+        records.push_back(record);
+        return record;
+    }
+
+    static void remove(const std::shared_ptr<TaskRecord>& record) {
+        std::lock_guard<std::mutex> lock(recordsMutex);
+        records.remove(record);
+    }
+
+    /**
+     * @brief Samples every running task, and resets loop statistics.
+     */
+    static void sample(std::function<void(const TaskSample&)> callback) {
+        std::lock_guard<std::mutex> lock(recordsMutex);
+#ifdef CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+        // Counters may wrap around, but unsigned arithmetic takes care of that
+        configRUN_TIME_COUNTER_TYPE totalRunTime = portGET_RUN_TIME_COUNTER_VALUE();
+        uint64_t elapsedRunTime = static_cast<configRUN_TIME_COUNTER_TYPE>(totalRunTime - lastTotalRunTime) * portNUM_PROCESSORS;
+        lastTotalRunTime = totalRunTime;
+#endif
+        for (auto& record : records) {
+            TaskHandle_t handle = record->handle.load();
+            if (handle == nullptr) {
+                // Not started yet
+                continue;
+            }
+
+            float cpuShare = -1;
+#ifdef CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+            configRUN_TIME_COUNTER_TYPE runTime = ulTaskGetRunTimeCounter(handle);
+            if (elapsedRunTime > 0) {
+                cpuShare = 100.0f * static_cast<configRUN_TIME_COUNTER_TYPE>(runTime - record->lastRunTime) / elapsedRunTime;
+            }
+            record->lastRunTime = runTime;
+#endif
+
+            uint32_t iterations = record->iterations.exchange(0);
+            uint64_t totalLoopTime = record->totalLoopTime.exchange(0);
+            uint32_t maxLoopTime = record->maxLoopTime.exchange(0);
+
+            callback(TaskSample {
+                .name = record->name,
+                .stackSize = record->stackSize,
+                .stackFree = static_cast<uint32_t>(uxTaskGetStackHighWaterMark2(handle)),
+                .priority = record->priority,
+                .cpuShare = cpuShare,
+                .iterations = iterations,
+                .averageLoopTime = microseconds(iterations == 0 ? 0 : totalLoopTime / iterations),
+                .maxLoopTime = microseconds(maxLoopTime),
+            });
+        }
+    }
+
+private:
+    static std::mutex recordsMutex;
+    static std::list<std::shared_ptr<TaskRecord>> records;
+#ifdef CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    static configRUN_TIME_COUNTER_TYPE lastTotalRunTime;
+#endif
+};
+
+// Inline, as several test translation units include this via Scheduler.hpp
+inline std::mutex TaskRegistry::recordsMutex;
+inline std::list<std::shared_ptr<TaskRecord>> TaskRegistry::records;
+#ifdef CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+inline configRUN_TIME_COUNTER_TYPE TaskRegistry::lastTotalRunTime = 0;
+#endif
+
 class TaskHandle {
 public:
     TaskHandle(const TaskHandle_t handle)
@@ -72,14 +204,16 @@ public:
         return Task::run(name, stackSize, DEFAULT_PRIORITY, runFunction);
     }
     static TaskHandle run(const std::string& name, uint32_t stackSize, UBaseType_t priority, const TaskFunction runFunction) {
-        TaskFunction* taskFunction = new TaskFunction(runFunction);
+        auto record = TaskRegistry::add(name, stackSize, priority);
+        TaskParameters* parameters = new TaskParameters { runFunction, record };
         LOGD("Creating task %s with priority %d and stack size %ld",
             name.c_str(), priority, stackSize);
         TaskHandle_t handle = nullptr;
-        auto result = xTaskCreate(executeTask, name.c_str(), stackSize, taskFunction, priority, &handle);
+        auto result = xTaskCreate(executeTask, name.c_str(), stackSize, parameters, priority, &handle);
         if (result != pdPASS) {
             LOGE("Failed to create task %s: %d", name.c_str(), result);
-            delete taskFunction;
+            TaskRegistry::remove(record);
+            delete parameters;
             return TaskHandle();
         }
         return TaskHandle(handle);
@@ -96,7 +230,11 @@ public:
     static TaskHandle loop(const std::string& name, uint32_t stackSize, UBaseType_t priority, TaskFunction loopFunction) {
         return Task::run(name, stackSize, priority, [loopFunction](Task& task) {
             while (true) {
+                auto iterationStart = boot_clock::now();
+                BlockingTime::take();
                 loopFunction(task);
+                auto iterationTime = duration_cast<microseconds>(boot_clock::now() - iterationStart);
+                task.record->recordIteration(iterationTime - BlockingTime::take());
             }
         });
     }
@@ -104,6 +242,7 @@ public:
     static inline void delay(ticks time) {
         // LOGV("Task '%s' delaying for %lld ms",
         //     pcTaskGetName(nullptr), duration_cast<milliseconds>(time).count());
+        BlockingTime::Scope blocking;
         vTaskDelay(time.count());
     }
 
@@ -121,6 +260,7 @@ public:
     bool delayUntilAtLeast(ticks time) {
         // LOGV("Task '%s' delaying until %lld ms",
         //     pcTaskGetName(nullptr), duration_cast<milliseconds>(time).count());
+        BlockingTime::Scope blocking;
         return xTaskDelayUntil(&lastWakeTime, time.count());
     }
 
@@ -162,19 +302,36 @@ public:
     }
 
 private:
+    struct TaskParameters {
+        const TaskFunction function;
+        const std::shared_ptr<TaskRecord> record;
+    };
+
+    Task(std::shared_ptr<TaskRecord> record)
+        : record(record) {
+    }
+
     ~Task() {
         LOGV("Finished task %s\n",
             pcTaskGetName(nullptr));
-        vTaskDelete(nullptr);
+        TaskRegistry::remove(record);
     }
 
     static void executeTask(void* parameters) {
-        auto taskFunction = static_cast<TaskFunction*>(parameters);
-        Task task;
-        (*taskFunction)(task);
-        delete taskFunction;
+        {
+            auto taskParameters = static_cast<TaskParameters*>(parameters);
+            taskParameters->record->handle = xTaskGetCurrentTaskHandle();
+            Task task(taskParameters->record);
+            auto function = taskParameters->function;
+            delete taskParameters;
+            function(task);
+            // The function and the task with its record are destroyed here
+        }
+        // Never returns, so there must be no live C++ objects left on the stack
+        vTaskDelete(nullptr);
     }
 
+    const std::shared_ptr<TaskRecord> record;
     TickType_t lastWakeTime { xTaskGetTickCount() };
 };
 
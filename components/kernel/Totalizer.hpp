@@ -0,0 +1,112 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+
+using namespace std::chrono;
+
+namespace farmhub::kernel {
+
+/**
+ * @brief A monotonically increasing 64-bit counter that survives reboots via checkpoints.
+ *
+ * Writing the total to flash on every change would wear it out, so it is only checkpointed
+ * once it has grown by `checkpointCount`, or `checkpointInterval` has passed since the last
+ * checkpoint and it has changed at all. Checkpoint on shutdown, too, to lose nothing on a
+ * clean reboot.
+ *
+ * Whatever was counted after the last checkpoint is lost on a crash, so after restoring,
+ * the total may be less than what was last reported. Each restore starts a new generation,
+ * so the other side can tell: totals from the same generation can be subtracted from each
+ * other, and the first total of a new generation is a new baseline.
+ *
+ * The new generation is only checkpointed along with the first change to the total, right away.
+ * Until then every total reported in it equals the restored one, so booting again (e.g. waking
+ * from deep sleep) without counting anything can start the same generation without losing
+ * anything, and without writing to flash.
+ *
+ * Times are measured as time since boot. Persisting checkpoints is up to the caller.
+ */
+class Totalizer {
+public:
+    using Time = microseconds;
+
+    struct Checkpoint {
+        uint64_t total;
+        uint32_t generation;
+    };
+
+    Totalizer(uint64_t checkpointCount, Time checkpointInterval)
+        : checkpointCount(checkpointCount)
+        , checkpointInterval(checkpointInterval) {
+    }
+
+    /**
+     * @brief Continue from the saved checkpoint, if any, in a new generation.
+     */
+    void restore(std::optional<Checkpoint> saved, Time now) {
+        total = saved.has_value() ? saved->total : 0;
+        generation = saved.has_value() ? saved->generation + 1 : 0;
+        generationCheckpointed = false;
+        checkpointedTotal = total;
+        checkpointedAt = now;
+    }
+
+    void add(uint64_t count) {
+        total += count;
+    }
+
+    uint64_t getTotal() const {
+        return total;
+    }
+
+    uint32_t getGeneration() const {
+        return generation;
+    }
+
+    /**
+     * @brief The checkpoint to persist, if one is due by now.
+     *
+     * Persist it before reporting the new total, or a crash could make the total of the generation go down.
+     */
+    std::optional<Checkpoint> checkpointIfDue(Time now) {
+        auto sinceCheckpoint = total - checkpointedTotal;
+        if (sinceCheckpoint == 0) {
+            return std::nullopt;
+        }
+        if (!generationCheckpointed || sinceCheckpoint >= checkpointCount || now - checkpointedAt >= checkpointInterval) {
+            return markCheckpoint(now);
+        }
+        return std::nullopt;
+    }
+
+    /**
+     * @brief The checkpoint to persist now, e.g. before shutting down; none if nothing changed since the last one.
+     */
+    std::optional<Checkpoint> checkpointNow(Time now) {
+        if (total == checkpointedTotal) {
+            return std::nullopt;
+        }
+        return markCheckpoint(now);
+    }
+
+private:
+    Checkpoint markCheckpoint(Time now) {
+        checkpointedTotal = total;
+        checkpointedAt = now;
+        generationCheckpointed = true;
+        return { total, generation };
+    }
+
+    const uint64_t checkpointCount;
+    const Time checkpointInterval;
+
+    uint64_t total = 0;
+    uint32_t generation = 0;
+    bool generationCheckpointed = false;
+    uint64_t checkpointedTotal = 0;
+    Time checkpointedAt = Time::zero();
+};
+
+}    // namespace farmhub::kernel
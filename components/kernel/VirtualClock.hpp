@@ -0,0 +1,128 @@
+#pragma once
+
+#ifdef FARMHUB_SIMULATION
+
+#include <atomic>
+#include <chrono>
+#include <ctime>
+
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// Tickless idle depends on power management, which the linux target doesn't have, so we skip idle time from the idle hook
+#if !(CONFIG_FREERTOS_USE_IDLE_HOOK)
+#error "Simulation requires CONFIG_FREERTOS_USE_IDLE_HOOK to skip idle time"
+#endif
+
+using namespace std::chrono;
+
+namespace farmhub::kernel {
+
+/**
+ * @brief Virtual time for simulation builds on the POSIX (linux target) FreeRTOS port.
+ *
+ * Time is derived from the FreeRTOS tick count. When every task is blocked, the idle task
+ * advances the tick count as fast as it can instead of waiting for the next tick in real time,
+ * so a simulated day of operation passes in seconds. It advances one tick at a time, so that
+ * tasks wake up at exactly the tick they asked for. Anything that blocks on FreeRTOS primitives
+ * (`Task::delay()`, `Task::delayUntil()`, queue and state timeouts) runs on virtual time
+ * as is; `boot_clock` and `system_clock` are redirected to it as well.
+ *
+ * Use `FARMHUB_SIMULATION_HOOKS()` in exactly one translation unit to install the hooks.
+ */
+class VirtualClock {
+public:
+    /**
+     * @brief Virtual time elapsed since boot; does not wrap around like the tick count does.
+     *
+     * Called from any task and from ISRs, so instead of taking a lock (which could leave the thread
+     * of a preempted task holding it), the extended tick count is kept in a single atomic.
+     */
+    static microseconds sinceBoot() {
+        constexpr uint64_t epoch = static_cast<uint64_t>(1) << (sizeof(TickType_t) * 8);
+        while (true) {
+            // Reading the tick count after the last total means it can only be behind it if it wrapped around
+            uint64_t last = totalTicks.load();
+            TickType_t tickCount = xTaskGetTickCount();
+            uint64_t total = (last & ~(epoch - 1)) | tickCount;
+            if (total < last) {
+                total += epoch;
+            }
+            if (total == last || totalTicks.compare_exchange_weak(last, total)) {
+                return microseconds(total * 1000000 / configTICK_RATE_HZ);
+            }
+        }
+    }
+
+    /**
+     * @brief Set the simulated wall clock, e.g. to simulate the RTC being synced at a given time of day.
+     */
+    static void setWallClock(time_point<system_clock> now) {
+        wallClockOffset = (duration_cast<microseconds>(now.time_since_epoch()) - sinceBoot()).count();
+    }
+
+    static time_point<system_clock> wallClock() {
+        return time_point<system_clock>(duration_cast<system_clock::duration>(microseconds(wallClockOffset) + sinceBoot()));
+    }
+
+    /**
+     * @brief Called by the idle task when no other task is ready to run.
+     */
+    static void skipIdleTick() {
+        xTaskCatchUpTicks(1);
+        skippedTicks++;
+    }
+
+    /**
+     * @brief How much time was skipped instead of waited for in real time.
+     */
+    static microseconds getSkippedTime() {
+        return microseconds(skippedTicks * 1000000 / configTICK_RATE_HZ);
+    }
+
+private:
+    static std::atomic<uint64_t> totalTicks;
+    static std::atomic<int64_t> wallClockOffset;
+    static std::atomic<uint64_t> skippedTicks;
+};
+
+// Inline, as every translation unit includes this via BootClock.hpp
+inline std::atomic<uint64_t> VirtualClock::totalTicks { 0 };
+inline std::atomic<int64_t> VirtualClock::wallClockOffset { 0 };
+inline std::atomic<uint64_t> VirtualClock::skippedTicks { 0 };
+
+}    // namespace farmhub::kernel
+
+/**
+ * @brief Install the simulation hooks: skipping idle time, and serving wall-clock time from the virtual clock.
+ *
+ * `system_clock::now()` ends up calling `clock_gettime(CLOCK_REALTIME)`, so we interpose that
+ * (and `gettimeofday()`) for the real-time clock, and pass every other clock to the kernel.
+ */
+#define FARMHUB_SIMULATION_HOOKS()                                                               \
+    extern "C" void vApplicationIdleHook() {                                                     \
+        farmhub::kernel::VirtualClock::skipIdleTick();                                           \
+    }                                                                                            \
+    extern "C" int clock_gettime(clockid_t clock, struct timespec* ts) noexcept {               \
+        if (clock != CLOCK_REALTIME) {                                                           \
+            return syscall(SYS_clock_gettime, clock, ts);                                        \
+        }                                                                                        \
+        auto now = farmhub::kernel::VirtualClock::wallClock().time_since_epoch();               \
+        auto secs = std::chrono::duration_cast<std::chrono::seconds>(now);                      \
+        ts->tv_sec = secs.count();                                                               \
+        ts->tv_nsec = std::chrono::duration_cast<std::chrono::nanoseconds>(now - secs).count(); \
+        return 0;                                                                                \
+    }                                                                                            \
+    extern "C" int gettimeofday(struct timeval* tv, void*) noexcept {                           \
+        auto now = farmhub::kernel::VirtualClock::wallClock().time_since_epoch();               \
+        auto secs = std::chrono::duration_cast<std::chrono::seconds>(now);                      \
+        tv->tv_sec = secs.count();                                                               \
+        tv->tv_usec = std::chrono::duration_cast<std::chrono::microseconds>(now - secs).count(); \
+        return 0;                                                                                \
+    }
+
+#endif    // FARMHUB_SIMULATION
@@ -1,9 +1,15 @@
 #pragma once
 
+#include <algorithm>
 #include <functional>
 
 #include <esp_check.h>
 
+#ifdef FARMHUB_SIMULATION
+#include <freertos/FreeRTOS.h>
+#include <freertos/timers.h>
+#endif
+
 #include <Time.hpp>
 
 namespace farmhub::kernel {
@@ -22,6 +28,17 @@ public:
         : name(name)
         , timeout(timeout)
         , callback(callback) {
+#ifdef FARMHUB_SIMULATION
+        // esp_timer runs on real time, but FreeRTOS timers follow the virtual clock
+        timer = xTimerCreate(this->name.c_str(), std::max<TickType_t>(1, duration_cast<ticks>(timeout).count()), pdFALSE, this, [](TimerHandle_t handle) {
+            auto watchdog = (Watchdog*) pvTimerGetTimerID(handle);
+            watchdog->callback(WatchdogState::TimedOut);
+        });
+        if (timer == nullptr) {
+            LOGE("Failed to create watchdog timer");
+            esp_system_abort("Failed to create watchdog timer");
+        }
+#else
         esp_timer_create_args_t config = {
             .callback = [](void* arg) {
                 auto watchdog = (Watchdog*) arg;
@@ -35,6 +52,7 @@ public:
             LOGE("Failed to create watchdog timer: %s", esp_err_to_name(ret));
             esp_system_abort("Failed to create watchdog timer");
         }
+#endif
         if (startImmediately) {
             restart();
         }
@@ -42,28 +60,44 @@ public:
 
     ~Watchdog() {
         cancel();
+#ifdef FARMHUB_SIMULATION
+        xTimerDelete(timer, portMAX_DELAY);
+#else
         esp_timer_delete(timer);
+#endif
     }
 
     bool restart() {
         // TODO Add proper error handling
+#ifdef FARMHUB_SIMULATION
+        xTimerReset(timer, portMAX_DELAY);
+#else
         if (esp_timer_restart(timer, timeout.count()) == ESP_ERR_INVALID_STATE) {
             esp_timer_start_once(timer, timeout.count());
         }
+#endif
         callback(WatchdogState::Started);
         return true;
     }
 
     bool cancel() {
         // TODO Add proper error handling
+#ifdef FARMHUB_SIMULATION
+        return xTimerStop(timer, portMAX_DELAY) == pdPASS;
+#else
         return esp_timer_stop(timer) == ESP_OK;
+#endif
     }
 
 private:
     const std::string name;
     const microseconds timeout;
     const WatchdogCallback callback;
+#ifdef FARMHUB_SIMULATION
+    TimerHandle_t timer;
+#else
     esp_timer_handle_t timer;
+#endif
 };
 
 }    // namespace farmhub::kernel
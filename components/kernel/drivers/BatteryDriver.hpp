@@ -3,6 +3,7 @@
 #include <chrono>
 #include <limits>
 
+#include <AdcManager.hpp>
 #include <Pin.hpp>
 #include <Telemetry.hpp>
 
@@ -34,32 +35,49 @@ public:
     const BatteryParameters parameters;
 };
 
+/**
+ * @brief What the voltage divider ratio of an analog battery driver applies to.
+ */
+enum class AdcScale {
+    // Calibrated millivolts
+    Calibrated,
+    // Raw codes on the nominal 3.3 V / 4096 scale; for ratios fitted before readings were calibrated
+    Nominal,
+};
+
 class AnalogBatteryDriver
     : public BatteryDriver {
 public:
-    AnalogBatteryDriver(InternalPinPtr pin, float voltageDividerRatio, const BatteryParameters& parameters)
+    AnalogBatteryDriver(std::shared_ptr<AdcManager> adc, InternalPinPtr pin, float voltageDividerRatio, const BatteryParameters& parameters, AdcScale scale = AdcScale::Calibrated)
         : BatteryDriver(parameters)
-        , analogPin(pin)
-        , voltageDividerRatio(voltageDividerRatio) {
+        , adc(adc)
+        , channel(adc->registerChannel(pin))
+        , voltageDividerRatio(voltageDividerRatio)
+        , scale(scale) {
         LOGI("Initializing analog battery driver on pin %s",
-            analogPin.getName().c_str());
+            channel->getName().c_str());
     }
 
     float getVoltage() {
-        for (int trial = 0; trial < 5; trial++) {
-            auto batteryLevel = analogPin.analogRead();
-            if (!batteryLevel.has_value()) {
-                LOGE("Failed to read battery level");
-                continue;
-            }
-            return batteryLevel.value() * 3.3 / 4096 * voltageDividerRatio;
+        auto reading = adc->read(channel);
+        if (!reading.has_value()) {
+            LOGE("Failed to read battery level");
+            return std::numeric_limits<float>::quiet_NaN();
+        }
+        switch (scale) {
+            case AdcScale::Nominal:
+                return reading->raw * 3.3 / 4096 * voltageDividerRatio;
+            case AdcScale::Calibrated:
+            default:
+                return reading->millivolts / 1000.0 * voltageDividerRatio;
         }
-        return std::numeric_limits<float>::quiet_NaN();
     }
 
 private:
-    AnalogPin analogPin;
+    const std::shared_ptr<AdcManager> adc;
+    const AnalogChannelPtr channel;
     const float voltageDividerRatio;
+    const AdcScale scale;
 };
 
 }    // namespace farmhub::kernel::drivers
@@ -93,7 +93,7 @@ private:
         }
 
         void drive(MotorPhase phase, double duty = 1) override {
-            int dutyValue = static_cast<int>((in1Channel.maxValue() + in1Channel.maxValue() * duty) / 2);
+            int dutyValue = this->dutyValue(duty);
             LOGD("Driving motor %s on pins %s/%s at %d%% (duty = %d)",
                 phase == MotorPhase::FORWARD ? "forward" : "reverse",
                 in1Channel.getName().c_str(),
@@ -119,6 +119,26 @@ private:
             }
         }
 
+        void ramp(MotorPhase phase, double duty, milliseconds rampTime) override {
+            if (duty == 0 || rampTime <= 0ms) {
+                drive(phase, duty);
+                return;
+            }
+            LOGD("Ramping motor %s on pins %s/%s up to %d%% over %lld ms",
+                phase == MotorPhase::FORWARD ? "forward" : "reverse",
+                in1Channel.getName().c_str(),
+                in2Channel.getName().c_str(),
+                (int) (duty * 100),
+                rampTime.count());
+
+            const PwmPin& active = phase == MotorPhase::FORWARD ? in1Channel : in2Channel;
+            const PwmPin& inactive = phase == MotorPhase::FORWARD ? in2Channel : in1Channel;
+            inactive.write(0);
+            active.write(dutyValue(0));
+            wakeUp();
+            active.fadeTo(dutyValue(duty), rampTime);
+        }
+
         void sleep() {
             sleeping = true;
             driver->updateSleepState();
@@ -134,6 +154,10 @@ private:
         }
 
     private:
+        int dutyValue(double duty) const {
+            return static_cast<int>((in1Channel.maxValue() + in1Channel.maxValue() * duty) / 2);
+        }
+
         const std::shared_ptr<Drv8833Driver> driver;
         const PwmPin& in1Channel;
         const PwmPin& in2Channel;
@@ -3,6 +3,7 @@
 #include <atomic>
 #include <chrono>
 
+#include <Pin.hpp>
 #include <PwmManager.hpp>
 #include <drivers/MotorDriver.hpp>
 
@@ -28,12 +29,12 @@ public:
         std::shared_ptr<PwmManager> pwm,
         InternalPinPtr in1Pin,
         InternalPinPtr in2Pin,
-        PinPtr currentPin,
+        InternalPinPtr currentPin,
         PinPtr faultPin,
         PinPtr sleepPin)
         : in1Channel(pwm->registerPin(in1Pin, PWM_FREQ, PWM_RESOLUTION))
         , in2Channel(pwm->registerPin(in2Pin, PWM_FREQ, PWM_RESOLUTION))
-        , currentPin(currentPin)
+        , currentSense(currentPin)
         , faultPin(faultPin)
         , sleepPin(sleepPin) {
 
@@ -46,7 +47,6 @@ public:
 
         sleepPin->pinMode(Pin::Mode::Output);
         faultPin->pinMode(Pin::Mode::Input);
-        currentPin->pinMode(Pin::Mode::Input);
 
         sleep();
     }
@@ -59,21 +59,39 @@ public:
         }
         wakeUp();
 
-        int dutyValue = in1Channel.maxValue() / 2 + (int) (in1Channel.maxValue() / 2 * duty);
         LOGD("Driving motor %s at %d%%",
             phase == MotorPhase::FORWARD ? "forward" : "reverse",
             (int) (duty * 100));
 
-        switch (phase) {
-            case MotorPhase::FORWARD:
-                in1Channel.write(dutyValue);
-                in2Channel.write(0);
-                break;
-            case MotorPhase::REVERSE:
-                in1Channel.write(0);
-                in2Channel.write(dutyValue);
-                break;
+        inactiveChannel(phase).write(0);
+        activeChannel(phase).write(dutyValue(duty));
+    }
+
+    void ramp(MotorPhase phase, double duty, milliseconds rampTime) override {
+        if (duty == 0 || rampTime <= 0ms) {
+            drive(phase, duty);
+            return;
+        }
+
+        LOGD("Ramping motor %s up to %d%% over %lld ms",
+            phase == MotorPhase::FORWARD ? "forward" : "reverse",
+            (int) (duty * 100), rampTime.count());
+
+        // Start from standstill before waking up, so the motor never sees a step in duty
+        inactiveChannel(phase).write(0);
+        activeChannel(phase).write(dutyValue(0));
+        wakeUp();
+        activeChannel(phase).fadeTo(dutyValue(duty), rampTime);
+    }
+
+    /**
+     * @brief Raw ADC reading of the IPROPI output, which is proportional to the motor current.
+     */
+    std::optional<double> readCurrent() override {
+        if (sleeping) {
+            return 0;
         }
+        return currentSense.analogRead();
     }
 
     void sleep() {
@@ -91,9 +109,21 @@ public:
     }
 
 private:
+    int dutyValue(double duty) const {
+        return in1Channel.maxValue() / 2 + (int) (in1Channel.maxValue() / 2 * duty);
+    }
+
+    const PwmPin& activeChannel(MotorPhase phase) const {
+        return phase == MotorPhase::FORWARD ? in1Channel : in2Channel;
+    }
+
+    const PwmPin& inactiveChannel(MotorPhase phase) const {
+        return phase == MotorPhase::FORWARD ? in2Channel : in1Channel;
+    }
+
     const PwmPin& in1Channel;
     const PwmPin& in2Channel;
-    const PinPtr currentPin;
+    AnalogPin currentSense;
     const PinPtr faultPin;
     const PinPtr sleepPin;
 
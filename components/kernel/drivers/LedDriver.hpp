@@ -1,12 +1,16 @@
 #pragma once
 
-#include <atomic>
 #include <chrono>
+#include <memory>
 #include <vector>
 
+#include <esp_timer.h>
+
+#include <BlinkSequencer.hpp>
+#include <BootClock.hpp>
 #include <Concurrent.hpp>
+#include <Log.hpp>
 #include <Pin.hpp>
-#include <Task.hpp>
 
 using namespace std::chrono;
 
@@ -14,21 +18,88 @@ using farmhub::kernel::PinPtr;
 
 namespace farmhub::kernel::drivers {
 
+/**
+ * @brief Plays blink patterns for any number of LEDs from a single one-shot `esp_timer`.
+ *
+ * The timer is only armed for the next edge of any LED, and not at all while every LED is steady,
+ * so there's no task polling, and no wakeups while LEDs are simply on or off.
+ */
+class BlinkEngine {
+public:
+    static std::shared_ptr<BlinkEngine> shared() {
+        static auto engine = std::make_shared<BlinkEngine>();
+        return engine;
+    }
+
+    BlinkEngine() {
+        esp_timer_create_args_t config = {
+            .callback = [](void* arg) {
+                static_cast<BlinkEngine*>(arg)->onTimer();
+            },
+            .arg = this,
+            .dispatch_method = ESP_TIMER_TASK,
+            .name = "blink",
+        };
+        ESP_ERROR_CHECK(esp_timer_create(&config, &timer));
+    }
+
+    ~BlinkEngine() {
+        esp_timer_stop(timer);
+        esp_timer_delete(timer);
+    }
+
+    size_t add(BlinkSequencer::Output output) {
+        Lock lock(mutex);
+        return sequencer.add(output);
+    }
+
+    template <typename Iterator>
+    void setPattern(size_t led, Iterator begin, Iterator end) {
+        Lock lock(mutex);
+        sequencer.setPattern(led, begin, end, now());
+        rearm();
+    }
+
+private:
+    void onTimer() {
+        Lock lock(mutex);
+        sequencer.advance(now());
+        rearm();
+    }
+
+    void rearm() {
+        // Fails harmlessly when the timer is not running
+        esp_timer_stop(timer);
+        auto next = sequencer.nextDeadline();
+        if (next.has_value()) {
+            auto delay = std::max(*next - now(), BlinkSequencer::Time::zero());
+            ESP_ERROR_CHECK(esp_timer_start_once(timer, delay.count()));
+        }
+    }
+
+    static BlinkSequencer::Time now() {
+        return duration_cast<BlinkSequencer::Time>(boot_clock::now().time_since_epoch());
+    }
+
+    Mutex mutex;
+    BlinkSequencer sequencer;
+    esp_timer_handle_t timer = nullptr;
+};
+
 class LedDriver {
 public:
     typedef std::vector<milliseconds> BlinkPattern;
 
-    LedDriver(const std::string& name, PinPtr pin)
+    LedDriver(const std::string& name, PinPtr pin, std::shared_ptr<BlinkEngine> engine = BlinkEngine::shared())
         : pin(pin)
-        , patternQueue(name, 1)
-        , pattern({ -milliseconds::max() }) {
-        LOGI("Initializing LED driver on pin %s",
-            pin->getName().c_str());
+        , engine(engine)
+        // The pin is driven low while the LED is on
+        , led(engine->add([pin](bool on) { pin->digitalWrite(!on); })) {
+        LOGI("Initializing LED driver '%s' on pin %s",
+            name.c_str(), pin->getName().c_str());
 
         pin->pinMode(Pin::Mode::Output);
-        Task::loop(name, 2048, [this](Task& task) {
-            handleIteration();
-        });
+        turnOff();
     }
 
     void turnOn() {
@@ -51,46 +122,18 @@ public:
         if (pattern.empty()) {
             turnOff();
         } else {
-            setPattern(pattern);
+            engine->setPattern(led, pattern.begin(), pattern.end());
         }
     }
 
 private:
-    void handleIteration() {
-        if (cursor == pattern.end()) {
-            cursor = pattern.begin();
-        }
-        milliseconds blinkTime = *cursor;
-        cursor++;
-
-        if (blinkTime > milliseconds::zero()) {
-            setLedState(0);
-        } else {
-            setLedState(1);
-        }
-
-        // TOOD Substract processing time from delay
-        ticks timeout = blinkTime < milliseconds::zero() ? -blinkTime : blinkTime;
-        patternQueue.pollIn(timeout, [this](const BlinkPattern& newPattern) {
-            pattern = newPattern;
-            cursor = pattern.cbegin();
-        });
-    }
-
-    void setPattern(const BlinkPattern& pattern) {
-        patternQueue.put(pattern);
-    }
-
-    void setLedState(bool state) {
-        this->ledState = state;
-        pin->digitalWrite(state);
+    void setPattern(std::initializer_list<milliseconds> pattern) {
+        engine->setPattern(led, pattern.begin(), pattern.end());
     }
 
     const PinPtr pin;
-    Queue<BlinkPattern> patternQueue;
-    BlinkPattern pattern;
-    std::vector<milliseconds>::const_iterator cursor = pattern.cbegin();
-    std::atomic<bool> ledState;
+    const std::shared_ptr<BlinkEngine> engine;
+    const size_t led;
 };
 
 }    // namespace farmhub::kernel::drivers
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <atomic>
+
 #include <ArduinoJson.h>
 
 #include <mdns.h>
@@ -60,11 +62,44 @@ public:
         const std::string& hostname,
         const std::string& instanceName,
         const std::string& version,
-        StateSource& mdnsReady)
+        StateSource& mdnsReady,
+        bool deferInit = false)
         : networkReady(networkReady)
-        , mdnsReady(mdnsReady) {
+        , mdnsReady(mdnsReady)
+        , hostname(hostname)
+        , instanceName(instanceName)
+        , version(version) {
+        // When deferred, we only start mDNS if a lookup misses the cache
+        if (!deferInit) {
+            init();
+        }
+    }
+
+    bool lookupService(const std::string& serviceName, const std::string& port, MdnsRecord& record, bool loadFromCache = true, milliseconds timeout = 5s) {
+        // Wait indefinitely
+        Lock lock(lookupMutex);
+        auto result = lookupServiceUnderMutex(serviceName, port, record, loadFromCache, timeout);
+        return result;
+    }
+
+    State& getMdnsReady() {
+        return mdnsReady;
+    }
+
+    /**
+     * @brief Write pending cache updates to NVS; call before going to deep sleep.
+     */
+    void flushCache() {
+        nvs.flush();
+    }
+
+private:
+    void init() {
+        if (initStarted.exchange(true)) {
+            return;
+        }
         // TODO Add error handling
-        Task::run("mdns:init", 4096, [networkReady, mdnsReady, instanceName, hostname, version](Task& task) {
+        Task::run("mdns:init", 4096, [networkReady = networkReady, mdnsReady = mdnsReady, instanceName = instanceName, hostname = hostname, version = version](Task& task) {
             LOGTI(Tag::MDNS, "initializing");
             networkReady.awaitSet();
 
@@ -85,18 +120,6 @@ public:
         });
     }
 
-    bool lookupService(const std::string& serviceName, const std::string& port, MdnsRecord& record, bool loadFromCache = true, milliseconds timeout = 5s) {
-        // Wait indefinitely
-        Lock lock(lookupMutex);
-        auto result = lookupServiceUnderMutex(serviceName, port, record, loadFromCache, timeout);
-        return result;
-    }
-
-    State& getMdnsReady() {
-        return mdnsReady;
-    }
-
-private:
     bool lookupServiceUnderMutex(const std::string& serviceName, const std::string& port, MdnsRecord& record, bool loadFromCache, milliseconds timeout) {
         // TODO Use a callback and retry if cached entry doesn't work
         std::string cacheKey = serviceName + "." + port;
@@ -118,6 +141,7 @@ private:
             nvs.remove(cacheKey);
         }
 
+        init();
         networkReady.awaitSet();
         mdnsReady.awaitSet();
 
@@ -151,11 +175,18 @@ private:
 
     State& networkReady;
 
-    State& mdnsReady;
+    StateSource& mdnsReady;
+
+    const std::string hostname;
+    const std::string instanceName;
+    const std::string version;
+    std::atomic<bool> initStarted { false };
 
     Mutex lookupMutex;
 
-    NvsStore nvs { "mdns" };
+    // Long enough to cover a query, so dropping an untrusted record and caching its replacement is a single write
+    static constexpr milliseconds CACHE_WRITE_BEHIND = 10s;
+    NvsStore nvs { "mdns", CACHE_WRITE_BEHIND };
 };
 
 bool convertToJson(const MdnsRecord& src, JsonVariant dst) {
@@ -1,5 +1,13 @@
 #pragma once
 
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <optional>
+
+using namespace std::chrono;
+using namespace std::chrono_literals;
+
 namespace farmhub::kernel::drivers {
 
 enum class MotorPhase {
@@ -20,6 +28,166 @@ public:
     };
 
     virtual void drive(MotorPhase phase, double duty = 1) = 0;
+
+    /**
+     * @brief Start the motor from standstill and ramp it up to `duty` over `rampTime`.
+     *
+     * Returns right away, the ramp continues in the background. Drivers without hardware
+     * fades start at the target duty right away.
+     */
+    virtual void ramp(MotorPhase phase, double duty, [[maybe_unused]] milliseconds rampTime) {
+        drive(phase, duty);
+    }
+
+    /**
+     * @brief Sample the current flowing through the motor, if the driver can sense it.
+     *
+     * The value is proportional to the motor current, but its unit depends on the driver.
+     * Only compare it to other readings from the same driver.
+     */
+    virtual std::optional<double> readCurrent() {
+        return std::nullopt;
+    }
+};
+
+/**
+ * @brief How to switch a motor-driven mechanism, like a valve, from one end position to the other.
+ */
+struct MotorDriveProfile {
+    /**
+     * @brief Maximum time to run the motor for.
+     */
+    milliseconds switchDuration;
+
+    double switchDuty = 1.0;
+
+    /**
+     * @brief Time to soft-start the motor over; zero starts it at full duty right away.
+     */
+    milliseconds rampTime = 0ms;
+
+    /**
+     * @brief Stop early once the current rises to this multiple of the running current; zero disables stall detection.
+     */
+    double stallRatio = 0;
+
+    /**
+     * @brief Ignore the inrush current for this long after the ramp has finished.
+     */
+    milliseconds inrushBlanking = 100ms;
+
+    milliseconds sampleInterval = 10ms;
 };
 
+/**
+ * @brief Spots a motor stalling, or hitting an end-stop, from its current samples.
+ *
+ * After the inrush settles, the first few samples establish the running current. The motor
+ * counts as stalled once a number of samples in a row reach `ratio` times the running current.
+ */
+class StallDetector {
+public:
+    StallDetector(double ratio, milliseconds blanking, int baselineSamples = 4, int confirmSamples = 3)
+        : ratio(ratio)
+        , blanking(blanking)
+        , baselineSamples(baselineSamples)
+        , confirmSamples(confirmSamples) {
+    }
+
+    /**
+     * @param elapsed time since the motor started.
+     * @return whether the motor has stalled.
+     */
+    bool update(milliseconds elapsed, double current) {
+        peakCurrent = std::max(peakCurrent.value_or(current), current);
+        if (elapsed < blanking) {
+            return false;
+        }
+        if (baselineCount < baselineSamples) {
+            baselineSum += current;
+            baselineCount++;
+            return false;
+        }
+        double running = baselineSum / baselineCount;
+        if (current > running && current >= running * ratio) {
+            overCount++;
+        } else {
+            overCount = 0;
+        }
+        return overCount >= confirmSamples;
+    }
+
+    std::optional<double> getRunningCurrent() const {
+        return baselineCount == 0
+            ? std::nullopt
+            : std::optional(baselineSum / baselineCount);
+    }
+
+    std::optional<double> getPeakCurrent() const {
+        return peakCurrent;
+    }
+
+private:
+    const double ratio;
+    const milliseconds blanking;
+    const int baselineSamples;
+    const int confirmSamples;
+
+    double baselineSum = 0;
+    int baselineCount = 0;
+    int overCount = 0;
+    std::optional<double> peakCurrent;
+};
+
+enum class MotorSwitchOutcome {
+    // Ran for the full switch duration
+    Completed,
+    // Stopped early because the current showed a stall or end-stop
+    Stalled,
+};
+
+struct MotorSwitchResult {
+    MotorSwitchOutcome outcome;
+    milliseconds elapsed;
+    std::optional<double> runningCurrent;
+    std::optional<double> peakCurrent;
+};
+
+/**
+ * @brief Run the switch phase of `profile`, leaving the motor running at the switch duty.
+ *
+ * The caller decides what to do afterwards, like stopping the motor or dropping it to a hold duty.
+ * Without stall detection, or when the driver cannot sense current, this waits for the full
+ * switch duration in one go.
+ *
+ * @param delay waits for the given time; `Task::delay()` on the device, simulated time in tests.
+ */
+MotorSwitchResult switchMotor(PwmMotorDriver& motor, MotorPhase phase, const MotorDriveProfile& profile, const std::function<void(milliseconds)>& delay) {
+    motor.ramp(phase, profile.switchDuty, profile.rampTime);
+
+    StallDetector detector(profile.stallRatio, profile.rampTime + profile.inrushBlanking);
+    bool sensing = profile.stallRatio > 0;
+    milliseconds elapsed = 0ms;
+    while (elapsed < profile.switchDuration) {
+        if (!sensing) {
+            delay(profile.switchDuration - elapsed);
+            elapsed = profile.switchDuration;
+            break;
+        }
+        auto step = std::min(profile.sampleInterval, profile.switchDuration - elapsed);
+        delay(step);
+        elapsed += step;
+
+        auto current = motor.readCurrent();
+        if (!current.has_value()) {
+            sensing = false;
+            continue;
+        }
+        if (detector.update(elapsed, *current)) {
+            return { MotorSwitchOutcome::Stalled, elapsed, detector.getRunningCurrent(), detector.getPeakCurrent() };
+        }
+    }
+    return { MotorSwitchOutcome::Completed, elapsed, detector.getRunningCurrent(), detector.getPeakCurrent() };
+}
+
 }    // namespace farmhub::kernel::drivers
@@ -4,6 +4,8 @@
 #include <optional>
 #include <time.h>
 
+#include <esp_attr.h>
+
 #include "esp_netif_sntp.h"
 #include "esp_sntp.h"
 
@@ -27,6 +29,8 @@ namespace farmhub::kernel::drivers {
  *
  * - The second task configures the system time using the NTP server advertised by mDNS.
  *   This waits for mDNS to be ready, and then configures the system time.
+ *   When waking from deep sleep the RTC keeps running, so if the last sync was recent enough
+ *   the task waits until the next sync is due instead of syncing right away.
  */
 class RtcDriver {
 public:
@@ -47,6 +51,14 @@ public:
         }
 
         Task::run("ntp-sync", 4096, [this, &networkReady](Task& task) {
+            if (isTimeSet() && lastSync > 0) {
+                auto sinceLastSync = system_clock::now() - system_clock::from_time_t(lastSync);
+                if (sinceLastSync >= 0s && sinceLastSync < NTP_SYNC_INTERVAL) {
+                    LOGTD(Tag::RTC, "last synced %lld s ago, skipping NTP for now",
+                        duration_cast<seconds>(sinceLastSync).count());
+                    Task::delay(duration_cast<ticks>(NTP_SYNC_INTERVAL - sinceLastSync));
+                }
+            }
             while (true) {
                 {
                     networkReady.awaitSet();
@@ -62,7 +74,7 @@ public:
                 }
 
                 // We are good for a while now
-                Task::delay(1h);
+                Task::delay(NTP_SYNC_INTERVAL);
             }
         });
     }
@@ -80,6 +92,8 @@ public:
         return rtcInSync;
     }
 
+    static constexpr seconds NTP_SYNC_INTERVAL = 1h;
+
 private:
     bool updateTime() {
         esp_sntp_config_t config = ESP_NETIF_SNTP_DEFAULT_CONFIG("pool.ntp.org");
@@ -120,6 +134,7 @@ private:
         // we're not yet finished with smooth sync
         if (ret == ESP_OK || ret == ESP_ERR_NOT_FINISHED) {
             rtcInSync.set();
+            lastSync = system_clock::to_time_t(system_clock::now());
             success = true;
             LOGTD(Tag::RTC, "sync finished successfully");
         } else if (ret == ESP_ERR_TIMEOUT) {
@@ -154,6 +169,11 @@ private:
     StateSource& rtcInSync;
 
     bool trustMdnsCache = true;
+
+    // Survives deep sleep
+    static time_t lastSync;
 };
 
+RTC_DATA_ATTR time_t RtcDriver::lastSync = 0;
+
 }    // namespace farmhub::kernel::drivers
@@ -4,6 +4,7 @@
 #include <list>
 #include <memory>
 #include <optional>
+#include <unordered_map>
 #include <variant>
 #include <vector>
 
@@ -12,9 +13,11 @@
 
 #include <Concurrent.hpp>
 #include <Configuration.hpp>
+#include <JsonArena.hpp>
 #include <State.hpp>
 #include <Task.hpp>
 #include <drivers/MdnsDriver.hpp>
+#include <mqtt/MqttSession.hpp>
 
 using namespace std::chrono_literals;
 using namespace farmhub::kernel;
@@ -80,8 +83,8 @@ public:
         , configClientKey(joinStrings(config->clientKey.get()))
         , clientId(getClientId(config->clientId.get(), instanceName))
         , ready(ready)
-        , eventQueue("mqtt-outgoing", config->queueSize.get())
-        , incomingQueue("mqtt-incoming", config->queueSize.get()) {
+        , eventQueue("mqtt-outgoing", config->queueSize.get(), MemoryPlacement::Large, memoryTag())
+        , incomingQueue("mqtt-incoming", config->queueSize.get(), MemoryPlacement::Large, memoryTag()) {
 
         Task::run("mqtt", 5120, [this](Task& task) {
             configMqttClient(mqttConfig);
@@ -133,6 +136,10 @@ public:
             .credentials {
                 .client_id = clientId.c_str(),
             },
+            .session {
+                // Always resume the session, see MqttSession
+                .disable_clean_session = true,
+            },
             .network {
                 .timeout_ms = duration_cast<milliseconds>(10s).count(),
             },
@@ -173,15 +180,18 @@ public:
     static constexpr milliseconds MQTT_LOOP_INTERVAL = 1s;
     static constexpr milliseconds MQTT_QUEUE_TIMEOUT = 1s;
 
-private:
-    struct PendingSubscription {
-        const int messageId;
-        const time_point<boot_clock> subscribedAt;
-    };
+    /**
+     * @brief Queued messages and payloads are accounted to `mqtt` unless the publisher specifies otherwise.
+     */
+    static MemoryTag& memoryTag() {
+        static MemoryTag& tag = MemoryTag::get("mqtt");
+        return tag;
+    }
 
+private:
     struct OutgoingMessage {
         const std::string topic;
-        const std::string payload;
+        const LargeString payload;
         const Retention retain;
         const QoS qos;
         const TaskHandle_t waitingTask;
@@ -190,7 +200,7 @@ private:
 
     struct IncomingMessage {
         const std::string topic;
-        const std::string payload;
+        const LargeString payload;
     };
 
     struct Subscription {
@@ -206,6 +216,7 @@ private:
 
     struct Subscribed {
         const int messageId;
+        const bool success;
     };
 
     struct Connected {
@@ -214,7 +225,7 @@ private:
 
     struct Disconnected { };
 
-    PublishStatus publish(const std::string& topic, const JsonDocument& json, Retention retain, QoS qos, ticks timeout = MQTT_DEFAULT_PUBLISH_TIMEOUT, LogPublish log = LogPublish::Log) {
+    PublishStatus publish(const std::string& topic, const JsonDocument& json, Retention retain, QoS qos, ticks timeout = MQTT_DEFAULT_PUBLISH_TIMEOUT, LogPublish log = LogPublish::Log, MemoryTag& tag = memoryTag()) {
         if (log == LogPublish::Log) {
 #ifdef DUMP_MQTT
             std::string serializedJson;
@@ -233,9 +244,9 @@ private:
                 duration_cast<milliseconds>(timeout).count());
 #endif
         }
-        std::string payload;
+        LargeString payload { LargeAllocator<char>(tag) };
         serializeJson(json, payload);
-        return publishAndWait(topic, payload, retain, qos, timeout);
+        return publishAndWait(topic, std::move(payload), retain, qos, timeout);
     }
 
     PublishStatus clear(const std::string& topic, Retention retain, QoS qos, ticks timeout = MQTT_DEFAULT_PUBLISH_TIMEOUT) {
@@ -246,14 +257,14 @@ private:
         return publishAndWait(topic, "", retain, qos, timeout);
     }
 
-    PublishStatus publishAndWait(const std::string& topic, const std::string& payload, Retention retain, QoS qos, ticks timeout) {
+    PublishStatus publishAndWait(const std::string& topic, LargeString&& payload, Retention retain, QoS qos, ticks timeout) {
         TaskHandle_t waitingTask = timeout == ticks::zero() ? nullptr : xTaskGetCurrentTaskHandle();
 
         bool offered = eventQueue.offerIn(
             MQTT_QUEUE_TIMEOUT,
             OutgoingMessage {
                 topic,
-                payload,
+                std::move(payload),
                 retain,
                 qos,
                 waitingTask,
@@ -384,31 +395,20 @@ private:
         auto state = MqttState::Disconnected;
         auto connectionStarted = boot_clock::zero();
 
-        // The first session is always clean
-        auto nextSessionShouldBeClean = true;
-
-        // List of messages we are waiting on
-        std::list<PendingSubscription> pendingSubscriptions;
+        MqttSession session;
 
         while (true) {
             auto now = boot_clock::now();
 
-            // Cull pending subscriptions
-            // TODO Do this with deleted messages?
-            pendingSubscriptions.remove_if([&](const auto& pendingSubscription) {
-                if (now - pendingSubscription.subscribedAt > MQTT_SUBSCRIPTION_TIMEOUT) {
-                    LOGTE(Tag::MQTT, "Subscription timed out with message id %d", pendingSubscription.messageId);
-                    // Force next session to start clean, so we can re-subscribe
-                    nextSessionShouldBeClean = true;
-                    return true;
-                } else {
-                    return false;
-                }
-            });
+            // Cull pending subscriptions, and retry the ones that timed out
+            bool subscriptionsTimedOut = session.expire(now, MQTT_SUBSCRIPTION_TIMEOUT);
+            if (state == MqttState::Connected && subscriptionsTimedOut) {
+                processSubscriptions(unconfirmedSubscriptions(session), session);
+            }
 
             switch (state) {
                 case MqttState::Disconnected:
-                    connect(nextSessionShouldBeClean);
+                    connect();
                     state = MqttState::Connecting;
                     connectionStarted = now;
                     break;
@@ -435,16 +435,11 @@ private:
                             LOGTV(Tag::MQTT, "Processing connected event, session present: %d",
                                 arg.sessionPresent);
                             state = MqttState::Connected;
+                            session.connected(arg.sessionPresent);
 
-                            // TODO Should make it work with persistent sessions, but apparenlty it doesn't
-                            // // Next connection can start with a persistent session
-                            // nextSessionShouldBeClean = false;
-
-                            if (!arg.sessionPresent) {
-                                // Re-subscribe to existing subscriptions
-                                // because we got a clean session
-                                processSubscriptions(subscriptions, pendingSubscriptions);
-                            }
+                            // Only subscribe to what the broker does not know about yet;
+                            // when resuming a session this is usually nothing
+                            processSubscriptions(unconfirmedSubscriptions(session), session);
                         } else if constexpr (std::is_same_v<T, Disconnected>) {
                             LOGTV(Tag::MQTT, "Processing disconnected event");
                             state = MqttState::Disconnected;
@@ -453,16 +448,13 @@ private:
                             // Clear pending messages and notify waiting tasks
                             pendingMessages.clear();
 
-                            // Clear pending subscriptions
-                            pendingSubscriptions.clear();
+                            session.disconnected();
                         } else if constexpr (std::is_same_v<T, MessagePublished>) {
                             LOGTV(Tag::MQTT, "Processing message published: %d", arg.messageId);
                             pendingMessages.handlePublished(arg.messageId, arg.success);
                         } else if constexpr (std::is_same_v<T, Subscribed>) {
                             LOGTV(Tag::MQTT, "Processing subscribed event: %d", arg.messageId);
-                            pendingSubscriptions.remove_if([&](const auto& pendingSubscription) {
-                                return pendingSubscription.messageId == arg.messageId;
-                            });
+                            session.acknowledged(arg.messageId, arg.success);
                         } else if constexpr (std::is_same_v<T, OutgoingMessage>) {
                             LOGTV(Tag::MQTT, "Processing outgoing message to %s",
                                 arg.topic.c_str());
@@ -472,12 +464,9 @@ private:
                             subscriptions.push_back(arg);
                             if (state == MqttState::Connected) {
                                 // If we are connected, we need to subscribe immediately.
-                                processSubscriptions({ arg }, pendingSubscriptions);
-                            } else {
-                                // If we are not connected, we need to rely on the next
-                                // clean session to make the subscription.
-                                nextSessionShouldBeClean = true;
+                                processSubscriptions({ arg }, session);
                             }
+                            // Otherwise we subscribe once connected, as the topic is not confirmed yet
                         }
                     },
                     event);
@@ -485,15 +474,24 @@ private:
         }
     }
 
-    void connect(bool startCleanSession) {
+    std::list<Subscription> unconfirmedSubscriptions(const MqttSession& session) {
+        std::list<Subscription> result;
+        for (const auto& subscription : subscriptions) {
+            if (session.needsSubscribing(subscription.topic)) {
+                result.push_back(subscription);
+            }
+        }
+        return result;
+    }
+
+    void connect() {
         networkReady.awaitSet();
 
         stopClient();
 
-        mqttConfig.session.disable_clean_session = !startCleanSession;
         esp_mqtt_set_config(client, &mqttConfig);
-        LOGTD(Tag::MQTT, "Connecting to %s:%lu, clean session: %d",
-            mqttConfig.broker.address.hostname, mqttConfig.broker.address.port, startCleanSession);
+        LOGTD(Tag::MQTT, "Connecting to %s:%lu",
+            mqttConfig.broker.address.hostname, mqttConfig.broker.address.port);
         ESP_ERROR_CHECK(esp_mqtt_client_start(client));
         clientRunning = true;
     }
@@ -542,7 +540,8 @@ private:
             }
             case MQTT_EVENT_SUBSCRIBED: {
                 LOGTV(Tag::MQTT, "Subscribed, message ID: %d", event->msg_id);
-                eventQueue.offerIn(MQTT_QUEUE_TIMEOUT, Subscribed { event->msg_id });
+                bool success = MqttSession::isSubscriptionAccepted(reinterpret_cast<const uint8_t*>(event->data), event->data_len);
+                eventQueue.offerIn(MQTT_QUEUE_TIMEOUT, Subscribed { event->msg_id, success });
                 break;
             }
             case MQTT_EVENT_UNSUBSCRIBED: {
@@ -561,10 +560,10 @@ private:
             }
             case MQTT_EVENT_DATA: {
                 std::string topic(event->topic, event->topic_len);
-                std::string payload(event->data, event->data_len);
+                LargeString payload(event->data, event->data_len, LargeAllocator<char>(memoryTag()));
                 LOGTV(Tag::MQTT, "Received message on topic '%s'",
                     topic.c_str());
-                incomingQueue.offerIn(MQTT_QUEUE_TIMEOUT, IncomingMessage { topic, payload });
+                incomingQueue.offerIn(MQTT_QUEUE_TIMEOUT, IncomingMessage { topic, std::move(payload) });
                 break;
             }
             case MQTT_EVENT_ERROR: {
@@ -616,7 +615,7 @@ private:
         }
     }
 
-    void processSubscriptions(const std::list<Subscription>& subscriptions, std::list<PendingSubscription>& pendingSubscriptions) {
+    void processSubscriptions(const std::list<Subscription>& subscriptions, MqttSession& session) {
         std::vector<esp_mqtt_topic_t> topics;
         for (auto it = subscriptions.begin(); it != subscriptions.end();) {
             // Break up subscriptions into batches
@@ -627,12 +626,12 @@ private:
                 topics.emplace_back(subscription.topic.c_str(), static_cast<int>(subscription.qos));
             }
 
-            processSubscriptionBatch(topics, pendingSubscriptions);
+            processSubscriptionBatch(topics, session);
             topics.clear();
         }
     }
 
-    void processSubscriptionBatch(const std::vector<esp_mqtt_topic_t>& topics, std::list<PendingSubscription>& pendingSubscriptions) {
+    void processSubscriptionBatch(const std::vector<esp_mqtt_topic_t>& topics, MqttSession& session) {
         int ret = esp_mqtt_client_subscribe_multiple(client, topics.data(), topics.size());
 
         if (ret < 0) {
@@ -643,15 +642,19 @@ private:
             LOGTV(Tag::MQTT, "%d subscriptions published, message ID = %d",
                 topics.size(), messageId);
             if (messageId > 0) {
-                // Record pending task
-                pendingSubscriptions.emplace_back(messageId, boot_clock::now());
+                // Record pending subscription, so we know what got confirmed once the broker acknowledges it
+                std::list<std::string> pendingTopics;
+                for (const auto& topic : topics) {
+                    pendingTopics.emplace_back(topic.filter);
+                }
+                session.subscribing(messageId, pendingTopics, boot_clock::now());
             }
         }
     }
 
     void processIncomingMessage(const IncomingMessage& message) {
         const std::string& topic = message.topic;
-        const std::string& payload = message.payload;
+        const LargeString& payload = message.payload;
 
         if (payload.empty()) {
             LOGTV(Tag::MQTT, "Ignoring empty payload");
@@ -668,8 +671,9 @@ private:
         for (auto subscription : subscriptions) {
             if (subscription.topic == topic) {
                 Task::run("mqtt:incoming-handler", 4096, [topic, payload, subscription](Task& task) {
-                    JsonDocument json;
-                    deserializeJson(json, payload);
+                    JsonArena arena(memoryTag());
+                    JsonDocument json(arena.allocator());
+                    deserializeJson(json, payload.data(), payload.size());
                     subscription.handle(topic, json.as<JsonObject>());
                 });
                 return;
@@ -679,6 +683,9 @@ private:
             topic.c_str());
     }
 
+    /**
+     * @brief The client ID must be stable across reconnects and reboots for the broker to resume our session.
+     */
     static std::string getClientId(const std::string& clientId, const std::string& instanceName) {
         if (clientId.length() > 0) {
             return clientId;
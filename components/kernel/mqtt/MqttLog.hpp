@@ -1,19 +1,47 @@
 #pragma once
 
+#include <map>
+#include <string_view>
+
+#include <Console.hpp>
 #include <Log.hpp>
+#include <NvsStore.hpp>
 #include <Task.hpp>
 #include <mqtt/MqttRoot.hpp>
 
 namespace farmhub::kernel::mqtt {
 
+/**
+ * @brief Per-tag log level overrides persisted in NVS.
+ */
+struct LogLevelOverrides {
+    std::map<std::string, TagLevels> tags;
+};
+
+bool convertToJson(const LogLevelOverrides& src, JsonVariant dst) {
+    auto json = dst.to<JsonObject>();
+    for (auto& [tag, levels] : src.tags) {
+        json[tag] = levels;
+    }
+    return true;
+}
+void convertFromJson(JsonVariantConst src, LogLevelOverrides& dst) {
+    dst.tags.clear();
+    for (auto entry : src.as<JsonObjectConst>()) {
+        dst.tags[entry.key().c_str()] = entry.value().as<TagLevels>();
+    }
+}
+
 class MqttLog {
 public:
-    static void init(Level publishLevel, std::shared_ptr<Queue<LogRecord>> logRecords, std::shared_ptr<MqttRoot> mqttRoot) {
-        Task::loop("mqtt:log", 3072, [publishLevel, logRecords, mqttRoot](Task& task) {
+    static void init(std::shared_ptr<Queue<LogRecord>> logRecords, std::shared_ptr<MqttRoot> mqttRoot) {
+        restorePersistedLevels();
+        registerLogLevelCommand(mqttRoot);
+
+        auto logRoot = mqttRoot->forMemoryTag(ConsoleProvider::memoryTag());
+        Task::loop("mqtt:log", 3072, [logRecords, logRoot](Task& task) {
+            // Records are already filtered per tag by the console provider
             logRecords->take([&](const LogRecord& record) {
-                if (record.level > publishLevel) {
-                    return;
-                }
                 auto length = record.message.length();
                 // Remove the level prefix
                 auto messageStart = 2;
@@ -21,10 +49,11 @@ public:
                 auto messageEnd = record.message[length - 1] == '\n'
                     ? length - 1
                     : length;
-                std::string message = record.message.substr(messageStart, messageEnd - messageStart);
+                std::string_view message(record.message.data() + messageStart, messageEnd - messageStart);
 
-                mqttRoot->publish(
-                    "log", [level = record.level, message](JsonObject& json) {
+                // Capture the message by reference so the callback fits into std::function without allocating
+                logRoot->publish(
+                    "log", [level = record.level, &message](JsonObject& json) {
                         json["level"] = level;
                         json["message"] = message;
                     },
@@ -32,6 +61,83 @@ public:
             });
         });
     }
+
+private:
+    static void restorePersistedLevels() {
+        NvsStore nvs(NVS_NAMESPACE);
+        LogLevelOverrides overrides;
+        if (!nvs.get(NVS_KEY, overrides)) {
+            return;
+        }
+        for (auto& [tag, levels] : overrides.tags) {
+            LOGTI(Tag::MQTT, "Restoring log levels for '%s': console = %d, mqtt = %d",
+                tag.c_str(), static_cast<int>(levels.console), static_cast<int>(levels.mqtt));
+            Log::setLevels(tag, levels);
+        }
+    }
+
+    /**
+     * @brief Registers the `log-level` command.
+     *
+     * Request: `{ "tag": "farmhub:mqtt", "console": 5, "mqtt": 4, "persist": true }`
+     * to override levels for a tag, `{ "tag": "...", "reset": true }` to revert to
+     * defaults, or `{}` to only list the current levels.
+     */
+    static void registerLogLevelCommand(std::shared_ptr<MqttRoot> mqttRoot) {
+        mqttRoot->registerCommand("log-level", [](const JsonObject& request, JsonObject& response) {
+            if (request["tag"].is<std::string>()) {
+                std::string tag = request["tag"];
+                bool persist = request["persist"].as<bool>();
+                if (request["reset"].as<bool>()) {
+                    LOGTI(Tag::MQTT, "Resetting log levels for '%s'", tag.c_str());
+                    Log::resetLevels(tag);
+                    updatePersistedLevels([&](LogLevelOverrides& overrides) {
+                        overrides.tags.erase(tag);
+                    });
+                } else {
+                    TagLevels levels = Log::getLevels(tag);
+                    if (request["console"].is<int>()) {
+                        levels.console = request["console"].as<Level>();
+                    }
+                    if (request["mqtt"].is<int>()) {
+                        levels.mqtt = request["mqtt"].as<Level>();
+                    }
+                    levels = Log::setLevels(tag, levels);
+                    LOGTI(Tag::MQTT, "Log levels for '%s' set to console = %d, mqtt = %d%s",
+                        tag.c_str(), static_cast<int>(levels.console), static_cast<int>(levels.mqtt),
+                        persist ? " (persisted)" : "");
+                    if (persist) {
+                        updatePersistedLevels([&](LogLevelOverrides& overrides) {
+                            overrides.tags[tag] = levels;
+                        });
+                    }
+                }
+            }
+
+            response["build-level"] = Log::getBuildLevel();
+            auto levelsJson = response["levels"].to<JsonObject>();
+            Log::forEachTag([&](const std::string& tag, const TagLevels& levels) {
+                levelsJson[tag] = levels;
+            });
+        });
+    }
+
+    static void updatePersistedLevels(std::function<void(LogLevelOverrides&)> update) {
+        NvsStore nvs(NVS_NAMESPACE);
+        LogLevelOverrides overrides;
+        bool existed = nvs.get(NVS_KEY, overrides);
+        update(overrides);
+        if (overrides.tags.empty()) {
+            if (existed) {
+                nvs.remove(NVS_KEY);
+            }
+        } else {
+            nvs.set(NVS_KEY, overrides);
+        }
+    }
+
+    static constexpr const char* NVS_NAMESPACE = "log-levels";
+    static constexpr const char* NVS_KEY = "overrides";
 };
 
 }    // namespace farmhub::kernel::mqtt
@@ -9,21 +9,41 @@ namespace farmhub::kernel::mqtt {
 
 class MqttRoot {
 public:
-    MqttRoot(const std::shared_ptr<MqttDriver> mqtt, const std::string& rootTopic)
+    /**
+     * @param memoryTag the subsystem that JSON documents and payloads published under this root are accounted to.
+     */
+    MqttRoot(const std::shared_ptr<MqttDriver> mqtt, const std::string& rootTopic, MemoryTag& memoryTag = MqttDriver::memoryTag())
         : mqtt(mqtt)
-        , rootTopic(rootTopic) {
+        , rootTopic(rootTopic)
+        , memoryTag(memoryTag) {
     }
 
     std::shared_ptr<MqttRoot> forSuffix(const std::string& suffix) {
-        return std::make_shared<MqttRoot>(mqtt, rootTopic + "/" + suffix);
+        return forSuffix(suffix, memoryTag);
+    }
+
+    std::shared_ptr<MqttRoot> forSuffix(const std::string& suffix, MemoryTag& memoryTag) {
+        return std::make_shared<MqttRoot>(mqtt, rootTopic + "/" + suffix, memoryTag);
+    }
+
+    /**
+     * @brief The same topic, with allocations accounted to a different subsystem.
+     */
+    std::shared_ptr<MqttRoot> forMemoryTag(MemoryTag& memoryTag) {
+        return std::make_shared<MqttRoot>(mqtt, rootTopic, memoryTag);
+    }
+
+    MemoryTag& getMemoryTag() const {
+        return memoryTag;
     }
 
     PublishStatus publish(const std::string& suffix, const JsonDocument& json, Retention retain = Retention::NoRetain, QoS qos = QoS::AtMostOnce, ticks timeout = MqttDriver::MQTT_DEFAULT_PUBLISH_TIMEOUT, LogPublish log = LogPublish::Log) {
-        return mqtt->publish(fullTopic(suffix), json, retain, qos, timeout, log);
+        return mqtt->publish(fullTopic(suffix), json, retain, qos, timeout, log, memoryTag);
     }
 
     PublishStatus publish(const std::string& suffix, std::function<void(JsonObject&)> populate, Retention retain = Retention::NoRetain, QoS qos = QoS::AtMostOnce, ticks timeout = MqttDriver::MQTT_DEFAULT_PUBLISH_TIMEOUT, LogPublish log = LogPublish::Log) {
-        JsonDocument doc;
+        JsonArena arena(memoryTag);
+        JsonDocument doc(arena.allocator());
         JsonObject root = doc.to<JsonObject>();
         populate(root);
         return publish(suffix, doc, retain, qos, timeout, log);
@@ -40,7 +60,8 @@ public:
     bool registerCommand(const std::string& name, CommandHandler handler) {
         std::string suffix = "commands/" + name;
         return subscribe(suffix, QoS::ExactlyOnce, [this, name, suffix, handler](const std::string&, const JsonObject& request) {
-            JsonDocument responseDoc;
+            JsonArena arena(memoryTag);
+            JsonDocument responseDoc(arena.allocator());
             auto response = responseDoc.to<JsonObject>();
             handler(request, response);
             if (response.size() > 0) {
@@ -65,6 +86,7 @@ private:
 
     const std::shared_ptr<MqttDriver> mqtt;
     const std::string rootTopic;
+    MemoryTag& memoryTag;
 };
 
 }    // namespace farmhub::kernel::mqtt
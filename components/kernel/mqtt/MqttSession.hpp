@@ -0,0 +1,125 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <BootClock.hpp>
+#include <Log.hpp>
+
+using namespace std::chrono;
+
+namespace farmhub::kernel::mqtt {
+
+/**
+ * @brief Keeps track of what the broker knows about our subscriptions across reconnects.
+ *
+ * We never ask for a clean session: the broker discards a clean session as soon as we disconnect,
+ * so the first reconnect after boot would lose everything sent to us while we were away. Topics become
+ * confirmed when the broker acknowledges them, and stay confirmed as long as the broker keeps the
+ * session; a reconnect to a session the broker still has is a single CONNECT/CONNACK exchange.
+ * After a reboot nothing is confirmed, so everything is subscribed again even if the broker kept the session.
+ * Subscription requests are tracked by message ID until they are acknowledged, rejected, time out
+ * or the connection drops; their topics are subscribed again after that.
+ */
+class MqttSession {
+public:
+    void connected(bool sessionPresent) {
+        if (!sessionPresent) {
+            // The broker does not remember our subscriptions
+            confirmedTopics.clear();
+        }
+        // Anything sent in a previous connection is not coming back
+        pendingSubscriptions.clear();
+    }
+
+    void disconnected() {
+        // Unacknowledged subscriptions will be retried after reconnecting
+        pendingSubscriptions.clear();
+    }
+
+    /**
+     * @brief Whether we need to subscribe to the topic: it is neither confirmed nor waiting for an acknowledgement.
+     */
+    bool needsSubscribing(const std::string& topic) const {
+        if (confirmedTopics.contains(topic)) {
+            return false;
+        }
+        for (const auto& [messageId, pendingSubscription] : pendingSubscriptions) {
+            for (const auto& pendingTopic : pendingSubscription.topics) {
+                if (pendingTopic == topic) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    void subscribing(int messageId, std::list<std::string> topics, time_point<boot_clock> now) {
+        pendingSubscriptions.emplace(messageId, PendingSubscription { now, std::move(topics) });
+    }
+
+    /**
+     * @brief Process a SUBACK; returns false if it was not for a subscription we are waiting on.
+     */
+    bool acknowledged(int messageId, bool success) {
+        auto it = pendingSubscriptions.find(messageId);
+        if (it == pendingSubscriptions.end()) {
+            return false;
+        }
+        if (success) {
+            confirmedTopics.insert(it->second.topics.begin(), it->second.topics.end());
+        } else {
+            // Will be retried after the next reconnect
+            LOGTE(Tag::MQTT, "Subscription rejected by broker, message id %d", messageId);
+        }
+        pendingSubscriptions.erase(it);
+        return true;
+    }
+
+    /**
+     * @brief Forget subscriptions not acknowledged within `timeout`; returns whether there were any.
+     */
+    bool expire(time_point<boot_clock> now, milliseconds timeout) {
+        return std::erase_if(pendingSubscriptions, [&](const auto& entry) {
+            const auto& [messageId, pendingSubscription] = entry;
+            if (now - pendingSubscription.subscribedAt > timeout) {
+                LOGTE(Tag::MQTT, "Subscription timed out with message id %d", messageId);
+                return true;
+            } else {
+                return false;
+            }
+        }) > 0;
+    }
+
+    /**
+     * @brief Whether the SUBACK payload accepts every topic in the request.
+     *
+     * The payload holds a return code for each topic, 0x80 meaning failure.
+     */
+    static bool isSubscriptionAccepted(const uint8_t* returnCodes, size_t length) {
+        for (size_t i = 0; i < length; i++) {
+            if (returnCodes[i] == 0x80) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    struct PendingSubscription {
+        time_point<boot_clock> subscribedAt;
+        std::list<std::string> topics;
+    };
+
+    // Subscription requests we are waiting on, by message ID
+    std::unordered_map<int, PendingSubscription> pendingSubscriptions;
+
+    // Topics the broker has acknowledged in the current session
+    std::unordered_set<std::string> confirmedTopics;
+};
+
+}    // namespace farmhub::kernel::mqtt
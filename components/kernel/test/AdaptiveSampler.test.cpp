@@ -0,0 +1,155 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <numbers>
+#include <optional>
+#include <vector>
+
+#include <AdaptiveSampler.hpp>
+#include <Statistics.hpp>
+
+using namespace std::chrono;
+using namespace std::chrono_literals;
+
+namespace farmhub::kernel {
+
+/**
+ * @brief Synthetic clear-sky daylight curve, sunrise at 6:00 and sunset at 18:00.
+ *
+ * Above the horizon light follows the sine of the sun's elevation, peaking around 100 klx;
+ * below it, twilight fades by a decade every 3 degrees.
+ */
+static double daylight(seconds timeOfDay) {
+    double elevation = 60.0 * std::sin(2 * std::numbers::pi * (timeOfDay - 6h).count() / 86400.0);
+    if (elevation >= 0) {
+        return 400 + 100000 * std::sin(elevation * std::numbers::pi / 180);
+    }
+    return 400 * std::pow(10, elevation / 3);
+}
+
+static constexpr double CLOSE_LEVEL = 10;
+static constexpr double OPEN_LEVEL = 250;
+
+/**
+ * @brief Follows the averaged light level like the chicken door does, and notes when the door would move.
+ */
+struct DoorSimulation {
+    MovingMean<double, MAX_FILTER_WINDOW> level { 5 };
+    std::optional<bool> open;
+    std::vector<seconds> moves;
+    int samples = 0;
+
+    double sample(seconds time) {
+        samples++;
+        level.record(daylight(time));
+        double mean = level.getMean();
+        if (mean >= OPEN_LEVEL && open != true) {
+            open = true;
+            moves.push_back(time);
+        } else if (mean <= CLOSE_LEVEL && open != false) {
+            open = false;
+            moves.push_back(time);
+        }
+        return mean;
+    }
+};
+
+static DoorSimulation simulateFixed() {
+    DoorSimulation door;
+    for (seconds time = 0s; time < 24h; time += 1s) {
+        door.sample(time);
+    }
+    return door;
+}
+
+static AdaptiveSampler createSampler() {
+    AdaptiveSampler sampler(1s, 5min);
+    sampler.setThresholds({ OPEN_LEVEL, CLOSE_LEVEL });
+    return sampler;
+}
+
+TEST_CASE("sampling speeds up near thresholds") {
+    auto sampler = createSampler();
+    CHECK(sampler.nextInterval(CLOSE_LEVEL) == 1s);
+    CHECK(sampler.nextInterval(OPEN_LEVEL * 1.05) == 1s);
+    CHECK(sampler.nextInterval(50) > 1s);
+    CHECK(sampler.nextInterval(50) < 5min);
+    CHECK(sampler.nextInterval(0) > 1s);
+    CHECK(sampler.nextInterval(100000) <= 5min);
+    CHECK(sampler.nextInterval(std::nan("")) == 1s);
+
+    // Always a power of two multiple of the minimum interval
+    auto interval = sampler.nextInterval(3000);
+    auto steps = interval / 1s;
+    CHECK((steps & (steps - 1)) == 0);
+}
+
+TEST_CASE("band is bounded by the thresholds around the value") {
+    auto sampler = createSampler();
+    auto night = sampler.bandAround(1);
+    CHECK(night.low == 0);
+    CHECK(night.high == CLOSE_LEVEL);
+    auto dusk = sampler.bandAround(100);
+    CHECK(dusk.low == CLOSE_LEVEL);
+    CHECK(dusk.high == OPEN_LEVEL);
+    auto day = sampler.bandAround(5000);
+    CHECK(day.low == OPEN_LEVEL);
+    CHECK(std::isinf(day.high));
+    CHECK(day.contains(5000));
+    CHECK(!day.contains(200));
+}
+
+TEST_CASE("adaptive sampling over a day moves the door at the same times with far fewer samples") {
+    auto fixed = simulateFixed();
+    REQUIRE(fixed.samples == 86400);
+    // Closed at midnight, opened in the morning, closed in the evening
+    REQUIRE(fixed.moves.size() == 3);
+
+    auto sampler = createSampler();
+    DoorSimulation adaptive;
+    for (seconds time = 0s; time < 24h;) {
+        double mean = adaptive.sample(time);
+        time += duration_cast<seconds>(sampler.nextInterval(mean));
+    }
+
+    REQUIRE(adaptive.moves.size() == fixed.moves.size());
+    for (size_t i = 1; i < fixed.moves.size(); i++) {
+        CHECK(abs(adaptive.moves[i] - fixed.moves[i]) <= 30s);
+    }
+    // Over 86k samples down to a couple of thousand at most
+    CHECK(adaptive.samples < 2000);
+}
+
+TEST_CASE("threshold interrupts only wake up on crossings") {
+    auto fixed = simulateFixed();
+
+    // On each interrupt, sample for the latency interval to settle the average, then re-arm the interrupt
+    auto sampler = createSampler();
+    DoorSimulation events;
+    int interrupts = 0;
+    seconds time = 0s;
+    while (time < 24h) {
+        double mean = 0;
+        for (int i = 0; i < 5; i++, time += 1s) {
+            mean = events.sample(time);
+        }
+        auto band = sampler.bandAround(mean);
+        while (time < 24h && band.contains(daylight(time))) {
+            time += 1s;
+        }
+        if (time < 24h) {
+            interrupts++;
+        }
+    }
+
+    REQUIRE(events.moves.size() == fixed.moves.size());
+    for (size_t i = 1; i < fixed.moves.size(); i++) {
+        CHECK(abs(events.moves[i] - fixed.moves[i]) <= 10s);
+    }
+    // Morning crosses both thresholds up, the evening both down
+    CHECK(interrupts == 4);
+    CHECK(events.samples == 5 * (interrupts + 1));
+}
+
+}    // namespace farmhub::kernel
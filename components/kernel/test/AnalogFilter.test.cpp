@@ -0,0 +1,130 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/matchers/catch_matchers_floating_point.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <optional>
+#include <vector>
+
+#include <AnalogFilter.hpp>
+
+using Catch::Matchers::WithinAbs;
+
+namespace farmhub::kernel {
+
+// 12-bit ADC traces of 64 samples with Gaussian noise and a few spikes from the radio transmitting
+
+// Soil moisture sensor around 1862.4, noise σ = 5 codes
+static const std::vector<uint16_t> SOIL_TRACE {
+    1861, 1865, 1861, 1861, 1858, 1861, 1868, 1865, 1868, 2074, 2024, 1863, 1854, 1867, 1865, 1865,
+    1854, 1854, 1858, 1860, 1864, 1862, 1865, 1859, 1864, 1864, 1859, 1871, 1865, 1868, 1859, 1859,
+    1861, 1862, 1866, 1864, 1860, 1858, 1860, 1869, 1858, 1624, 1865, 1855, 1863, 1869, 1852, 1861,
+    1862, 1858, 1865, 1862, 1855, 1867, 1866, 1867, 1870, 1864, 1863, 1856, 1865, 1859, 1860, 1856,
+};
+
+// Battery voltage divider around 2871.7, noise σ = 3 codes
+static const std::vector<uint16_t> BATTERY_TRACE {
+    2869, 2870, 2876, 2866, 2867, 2872, 2876, 2873, 2866, 2864, 2873, 2869, 2868, 2875, 2875, 2872,
+    2872, 2873, 2876, 2874, 2968, 2873, 2867, 2876, 2875, 2873, 2866, 2870, 2874, 2866, 2871, 2875,
+    2868, 2877, 2873, 2871, 2873, 2874, 2872, 2875, 2870, 2870, 2875, 2872, 2869, 2875, 2876, 2870,
+    2868, 2871, 2871, 2871, 2996, 2869, 2875, 2868, 2869, 2874, 2875, 2874, 2873, 2872, 2872, 2873,
+};
+
+/**
+ * @brief Slightly non-linear curve that, like the ESP-IDF calibration schemes, converts whole codes to whole millivolts.
+ */
+static AnalogCalibration curveCalibration() {
+    auto converter = [](int raw) -> std::optional<double> {
+        if (raw < 0 || raw > 4095) {
+            return std::nullopt;
+        }
+        return std::round(0.72 * raw + 0.00002 * raw * raw);
+    };
+    return AnalogCalibration(converter, true);
+}
+
+static double mean(const std::vector<uint16_t>& samples) {
+    return std::accumulate(samples.begin(), samples.end(), 0.0) / samples.size();
+}
+
+TEST_CASE("filtering removes radio spikes") {
+    auto samples = SOIL_TRACE;
+    auto reading = AnalogFilter().apply(samples, curveCalibration());
+    REQUIRE(reading.has_value());
+    CHECK(reading->samples == 48);
+    CHECK_THAT(reading->raw, WithinAbs(1862.4, 0.25));
+    // The spikes would pull a plain mean away by more than a code
+    CHECK(std::abs(mean(SOIL_TRACE) - 1862.4) > 1.5);
+
+    auto batterySamples = BATTERY_TRACE;
+    auto batteryReading = AnalogFilter().apply(batterySamples, curveCalibration());
+    REQUIRE(batteryReading.has_value());
+    CHECK_THAT(batteryReading->raw, WithinAbs(2871.7, 0.5));
+    CHECK(std::abs(mean(BATTERY_TRACE) - 2871.7) > 3);
+}
+
+TEST_CASE("oversampled readings are interpolated between calibrated codes") {
+    auto calibration = curveCalibration();
+    CHECK(calibration.toMillivolts(1862) == 1410);
+    CHECK(calibration.toMillivolts(1863) == 1411);
+    CHECK_THAT(*calibration.toMillivolts(1862.25), WithinAbs(1410.25, 0.001));
+    // No code above the top one to interpolate with
+    CHECK(calibration.toMillivolts(4095.5) == calibration.toMillivolts(4095));
+    CHECK(!calibration.toMillivolts(-1).has_value());
+
+    auto samples = SOIL_TRACE;
+    auto reading = AnalogFilter().apply(samples, calibration);
+    REQUIRE(reading.has_value());
+    CHECK_THAT(reading->millivolts, WithinAbs(1410.3, 0.1));
+}
+
+TEST_CASE("nominal calibration is linear") {
+    auto calibration = AnalogCalibration::nominal(3300, 4096);
+    CHECK(!calibration.isCalibrated());
+    CHECK(calibration.toMillivolts(2048) == 1650);
+    CHECK_THAT(*calibration.toMillivolts(1024.5), WithinAbs(825.4, 0.01));
+}
+
+TEST_CASE("burst collects interleaved channels") {
+    // Continuous conversion alternates between the channels of the pattern
+    AnalogBurst burst({ 3, 5 }, SOIL_TRACE.size());
+    for (size_t i = 0; i < SOIL_TRACE.size(); i++) {
+        CHECK(!burst.isComplete());
+        burst.add(3, SOIL_TRACE[i]);
+        // Left over from some earlier conversion
+        burst.add(7, 4095);
+        burst.add(5, BATTERY_TRACE[i]);
+    }
+    REQUIRE(burst.isComplete());
+    // The conversion goes on until it's stopped
+    burst.add(3, 0);
+    burst.add(5, 0);
+
+    CHECK(burst.samplesAt(0) == SOIL_TRACE);
+    CHECK(burst.samplesAt(1) == BATTERY_TRACE);
+
+    AnalogFilter filter;
+    auto soil = filter.apply(burst.samplesAt(0), curveCalibration());
+    auto battery = filter.apply(burst.samplesAt(1), curveCalibration());
+    REQUIRE(soil.has_value());
+    REQUIRE(battery.has_value());
+    CHECK_THAT(soil->raw, WithinAbs(1862.4, 0.25));
+    CHECK_THAT(battery->raw, WithinAbs(2871.7, 0.5));
+}
+
+TEST_CASE("no reading without samples") {
+    std::vector<uint16_t> samples;
+    CHECK(!AnalogFilter().apply(samples, curveCalibration()).has_value());
+
+    AnalogBurst burst({ 3 }, 8);
+    burst.add(3, 1000);
+    CHECK(!burst.isComplete());
+    // A partial burst still gives a reading
+    auto reading = AnalogFilter().apply(burst.samplesAt(0), curveCalibration());
+    REQUIRE(reading.has_value());
+    CHECK(reading->samples == 1);
+    CHECK(reading->raw == 1000);
+}
+
+}    // namespace farmhub::kernel
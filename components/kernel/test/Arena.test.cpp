@@ -0,0 +1,73 @@
+#include <cstring>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <Arena.hpp>
+
+using namespace farmhub::kernel;
+
+TEST_CASE("bump arena serves short-lived documents without the heap") {
+    ArenaStats stats;
+    BumpArena arena(256, stats);
+
+    // A slot pool, then a string grown and trimmed like ArduinoJson's string builder does
+    auto pool = arena.allocate(64);
+    auto text = static_cast<char*>(arena.allocate(31));
+    std::strcpy(text, "temperature");
+    text = static_cast<char*>(arena.reallocate(text, 62));
+    REQUIRE(std::strcmp(text, "temperature") == 0);
+    text = static_cast<char*>(arena.reallocate(text, 12));
+    REQUIRE(arena.contains(pool));
+    REQUIRE(arena.contains(text));
+
+    // Freeing the top block gives its space back right away
+    auto used = arena.getUsed();
+    auto scratch = arena.allocate(16);
+    arena.deallocate(scratch);
+    REQUIRE(arena.getUsed() == used);
+
+    arena.deallocate(text);
+    arena.deallocate(pool);
+    arena.reset();
+    REQUIRE(arena.getUsed() == 0);
+    REQUIRE(stats.requests == 5);
+    REQUIRE(stats.heapAllocations == 0);
+}
+
+TEST_CASE("bump arena overflows to the heap") {
+    ArenaStats stats;
+    BumpArena arena(64, stats);
+    auto small = static_cast<char*>(arena.allocate(16));
+    std::strcpy(small, "kept");
+    auto large = arena.allocate(128);
+    REQUIRE_FALSE(arena.contains(large));
+    arena.deallocate(large);
+
+    // Growing a block past the end moves it to the heap with its contents
+    auto grown = static_cast<char*>(arena.reallocate(small, 100));
+    REQUIRE_FALSE(arena.contains(grown));
+    REQUIRE(std::strcmp(grown, "kept") == 0);
+    arena.deallocate(grown);
+    REQUIRE(stats.heapAllocations == 2);
+}
+
+TEST_CASE("arena pool hands out each arena once at a time") {
+    ArenaPool pool(2, 128);
+    {
+        auto first = pool.acquire();
+        auto second = pool.acquire();
+        REQUIRE(&first.get() != &second.get());
+        first.get().allocate(32);
+
+        // Exhausted pool falls back to the heap
+        auto third = pool.acquire();
+        auto ptr = third.get().allocate(8);
+        REQUIRE(third.get().getCapacity() == 0);
+        third.get().deallocate(ptr);
+    }
+    auto again = pool.acquire();
+    REQUIRE(again.get().getCapacity() == 128);
+    REQUIRE(again.get().getUsed() == 0);
+    REQUIRE(pool.getStats().heapAllocations == 1);
+    REQUIRE(pool.getHighWater() > 32);
+}
@@ -0,0 +1,150 @@
+#include <deque>
+#include <ostream>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <BlinkSequencer.hpp>
+
+using namespace farmhub::kernel;
+
+namespace {
+
+struct Edge {
+    milliseconds time;
+    bool on;
+
+    bool operator==(const Edge&) const = default;
+};
+
+std::ostream& operator<<(std::ostream& out, const Edge& edge) {
+    return out << edge.time.count() << "ms:" << (edge.on ? "on" : "off");
+}
+
+/**
+ * @brief Records the level changes of an LED, like a logic analyzer on the pin would.
+ */
+struct FakePin {
+    void write(bool on) {
+        if (edges.empty() || edges.back().on != on) {
+            edges.push_back({ duration_cast<milliseconds>(*now), on });
+        }
+    }
+
+    const BlinkSequencer::Time* now;
+    std::vector<Edge> edges;
+};
+
+/**
+ * @brief Fires the timer at the requested deadlines, optionally late, like a busy esp_timer task would.
+ */
+struct SimulatedTimer {
+    void runUntil(milliseconds end, milliseconds latency = 0ms) {
+        while (true) {
+            auto next = sequencer.nextDeadline();
+            if (!next.has_value() || *next + latency > end) {
+                break;
+            }
+            now = *next + latency;
+            sequencer.advance(now);
+        }
+        now = end;
+    }
+
+    FakePin& addLed() {
+        pins.push_back(FakePin { &now, {} });
+        auto index = sequencer.add([this, pinIndex = pins.size() - 1](bool on) { pins[pinIndex].write(on); });
+        REQUIRE(index == pins.size() - 1);
+        return pins.back();
+    }
+
+    template <typename... Steps>
+    void play(size_t led, Steps... steps) {
+        std::vector<milliseconds> pattern { steps... };
+        sequencer.setPattern(led, pattern.begin(), pattern.end(), now);
+    }
+
+    BlinkSequencer::Time now = 0us;
+    BlinkSequencer sequencer;
+    // Keeps references stable as LEDs are added
+    std::deque<FakePin> pins;
+};
+
+}    // namespace
+
+TEST_CASE("blinks with exact edge timings") {
+    SimulatedTimer timer;
+    auto& led = timer.addLed();
+    timer.play(0, 100ms, -100ms);
+    timer.runUntil(450ms);
+    REQUIRE(led.edges == std::vector<Edge> {
+                { 0ms, true },
+                { 100ms, false },
+                { 200ms, true },
+                { 300ms, false },
+                { 400ms, true },
+            });
+}
+
+TEST_CASE("steady states need no timer") {
+    SimulatedTimer timer;
+    auto& led = timer.addLed();
+    timer.play(0, milliseconds::max());
+    REQUIRE_FALSE(timer.sequencer.nextDeadline().has_value());
+    timer.play(0, -milliseconds::max());
+    REQUIRE_FALSE(timer.sequencer.nextDeadline().has_value());
+    REQUIRE(led.edges == std::vector<Edge> { { 0ms, true }, { 0ms, false } });
+}
+
+TEST_CASE("one engine drives several LEDs with their own patterns") {
+    SimulatedTimer timer;
+    auto& status = timer.addLed();
+    auto& error = timer.addLed();
+    // The status pattern from KernelStatus: three quick blinks, then a pause
+    timer.play(0, 100ms, -100ms, 100ms, -100ms, 100ms, -500ms);
+    timer.play(1, 250ms, -250ms);
+    timer.runUntil(999ms);
+
+    REQUIRE(status.edges == std::vector<Edge> {
+                { 0ms, true },
+                { 100ms, false },
+                { 200ms, true },
+                { 300ms, false },
+                { 400ms, true },
+                { 500ms, false },
+            });
+    REQUIRE(error.edges == std::vector<Edge> {
+                { 0ms, true },
+                { 250ms, false },
+                { 500ms, true },
+                { 750ms, false },
+            });
+}
+
+TEST_CASE("changing the pattern restarts it, setting the same one does not") {
+    SimulatedTimer timer;
+    auto& led = timer.addLed();
+    timer.play(0, 500ms, -500ms);
+    timer.runUntil(250ms);
+    timer.play(0, 500ms, -500ms);
+    timer.runUntil(600ms);
+    timer.play(0, -100ms, 100ms);
+    timer.runUntil(799ms);
+    REQUIRE(led.edges == std::vector<Edge> {
+                { 0ms, true },
+                { 500ms, false },
+                { 700ms, true },
+            });
+}
+
+TEST_CASE("late timer callbacks don't accumulate drift") {
+    SimulatedTimer timer;
+    auto& led = timer.addLed();
+    timer.play(0, 100ms, -100ms);
+    timer.runUntil(1000ms, 3ms);
+    // Each edge is late, but the next one is still scheduled from the ideal time
+    REQUIRE(led.edges.size() == 10);
+    for (size_t i = 1; i < led.edges.size(); i++) {
+        REQUIRE(led.edges[i].time == i * 100ms + 3ms);
+    }
+}
@@ -0,0 +1,334 @@
+#include <algorithm>
+#include <cstring>
+#include <optional>
+#include <random>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <DeltaPatch.hpp>
+
+using namespace farmhub::kernel;
+
+namespace {
+
+using Bytes = std::vector<uint8_t>;
+
+Bytes sha256(const Bytes& data) {
+    Bytes digest(32);
+    mbedtls_sha256(data.data(), data.size(), digest.data(), 0);
+    return digest;
+}
+
+void appendUint32(Bytes& out, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        out.push_back((value >> (8 * i)) & 0xFF);
+    }
+}
+
+void appendVarint(Bytes& out, uint32_t value) {
+    while (value >= 0x80) {
+        out.push_back((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    out.push_back(value);
+}
+
+/**
+ * @brief Wraps the data in a zlib stream of stored (uncompressed) blocks, declaring the given window size.
+ */
+Bytes storedZlib(const Bytes& data, int windowBits = Inflater::WINDOW_BITS) {
+    uint8_t cmf = ((windowBits - 8) << 4) | 8;
+    Bytes out { cmf, static_cast<uint8_t>(31 - (cmf << 8) % 31) };
+    size_t position = 0;
+    do {
+        size_t length = std::min<size_t>(data.size() - position, 65535);
+        bool last = position + length == data.size();
+        out.push_back(last ? 1 : 0);
+        out.push_back(length & 0xFF);
+        out.push_back(length >> 8);
+        out.push_back(~length & 0xFF);
+        out.push_back((~length >> 8) & 0xFF);
+        out.insert(out.end(), data.begin() + position, data.begin() + position + length);
+        position += length;
+    } while (position < data.size());
+    uint32_t a = 1, b = 0;
+    for (auto byte : data) {
+        a = (a + byte) % 65521;
+        b = (b + a) % 65521;
+    }
+    uint32_t adler = (b << 16) | a;
+    for (int i = 3; i >= 0; i--) {
+        out.push_back((adler >> (8 * i)) & 0xFF);
+    }
+    return out;
+}
+
+/**
+ * @brief Builds patches the same way `make-delta.py` does, with records given by hand instead of bsdiff.
+ *
+ * There is no compressor on the device, so records are stored in the zlib stream uncompressed by default.
+ */
+class PatchBuilder {
+public:
+    PatchBuilder(const Bytes& source)
+        : source(source) {
+    }
+
+    /**
+     * @brief Append a record producing `diffLength` bytes from the source with `changes` applied,
+     * then the `extra` bytes, then moving the source position by `seek`.
+     */
+    PatchBuilder& record(uint32_t diffLength, std::vector<std::pair<size_t, uint8_t>> changes, const Bytes& extra, int32_t seek) {
+        Bytes diff(diffLength, 0);
+        for (auto [offset, value] : changes) {
+            diff[offset] = value - source[sourcePosition + offset];
+        }
+        for (uint32_t i = 0; i < diffLength; i++) {
+            target.push_back(source[sourcePosition + i] + diff[i]);
+        }
+        target.insert(target.end(), extra.begin(), extra.end());
+
+        appendUint32(records, diffLength);
+        appendUint32(records, extra.size());
+        appendUint32(records, static_cast<uint32_t>(seek));
+        // Alternate zero runs and literal runs
+        size_t start = 0;
+        while (start < diff.size()) {
+            bool zero = diff[start] == 0;
+            size_t end = start;
+            while (end < diff.size() && (diff[end] == 0) == zero) {
+                end++;
+            }
+            appendVarint(records, ((end - start) << 1) | (zero ? 0 : 1));
+            if (!zero) {
+                records.insert(records.end(), diff.begin() + start, diff.begin() + end);
+            }
+            start = end;
+        }
+        records.insert(records.end(), extra.begin(), extra.end());
+        sourcePosition = static_cast<int64_t>(sourcePosition + diffLength) + seek;
+        return *this;
+    }
+
+    Bytes build() const {
+        return build(storedZlib(records));
+    }
+
+    Bytes build(const Bytes& compressedRecords) const {
+        Bytes patch { 'F', 'H', 'D', '2' };
+        appendUint32(patch, source.size());
+        appendUint32(patch, target.size());
+        auto sourceHash = sha256(source);
+        auto targetHash = sha256(target);
+        patch.insert(patch.end(), sourceHash.begin(), sourceHash.end());
+        patch.insert(patch.end(), targetHash.begin(), targetHash.end());
+        patch.insert(patch.end(), compressedRecords.begin(), compressedRecords.end());
+        return patch;
+    }
+
+    const Bytes source;
+    Bytes target;
+    Bytes records;
+
+private:
+    size_t sourcePosition = 0;
+};
+
+/**
+ * @brief Stands in for the HTTP server, serving the patch in chunks of varying size like a network stream would.
+ */
+class PatchServer {
+public:
+    PatchServer(const Bytes& patch, size_t maxChunkSize, uint32_t seed = 42)
+        : patch(patch)
+        , maxChunkSize(maxChunkSize)
+        , random(seed) {
+    }
+
+    int read(uint8_t* buffer, size_t length) {
+        if (failAt.has_value() && position >= failAt.value()) {
+            return -1;
+        }
+        size_t chunkSize = std::uniform_int_distribution<size_t>(1, maxChunkSize)(random);
+        size_t count = std::min({ length, chunkSize, patch.size() - position });
+        std::memcpy(buffer, patch.data() + position, count);
+        position += count;
+        return count;
+    }
+
+    std::optional<size_t> failAt;
+
+private:
+    const Bytes patch;
+    const size_t maxChunkSize;
+    std::mt19937 random;
+    size_t position = 0;
+};
+
+Bytes firmware(size_t size, uint32_t seed) {
+    std::mt19937 random(seed);
+    Bytes data(size);
+    for (auto& byte : data) {
+        byte = random();
+    }
+    return data;
+}
+
+struct PatchResult {
+    DeltaPatchResult result;
+    Bytes target;
+};
+
+PatchResult applyPatch(const Bytes& source, PatchServer& server) {
+    Bytes target;
+    DeltaPatch patch(
+        [&](size_t offset, uint8_t* buffer, size_t length) {
+            if (offset + length > source.size()) {
+                return false;
+            }
+            std::memcpy(buffer, source.data() + offset, length);
+            return true;
+        },
+        [&](const uint8_t* data, size_t length) {
+            target.insert(target.end(), data, data + length);
+            return true;
+        });
+    auto result = patch.apply([&](uint8_t* buffer, size_t length) {
+        return server.read(buffer, length);
+    });
+    return { result, target };
+}
+
+PatchBuilder typicalUpdate(const Bytes& source) {
+    PatchBuilder builder(source);
+    // Mostly unchanged code with a few patched addresses, some new code, then code that moved around
+    builder
+        .record(20000, { { 100, 0x12 }, { 101, 0x34 }, { 15000, 0xFF } }, firmware(3000, 2), 5000)
+        .record(30000, { { 0, 0 } }, {}, -40000)
+        .record(10000, {}, firmware(500, 3), 0);
+    return builder;
+}
+
+}    // namespace
+
+TEST_CASE("delta patch reproduces the target regardless of how the stream is chunked") {
+    auto source = firmware(64 * 1024, 1);
+    auto builder = typicalUpdate(source);
+    auto patch = builder.build();
+    REQUIRE(patch.size() < builder.target.size() / 10);
+
+    for (size_t maxChunkSize : { 1, 13, 1024, 16 * 1024 }) {
+        PatchServer server(patch, maxChunkSize);
+        auto [result, target] = applyPatch(source, server);
+        REQUIRE(result == DeltaPatchResult::Ok);
+        REQUIRE(target == builder.target);
+    }
+}
+
+TEST_CASE("delta patch deflated by make-delta.py is inflated") {
+    auto source = firmware(8 * 1024, 1);
+    PatchBuilder builder(source);
+    std::string text;
+    for (int i = 0; i < 20; i++) {
+        text += "farmhub ugly duckling ";
+    }
+    builder
+        .record(4000, { { 10, 0xAA }, { 11, 0xBB }, { 3000, 0x01 } }, Bytes(text.begin(), text.end()), 100)
+        .record(2000, {}, {}, 0);
+    // The records above, compressed by make-delta.py's compress()
+    Bytes compressedRecords {
+        0x58, 0xc3, 0x5b, 0xc0, 0xcf, 0xc0, 0xb0, 0x83, 0x91, 0x81, 0x21, 0x85, 0x81, 0x81, 0x41, 0x84,
+        0x55, 0xca, 0xea, 0x86, 0x1e, 0xb3, 0xcc, 0x39, 0xfe, 0xb4, 0xc4, 0xa2, 0xdc, 0x8c, 0xd2, 0x24,
+        0x85, 0xd2, 0xf4, 0x9c, 0x4a, 0x85, 0x94, 0xd2, 0xe4, 0xec, 0x9c, 0xcc, 0xbc, 0x74, 0x85, 0x51,
+        0xd1, 0xc1, 0x2e, 0x7a, 0x81, 0x9d, 0x01, 0x0e, 0x16, 0xc8, 0x03, 0x00, 0xbf, 0x6c, 0xac, 0x9e
+    };
+    auto patch = builder.build(compressedRecords);
+
+    for (size_t maxChunkSize : { 1, 7, 1024 }) {
+        PatchServer server(patch, maxChunkSize);
+        auto [result, target] = applyPatch(source, server);
+        REQUIRE(result == DeltaPatchResult::Ok);
+        REQUIRE(target == builder.target);
+    }
+}
+
+TEST_CASE("delta patch needing a larger window than the device has is corrupt") {
+    auto source = firmware(64 * 1024, 1);
+    auto builder = typicalUpdate(source);
+    auto patch = builder.build(storedZlib(builder.records, 15));
+
+    PatchServer server(patch, 1024);
+    REQUIRE(applyPatch(source, server).result == DeltaPatchResult::CorruptPatch);
+}
+
+TEST_CASE("delta patch for a different source is rejected before writing anything") {
+    auto source = firmware(64 * 1024, 1);
+    auto patch = typicalUpdate(source).build();
+    auto otherSource = source;
+    otherSource[1000] ^= 1;
+
+    PatchServer server(patch, 1024);
+    auto [result, target] = applyPatch(otherSource, server);
+    REQUIRE(result == DeltaPatchResult::SourceMismatch);
+    REQUIRE(target.empty());
+}
+
+TEST_CASE("corrupted delta patch is rejected") {
+    auto source = firmware(64 * 1024, 1);
+    auto patch = typicalUpdate(source).build();
+
+    SECTION("compressed stream") {
+        // Flip a bit in the last extra byte, caught by the checksum of the zlib stream
+        patch[patch.size() - 5] ^= 1;
+        PatchServer server(patch, 1024);
+        REQUIRE(applyPatch(source, server).result == DeltaPatchResult::CorruptPatch);
+    }
+
+    SECTION("data after the end of the stream") {
+        patch.push_back(0);
+        PatchServer server(patch, 1024);
+        REQUIRE(applyPatch(source, server).result == DeltaPatchResult::CorruptPatch);
+    }
+}
+
+TEST_CASE("delta patch not reproducing the target fails target verification") {
+    auto source = firmware(64 * 1024, 1);
+    auto builder = typicalUpdate(source);
+    // Change the last extra byte before compressing, so only the target hash catches it
+    builder.records.back() ^= 1;
+    auto patch = builder.build();
+
+    PatchServer server(patch, 1024);
+    REQUIRE(applyPatch(source, server).result == DeltaPatchResult::TargetMismatch);
+}
+
+TEST_CASE("interrupted delta patch download is incomplete") {
+    auto source = firmware(64 * 1024, 1);
+    auto patch = typicalUpdate(source).build();
+
+    SECTION("connection error") {
+        PatchServer server(patch, 1024);
+        server.failAt = patch.size() / 2;
+        REQUIRE(applyPatch(source, server).result == DeltaPatchResult::Incomplete);
+    }
+
+    SECTION("stream ends early") {
+        patch.resize(patch.size() / 2);
+        PatchServer server(patch, 1024);
+        REQUIRE(applyPatch(source, server).result == DeltaPatchResult::Incomplete);
+    }
+}
+
+TEST_CASE("delta patch reading outside the source is corrupt") {
+    auto source = firmware(1024, 1);
+    PatchBuilder builder(source);
+    builder.record(512, {}, {}, 0);
+    // Seek past the end of the source
+    builder.records[8] = 0x00;
+    builder.records[9] = 0x10;
+    auto patch = builder.build();
+
+    PatchServer server(patch, 1024);
+    REQUIRE(applyPatch(source, server).result == DeltaPatchResult::CorruptPatch);
+}
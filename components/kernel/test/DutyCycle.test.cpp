@@ -0,0 +1,101 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <DutyCycle.hpp>
+
+using namespace farmhub::kernel;
+
+namespace {
+
+struct SimulatedNode {
+    SimulatedNode(milliseconds cycle, milliseconds awakeBudget)
+        : dutyCycle(
+              cycle,
+              awakeBudget,
+              state,
+              [this]() { return clock.awakeFor(); },
+              [this](milliseconds duration) { clock.sleep(duration); }) {
+    }
+
+    /**
+     * @brief Simulate a wake: a cold boot has to look up the broker and sync the clock, a warm one doesn't.
+     */
+    void runCycle(bool wokenByTimer, milliseconds coldWork, milliseconds warmWork) {
+        auto kind = dutyCycle.wake(wokenByTimer);
+        auto work = kind == WakeKind::Cold ? coldWork : warmWork;
+        clock.work(std::min(work, dutyCycle.getRemainingBudget()));
+        dutyCycle.sleep();
+    }
+
+    DutyCycleState state {};
+    VirtualSleepClock clock;
+    DutyCycle dutyCycle;
+};
+
+}    // namespace
+
+TEST_CASE("duty cycle keeps a steady pace regardless of time spent awake") {
+    SimulatedNode node(5min, 30s);
+    node.runCycle(false, 8s, 2s);
+    auto firstWake = node.clock.now;
+    for (int i = 0; i < 287; i++) {
+        node.runCycle(true, 8s, 2s);
+    }
+    // A simulated day of 5 minute cycles
+    REQUIRE(node.clock.now == firstWake + 287 * 5min);
+    REQUIRE(node.state.cycles == 288);
+    REQUIRE(node.state.overruns == 0);
+    REQUIRE(node.state.lastAwakeMs == 2000);
+    REQUIRE(node.state.totalAwakeMs == 8000 + 287 * 2000);
+}
+
+TEST_CASE("duty cycle starts over after a cold boot") {
+    SimulatedNode node(1min, 10s);
+    node.runCycle(false, 5s, 1s);
+    node.runCycle(true, 5s, 1s);
+    REQUIRE(node.dutyCycle.getWakeKind() == WakeKind::Warm);
+    REQUIRE(node.state.cycles == 2);
+
+    // E.g. a reset that left RTC memory intact is still a cold boot
+    node.runCycle(false, 5s, 1s);
+    REQUIRE(node.dutyCycle.getWakeKind() == WakeKind::Cold);
+    REQUIRE(node.state.cycles == 1);
+    REQUIRE(node.state.lastAwakeMs == 5000);
+
+    // Garbage in RTC memory after power loss
+    node.state.magic = 0x12345678;
+    REQUIRE(node.dutyCycle.wake(true) == WakeKind::Cold);
+    REQUIRE(node.state.cycles == 0);
+}
+
+TEST_CASE("duty cycle cuts wakes short at the awake budget") {
+    SimulatedNode node(1min, 20s);
+    node.runCycle(false, 2min, 2min);
+    REQUIRE(node.state.overruns == 1);
+    REQUIRE(node.state.lastAwakeMs == 20000);
+    REQUIRE(node.clock.now == 1min);
+
+    // Even with a budget as long as the cycle we still get some sleep
+    SimulatedNode busy(1min, 5min);
+    busy.runCycle(false, 2min, 2min);
+    REQUIRE(busy.clock.now == 1min + DutyCycle::MIN_SLEEP);
+}
+
+TEST_CASE("duty cycle energy per cycle can be estimated") {
+    DutyCycleEnergy energy { .awakeCurrentMa = 120, .sleepCurrentUa = 20 };
+
+    SimulatedNode node(10min, 30s);
+    node.runCycle(false, 9s, 3s);
+    for (int i = 0; i < 143; i++) {
+        node.runCycle(true, 9s, 3s);
+    }
+
+    // Warm wakes dominate: 3 s at 120 mA plus ~597 s at 20 uA, and one slower cold boot
+    auto perCycle = energy.chargePerCycleMah(node.state);
+    REQUIRE(perCycle > 0.104);
+    REQUIRE(perCycle < 0.105);
+    // About 0.63 mA on average, i.e. ~15 mAh a day
+    auto average = energy.averageCurrentMa(node.state);
+    REQUIRE(average > 0.62);
+    REQUIRE(average < 0.64);
+    REQUIRE(energy.chargeMah(1h, 0ms) == 120);
+}
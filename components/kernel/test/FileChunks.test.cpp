@@ -0,0 +1,235 @@
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <FileChunks.hpp>
+
+using namespace farmhub::kernel;
+
+namespace {
+
+using Bytes = std::vector<uint8_t>;
+
+/**
+ * @brief Stands in for `FileSystem`, with files in a temporary directory on the host.
+ */
+class TempFileSystem {
+public:
+    TempFileSystem() {
+        std::string pattern = (std::filesystem::temp_directory_path() / "chunks-XXXXXX").string();
+        root = mkdtemp(pattern.data());
+    }
+
+    ~TempFileSystem() {
+        std::filesystem::remove_all(root);
+    }
+
+    bool exists(const std::string& path) const {
+        return std::filesystem::exists(resolve(path));
+    }
+
+    FILE* open(const std::string& path, const char* mode) const {
+        return fopen(resolve(path).c_str(), mode);
+    }
+
+    size_t size(const std::string& path) const {
+        std::error_code error;
+        auto size = std::filesystem::file_size(resolve(path), error);
+        return error ? 0 : size;
+    }
+
+    int remove(const std::string& path) const {
+        return ::remove(resolve(path).c_str());
+    }
+
+    bool rename(const std::string& from, const std::string& to) const {
+        return ::rename(resolve(from).c_str(), resolve(to).c_str()) == 0;
+    }
+
+    Bytes contents(const std::string& path) const {
+        Bytes result(size(path));
+        FILE* file = open(path, "r");
+        REQUIRE(file != nullptr);
+        REQUIRE(fread(result.data(), 1, result.size(), file) == result.size());
+        fclose(file);
+        return result;
+    }
+
+private:
+    std::string resolve(const std::string& path) const {
+        return root + path;
+    }
+
+    std::string root;
+};
+
+using Transfer = FileChunkTransfer<TempFileSystem>;
+
+Bytes randomBytes(size_t size) {
+    std::mt19937 random(42);
+    Bytes bytes(size);
+    for (auto& byte : bytes) {
+        byte = random();
+    }
+    return bytes;
+}
+
+Bytes chunkAt(const Bytes& file, size_t index) {
+    auto begin = file.begin() + std::min(file.size(), index * Transfer::MAX_CHUNK_SIZE);
+    auto end = file.begin() + std::min(file.size(), (index + 1) * Transfer::MAX_CHUNK_SIZE);
+    return { begin, end };
+}
+
+/**
+ * @brief What the sender would put in the `sha256` field.
+ */
+std::string sha256Of(const std::shared_ptr<TempFileSystem>& fs, const Bytes& data) {
+    FILE* file = fs->open("/reference", "w");
+    fwrite(data.data(), 1, data.size(), file);
+    fclose(file);
+    auto hash = Transfer(fs).hash("/reference");
+    fs->remove("/reference");
+    return hash.value();
+}
+
+}    // namespace
+
+TEST_CASE("file is put back together from chunks") {
+    auto fs = std::make_shared<TempFileSystem>();
+    Transfer transfer(fs);
+    auto file = randomBytes(2500);
+    auto sha256 = sha256Of(fs, file);
+
+    size_t chunkCount = 3;
+    for (size_t i = 0; i < chunkCount; i++) {
+        auto chunk = chunkAt(file, i);
+        bool last = i == chunkCount - 1;
+        auto result = transfer.write("/config.json", i * Transfer::MAX_CHUNK_SIZE, chunk, Transfer::crc32(chunk), last, last ? sha256 : "");
+        REQUIRE(result.isAccepted());
+        CHECK(result.expectedOffset == std::min(file.size(), (i + 1) * Transfer::MAX_CHUNK_SIZE));
+        // The target only appears once the whole file has arrived
+        CHECK(fs->exists("/config.json") == last);
+        CHECK(result.sha256.has_value() == last);
+    }
+    CHECK(fs->contents("/config.json") == file);
+    CHECK(!fs->exists("/config.json.part"));
+
+    // Reading it back in chunks gives the same file
+    Bytes received;
+    for (bool eof = false; !eof;) {
+        auto chunk = transfer.read("/config.json", received.size(), Transfer::MAX_CHUNK_SIZE);
+        REQUIRE(chunk.has_value());
+        CHECK(chunk->fileSize == file.size());
+        CHECK(chunk->crc == Transfer::crc32(chunk->data));
+        received.insert(received.end(), chunk->data.begin(), chunk->data.end());
+        eof = chunk->eof;
+    }
+    CHECK(received == file);
+    CHECK(transfer.hash("/config.json") == sha256);
+}
+
+TEST_CASE("chunks out of order are rejected until resent in order") {
+    auto fs = std::make_shared<TempFileSystem>();
+    Transfer transfer(fs);
+    auto file = randomBytes(3000);
+    auto sha256 = sha256Of(fs, file);
+
+    REQUIRE(transfer.write("/file", 0, chunkAt(file, 0), std::nullopt, false, "").isAccepted());
+
+    // The second chunk got lost, the third one arrives
+    auto skipped = transfer.write("/file", 2048, chunkAt(file, 2), std::nullopt, true, sha256);
+    CHECK(skipped.error == "Unexpected offset");
+    CHECK(skipped.expectedOffset == 1024);
+    CHECK(!fs->exists("/file"));
+    CHECK(fs->size("/file.part") == 1024);
+
+    REQUIRE(transfer.write("/file", 1024, chunkAt(file, 1), std::nullopt, false, "").isAccepted());
+
+    // The response to the second chunk got lost, so it is sent again
+    auto repeated = transfer.write("/file", 1024, chunkAt(file, 1), std::nullopt, false, "");
+    CHECK(repeated.error == "Unexpected offset");
+    CHECK(repeated.expectedOffset == 2048);
+    CHECK(fs->size("/file.part") == 2048);
+
+    REQUIRE(transfer.write("/file", 2048, chunkAt(file, 2), std::nullopt, true, sha256).isAccepted());
+    CHECK(fs->contents("/file") == file);
+}
+
+TEST_CASE("bad chunks are rejected") {
+    auto fs = std::make_shared<TempFileSystem>();
+    Transfer transfer(fs);
+    auto file = randomBytes(2048);
+    auto sha256 = sha256Of(fs, file);
+
+    SECTION("offset past the end of the upload") {
+        auto result = transfer.write("/file", 1024, chunkAt(file, 1), std::nullopt, false, "");
+        CHECK(result.error == "Unexpected offset");
+        CHECK(result.expectedOffset == 0);
+        CHECK(!fs->exists("/file.part"));
+    }
+
+    SECTION("chunk with the wrong CRC") {
+        REQUIRE(transfer.write("/file", 0, chunkAt(file, 0), std::nullopt, false, "").isAccepted());
+        auto corrupted = chunkAt(file, 1);
+        auto crc = Transfer::crc32(corrupted);
+        corrupted[100] ^= 0x01;
+        auto result = transfer.write("/file", 1024, corrupted, crc, true, sha256);
+        CHECK(result.error == "CRC mismatch");
+        CHECK(result.expectedOffset == 1024);
+        CHECK(fs->size("/file.part") == 1024);
+    }
+
+    SECTION("chunk too large") {
+        Bytes chunk(Transfer::MAX_CHUNK_SIZE + 1);
+        auto result = transfer.write("/file", 0, chunk, std::nullopt, false, "");
+        CHECK(result.error == "Chunk too large");
+        CHECK(!fs->exists("/file.part"));
+    }
+
+    SECTION("whole file with the wrong hash") {
+        auto previous = randomBytes(10);
+        FILE* target = fs->open("/file", "w");
+        fwrite(previous.data(), 1, previous.size(), target);
+        fclose(target);
+
+        REQUIRE(transfer.write("/file", 0, chunkAt(file, 0), std::nullopt, false, "").isAccepted());
+        auto result = transfer.write("/file", 1024, chunkAt(file, 1), std::nullopt, true, sha256Of(fs, previous));
+        CHECK(result.error == "Hash mismatch");
+        CHECK(result.expectedOffset == 0);
+        CHECK(!fs->exists("/file.part"));
+        // The file being replaced is left alone
+        CHECK(fs->contents("/file") == previous);
+    }
+
+    SECTION("offset zero starts over") {
+        REQUIRE(transfer.write("/file", 0, chunkAt(file, 1), std::nullopt, false, "").isAccepted());
+        REQUIRE(transfer.write("/file", 0, chunkAt(file, 0), std::nullopt, false, "").isAccepted());
+        REQUIRE(transfer.write("/file", 1024, chunkAt(file, 1), std::nullopt, true, sha256).isAccepted());
+        CHECK(fs->contents("/file") == file);
+    }
+}
+
+TEST_CASE("reading past the end of a file gives an empty last chunk") {
+    auto fs = std::make_shared<TempFileSystem>();
+    Transfer transfer(fs);
+    auto file = randomBytes(100);
+    FILE* target = fs->open("/file", "w");
+    fwrite(file.data(), 1, file.size(), target);
+    fclose(target);
+
+    auto chunk = transfer.read("/file", 200, Transfer::MAX_CHUNK_SIZE);
+    REQUIRE(chunk.has_value());
+    CHECK(chunk->data.empty());
+    CHECK(chunk->eof);
+
+    // Never more than a chunk at a time
+    CHECK(transfer.read("/file", 0, 10 * Transfer::MAX_CHUNK_SIZE)->data.size() == 100);
+
+    CHECK(!transfer.read("/missing", 0, Transfer::MAX_CHUNK_SIZE).has_value());
+    CHECK(!transfer.hash("/missing").has_value());
+}
@@ -0,0 +1,203 @@
+#if __has_include(<lfs.h>)
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+
+#include <lfs.h>
+
+#include <AtomicFile.hpp>
+
+using namespace farmhub::kernel;
+
+namespace {
+
+/**
+ * @brief LittleFS on a RAM block device with the geometry of our data partition.
+ */
+class RamLittleFs {
+public:
+    RamLittleFs()
+        : storage(BLOCK_SIZE * BLOCK_COUNT, 0xFF) {
+        config.context = this;
+        config.read = [](const lfs_config* c, lfs_block_t block, lfs_off_t off, void* buffer, lfs_size_t size) {
+            std::memcpy(buffer, self(c).at(block, off), size);
+            return 0;
+        };
+        config.prog = [](const lfs_config* c, lfs_block_t block, lfs_off_t off, const void* buffer, lfs_size_t size) {
+            std::memcpy(self(c).at(block, off), buffer, size);
+            return 0;
+        };
+        config.erase = [](const lfs_config* c, lfs_block_t block) {
+            std::memset(self(c).at(block, 0), 0xFF, BLOCK_SIZE);
+            return 0;
+        };
+        config.sync = [](const lfs_config*) {
+            return 0;
+        };
+        config.read_size = 16;
+        config.prog_size = 16;
+        config.block_size = BLOCK_SIZE;
+        config.block_count = BLOCK_COUNT;
+        config.block_cycles = 512;
+        config.cache_size = 256;
+        config.lookahead_size = 16;
+
+        REQUIRE(lfs_format(&lfs, &config) == 0);
+        REQUIRE(lfs_mount(&lfs, &config) == 0);
+    }
+
+    ~RamLittleFs() {
+        lfs_unmount(&lfs);
+    }
+
+    void write(const char* path, const std::string& contents) {
+        lfs_file_t file;
+        REQUIRE(lfs_file_open(&lfs, &file, path, LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC) == 0);
+        REQUIRE(lfs_file_write(&lfs, &file, contents.data(), contents.size()) == static_cast<lfs_ssize_t>(contents.size()));
+        REQUIRE(lfs_file_close(&lfs, &file) == 0);
+    }
+
+    std::string read(const char* path, size_t size) {
+        std::string contents(size, '\0');
+        lfs_file_t file;
+        REQUIRE(lfs_file_open(&lfs, &file, path, LFS_O_RDONLY) == 0);
+        REQUIRE(lfs_file_read(&lfs, &file, contents.data(), size) == static_cast<lfs_ssize_t>(size));
+        REQUIRE(lfs_file_close(&lfs, &file) == 0);
+        return contents;
+    }
+
+    void rename(const char* from, const char* to) {
+        REQUIRE(lfs_rename(&lfs, from, to) == 0);
+    }
+
+    void mkdir(const char* path) {
+        REQUIRE(lfs_mkdir(&lfs, path) == 0);
+    }
+
+    bool exists(const char* path) {
+        lfs_info info;
+        return lfs_stat(&lfs, path, &info) == 0;
+    }
+
+private:
+    friend class RamFileSystem;
+
+    static RamLittleFs& self(const lfs_config* c) {
+        return *static_cast<RamLittleFs*>(c->context);
+    }
+
+    uint8_t* at(lfs_block_t block, lfs_off_t off) {
+        return storage.data() + block * BLOCK_SIZE + off;
+    }
+
+    // 96 kB, same as the data partition
+    static constexpr lfs_size_t BLOCK_SIZE = 4096;
+    static constexpr lfs_size_t BLOCK_COUNT = 24;
+
+    std::vector<uint8_t> storage;
+    lfs_config config {};
+    lfs_t lfs;
+};
+
+/**
+ * @brief Stands in for `FileSystem` mounted as LittleFS, with the same file operations.
+ */
+class RamFileSystem {
+public:
+    explicit RamFileSystem(RamLittleFs& fs)
+        : lfs(&fs.lfs) {
+    }
+
+    size_t write(const std::string& path, const char* buffer, size_t size) {
+        lfs_file_t file;
+        if (lfs_file_open(lfs, &file, path.c_str(), LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC) != 0) {
+            return 0;
+        }
+        lfs_ssize_t written = lfs_file_write(lfs, &file, buffer, size);
+        // Data still in the cache is only written when closing
+        if (lfs_file_close(lfs, &file) != 0 || written < 0) {
+            return 0;
+        }
+        return written;
+    }
+
+    int remove(const std::string& path) {
+        return lfs_remove(lfs, path.c_str());
+    }
+
+    bool rename(const std::string& from, const std::string& to) {
+        return lfs_rename(lfs, from.c_str(), to.c_str()) == 0;
+    }
+
+    bool makeDirectory(const std::string& path) {
+        int err = lfs_mkdir(lfs, path.c_str());
+        return err == 0 || err == LFS_ERR_EXIST;
+    }
+
+private:
+    lfs_t* lfs;
+};
+
+}    // namespace
+
+TEST_CASE("LittleFS write-then-rename replaces contents") {
+    RamLittleFs fs;
+    fs.mkdir("p");
+    fs.write("p/valve.json", "old");
+    fs.write("p/valve.json.tmp", "new");
+    fs.rename("p/valve.json.tmp", "p/valve.json");
+    REQUIRE(fs.read("p/valve.json", 3) == "new");
+}
+
+TEST_CASE("writeAtomically creates parent directories and replaces contents") {
+    RamLittleFs lfs;
+    RamFileSystem fs(lfs);
+    REQUIRE(writeAtomically(fs, "/p/valve/config.json", "old") == 3);
+    REQUIRE(lfs.read("/p/valve/config.json", 3) == "old");
+
+    REQUIRE(writeAtomically(fs, "/p/valve/config.json", "new") == 3);
+    CHECK(lfs.read("/p/valve/config.json", 3) == "new");
+    CHECK(!lfs.exists("/p/valve/config.json.tmp"));
+}
+
+TEST_CASE("writeAtomically keeps the old contents when the new ones don't fit") {
+    RamLittleFs lfs;
+    RamFileSystem fs(lfs);
+    // Takes up more than half of the partition, so there is no room for a second copy
+    std::string old(60 * 1024, 'o');
+    REQUIRE(writeAtomically(fs, "/config.json", old) == old.size());
+
+    CHECK(writeAtomically(fs, "/config.json", std::string(old.size(), 'n')) == 0);
+    CHECK(lfs.read("/config.json", old.size()) == old);
+    CHECK(!lfs.exists("/config.json.tmp"));
+
+    // The space taken up by the failed attempt is freed
+    CHECK(writeAtomically(fs, "/small.json", "{}") == 2);
+}
+
+TEST_CASE("LittleFS latency on RAM block device", "[!benchmark]") {
+    RamLittleFs fs;
+    fs.mkdir("p");
+    // About the size of a typical device config
+    std::string config(1024, 'x');
+    fs.write("p/config.json", config);
+
+    BENCHMARK("write 1 kB") {
+        fs.write("p/config.json", config);
+    };
+
+    BENCHMARK("read 1 kB") {
+        return fs.read("p/config.json", config.size());
+    };
+
+    BENCHMARK("atomic write 1 kB (write and rename)") {
+        fs.write("p/config.json.tmp", config);
+        fs.rename("p/config.json.tmp", "p/config.json");
+    };
+}
+
+#endif
@@ -0,0 +1,241 @@
+#include <map>
+#include <memory>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <FileSystemMigration.hpp>
+
+using namespace farmhub::kernel;
+
+namespace {
+
+struct PowerCut { };
+
+/**
+ * @brief Cuts the power after a given number of writes to flash.
+ */
+class Power {
+public:
+    explicit Power(int writesLeft = -1)
+        : writesLeft(writesLeft) {
+    }
+
+    void write() {
+        if (writesLeft == 0) {
+            throw PowerCut();
+        }
+        if (writesLeft > 0) {
+            writesLeft--;
+        }
+    }
+
+private:
+    int writesLeft;
+};
+
+using Files = std::map<std::string, std::string>;
+
+/**
+ * @brief The data partition, holding either SPIFFS or LittleFS; formatting erases it first.
+ */
+struct Partition {
+    enum class Format {
+        Spiffs,
+        LittleFs,
+        Erased,
+    };
+
+    Format format = Format::Spiffs;
+    Files files;
+};
+
+class MemoryStaging : public MigrationStaging {
+public:
+    MemoryStaging(Power& power, size_t capacity = SIZE_MAX)
+        : power(power)
+        , capacity(capacity) {
+    }
+
+    std::optional<size_t> getCompleted() override {
+        return completed;
+    }
+
+    bool stage(size_t index, const MigratedFile& file) override {
+        if (files.size() >= capacity) {
+            return false;
+        }
+        power.write();
+        files[index] = file;
+        return true;
+    }
+
+    std::optional<MigratedFile> load(size_t index) override {
+        auto it = files.find(index);
+        if (it == files.end()) {
+            return std::nullopt;
+        }
+        return it->second;
+    }
+
+    bool complete(size_t count) override {
+        power.write();
+        completed = count;
+        return true;
+    }
+
+    bool markMigrated() override {
+        if (failMarking) {
+            return false;
+        }
+        power.write();
+        completed.reset();
+        return true;
+    }
+
+    bool clear() override {
+        // Only fails when there is something to clear
+        if (failClearing && !files.empty()) {
+            return false;
+        }
+        power.write();
+        completed.reset();
+        power.write();
+        files.clear();
+        return true;
+    }
+
+    bool failMarking = false;
+    bool failClearing = false;
+    Power& power;
+    const size_t capacity;
+    std::map<size_t, MigratedFile> files;
+    std::optional<size_t> completed;
+};
+
+MigrationResult boot(Partition& partition, MigrationStaging& staging, Power& power) {
+    FileSystemMigration migration(
+        std::shared_ptr<MigrationStaging>(&staging, [](MigrationStaging*) { }),
+        [&]() {
+            return partition.format == Partition::Format::LittleFs;
+        },
+        [&]() {
+            power.write();
+            partition.format = Partition::Format::Erased;
+            partition.files.clear();
+            power.write();
+            partition.format = Partition::Format::LittleFs;
+            return true;
+        },
+        [&]() -> std::optional<std::list<MigratedFile>> {
+            if (partition.format != Partition::Format::Spiffs) {
+                return std::nullopt;
+            }
+            std::list<MigratedFile> files;
+            for (const auto& [path, contents] : partition.files) {
+                files.push_back({ path, contents });
+            }
+            return files;
+        },
+        [&](const MigratedFile& file) {
+            // Written atomically, like FileSystem::writeAll() does on LittleFS
+            power.write();
+            partition.files[file.path] = file.contents;
+            return true;
+        });
+    return migration.run();
+}
+
+const Files CONFIG {
+    { "/device-config.json", R"({"instance":"greenhouse"})" },
+    { "/mqtt-config.json", R"({"host":"broker.local"})" },
+    { "/p/valve.json", R"({"strategy":"latching"})" },
+    { "/empty", "" },
+};
+
+}    // namespace
+
+TEST_CASE("migration survives losing power at any point") {
+    for (int writes = 0;; writes++) {
+        INFO("Power lost after " << writes << " writes");
+        Partition partition { Partition::Format::Spiffs, CONFIG };
+        Power power(writes);
+        MemoryStaging staging(power);
+
+        bool powerLost = false;
+        try {
+            auto result = boot(partition, staging, power);
+            REQUIRE(result == MigrationResult::Mounted);
+        } catch (const PowerCut&) {
+            powerLost = true;
+        }
+
+        // Power stays on from the next boot on
+        power = Power();
+        if (powerLost) {
+            REQUIRE(boot(partition, staging, power) == MigrationResult::Mounted);
+        }
+        CHECK(partition.format == Partition::Format::LittleFs);
+        CHECK(partition.files == CONFIG);
+        // Staged files might be left over, but they don't count without the marker
+        CHECK(!staging.getCompleted().has_value());
+
+        // Later boots leave the migrated files alone
+        partition.files["/device-config.json"] = R"({"instance":"changed"})";
+        REQUIRE(boot(partition, staging, power) == MigrationResult::Mounted);
+        CHECK(partition.files["/device-config.json"] == R"({"instance":"changed"})");
+
+        if (!powerLost) {
+            break;
+        }
+    }
+}
+
+TEST_CASE("files changed after a migration are not overwritten when staging can't be cleared") {
+    Partition partition { Partition::Format::Spiffs, CONFIG };
+    Power power;
+    MemoryStaging staging(power);
+    staging.failClearing = true;
+
+    REQUIRE(boot(partition, staging, power) == MigrationResult::Mounted);
+    CHECK(partition.files == CONFIG);
+    CHECK(!staging.files.empty());
+
+    partition.files["/device-config.json"] = R"({"instance":"changed"})";
+    REQUIRE(boot(partition, staging, power) == MigrationResult::Mounted);
+    CHECK(partition.files["/device-config.json"] == R"({"instance":"changed"})");
+}
+
+TEST_CASE("staged files are kept when the migration can't be marked done") {
+    Partition partition { Partition::Format::Spiffs, CONFIG };
+    Power power;
+    MemoryStaging staging(power);
+    staging.failMarking = true;
+
+    CHECK(boot(partition, staging, power) == MigrationResult::Mounted);
+    CHECK(partition.files == CONFIG);
+    // Nothing is cleared while the migration still counts as staged
+    CHECK(staging.getCompleted() == CONFIG.size());
+    CHECK(staging.files.size() == CONFIG.size());
+}
+
+TEST_CASE("old file system is kept when its files can't be staged") {
+    Partition partition { Partition::Format::Spiffs, CONFIG };
+    Power power;
+    MemoryStaging staging(power, 2);
+
+    CHECK(boot(partition, staging, power) == MigrationResult::KeptOld);
+    CHECK(partition.format == Partition::Format::Spiffs);
+    CHECK(partition.files == CONFIG);
+    CHECK(!staging.getCompleted().has_value());
+    CHECK(staging.files.empty());
+}
+
+TEST_CASE("partition without a file system is formatted") {
+    Partition partition { Partition::Format::Erased, {} };
+    Power power;
+    MemoryStaging staging(power);
+
+    CHECK(boot(partition, staging, power) == MigrationResult::Mounted);
+    CHECK(partition.format == Partition::Format::LittleFs);
+    CHECK(partition.files.empty());
+}
@@ -0,0 +1,119 @@
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <ArduinoJson.h>
+
+#include <JsonArena.hpp>
+#include <Log.hpp>
+
+using namespace farmhub::kernel;
+
+namespace {
+
+/**
+ * @brief Allocates from the heap like a plain `JsonDocument` does, counting the calls.
+ */
+class CountingHeapAllocator : public ArduinoJson::Allocator {
+public:
+    void* allocate(size_t size) override {
+        calls++;
+        return std::malloc(size);
+    }
+
+    void deallocate(void* ptr) override {
+        std::free(ptr);
+    }
+
+    void* reallocate(void* ptr, size_t newSize) override {
+        calls++;
+        return std::realloc(ptr, newSize);
+    }
+
+    uint32_t calls = 0;
+};
+
+/**
+ * @brief The documents published in one telemetry cycle by a device with a valve, a flow meter and an environment sensor.
+ *
+ * Shaped like what the telemetry providers and peripherals populate. Names that aren't string literals,
+ * like those of tasks and scheduler jobs, are copied into the document just like on the device.
+ */
+const std::vector<std::function<void(JsonObject)>> TELEMETRY_CYCLE {
+    [](JsonObject json) {
+        json["uptime"] = 3600000;
+        json["battery"].to<JsonObject>()["voltage"] = 3.92;
+        json["wifi"].to<JsonObject>()["uptime"] = 3540000;
+        auto memory = json["memory"].to<JsonObject>();
+        memory["free-heap"] = 143212;
+        memory["min-heap"] = 121880;
+        memory["largest-heap-block"] = 110592;
+        memory["heap-fragmentation"] = 0.23;
+        memory["json-allocs"] = 42;
+        memory["json-heap-allocs"] = 0;
+        memory["json-arena-peak"] = 1024;
+        auto tasks = json["tasks"].to<JsonObject>();
+        for (std::string name : { "main", "telemetry", "mqtt", "mqtt:incoming-handler", "logs", "ntp-sync", "status", "scheduler", "nvs-flush", "valve" }) {
+            auto task = tasks[name].to<JsonObject>();
+            task["stack"] = 4096;
+            task["stack-free"] = 1800;
+            task["cpu"] = 0.4;
+        }
+        auto pm = json["pm"].to<JsonObject>();
+        pm["wakes"] = 720;
+        auto sources = pm["wake-sources"].to<JsonObject>();
+        for (std::string name : { "battery", "console", "flow-meter", "peripherals:clock" }) {
+            auto source = sources[name].to<JsonObject>();
+            source["wakes"] = 180;
+            source["runs"] = 720;
+        }
+    },
+    [](JsonObject json) {
+        json["state"] = 1;
+        json["overrideEnd"] = std::string("2026-10-18T12:00:00Z");
+        json["overrideState"] = 1;
+    },
+    [](JsonObject json) {
+        json["volume"] = 1523.5;
+        json["flowRate"] = 12.4;
+    },
+    [](JsonObject json) {
+        json["temperature"] = 21.3;
+        json["humidity"] = 64.2;
+    },
+};
+
+}    // namespace
+
+TEST_CASE("JSON arenas take telemetry documents off the heap") {
+    CountingHeapAllocator heap;
+    for (const auto& populate : TELEMETRY_CYCLE) {
+        JsonDocument doc(&heap);
+        populate(doc.to<JsonObject>());
+        std::string payload;
+        serializeJson(doc, payload);
+    }
+
+    const auto& stats = JsonArena::getStats();
+    uint32_t requestsBefore = stats.requests;
+    uint32_t heapAllocationsBefore = stats.heapAllocations;
+    for (const auto& populate : TELEMETRY_CYCLE) {
+        JsonArena arena;
+        JsonDocument doc(arena.allocator());
+        populate(doc.to<JsonObject>());
+        std::string payload;
+        serializeJson(doc, payload);
+    }
+    uint32_t requests = stats.requests - requestsBefore;
+    uint32_t heapAllocations = stats.heapAllocations - heapAllocationsBefore;
+
+    LOGI("Heap allocations per telemetry cycle: %u with plain documents, %u with arenas (%u requests, arena peak %u of %u bytes)",
+        heap.calls, heapAllocations, requests, JsonArena::getHighWater(), JsonArena::ARENA_SIZE);
+    // Documents ask for the same memory either way, only where it comes from changes
+    CHECK(requests == heap.calls);
+    CHECK(heap.calls > 0);
+    CHECK(heapAllocations == 0);
+}
@@ -0,0 +1,51 @@
+#include <cstring>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <Arena.hpp>
+#include <Memory.hpp>
+
+using namespace farmhub::kernel;
+
+TEST_CASE("tagged allocations are accounted until freed") {
+    MemoryTag& tag = MemoryTag::get("test/accounting");
+    REQUIRE(&MemoryTag::get("test/accounting") == &tag);
+
+    auto block = static_cast<char*>(Memory::allocate(100, MemoryPlacement::Large, tag));
+    std::strcpy(block, "payload");
+    REQUIRE(tag.getLiveBytes() == 100);
+
+    // Resizing keeps the original tag and contents
+    block = static_cast<char*>(Memory::reallocate(block, 300, MemoryPlacement::Large));
+    REQUIRE(std::strcmp(block, "payload") == 0);
+    REQUIRE(tag.getLiveBytes() == 300);
+
+    {
+        LargeString text(200, 'x', LargeAllocator<char>(tag));
+        REQUIRE(tag.getLiveBytes() > 500);
+    }
+    Memory::free(block);
+    REQUIRE(tag.getLiveBytes() == 0);
+    REQUIRE(tag.getPeakBytes() > 500);
+    REQUIRE(tag.getAllocations() == tag.getFrees());
+}
+
+TEST_CASE("arena overflow is accounted to the lease's tag") {
+    MemoryTag& tag = MemoryTag::get("test/arena");
+    ArenaPool pool(1, 64);
+    {
+        auto lease = pool.acquire(tag);
+        lease.get().allocate(16);
+        REQUIRE(tag.getAllocations() == 0);
+        auto large = lease.get().allocate(128);
+        REQUIRE(tag.getLiveBytes() == 128);
+        lease.get().deallocate(large);
+    }
+    REQUIRE(tag.getLiveBytes() == 0);
+
+    bool found = false;
+    MemoryTag::forEach([&](const MemoryTag& each) {
+        found |= &each == &tag;
+    });
+    REQUIRE(found);
+}
@@ -0,0 +1,149 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/matchers/catch_matchers_floating_point.hpp>
+
+#include <chrono>
+#include <optional>
+#include <vector>
+
+#include <drivers/MotorDriver.hpp>
+
+using namespace std::chrono;
+using namespace std::chrono_literals;
+using namespace farmhub::kernel::drivers;
+
+namespace farmhub::kernel::drivers {
+
+/**
+ * @brief Simple current model of a small DC motor driving a mechanism against an end-stop.
+ *
+ * Draws a decaying inrush current after starting, then the running current, and the stall current
+ * once the mechanism reaches the end-stop.
+ */
+struct CurrentModel {
+    double inrush = 3.0;
+    milliseconds inrushDecay = 60ms;
+    double running = 1.0;
+    double stall = 2.6;
+    std::optional<milliseconds> endStopAt = std::nullopt;
+
+    double at(milliseconds time) const {
+        if (endStopAt.has_value() && time >= *endStopAt) {
+            return stall;
+        }
+        if (time < inrushDecay) {
+            return running + (inrush - running) * (1.0 - static_cast<double>(time.count()) / inrushDecay.count());
+        }
+        // A little ripple from the commutator
+        return running + ((time.count() / 10) % 2 == 0 ? 0.05 : -0.05);
+    }
+};
+
+class FakeMotorDriver : public PwmMotorDriver {
+public:
+    FakeMotorDriver(CurrentModel model, bool canSense = true)
+        : model(model)
+        , canSense(canSense) {
+    }
+
+    void drive(MotorPhase phase, double duty = 1) override {
+        this->phase = phase;
+        this->duty = duty;
+    }
+
+    void ramp(MotorPhase phase, double duty, milliseconds rampTime) override {
+        drive(phase, duty);
+        this->rampTime = rampTime;
+    }
+
+    std::optional<double> readCurrent() override {
+        if (!canSense) {
+            return std::nullopt;
+        }
+        samples++;
+        return duty == 0 ? 0 : model.at(now);
+    }
+
+    void delay(milliseconds time) {
+        delays.push_back(time);
+        now += time;
+    }
+
+    const CurrentModel model;
+    const bool canSense;
+
+    milliseconds now = 0ms;
+    std::vector<milliseconds> delays;
+    int samples = 0;
+    MotorPhase phase = MotorPhase::FORWARD;
+    double duty = 0;
+    std::optional<milliseconds> rampTime;
+};
+
+MotorSwitchResult runSwitch(FakeMotorDriver& motor, const MotorDriveProfile& profile) {
+    return switchMotor(motor, MotorPhase::REVERSE, profile, [&](milliseconds time) {
+        motor.delay(time);
+    });
+}
+
+TEST_CASE("without stall detection the motor runs for the full switch duration") {
+    FakeMotorDriver motor({ .endStopAt = 200ms });
+    auto result = runSwitch(motor, { .switchDuration = 500ms, .switchDuty = 0.8, .rampTime = 50ms });
+
+    CHECK(result.outcome == MotorSwitchOutcome::Completed);
+    CHECK(result.elapsed == 500ms);
+    CHECK(motor.delays == std::vector<milliseconds> { 500ms });
+    CHECK(motor.samples == 0);
+    CHECK(motor.phase == MotorPhase::REVERSE);
+    CHECK(motor.duty == 0.8);
+    CHECK(motor.rampTime == 50ms);
+}
+
+TEST_CASE("switch phase ends early when the mechanism hits the end-stop") {
+    FakeMotorDriver motor({ .endStopAt = 300ms });
+    auto result = runSwitch(motor, { .switchDuration = 1000ms, .stallRatio = 2.0 });
+
+    CHECK(result.outcome == MotorSwitchOutcome::Stalled);
+    // Three samples in a row above the threshold confirm the stall
+    CHECK(result.elapsed == 320ms);
+    CHECK(motor.now == 320ms);
+    REQUIRE(result.runningCurrent.has_value());
+    CHECK_THAT(*result.runningCurrent, Catch::Matchers::WithinAbs(1.0, 0.05));
+    REQUIRE(result.peakCurrent.has_value());
+    CHECK_THAT(*result.peakCurrent, Catch::Matchers::WithinAbs(2.67, 0.01));
+    // The motor is left running for the caller to stop or hold
+    CHECK(motor.duty == 1.0);
+}
+
+TEST_CASE("inrush current does not count as a stall") {
+    // Inrush is well above the stall threshold, but it's over before blanking ends
+    FakeMotorDriver motor({ .inrush = 4.0, .inrushDecay = 90ms });
+    auto result = runSwitch(motor, { .switchDuration = 500ms, .stallRatio = 2.0 });
+
+    CHECK(result.outcome == MotorSwitchOutcome::Completed);
+    CHECK(result.elapsed == 500ms);
+    CHECK(motor.samples == 50);
+}
+
+TEST_CASE("blanking includes the ramp") {
+    // Slow ramp: the inrush shows up late, at the end of the ramp
+    CurrentModel model { .inrushDecay = 250ms };
+    FakeMotorDriver motor(model);
+    auto result = runSwitch(motor, { .switchDuration = 600ms, .rampTime = 200ms, .stallRatio = 2.0 });
+
+    CHECK(result.outcome == MotorSwitchOutcome::Completed);
+    REQUIRE(result.runningCurrent.has_value());
+    CHECK_THAT(*result.runningCurrent, Catch::Matchers::WithinAbs(1.0, 0.1));
+}
+
+TEST_CASE("drivers without current sense wait for the full switch duration") {
+    FakeMotorDriver motor({ .endStopAt = 100ms }, false);
+    auto result = runSwitch(motor, { .switchDuration = 500ms, .stallRatio = 2.0, .sampleInterval = 20ms });
+
+    CHECK(result.outcome == MotorSwitchOutcome::Completed);
+    CHECK(result.elapsed == 500ms);
+    // One sample to find out there's no current sense, then the rest in one go
+    CHECK(motor.delays == std::vector<milliseconds> { 20ms, 480ms });
+    CHECK(!result.peakCurrent.has_value());
+}
+
+}    // namespace farmhub::kernel::drivers
@@ -0,0 +1,289 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <chrono>
+#include <list>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <mqtt/MqttSession.hpp>
+
+using namespace std::chrono;
+using namespace std::chrono_literals;
+
+namespace farmhub::kernel::mqtt {
+
+namespace {
+
+/**
+ * @brief Behaves like mosquitto with `persistence false`: sessions of clients connecting without
+ * a clean session are kept until the broker restarts, and QoS 1 messages are queued for them while
+ * they are away.
+ */
+class ScriptedBroker {
+public:
+    struct ConnAck {
+        bool sessionPresent;
+        std::vector<std::string> queuedMessages;
+    };
+
+    ConnAck connect(const std::string& clientId, bool cleanSession) {
+        if (cleanSession) {
+            sessions.erase(clientId);
+        }
+        bool sessionPresent = sessions.contains(clientId);
+        auto& session = sessions[clientId];
+        session.cleanSession = cleanSession;
+        session.online = true;
+        auto queued = std::move(session.queued);
+        session.queued.clear();
+        return { sessionPresent, queued };
+    }
+
+    void disconnect(const std::string& clientId) {
+        auto& session = sessions.at(clientId);
+        session.online = false;
+        if (session.cleanSession) {
+            sessions.erase(clientId);
+        }
+    }
+
+    void restart() {
+        sessions.clear();
+    }
+
+    /**
+     * @brief Returns the SUBACK return codes.
+     */
+    std::vector<uint8_t> subscribe(const std::string& clientId, const std::list<std::string>& topics) {
+        std::vector<uint8_t> returnCodes;
+        for (const auto& topic : topics) {
+            if (deniedTopics.contains(topic)) {
+                returnCodes.push_back(0x80);
+            } else {
+                sessions.at(clientId).topics.insert(topic);
+                returnCodes.push_back(0x01);
+            }
+        }
+        return returnCodes;
+    }
+
+    void publishQos1(const std::string& topic) {
+        for (auto& [clientId, session] : sessions) {
+            if (!session.online && session.topics.contains(topic)) {
+                session.queued.push_back(topic);
+            }
+        }
+    }
+
+    std::set<std::string> deniedTopics;
+
+private:
+    struct Session {
+        bool cleanSession;
+        bool online;
+        std::set<std::string> topics;
+        std::vector<std::string> queued;
+    };
+
+    std::map<std::string, Session> sessions;
+};
+
+/**
+ * @brief Drives `MqttSession` the way `MqttDriver` does, recording the packets it sends.
+ */
+class ScriptedClient {
+public:
+    ScriptedClient(ScriptedBroker& broker, std::list<std::string> topics)
+        : broker(broker)
+        , topics(topics) {
+    }
+
+    /**
+     * @brief Connect and subscribe to whatever needs it; SUBACKs are held back until `receiveSubAcks()`.
+     */
+    void connect() {
+        sent.push_back("CONNECT");
+        auto connAck = broker.connect(CLIENT_ID, false);
+        received.insert(received.end(), connAck.queuedMessages.begin(), connAck.queuedMessages.end());
+        session.connected(connAck.sessionPresent);
+        subscribeUnconfirmed();
+    }
+
+    void subscribeUnconfirmed() {
+        std::list<std::string> batch;
+        for (const auto& topic : topics) {
+            if (session.needsSubscribing(topic)) {
+                batch.push_back(topic);
+            }
+        }
+        if (batch.empty()) {
+            return;
+        }
+        int messageId = nextMessageId++;
+        sent.push_back("SUBSCRIBE " + std::to_string(batch.size()));
+        session.subscribing(messageId, batch, now);
+        inFlight.emplace_back(messageId, broker.subscribe(CLIENT_ID, batch));
+    }
+
+    void receiveSubAcks() {
+        for (const auto& [messageId, returnCodes] : inFlight) {
+            session.acknowledged(messageId, MqttSession::isSubscriptionAccepted(returnCodes.data(), returnCodes.size()));
+        }
+        inFlight.clear();
+    }
+
+    void disconnect() {
+        // Anything still in flight is lost with the connection
+        inFlight.clear();
+        broker.disconnect(CLIENT_ID);
+        session.disconnected();
+    }
+
+    static constexpr const char* CLIENT_ID = "farmhub-test";
+
+    MqttSession session;
+    time_point<boot_clock> now;
+    std::vector<std::string> sent;
+    std::vector<std::string> received;
+
+private:
+    ScriptedBroker& broker;
+    const std::list<std::string> topics;
+    int nextMessageId = 1;
+    std::list<std::pair<int, std::vector<uint8_t>>> inFlight;
+};
+
+}    // namespace
+
+TEST_CASE("reconnecting resumes the session without subscribing again") {
+    ScriptedBroker broker;
+    ScriptedClient client(broker, { "commands/ping", "commands/restart", "config" });
+
+    client.connect();
+    client.receiveSubAcks();
+    CHECK(client.sent == std::vector<std::string> { "CONNECT", "SUBSCRIBE 3" });
+
+    // A command sent while we are offline is delivered when we are back
+    client.disconnect();
+    broker.publishQos1("commands/ping");
+    client.sent.clear();
+    client.connect();
+    CHECK(client.sent == std::vector<std::string> { "CONNECT" });
+    CHECK(client.received == std::vector<std::string> { "commands/ping" });
+
+    // And again
+    client.disconnect();
+    client.sent.clear();
+    client.connect();
+    CHECK(client.sent == std::vector<std::string> { "CONNECT" });
+}
+
+TEST_CASE("messages sent while rebooting are delivered, and everything is subscribed again") {
+    ScriptedBroker broker;
+    ScriptedClient beforeReboot(broker, { "commands/ping", "config" });
+    beforeReboot.connect();
+    beforeReboot.receiveSubAcks();
+    beforeReboot.disconnect();
+
+    broker.publishQos1("commands/ping");
+    ScriptedClient client(broker, { "commands/ping", "config" });
+    client.connect();
+    client.receiveSubAcks();
+    // We can't tell which topics the kept session has, so they are all subscribed again
+    CHECK(client.sent == std::vector<std::string> { "CONNECT", "SUBSCRIBE 2" });
+    CHECK(client.received == std::vector<std::string> { "commands/ping" });
+
+    client.disconnect();
+    client.sent.clear();
+    client.connect();
+    CHECK(client.sent == std::vector<std::string> { "CONNECT" });
+}
+
+TEST_CASE("subscribes again when the broker lost the session") {
+    ScriptedBroker broker;
+    ScriptedClient client(broker, { "commands/ping", "config" });
+    client.connect();
+    client.receiveSubAcks();
+    client.disconnect();
+
+    broker.restart();
+    client.sent.clear();
+    client.connect();
+    client.receiveSubAcks();
+    CHECK(client.sent == std::vector<std::string> { "CONNECT", "SUBSCRIBE 2" });
+
+    // The new session is resumed from then on
+    client.disconnect();
+    broker.publishQos1("config");
+    client.sent.clear();
+    client.connect();
+    CHECK(client.sent == std::vector<std::string> { "CONNECT" });
+    CHECK(client.received == std::vector<std::string> { "config" });
+}
+
+TEST_CASE("rejected subscriptions are retried after reconnecting") {
+    ScriptedBroker broker;
+    broker.deniedTopics = { "config" };
+    ScriptedClient client(broker, { "commands/ping", "config" });
+    client.connect();
+    client.receiveSubAcks();
+    CHECK(client.session.needsSubscribing("commands/ping"));
+    CHECK(client.session.needsSubscribing("config"));
+
+    // Once the broker lets us, the subscription sticks
+    broker.deniedTopics.clear();
+    client.disconnect();
+    client.sent.clear();
+    client.connect();
+    client.receiveSubAcks();
+    CHECK(client.sent == std::vector<std::string> { "CONNECT", "SUBSCRIBE 2" });
+
+    client.disconnect();
+    client.sent.clear();
+    client.connect();
+    CHECK(client.sent == std::vector<std::string> { "CONNECT" });
+}
+
+TEST_CASE("subscriptions without a SUBACK are sent again") {
+    ScriptedBroker broker;
+    ScriptedClient client(broker, { "commands/ping", "config" });
+
+    SECTION("when the connection drops") {
+        client.connect();
+        // Connection drops before the SUBACK arrives
+        client.disconnect();
+        client.sent.clear();
+        client.connect();
+        client.receiveSubAcks();
+        CHECK(client.sent == std::vector<std::string> { "CONNECT", "SUBSCRIBE 2" });
+        CHECK(!client.session.needsSubscribing("config"));
+    }
+
+    SECTION("when the SUBACK times out") {
+        client.now = time_point<boot_clock>(10s);
+        client.connect();
+        // Still waiting, so not sent twice
+        client.sent.clear();
+        client.subscribeUnconfirmed();
+        CHECK(client.sent.empty());
+
+        CHECK(!client.session.expire(time_point<boot_clock>(12s), 5s));
+        CHECK(client.session.expire(time_point<boot_clock>(16s), 5s));
+        // A late SUBACK for the expired request is ignored
+        CHECK(!client.session.acknowledged(1, true));
+        client.subscribeUnconfirmed();
+        CHECK(client.sent == std::vector<std::string> { "SUBSCRIBE 2" });
+    }
+}
+
+TEST_CASE("SUBACK return codes") {
+    uint8_t granted[] = { 0x00, 0x01, 0x02 };
+    CHECK(MqttSession::isSubscriptionAccepted(granted, sizeof(granted)));
+    uint8_t partlyRejected[] = { 0x01, 0x80 };
+    CHECK(!MqttSession::isSubscriptionAccepted(partlyRejected, sizeof(partlyRejected)));
+    CHECK(MqttSession::isSubscriptionAccepted(nullptr, 0));
+}
+
+}    // namespace farmhub::kernel::mqtt
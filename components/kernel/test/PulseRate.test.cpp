@@ -0,0 +1,93 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/matchers/catch_matchers_floating_point.hpp>
+
+#include <chrono>
+#include <vector>
+
+#include <PulseRate.hpp>
+
+using namespace std::chrono;
+using namespace std::chrono_literals;
+
+using Catch::Matchers::WithinAbs;
+using Catch::Matchers::WithinRel;
+
+namespace farmhub::kernel {
+
+/**
+ * @brief Feeds a pulse train with the given period to the meter, and returns the average for each window.
+ */
+static std::vector<double> measureWindows(PulseRateMeter& meter, microseconds period, microseconds window, int windows, microseconds firstPulse = 0s) {
+    std::vector<double> averages;
+    auto nextPulse = firstPulse;
+    for (int i = 1; i <= windows; i++) {
+        auto windowEnd = window * i;
+        for (; nextPulse < windowEnd; nextPulse += period) {
+            meter.recordPulse(nextPulse);
+        }
+        averages.push_back(meter.takeAverage(windowEnd));
+    }
+    return averages;
+}
+
+TEST_CASE("low frequency is measured from pulse periods") {
+    // A few pulses a minute: counting per window would alternate between 2 and 3 pulses per minute
+    PulseRateMeter meter;
+    auto averages = measureWindows(meter, 23s, 1min, 10, 1s);
+    for (auto average : averages) {
+        CHECK_THAT(average, WithinRel(1.0 / 23, 1e-9));
+    }
+}
+
+TEST_CASE("high frequency is measured by counting") {
+    PulseRateMeter meter;
+    auto averages = measureWindows(meter, 10ms, 1s, 5);
+    for (auto average : averages) {
+        CHECK_THAT(average, WithinRel(100.0, 1e-9));
+    }
+}
+
+TEST_CASE("frequency falls off when pulses stop") {
+    PulseRateMeter meter(PulseRateMeter::DEFAULT_COUNTING_THRESHOLD, 60s);
+    for (auto time = 0s; time <= 100s; time += 10s) {
+        meter.recordPulse(time);
+    }
+    CHECK_THAT(meter.getInstantaneous(105s), WithinRel(0.1, 1e-9));
+    CHECK_THAT(meter.getInstantaneous(120s), WithinRel(0.05, 1e-9));
+    CHECK(meter.getInstantaneous(161s) == 0);
+
+    // The window average can't claim more than the time since the last pulse allows
+    CHECK_THAT(meter.takeAverage(140s), WithinRel(1.0 / 40, 1e-9));
+    CHECK(meter.takeAverage(200s) == 0);
+}
+
+TEST_CASE("the first pulse after a pause does not measure a period") {
+    PulseRateMeter meter(PulseRateMeter::DEFAULT_COUNTING_THRESHOLD, 60s);
+    meter.recordPulse(0s);
+    meter.recordPulse(5s);
+    CHECK_THAT(meter.getInstantaneous(5s), WithinRel(0.2, 1e-9));
+
+    // Flow starts again after ten minutes
+    meter.recordPulse(605s);
+    CHECK(meter.getInstantaneous(605s) == 0);
+    meter.recordPulse(607s);
+    CHECK_THAT(meter.getInstantaneous(607s), WithinRel(0.5, 1e-9));
+    CHECK_THAT(meter.takeAverage(607s), WithinAbs(1.0 / 3.5, 1e-9));
+}
+
+TEST_CASE("slowing down is followed within a window") {
+    PulseRateMeter meter;
+    auto fast = measureWindows(meter, 5s, 1min, 3);
+    CHECK_THAT(fast.back(), WithinRel(0.2, 1e-9));
+    // Jitter-free half speed from here on
+    std::vector<double> slow;
+    for (auto time = 185s; time < 600s; time += 10s) {
+        meter.recordPulse(time);
+        if ((time + 5s) % 1min == 0s) {
+            slow.push_back(meter.takeAverage(time + 5s));
+        }
+    }
+    CHECK_THAT(slow.back(), WithinRel(0.1, 1e-9));
+}
+
+}    // namespace farmhub::kernel
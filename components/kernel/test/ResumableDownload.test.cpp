@@ -0,0 +1,290 @@
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <ResumableDownload.hpp>
+
+using namespace farmhub::kernel;
+
+namespace {
+
+using Bytes = std::vector<uint8_t>;
+
+/**
+ * @brief Stands in for the HTTP server: honors `Range` and `If-Range`, and drops connections at random.
+ *
+ * With `chunked` set, it doesn't tell the size of the resource, and dropped connections look like
+ * the end of the response.
+ */
+class FlakyServer {
+public:
+    FlakyServer(size_t size, double dropProbability, bool chunked = false, uint32_t seed = 42)
+        : random(seed)
+        , dropProbability(dropProbability)
+        , chunked(chunked) {
+        publish(size);
+    }
+
+    void publish(size_t size) {
+        resource.resize(size);
+        for (auto& byte : resource) {
+            byte = random();
+        }
+        etag = "\"v" + std::to_string(++version) + "\"";
+    }
+
+    std::unique_ptr<DownloadConnection> connect(size_t offset, const std::string& ifRange) {
+        requests++;
+        if (offset > 0) {
+            rangeRequests++;
+        }
+        if (std::bernoulli_distribution(dropProbability)(random)) {
+            return std::make_unique<Connection>(*this, -1, 0);
+        }
+        if (offset > 0 && ifRange == etag) {
+            return std::make_unique<Connection>(*this, 206, offset);
+        }
+        return std::make_unique<Connection>(*this, 200, 0);
+    }
+
+    Bytes resource;
+    std::string etag;
+    int requests = 0;
+    int rangeRequests = 0;
+
+private:
+    class Connection : public DownloadConnection {
+    public:
+        Connection(FlakyServer& server, int status, size_t position)
+            : server(server)
+            , status(status)
+            , position(position) {
+        }
+
+        int getStatus() override {
+            return status;
+        }
+
+        std::string getEtag() override {
+            return server.etag;
+        }
+
+        size_t getSize() override {
+            return server.chunked ? 0 : server.resource.size();
+        }
+
+        int read(uint8_t* buffer, size_t length) override {
+            if (std::bernoulli_distribution(server.dropProbability)(server.random)) {
+                return server.chunked ? 0 : -1;
+            }
+            size_t count = std::min(length, server.resource.size() - position);
+            std::memcpy(buffer, server.resource.data() + position, count);
+            position += count;
+            return count;
+        }
+
+    private:
+        FlakyServer& server;
+        const int status;
+        size_t position;
+    };
+
+    std::mt19937 random;
+    const double dropProbability;
+    const bool chunked;
+    int version = 0;
+};
+
+class MemoryTarget : public DownloadTarget {
+public:
+    bool begin(size_t offset) override {
+        if (offset > data.size()) {
+            return false;
+        }
+        data.resize(offset);
+        return true;
+    }
+
+    bool write(const uint8_t* buffer, size_t length) override {
+        data.insert(data.end(), buffer, buffer + length);
+        return true;
+    }
+
+    bool read(size_t offset, uint8_t* buffer, size_t length) override {
+        if (offset + length > data.size()) {
+            return false;
+        }
+        std::memcpy(buffer, data.data() + offset, length);
+        return true;
+    }
+
+    bool finish() override {
+        return validate(data);
+    }
+
+    Bytes data;
+    // Like checking the firmware image's checksum
+    std::function<bool(const Bytes&)> validate = [](const Bytes&) { return true; };
+};
+
+struct Harness {
+    Harness(FlakyServer& server, uint32_t maxAttempts = 100, uint32_t maxAttemptsPerRun = 100)
+        : target(std::make_shared<MemoryTarget>())
+        , download(
+              [&server](const std::string&, size_t offset, const std::string& etag) {
+                  return server.connect(offset, etag);
+              },
+              target,
+              [this](const DownloadProgress& progress) {
+                  persisted = progress;
+                  history.push_back(progress);
+              },
+              [this](milliseconds delay) {
+                  delays.push_back(delay);
+              },
+              maxAttempts,
+              maxAttemptsPerRun,
+              4096) {
+        persisted.url = "http://localhost/firmware.bin";
+    }
+
+    std::shared_ptr<MemoryTarget> target;
+    ResumableDownload download;
+    DownloadProgress persisted;
+    std::vector<DownloadProgress> history;
+    std::vector<milliseconds> delays;
+};
+
+}    // namespace
+
+TEST_CASE("download resumes after random connection drops") {
+    FlakyServer server(256 * 1024, 0.01);
+    Harness harness(server);
+
+    auto progress = harness.persisted;
+    REQUIRE(harness.download.run(progress) == DownloadResult::Complete);
+    REQUIRE(harness.target->data == server.resource);
+    REQUIRE(progress.written == server.resource.size());
+    // Some attempts failed, and were resumed instead of starting over
+    REQUIRE(progress.attempts > 1);
+    REQUIRE(server.rangeRequests > 0);
+}
+
+TEST_CASE("download resumes from persisted progress after reboot") {
+    FlakyServer server(256 * 1024, 0.02);
+    Harness beforeReboot(server, 100, 2);
+    auto progress = beforeReboot.persisted;
+    REQUIRE(beforeReboot.download.run(progress) == DownloadResult::Failed);
+    auto persisted = beforeReboot.persisted;
+    REQUIRE(persisted.written > 0);
+    REQUIRE(persisted.written % 4096 == 0);
+
+    // The OTA partition survives the reboot
+    Harness afterReboot(server);
+    afterReboot.target->data = beforeReboot.target->data;
+    int rangeRequestsBefore = server.rangeRequests;
+    REQUIRE(afterReboot.download.run(persisted) == DownloadResult::Complete);
+    REQUIRE(afterReboot.target->data == server.resource);
+    REQUIRE(server.rangeRequests > rangeRequestsBefore);
+}
+
+TEST_CASE("download starts over when the resource changed") {
+    FlakyServer server(64 * 1024, 0.0);
+    Harness harness(server);
+    DownloadProgress progress = harness.persisted;
+    REQUIRE(harness.download.run(progress) == DownloadResult::Complete);
+
+    // Pretend we were interrupted halfway, then a new version got published
+    auto halfway = std::find_if(harness.history.begin(), harness.history.end(), [](const DownloadProgress& checkpoint) {
+        return checkpoint.written == 32 * 1024;
+    });
+    REQUIRE(halfway != harness.history.end());
+    progress = *halfway;
+    harness.target->begin(progress.written);
+    server.publish(80 * 1024);
+    int rangeRequestsBefore = server.rangeRequests;
+
+    REQUIRE(harness.download.run(progress) == DownloadResult::Complete);
+    REQUIRE(harness.target->data == server.resource);
+    REQUIRE(progress.etag == server.etag);
+    // We asked for the rest, but got the whole new version
+    REQUIRE(server.rangeRequests == rangeRequestsBefore + 1);
+}
+
+TEST_CASE("download starts over when the target lost what was written") {
+    FlakyServer server(64 * 1024, 0.0);
+    Harness harness(server);
+    DownloadProgress progress = harness.persisted;
+    progress.etag = server.etag;
+    progress.written = 8192;
+    progress.sha256 = "0000";
+
+    REQUIRE(harness.download.run(progress) == DownloadResult::Complete);
+    REQUIRE(harness.target->data == server.resource);
+}
+
+TEST_CASE("download gives up with exponential backoff") {
+    FlakyServer server(64 * 1024, 1.0);
+    Harness harness(server, 6);
+
+    auto progress = harness.persisted;
+    REQUIRE(harness.download.run(progress) == DownloadResult::GaveUp);
+    REQUIRE(harness.persisted.attempts == 6);
+    REQUIRE(harness.delays == std::vector<milliseconds> { 5s, 10s, 20s, 40s, 80s });
+    REQUIRE(ResumableDownload::backoffAfter(10) == ResumableDownload::MAX_BACKOFF);
+}
+
+TEST_CASE("attempts are counted before they are made") {
+    FlakyServer server(64 * 1024, 0.0);
+    Harness harness(server);
+    std::vector<uint32_t> attemptsAtConnect;
+    ResumableDownload download(
+        [&](const std::string&, size_t offset, const std::string& etag) {
+            // If the device crashed now, the attempt would already be on record
+            attemptsAtConnect.push_back(harness.persisted.attempts);
+            return server.connect(offset, etag);
+        },
+        harness.target,
+        [&](const DownloadProgress& progress) {
+            harness.persisted = progress;
+        },
+        [](milliseconds) {},
+        3,
+        3);
+
+    DownloadProgress progress = harness.persisted;
+    progress.attempts = 1;
+    REQUIRE(download.run(progress) == DownloadResult::Complete);
+    REQUIRE(attemptsAtConnect == std::vector<uint32_t> { 2 });
+
+    // Once out of attempts, we don't even try
+    progress = harness.persisted;
+    progress.attempts = 3;
+    REQUIRE(download.run(progress) == DownloadResult::GaveUp);
+    REQUIRE(attemptsAtConnect.size() == 1);
+}
+
+TEST_CASE("truncated download of unknown size is not accepted") {
+    FlakyServer server(64 * 1024, 0.005, true);
+    Harness harness(server);
+    int validations = 0;
+    harness.target->validate = [&](const Bytes& data) {
+        validations++;
+        return data == server.resource;
+    };
+
+    auto progress = harness.persisted;
+    REQUIRE(harness.download.run(progress) == DownloadResult::Complete);
+    REQUIRE(harness.target->data == server.resource);
+    // Some truncated downloads were rejected
+    REQUIRE(validations > 1);
+    // Without knowing the size, nothing is checkpointed or resumed
+    REQUIRE(server.rangeRequests == 0);
+    for (auto& checkpoint : harness.history) {
+        REQUIRE(checkpoint.written == 0);
+    }
+}
@@ -0,0 +1,82 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <Scheduler.hpp>
+
+using namespace farmhub::kernel;
+
+namespace {
+
+/**
+ * @brief Drive the job queue with a virtual clock, and count how many times we had to wake up.
+ */
+uint32_t simulateWakeups(const std::vector<JobHandle>& jobs, microseconds duration) {
+    JobQueue queue;
+    auto now = boot_clock::zero();
+    for (const auto& job : jobs) {
+        queue.add(job, now);
+    }
+    auto end = now + duration;
+    while (true) {
+        now = queue.nextWakeup();
+        if (now > end) {
+            break;
+        }
+        for (const auto& entry : queue.takeDue(now)) {
+            REQUIRE(entry.due <= now);
+            REQUIRE(now <= entry.latest());
+            queue.reschedule(entry, now);
+        }
+    }
+    return queue.getWakeups();
+}
+
+JobHandle job(const std::string& name, microseconds period, microseconds tolerance = microseconds::zero()) {
+    return std::make_shared<Job>(name, period, tolerance, []() { });
+}
+
+}    // namespace
+
+TEST_CASE("nextAlignedSlot") {
+    auto at = [](microseconds time) { return time_point<boot_clock>(time); };
+    REQUIRE(JobQueue::nextAlignedSlot(at(0s), 10s) == at(0s));
+    REQUIRE(JobQueue::nextAlignedSlot(at(1us), 10s) == at(10s));
+    REQUIRE(JobQueue::nextAlignedSlot(at(10s), 10s) == at(10s));
+    REQUIRE(JobQueue::nextAlignedSlot(at(25s), 10s) == at(30s));
+}
+
+TEST_CASE("aligned jobs share wakeups") {
+    // 1 s, 10 s and 1 min wake together, so we only wake up once a second
+    REQUIRE(simulateWakeups({ job("a", 1s), job("b", 10s), job("c", 1min) }, 1h) == 3601);
+}
+
+TEST_CASE("tolerance coalesces unaligned jobs") {
+    // The old prime battery check interval next to a light sensor and the telemetry
+    auto strict = simulateWakeups({ job("battery", 10313ms), job("light", 1500ms), job("telemetry", 1min) }, 1h);
+    auto tolerant = simulateWakeups({ job("battery", 10313ms, 5s), job("light", 1500ms, 750ms), job("telemetry", 1min, 10s) }, 1h);
+    REQUIRE(tolerant < strict);
+    // Every wakeup is driven by the light sensor
+    REQUIRE(tolerant <= 2401);
+}
+
+TEST_CASE("cancelled jobs do not wake us up") {
+    JobQueue queue;
+    auto cancelled = job("cancelled", 1s);
+    auto kept = job("kept", 1min);
+    queue.add(cancelled, boot_clock::zero());
+    queue.add(kept, boot_clock::zero());
+    queue.takeDue(boot_clock::zero());
+    cancelled->cancel();
+    queue.reschedule({ boot_clock::zero(), cancelled }, boot_clock::zero());
+    queue.reschedule({ boot_clock::zero(), kept }, boot_clock::zero());
+    REQUIRE(queue.nextWakeup() == time_point<boot_clock>(1min));
+}
+
+TEST_CASE("missed deadlines skip to the next aligned slot") {
+    JobQueue queue;
+    auto slow = job("slow", 1s);
+    queue.add(slow, boot_clock::zero());
+    auto due = queue.takeDue(boot_clock::zero());
+    REQUIRE(due.size() == 1);
+    REQUIRE(queue.reschedule(due[0], time_point<boot_clock>(2500ms)) == 1500ms);
+    REQUIRE(queue.nextWakeup() == time_point<boot_clock>(3s));
+}
@@ -0,0 +1,256 @@
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+
+#include <MovingAverage.hpp>
+#include <Statistics.hpp>
+
+using namespace farmhub::kernel;
+
+TEST_CASE("ring buffer keeps the last samples in the window") {
+    RingBuffer<int, 8> ring(3);
+    REQUIRE(ring.empty());
+    REQUIRE_FALSE(ring.push(1).has_value());
+    REQUIRE_FALSE(ring.push(2).has_value());
+    REQUIRE_FALSE(ring.push(3).has_value());
+    REQUIRE(ring.full());
+    REQUIRE(ring.push(4) == 1);
+    REQUIRE(ring.size() == 3);
+    REQUIRE(ring[0] == 2);
+    REQUIRE(ring[2] == 4);
+    REQUIRE(ring.newest() == 4);
+
+    // Windows larger than the capacity are clamped
+    REQUIRE(RingBuffer<int, 4>(10).getWindow() == 4);
+}
+
+TEST_CASE("windowed statistics") {
+    MovingMean<double, 4> mean;
+    MovingMinMax<double, 4> minMax;
+    MovingVariance<double, 4> variance;
+    REQUIRE(mean.getMean() == 0);
+    for (double value : { 10.0, 2.0, 4.0, 6.0, 8.0 }) {
+        mean.record(value);
+        minMax.record(value);
+        variance.record(value);
+    }
+    // 10 dropped out of the window
+    REQUIRE(mean.getMean() == 5);
+    REQUIRE(minMax.getMin() == 2);
+    REQUIRE(minMax.getMax() == 8);
+    REQUIRE(variance.getMean() == 5);
+    REQUIRE(std::abs(variance.getVariance() - 20.0 / 3) < 1e-12);
+}
+
+TEST_CASE("ewma follows changes at the configured rate") {
+    Ewma<double> ewma(0.5);
+    ewma.record(8);
+    REQUIRE(ewma.getMean() == 8);
+    ewma.record(0);
+    REQUIRE(ewma.getMean() == 4);
+    ewma.record(0);
+    REQUIRE(ewma.getMean() == 2);
+}
+
+TEST_CASE("median filter removes spikes but keeps edges") {
+    MedianFilter<double, 5> median(3);
+    REQUIRE(median.filter(1) == 1);
+    REQUIRE(median.filter(3) == 2);
+    REQUIRE(median.filter(100) == 3);
+    REQUIRE(median.filter(3) == 3);
+    REQUIRE(median.filter(3) == 3);
+    // Step change goes through after two samples
+    REQUIRE(median.filter(10) == 3);
+    REQUIRE(median.filter(10) == 10);
+}
+
+TEST_CASE("hampel filter replaces outliers only") {
+    HampelFilter<double, 7> hampel;
+    std::mt19937 random(42);
+    std::normal_distribution<double> noise(20.0, 0.1);
+    for (int i = 0; i < 100; i++) {
+        auto value = noise(random);
+        if (i % 10 == 5) {
+            // Glitch, e.g. a bad I2C read
+            REQUIRE(std::abs(hampel.filter(-999) - 20.0) < 1);
+        } else {
+            // Ordinary noise passes through untouched
+            auto filtered = hampel.filter(value);
+            REQUIRE((filtered == value || std::abs(value - 20.0) > 0.2));
+        }
+    }
+    REQUIRE(hampel.getOutliers() >= 10);
+}
+
+TEST_CASE("filter chain composes stages from config") {
+    FilterChain<double> passThrough;
+    REQUIRE(passThrough.empty());
+    REQUIRE(passThrough.filter(42) == 42);
+
+    FilterChain<double> chain({
+        { .type = FilterType::Hampel, .window = 5 },
+        { .type = FilterType::Mean, .window = 2 },
+    });
+    for (double value : { 10.0, 11.0, 10.0, 11.0 }) {
+        chain.filter(value);
+    }
+    // The spike is dropped before it reaches the mean
+    REQUIRE(chain.filter(1000) == 11);
+    REQUIRE(chain.filter(12) == 11.5);
+}
+
+TEST_CASE("moving mean does not drift like MovingAverage") {
+    // Large readings with small variations, e.g. light levels in lux over weeks of sampling every second
+    const size_t window = 16;
+    MovingAverage<double> legacy(window);
+    MovingMean<double, window> mean;
+    std::mt19937 random(42);
+    std::uniform_real_distribution<double> reading(0, 1);
+    const double offset = 1e7;
+    RingBuffer<double, window> recent;
+    for (int i = 0; i < 1'000'000; i++) {
+        double value = (i % 2 == 0 ? offset : 0) + reading(random);
+        legacy.record(value);
+        mean.record(value);
+        recent.push(value);
+    }
+    long double exact = 0;
+    recent.forEach([&](double value) { exact += value; });
+    exact /= window;
+
+    double legacyError = std::abs(static_cast<double>(legacy.getAverage() - exact));
+    double meanError = std::abs(static_cast<double>(mean.getMean() - exact));
+    REQUIRE(meanError < 1e-8);
+    REQUIRE(legacyError > 10 * meanError);
+}
+
+namespace {
+
+double exactQuantile(std::vector<double> values, double quantile) {
+    std::sort(values.begin(), values.end());
+    return values[static_cast<size_t>(std::round(quantile * (values.size() - 1)))];
+}
+
+}    // namespace
+
+TEST_CASE("interval stats are exact for short intervals") {
+    IntervalStats<double> stats;
+    REQUIRE(stats.summarize().count == 0);
+    for (double value : { 4.0, 1.0, 3.0 }) {
+        stats.record(value);
+    }
+    auto summary = stats.take();
+    REQUIRE(summary.count == 3);
+    REQUIRE(summary.min == 1);
+    REQUIRE(summary.max == 4);
+    REQUIRE(std::abs(summary.mean - 8.0 / 3) < 1e-12);
+    REQUIRE(summary.p50 == 3);
+    REQUIRE(summary.p95 == 4);
+
+    // Taking the summary starts a new interval
+    stats.record(10);
+    summary = stats.take();
+    REQUIRE(summary.count == 1);
+    REQUIRE(summary.min == 10);
+    REQUIRE(summary.p50 == 10);
+}
+
+TEST_CASE("interval percentiles are accurate for long intervals") {
+    std::mt19937 random(42);
+
+    SECTION("normal noise") {
+        // E.g. a temperature sampled every second for a minute, or every 100 ms for 10 minutes
+        for (size_t count : { 60, 6000 }) {
+            std::normal_distribution<double> temperature(21.5, 0.3);
+            IntervalStats<double> stats;
+            std::vector<double> values;
+            for (size_t i = 0; i < count; i++) {
+                auto value = temperature(random);
+                stats.record(value);
+                values.push_back(value);
+            }
+            auto summary = stats.take();
+            REQUIRE(summary.count == count);
+            REQUIRE(summary.min == *std::min_element(values.begin(), values.end()));
+            REQUIRE(summary.max == *std::max_element(values.begin(), values.end()));
+            REQUIRE(std::abs(summary.p50 - exactQuantile(values, 0.5)) < 0.1);
+            REQUIRE(std::abs(summary.p95 - exactQuantile(values, 0.95)) < 0.1);
+        }
+    }
+
+    SECTION("skewed with a short event") {
+        // Pressure mostly steady, with a brief drop that the mean would hide
+        IntervalStats<double> stats;
+        std::vector<double> values;
+        std::exponential_distribution<double> flow(1.0);
+        for (size_t i = 0; i < 600; i++) {
+            auto value = (i >= 300 && i < 310) ? 0.0 : 3.0 + flow(random);
+            stats.record(value);
+            values.push_back(value);
+        }
+        auto summary = stats.take();
+        REQUIRE(summary.min == 0);
+        auto p50 = exactQuantile(values, 0.5);
+        auto p95 = exactQuantile(values, 0.95);
+        REQUIRE(std::abs(summary.p50 - p50) < 0.05 * p50);
+        REQUIRE(std::abs(summary.p95 - p95) < 0.1 * p95);
+    }
+}
+
+TEST_CASE("statistics cost compared to MovingAverage", "[.benchmark]") {
+    std::mt19937 random(42);
+    std::uniform_real_distribution<double> reading(0, 1000);
+    std::vector<double> samples(1024);
+    for (auto& sample : samples) {
+        sample = reading(random);
+    }
+
+    BENCHMARK("MovingAverage") {
+        MovingAverage<double> legacy(16);
+        for (auto sample : samples) {
+            legacy.record(sample);
+        }
+        return legacy.getAverage();
+    };
+    BENCHMARK("MovingMean") {
+        MovingMean<double, 16> mean;
+        for (auto sample : samples) {
+            mean.record(sample);
+        }
+        return mean.getMean();
+    };
+    BENCHMARK("Ewma") {
+        Ewma<double> ewma(0.1);
+        for (auto sample : samples) {
+            ewma.record(sample);
+        }
+        return ewma.getMean();
+    };
+    BENCHMARK("MedianFilter") {
+        MedianFilter<double, 5> median;
+        double result = 0;
+        for (auto sample : samples) {
+            result += median.filter(sample);
+        }
+        return result;
+    };
+    BENCHMARK("HampelFilter") {
+        HampelFilter<double, 7> hampel;
+        double result = 0;
+        for (auto sample : samples) {
+            result += hampel.filter(sample);
+        }
+        return result;
+    };
+    BENCHMARK("IntervalStats") {
+        IntervalStats<double> stats;
+        for (auto sample : samples) {
+            stats.record(sample);
+        }
+        return stats.take().p95;
+    };
+}
@@ -0,0 +1,115 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <chrono>
+#include <optional>
+
+#include <Totalizer.hpp>
+
+using namespace std::chrono;
+using namespace std::chrono_literals;
+
+namespace farmhub::kernel {
+
+TEST_CASE("checkpoints once the total has grown enough") {
+    Totalizer totalizer(100, 15min);
+    totalizer.restore(std::nullopt, 0s);
+    // The first change of the generation is checkpointed right away
+    totalizer.add(1);
+    REQUIRE(totalizer.checkpointIfDue(0s).has_value());
+
+    totalizer.add(60);
+    CHECK(!totalizer.checkpointIfDue(1s).has_value());
+    totalizer.add(60);
+    auto checkpoint = totalizer.checkpointIfDue(2s);
+    REQUIRE(checkpoint.has_value());
+    CHECK(checkpoint->total == 121);
+    CHECK(checkpoint->generation == 0);
+
+    // Counting starts over from the last checkpoint
+    totalizer.add(90);
+    CHECK(!totalizer.checkpointIfDue(3s).has_value());
+}
+
+TEST_CASE("checkpoints slow changes after the interval") {
+    Totalizer totalizer(100, 15min);
+    totalizer.restore(std::nullopt, 0s);
+    totalizer.add(1);
+    REQUIRE(totalizer.checkpointIfDue(0s).has_value());
+
+    totalizer.add(1);
+    CHECK(!totalizer.checkpointIfDue(14min).has_value());
+    auto checkpoint = totalizer.checkpointIfDue(15min);
+    REQUIRE(checkpoint.has_value());
+    CHECK(checkpoint->total == 2);
+}
+
+TEST_CASE("does not write when nothing changed") {
+    Totalizer totalizer(100, 15min);
+    totalizer.restore(std::nullopt, 0s);
+
+    CHECK(!totalizer.checkpointIfDue(1h).has_value());
+    CHECK(!totalizer.checkpointNow(1h).has_value());
+
+    totalizer.add(5);
+    auto checkpoint = totalizer.checkpointNow(1h);
+    REQUIRE(checkpoint.has_value());
+    CHECK(checkpoint->total == 5);
+    CHECK(!totalizer.checkpointNow(1h + 1s).has_value());
+}
+
+TEST_CASE("restoring continues the total in a new generation") {
+    Totalizer totalizer(100, 15min);
+    totalizer.restore(std::nullopt, 0s);
+    CHECK(totalizer.getTotal() == 0);
+    CHECK(totalizer.getGeneration() == 0);
+
+    Totalizer rebooted(100, 15min);
+    rebooted.restore(Totalizer::Checkpoint { 12345, 7 }, 0s);
+    CHECK(rebooted.getTotal() == 12345);
+    CHECK(rebooted.getGeneration() == 8);
+
+    // The restored total counts as checkpointed already
+    CHECK(!rebooted.checkpointNow(1s).has_value());
+    rebooted.add(10);
+    auto checkpoint = rebooted.checkpointNow(2s);
+    REQUIRE(checkpoint.has_value());
+    CHECK(checkpoint->total == 12355);
+    CHECK(checkpoint->generation == 8);
+}
+
+TEST_CASE("new generation is checkpointed only with the first change") {
+    Totalizer totalizer(100, 15min);
+    totalizer.restore(Totalizer::Checkpoint { 12345, 7 }, 0s);
+    CHECK(!totalizer.checkpointIfDue(1h).has_value());
+
+    // Booting again without counting anything starts the same generation
+    Totalizer woken(100, 15min);
+    woken.restore(Totalizer::Checkpoint { 12345, 7 }, 0s);
+    CHECK(woken.getGeneration() == 8);
+
+    // The first change is checkpointed right away, however small
+    woken.add(1);
+    auto checkpoint = woken.checkpointIfDue(1s);
+    REQUIRE(checkpoint.has_value());
+    CHECK(checkpoint->total == 12346);
+    CHECK(checkpoint->generation == 8);
+
+    // From then on the usual thresholds apply
+    woken.add(1);
+    CHECK(!woken.checkpointIfDue(2s).has_value());
+
+    Totalizer rebooted(100, 15min);
+    rebooted.restore(*checkpoint, 0s);
+    CHECK(rebooted.getGeneration() == 9);
+}
+
+TEST_CASE("counts past 32 bits") {
+    Totalizer totalizer(1, 15min);
+    totalizer.restore(Totalizer::Checkpoint { UINT32_MAX, 0 }, 0s);
+    totalizer.add(2);
+    auto checkpoint = totalizer.checkpointIfDue(1s);
+    REQUIRE(checkpoint.has_value());
+    CHECK(checkpoint->total == 0x100000001ULL);
+}
+
+}    // namespace farmhub::kernel
@@ -0,0 +1,111 @@
+#ifdef FARMHUB_SIMULATION
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <BootClock.hpp>
+#include <Concurrent.hpp>
+#include <Scheduler.hpp>
+#include <Task.hpp>
+#include <VirtualClock.hpp>
+#include <Watchdog.hpp>
+
+using namespace farmhub::kernel;
+
+TEST_CASE("delays run on virtual time") {
+    auto realStart = steady_clock::now();
+    auto start = boot_clock::now();
+    Task::delay(ticks(24h));
+    REQUIRE(boot_clock::now() - start >= 24h);
+    // A simulated day should pass in well under a minute
+    REQUIRE(steady_clock::now() - realStart < 1min);
+}
+
+TEST_CASE("queue timeouts run on virtual time") {
+    Queue<int> queue("test", 1);
+    auto start = boot_clock::now();
+    REQUIRE_FALSE(queue.pollIn(ticks(1h)));
+    REQUIRE(boot_clock::now() - start >= 1h);
+}
+
+TEST_CASE("system_clock follows the virtual wall clock") {
+    auto midnight = system_clock::from_time_t(1735689600);
+    VirtualClock::setWallClock(midnight);
+    Task::delay(ticks(6h));
+    REQUIRE(system_clock::now() - midnight >= 6h);
+    REQUIRE(system_clock::now() - midnight < 6h + 1s);
+}
+
+TEST_CASE("watchdog times out on virtual time") {
+    std::atomic<bool> timedOut { false };
+    Watchdog watchdog("test", 5min, true, [&](WatchdogState state) {
+        if (state == WatchdogState::TimedOut) {
+            timedOut = true;
+        }
+    });
+    Task::delay(ticks(4min));
+    REQUIRE_FALSE(timedOut);
+    Task::delay(ticks(2min));
+    REQUIRE(timedOut);
+}
+
+TEST_CASE("scheduler keeps to its slots over simulated hours") {
+    // The scheduler's worker task never stops, so the scheduler must outlive the test
+    static Scheduler scheduler("simulation");
+
+    struct Observed {
+        std::atomic<uint32_t> runs { 0 };
+        // Worst delay after the aligned slot, in microseconds
+        std::atomic<int64_t> maxDelay { 0 };
+    };
+    auto observe = [](Observed& observed, microseconds period) {
+        return [&observed, period]() {
+            observed.runs++;
+            auto delay = boot_clock::now().time_since_epoch() % period;
+            if (delay.count() > observed.maxDelay) {
+                observed.maxDelay = delay.count();
+            }
+        };
+    };
+
+    // Roughly what a soil sensor node runs: sampling, an odd battery interval, and telemetry
+    Observed samples;
+    Observed battery;
+    Observed telemetry;
+    auto realStart = steady_clock::now();
+    auto start = boot_clock::now();
+    auto sampleJob = scheduler.schedule("sample", 1min, observe(samples, 1min));
+    auto batteryJob = scheduler.schedule("battery", 10313ms, 5s, observe(battery, 10313ms));
+    auto telemetryJob = scheduler.schedule("telemetry", 5min, 1min, observe(telemetry, 5min));
+    auto wakeupsBefore = scheduler.getWakeups();
+
+    Task::delay(ticks(6h));
+
+    sampleJob->cancel();
+    batteryJob->cancel();
+    telemetryJob->cancel();
+    auto elapsed = boot_clock::now() - start;
+    REQUIRE(elapsed >= 6h);
+
+    // Every slot was served once, within its tolerance (and a tick of rounding)
+    auto expectedRuns = [&](microseconds period) {
+        return static_cast<uint32_t>(elapsed / period);
+    };
+    CHECK(samples.runs >= expectedRuns(1min));
+    CHECK(samples.runs <= expectedRuns(1min) + 1);
+    CHECK(battery.runs >= expectedRuns(10313ms));
+    CHECK(battery.runs <= expectedRuns(10313ms) + 1);
+    CHECK(telemetry.runs >= expectedRuns(5min));
+    CHECK(telemetry.runs <= expectedRuns(5min) + 1);
+    CHECK(microseconds(samples.maxDelay) <= ticks(1));
+    CHECK(microseconds(battery.maxDelay) <= 5s + ticks(1));
+    CHECK(microseconds(telemetry.maxDelay) <= 1min + ticks(1));
+
+    // Telemetry always shares a wakeup with sampling, and the battery check sometimes does
+    auto wakeups = scheduler.getWakeups() - wakeupsBefore;
+    CHECK(wakeups < samples.runs + battery.runs);
+
+    // Six simulated hours should pass in well under a minute
+    REQUIRE(steady_clock::now() - realStart < 1min);
+}
+
+#endif
@@ -11,6 +11,21 @@ using namespace farmhub::kernel::drivers;
 
 namespace farmhub::devices {
 
+/**
+ * @brief Deep-sleep duty cycle for battery-powered sensor nodes.
+ */
+class DutyCycleConfig : public ConfigurationSection {
+public:
+    // Time between the start of two wakes; zero means the device stays awake all the time
+    Property<seconds> cycle { this, "cycle", 0s };
+    // Longest time to stay awake in a cycle, e.g. when the network is down
+    Property<seconds> awakeBudget { this, "awakeBudget", 30s };
+
+    bool isEnabled() const {
+        return cycle.get() > 0s;
+    }
+};
+
 class DeviceConfiguration : public ConfigurationSection {
 public:
     DeviceConfiguration(const std::string& defaultModel)
@@ -29,6 +44,8 @@ public:
 
     Property<bool> sleepWhenIdle { this, "sleepWhenIdle", true };
 
+    NamedConfigurationEntry<DutyCycleConfig> dutyCycle { this, "dutyCycle" };
+
     Property<seconds> publishInterval { this, "publishInterval", 1min };
     Property<Level> publishLogs { this, "publishLogs", Level::Info };
 
@@ -66,7 +66,7 @@ public:
         return {};
     }
 
-    static std::shared_ptr<BatteryDriver> createBatteryDriver(std::shared_ptr<I2CManager> i2c) {
+    static std::shared_ptr<BatteryDriver> createBatteryDriver(std::shared_ptr<I2CManager> i2c, std::shared_ptr<AdcManager> adc) {
         return nullptr;
     }
 
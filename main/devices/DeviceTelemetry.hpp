@@ -3,6 +3,9 @@
 #include <chrono>
 #include <memory>
 
+#include <JsonArena.hpp>
+#include <Memory.hpp>
+
 using namespace farmhub::kernel;
 
 namespace farmhub::devices {
@@ -12,6 +15,73 @@ public:
     void populateTelemetry(JsonObject& json) override {
         json["free-heap"] = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
         json["min-heap"] = heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL);
+        json["largest-heap-block"] = heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL);
+        json["heap-fragmentation"] = getFragmentation(MALLOC_CAP_INTERNAL);
+        if (Memory::hasSpiram()) {
+            json["free-spiram"] = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+            json["min-spiram"] = heap_caps_get_minimum_free_size(MALLOC_CAP_SPIRAM);
+            json["largest-spiram-block"] = heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM);
+            json["spiram-fragmentation"] = getFragmentation(MALLOC_CAP_SPIRAM);
+        }
+
+        // JSON allocations since the previous cycle: all requests, and those that still went to the heap
+        auto& jsonStats = JsonArena::getStats();
+        uint32_t jsonRequests = jsonStats.requests;
+        uint32_t jsonHeapAllocations = jsonStats.heapAllocations;
+        json["json-allocs"] = jsonRequests - lastJsonRequests;
+        json["json-heap-allocs"] = jsonHeapAllocations - lastJsonHeapAllocations;
+        json["json-arena-peak"] = JsonArena::getHighWater();
+        lastJsonRequests = jsonRequests;
+        lastJsonHeapAllocations = jsonHeapAllocations;
+    }
+
+    static void reportHeap(JsonObject json, uint32_t caps) {
+        json["free"] = heap_caps_get_free_size(caps);
+        json["min"] = heap_caps_get_minimum_free_size(caps);
+        json["largest-block"] = heap_caps_get_largest_free_block(caps);
+        json["fragmentation"] = getFragmentation(caps);
+    }
+
+    /**
+     * @brief The share of free memory that is not available as a single block.
+     *
+     * A high value means large allocations, like the buffers of a TLS handshake, can fail
+     * even though there is plenty of free heap.
+     */
+    static double getFragmentation(uint32_t caps) {
+        size_t free = heap_caps_get_free_size(caps);
+        if (free == 0) {
+            return 0;
+        }
+        return 1.0 - static_cast<double>(heap_caps_get_largest_free_block(caps)) / free;
+    }
+
+private:
+    uint32_t lastJsonRequests = 0;
+    uint32_t lastJsonHeapAllocations = 0;
+};
+
+class TaskTelemetryProvider : public TelemetryProvider {
+public:
+    void populateTelemetry(JsonObject& json) override {
+        TaskRegistry::sample([&](const TaskSample& sample) {
+            // Short-lived tasks like MQTT handlers can share a name
+            std::string key = sample.name;
+            for (int index = 2; json[key].is<JsonObject>(); index++) {
+                key = sample.name + "#" + std::to_string(index);
+            }
+            auto taskJson = json[key].to<JsonObject>();
+            taskJson["stack"] = sample.stackSize;
+            taskJson["stack-free"] = sample.stackFree;
+            if (sample.cpuShare >= 0) {
+                taskJson["cpu"] = sample.cpuShare;
+            }
+            if (sample.iterations > 0) {
+                taskJson["loops"] = sample.iterations;
+                taskJson["loop-avg"] = sample.averageLoopTime.count();
+                taskJson["loop-max"] = sample.maxLoopTime.count();
+            }
+        });
     }
 };
 
@@ -31,19 +101,64 @@ private:
 
 class PowerManagementTelemetryProvider : public TelemetryProvider {
 public:
-    PowerManagementTelemetryProvider(std::shared_ptr<PowerManager> powerManager)
-        : powerManager(powerManager) {
+    PowerManagementTelemetryProvider(std::shared_ptr<PowerManager> powerManager, std::shared_ptr<Scheduler> scheduler)
+        : powerManager(powerManager)
+        , scheduler(scheduler) {
     }
 
     void populateTelemetry(JsonObject& json) override {
 #ifdef CONFIG_PM_LIGHT_SLEEP_CALLBACKS
-        json["sleep-time"] = powerManager->getLightSleepTime().count();
+        auto sleepTime = powerManager->getLightSleepTime();
+        json["sleep-time"] = sleepTime.count();
         json["sleep-count"] = powerManager->getLightSleepCount();
+
+        // Share of time spent in light sleep since the previous report, in percent
+        auto now = boot_clock::now();
+        auto elapsed = duration_cast<milliseconds>(now - lastReported);
+        if (elapsed > milliseconds::zero()) {
+            json["sleep-residency"] = 100.0 * (sleepTime - lastSleepTime).count() / elapsed.count();
+        }
+        lastReported = now;
+        lastSleepTime = sleepTime;
 #endif
+
+        json["wakes"] = scheduler->getWakeups();
+        auto sourcesJson = json["wake-sources"].to<JsonObject>();
+        scheduler->forEachJob([&](const Job& job) {
+            auto jobJson = sourcesJson[job.name].to<JsonObject>();
+            jobJson["wakes"] = job.getWakeups();
+            jobJson["runs"] = job.getRuns();
+        });
     }
 
 private:
     const std::shared_ptr<PowerManager> powerManager;
+    const std::shared_ptr<Scheduler> scheduler;
+
+#ifdef CONFIG_PM_LIGHT_SLEEP_CALLBACKS
+    time_point<boot_clock> lastReported = boot_clock::zero();
+    milliseconds lastSleepTime = milliseconds::zero();
+#endif
+};
+
+class DutyCycleTelemetryProvider : public TelemetryProvider {
+public:
+    DutyCycleTelemetryProvider(std::shared_ptr<DutyCycle> dutyCycle)
+        : dutyCycle(dutyCycle) {
+    }
+
+    void populateTelemetry(JsonObject& json) override {
+        const auto& state = dutyCycle->getState();
+        json["warm"] = dutyCycle->getWakeKind() == WakeKind::Warm;
+        json["cycles"] = state.cycles;
+        json["overruns"] = state.overruns;
+        json["last-awake"] = state.lastAwakeMs;
+        json["awake-time"] = state.totalAwakeMs;
+        json["sleep-time"] = state.totalSleepMs;
+    }
+
+private:
+    const std::shared_ptr<DutyCycle> dutyCycle;
 };
 
 }    // namespace farmhub::devices
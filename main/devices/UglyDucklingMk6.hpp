@@ -93,15 +93,19 @@ public:
         pins::LEDA_RED->digitalWrite(1);
     }
 
-    static std::shared_ptr<BatteryDriver> createBatteryDriver(std::shared_ptr<I2CManager> i2c) {
+    static std::shared_ptr<BatteryDriver> createBatteryDriver(std::shared_ptr<I2CManager> i2c, std::shared_ptr<AdcManager> adc) {
         return std::make_shared<AnalogBatteryDriver>(
+            adc,
             pins::BATTERY,
+            // Fitted to uncalibrated readings; with only 0.3 V between the boot threshold and a full
+            // battery, keep using that scale until the ratio is measured again against calibrated readings
             1.2424,
             BatteryParameters {
                 .maximumVoltage = 4.1,
                 .bootThreshold = 3.8,
                 .shutdownThreshold = 3.4,
-            });
+            },
+            AdcScale::Nominal);
     }
 
 protected:
@@ -86,7 +86,7 @@ public:
         : DeviceDefinition(pins::STATUS, pins::BOOT) {
     }
 
-    static std::shared_ptr<BatteryDriver> createBatteryDriver(std::shared_ptr<I2CManager> i2c) {
+    static std::shared_ptr<BatteryDriver> createBatteryDriver(std::shared_ptr<I2CManager> i2c, std::shared_ptr<AdcManager> adc) {
         return std::make_shared<Bq27220Driver>(i2c, pins::SDA, pins::SCL, BatteryParameters {
             .maximumVoltage = 4.1,
             .bootThreshold = 3.7,
@@ -4,21 +4,32 @@
 
 #include <atomic>
 #include <chrono>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
+#include <vector>
 
 #include <driver/gpio.h>
 #include <esp_app_desc.h>
+#include <mbedtls/base64.h>
 
 static const char* const farmhubVersion = esp_app_get_description()->version;
 
+#include <AdcManager.hpp>
 #include <BatteryManager.hpp>
+#include <BootProfiler.hpp>
 #include <Console.hpp>
 #include <CrashManager.hpp>
 #include <DebugConsole.hpp>
+#include <DutyCycle.hpp>
+#include <FileChunks.hpp>
 #include <HttpUpdate.hpp>
 #include <KernelStatus.hpp>
 #include <Log.hpp>
+#include <Memory.hpp>
+#include <Scheduler.hpp>
 #include <Strings.hpp>
 #include <mqtt/MqttLog.hpp>
 #include <mqtt/MqttTelemetryPublisher.hpp>
@@ -144,8 +155,8 @@ void performFactoryReset(std::shared_ptr<LedDriver> statusLed, bool completeRese
     esp_restart();
 }
 
-std::shared_ptr<BatteryDriver> initBattery(std::shared_ptr<I2CManager> i2c) {
-    auto battery = TDeviceDefinition::createBatteryDriver(i2c);
+std::shared_ptr<BatteryDriver> initBattery(std::shared_ptr<I2CManager> i2c, std::shared_ptr<AdcManager> adc) {
+    auto battery = TDeviceDefinition::createBatteryDriver(i2c, adc);
     if (battery != nullptr) {
         // If the battery voltage is below the device's threshold, we should not boot yet.
         // This is to prevent the device from booting and immediately shutting down
@@ -209,10 +220,139 @@ void registerBasicCommands(std::shared_ptr<MqttRoot> mqttRoot) {
     });
 }
 
+/**
+ * @brief Registers the `memory` command reporting heap regions and allocations per memory tag.
+ *
+ * The allocation rate of each tag is measured since the previous `memory` command, or boot.
+ */
+void registerMemoryCommand(std::shared_ptr<MqttRoot> mqttRoot) {
+    struct TagSample {
+        uint32_t allocations = 0;
+        time_point<boot_clock> time;
+    };
+    struct Samples {
+        std::mutex mutex;
+        std::map<std::string, TagSample> tags;
+    };
+    auto samples = std::make_shared<Samples>();
+    mqttRoot->registerCommand("memory", [samples](const JsonObject&, JsonObject& response) {
+        MemoryTelemetryProvider::reportHeap(response["internal"].to<JsonObject>(), MALLOC_CAP_INTERNAL);
+        if (Memory::hasSpiram()) {
+            MemoryTelemetryProvider::reportHeap(response["spiram"].to<JsonObject>(), MALLOC_CAP_SPIRAM);
+        }
+
+        auto now = boot_clock::now();
+        auto tagsJson = response["tags"].to<JsonObject>();
+        std::lock_guard<std::mutex> lock(samples->mutex);
+        MemoryTag::forEach([&](const MemoryTag& tag) {
+            auto allocations = tag.getAllocations();
+            auto tagJson = tagsJson[tag.getName()].to<JsonObject>();
+            tagJson["live"] = tag.getLiveBytes();
+            tagJson["peak"] = tag.getPeakBytes();
+            tagJson["allocs"] = allocations;
+            tagJson["frees"] = tag.getFrees();
+            auto& last = samples->tags[tag.getName()];
+            auto elapsed = duration_cast<milliseconds>(now - last.time);
+            if (elapsed > 0ms) {
+                tagJson["allocs-per-sec"] = (allocations - last.allocations) * 1000.0 / elapsed.count();
+            }
+            last = { allocations, now };
+        });
+    });
+}
+
+void registerFileChunkCommands(std::shared_ptr<MqttRoot> mqttRoot, std::shared_ptr<FileSystem> fs) {
+    using FileChunks = FileChunkTransfer<FileSystem>;
+    auto chunks = std::make_shared<FileChunks>(fs);
+
+    // Request: { "path": "...", "offset": 0, "length": 1024 }
+    // Response contains the chunk base64 encoded, with its CRC-32 (as in zlib)
+    mqttRoot->registerCommand("files/read-chunk", [chunks](const JsonObject& request, JsonObject& response) {
+        std::string path = request["path"];
+        if (!path.starts_with("/")) {
+            path = "/" + path;
+        }
+        size_t offset = request["offset"] | 0;
+        size_t length = request["length"] | FileChunks::MAX_CHUNK_SIZE;
+        response["path"] = path;
+        response["offset"] = offset;
+
+        auto chunk = chunks->read(path, offset, length);
+        if (!chunk.has_value()) {
+            response["error"] = "File not found";
+            return;
+        }
+
+        std::string encoded(4 * ((chunk->data.size() + 2) / 3) + 1, '\0');
+        size_t encodedLength = 0;
+        mbedtls_base64_encode(reinterpret_cast<unsigned char*>(encoded.data()), encoded.size(), &encodedLength, chunk->data.data(), chunk->data.size());
+        encoded.resize(encodedLength);
+
+        response["size"] = chunk->fileSize;
+        response["length"] = chunk->data.size();
+        response["data"] = encoded;
+        response["crc"] = chunk->crc;
+        response["eof"] = chunk->eof;
+    });
+
+    // Request: { "path": "..." }
+    mqttRoot->registerCommand("files/hash", [fs, chunks](const JsonObject& request, JsonObject& response) {
+        std::string path = request["path"];
+        if (!path.starts_with("/")) {
+            path = "/" + path;
+        }
+        response["path"] = path;
+        auto hash = chunks->hash(path);
+        if (!hash.has_value()) {
+            response["error"] = "File not found";
+            return;
+        }
+        response["size"] = fs->size(path);
+        response["sha256"] = hash.value();
+    });
+
+    // Request: { "path": "...", "offset": 0, "data": "<base64>", "crc": 123, "last": false, "sha256": "<hex, when last>" }
+    // See FileChunkTransfer for how chunks are put together
+    mqttRoot->registerCommand("files/write-chunk", [chunks](const JsonObject& request, JsonObject& response) {
+        std::string path = request["path"];
+        if (!path.starts_with("/")) {
+            path = "/" + path;
+        }
+        size_t offset = request["offset"] | 0;
+        response["path"] = path;
+        response["offset"] = offset;
+
+        std::string encoded = request["data"] | "";
+        std::vector<uint8_t> data(3 * (encoded.length() / 4) + 3);
+        size_t dataLength = 0;
+        if (mbedtls_base64_decode(data.data(), data.size(), &dataLength, reinterpret_cast<const unsigned char*>(encoded.data()), encoded.length()) != 0) {
+            response["error"] = "Invalid data";
+            return;
+        }
+        data.resize(dataLength);
+
+        std::optional<uint32_t> crc;
+        if (request["crc"].is<uint32_t>()) {
+            crc = request["crc"].as<uint32_t>();
+        }
+        auto result = chunks->write(path, offset, data, crc, request["last"] | false, request["sha256"] | "");
+        if (!result.isAccepted()) {
+            response["error"] = result.error;
+            response["expected-offset"] = result.expectedOffset;
+            return;
+        }
+        response["written"] = data.size();
+        response["size"] = result.expectedOffset;
+        if (result.sha256.has_value()) {
+            response["sha256"] = result.sha256.value();
+        }
+    });
+}
+
 void registerFileCommands(std::shared_ptr<MqttRoot> mqttRoot, std::shared_ptr<FileSystem> fs) {
     mqttRoot->registerCommand("files/list", [fs](const JsonObject&, JsonObject& response) {
         JsonArray files = response["files"].to<JsonArray>();
-        fs->readDir("/", [files](const std::string& name, off_t size) {
+        fs->readDirRecursive("/", [files](const std::string& name, off_t size) {
             JsonObject file = files.add<JsonObject>();
             file["name"] = name;
             file["size"] = size;
@@ -276,7 +416,8 @@ void registerHttpUpdateCommand(std::shared_ptr<MqttRoot> mqttRoot, std::shared_p
             response["failure"] = "Command contains empty url";
             return;
         }
-        HttpUpdater::startUpdate(url, fs);
+        bool delta = request["delta"] | false;
+        HttpUpdater::startUpdate(url, delta, fs);
         response["success"] = true;
     });
 }
@@ -307,17 +448,45 @@ void initTelemetryPublishTask(
     });
 }
 
+static RTC_DATA_ATTR DutyCycleState dutyCycleState;
+
+std::shared_ptr<DutyCycle> initDutyCycle(std::shared_ptr<DutyCycleConfig> config) {
+    auto dutyCycle = std::make_shared<DutyCycle>(
+        config->cycle.get(),
+        config->awakeBudget.get(),
+        dutyCycleState,
+        []() {
+            return duration_cast<milliseconds>(boot_clock::now().time_since_epoch());
+        },
+        [](milliseconds duration) {
+            esp_deep_sleep(duration_cast<microseconds>(duration).count());
+        });
+    dutyCycle->wake(esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_TIMER);
+
+    // Don't let a wake that cannot finish (e.g. because the network is down) drain the battery
+    Task::run("duty-cycle", 3072, [dutyCycle](Task&) {
+        Task::delay(duration_cast<ticks>(dutyCycle->getRemainingBudget()));
+        dutyCycle->sleep();
+    });
+    return dutyCycle;
+}
+
 enum class InitState {
     Success = 0,
     PeripheralError = 1,
 };
 
 extern "C" void app_main() {
+    BootProfiler::init();
+
+    BootProfiler::phase("battery");
     auto i2c = std::make_shared<I2CManager>();
-    auto battery = initBattery(i2c);
+    auto adc = std::make_shared<AdcManager>();
+    auto battery = initBattery(i2c, adc);
 
     Log::init();
 
+    BootProfiler::phase("nvs");
     initNvsFlash();
 
     // Install GPIO ISR service
@@ -329,13 +498,22 @@ extern "C" void app_main() {
 
     auto watchdog = initWatchdog();
 
+    BootProfiler::phase("fs");
     auto fs = std::make_shared<FileSystem>();
 
+    BootProfiler::phase("config");
     auto deviceConfig = loadConfig<TDeviceConfiguration>(fs, "/device-config.json");
 
     auto powerManager = std::make_shared<PowerManager>(deviceConfig->sleepWhenIdle.get());
 
-    auto logRecords = std::make_shared<Queue<LogRecord>>("logs", 32);
+    // Init deep-sleep duty cycle if configured; warm wakes rely on cached state instead of discovery
+    std::shared_ptr<DutyCycle> dutyCycle;
+    if (deviceConfig->dutyCycle.get()->isEnabled()) {
+        dutyCycle = initDutyCycle(deviceConfig->dutyCycle.get());
+    }
+    bool warmWake = dutyCycle != nullptr && dutyCycle->getWakeKind() == WakeKind::Warm;
+
+    auto logRecords = std::make_shared<Queue<LogRecord>>("logs", 32, MemoryPlacement::Large, ConsoleProvider::memoryTag());
     ConsoleProvider::init(logRecords, deviceConfig->publishLogs.get());
 
     LOGD("   ______                   _    _       _");
@@ -358,6 +536,9 @@ extern "C" void app_main() {
     auto states = std::make_shared<ModuleStates>();
     KernelStatusTask::init(statusLed, states);
 
+    // Drivers only get started here, connecting happens in the background; see waiting for the network below
+    BootProfiler::phase("drivers");
+
     // Init WiFi
     auto wifi = std::make_shared<WiFiDriver>(
         states->networkConnecting,
@@ -377,41 +558,49 @@ extern "C" void app_main() {
         }
     });
 
+    // Init shared scheduler for periodic jobs
+    auto scheduler = std::make_shared<Scheduler>();
+
     // Init battery management
     auto shutdownManager = std::make_shared<ShutdownManager>();
     std::shared_ptr<BatteryManager> batteryManager;
     if (battery != nullptr) {
         LOGI("Battery configured");
-        batteryManager = std::make_shared<BatteryManager>(battery, shutdownManager);
+        batteryManager = std::make_shared<BatteryManager>(battery, shutdownManager, scheduler);
     } else {
         LOGI("No battery configured");
     }
 
 #ifdef FARMHUB_DEBUG
-    new DebugConsole(batteryManager, wifi);
+    new DebugConsole(batteryManager, wifi, scheduler);
 #endif
 
     // Init mDNS
-    auto mdns = std::make_shared<MdnsDriver>(wifi->getNetworkReady(), deviceConfig->getHostname(), "ugly-duckling", farmhubVersion, states->mdnsReady);
+    auto mdns = std::make_shared<MdnsDriver>(wifi->getNetworkReady(), deviceConfig->getHostname(), "ugly-duckling", farmhubVersion, states->mdnsReady, warmWake);
 
     // Init real time clock
     auto rtc = std::make_shared<RtcDriver>(wifi->getNetworkReady(), mdns, deviceConfig->ntp.get(), states->rtcInSync);
 
     // Init MQTT connection
+    BootProfiler::phase("mqtt");
     auto mqttConfig = loadConfig<MqttDriver::Config>(fs, "/mqtt-config.json");
     auto mqttRoot = initMqtt(states, mdns, mqttConfig, deviceConfig->instance.get(), deviceConfig->location.get());
-    MqttLog::init(deviceConfig->publishLogs.get(), logRecords, mqttRoot);
+    MqttLog::init(logRecords, mqttRoot);
     registerBasicCommands(mqttRoot);
+    registerMemoryCommand(mqttRoot);
     registerFileCommands(mqttRoot, fs);
+    registerFileChunkCommands(mqttRoot, fs);
 
     // Handle any pending HTTP update (will reboot if update was required and was successful)
+    BootProfiler::phase("update");
     registerHttpUpdateCommand(mqttRoot, fs);
     HttpUpdater::performPendingHttpUpdateIfNecessary(fs, wifi, watchdog);
 
+    BootProfiler::phase("services");
     auto pcnt = std::make_shared<PcntManager>();
     auto pulseCounterManager = std::make_shared<PulseCounterManager>();
     auto pwm = std::make_shared<PwmManager>();
-    auto peripheralServices = PeripheralServices { i2c, pcnt, pulseCounterManager, pwm, switches };
+    auto peripheralServices = PeripheralServices { adc, i2c, pcnt, pulseCounterManager, pwm, switches, scheduler, states->rtcInSync };
 
     // Init peripherals
     auto peripheralManager = std::make_shared<PeripheralManager>(fs, peripheralServices, mqttRoot);
@@ -433,15 +622,17 @@ extern "C" void app_main() {
         deviceTelemetryCollector->registerProvider("battery", batteryManager);
     }
     deviceTelemetryCollector->registerProvider("wifi", std::make_shared<WiFiTelemetryProvider>(wifi));
-#if defined(FARMHUB_DEBUG) || defined(FARMHUB_REPORT_MEMORY)
+    // Always report memory, fragmentation is what makes TLS handshakes fail in the field
     deviceTelemetryCollector->registerProvider("memory", std::make_shared<MemoryTelemetryProvider>());
-#endif
-    deviceTelemetryCollector->registerProvider("pm", std::make_shared<PowerManagementTelemetryProvider>(powerManager));
-
-    // We want RTC to be in sync before we start setting up peripherals
-    states->rtcInSync.awaitSet();
+    // Run-time stats are enabled in every build (see sdkconfig.defaults), so CPU shares are always reported
+    deviceTelemetryCollector->registerProvider("tasks", std::make_shared<TaskTelemetryProvider>());
+    deviceTelemetryCollector->registerProvider("pm", std::make_shared<PowerManagementTelemetryProvider>(powerManager, scheduler));
+    if (dutyCycle != nullptr) {
+        deviceTelemetryCollector->registerProvider("duty-cycle", std::make_shared<DutyCycleTelemetryProvider>(dutyCycle));
+    }
 
-    // Init peripherals
+    // Start peripherals right away; those that need the wall clock wait for RTC sync on their own
+    BootProfiler::phase("peripherals");
     JsonDocument peripheralsInitDoc;
     auto peripheralsInitJson = peripheralsInitDoc.to<JsonArray>();
     InitState initState = InitState::Success;
@@ -464,36 +655,52 @@ extern "C" void app_main() {
         }
     }
 
-    initTelemetryPublishTask(deviceConfig->publishInterval.get(), watchdog, peripheralManager, deviceTelemetryPublisher, telemetryPublishQueue);
+    // Telemetry and the init message carry timestamps, so we need RTC to be in sync from here on
+    if (!states->rtcInSync.isSet()) {
+        // Syncing needs the network, so waiting for it first costs nothing, but shows how long connecting took
+        BootProfiler::await(states->networkReady);
+    }
+    BootProfiler::await(states->rtcInSync);
+
+    BootProfiler::phase("telemetry");
+    if (dutyCycle == nullptr) {
+        initTelemetryPublishTask(deviceConfig->publishInterval.get(), watchdog, peripheralManager, deviceTelemetryPublisher, telemetryPublishQueue);
+    }
 
     // Enable power saving once we are done initializing
     wifi->setPowerSaveMode(deviceConfig->sleepWhenIdle.get());
 
-    mqttRoot->publish(
-        "init",
-        [deviceConfig, initState, peripheralsInitJson, powerManager](JsonObject& json) {
-            // TODO Remove redundant mentions of "ugly-duckling"
-            json["type"] = "ugly-duckling";
-            json["model"] = deviceConfig->model.get();
-            json["id"] = deviceConfig->id.get();
-            json["instance"] = deviceConfig->instance.get();
-            json["mac"] = getMacAddress();
-            auto device = json["deviceConfig"].to<JsonObject>();
-            deviceConfig->store(device, false);
-            // TODO Remove redundant mentions of "ugly-duckling"
-            json["app"] = "ugly-duckling";
-            json["version"] = farmhubVersion;
-            json["reset"] = esp_reset_reason();
-            json["wakeup"] = esp_sleep_get_wakeup_cause();
-            json["bootCount"] = bootCount++;
-            json["time"] = duration_cast<seconds>(system_clock::now().time_since_epoch()).count();
-            json["state"] = static_cast<int>(initState);
-            json["peripherals"].to<JsonArray>().set(peripheralsInitJson);
-            json["sleepWhenIdle"] = powerManager->sleepWhenIdle;
-
-            CrashManager::handleCrashReport(json);
-        },
-        Retention::NoRetain, QoS::AtLeastOnce, 5s);
+    BootProfiler::finish();
+
+    // Warm wakes in duty-cycle mode skip the init message, nothing changed since the cold boot
+    if (!warmWake) {
+        mqttRoot->publish(
+            "init",
+            [deviceConfig, initState, peripheralsInitJson, powerManager](JsonObject& json) {
+                // TODO Remove redundant mentions of "ugly-duckling"
+                json["type"] = "ugly-duckling";
+                json["model"] = deviceConfig->model.get();
+                json["id"] = deviceConfig->id.get();
+                json["instance"] = deviceConfig->instance.get();
+                json["mac"] = getMacAddress();
+                auto device = json["deviceConfig"].to<JsonObject>();
+                deviceConfig->store(device, false);
+                // TODO Remove redundant mentions of "ugly-duckling"
+                json["app"] = "ugly-duckling";
+                json["version"] = farmhubVersion;
+                json["reset"] = esp_reset_reason();
+                json["wakeup"] = esp_sleep_get_wakeup_cause();
+                json["bootCount"] = bootCount++;
+                json["time"] = duration_cast<seconds>(system_clock::now().time_since_epoch()).count();
+                json["state"] = static_cast<int>(initState);
+                json["peripherals"].to<JsonArray>().set(peripheralsInitJson);
+                json["sleepWhenIdle"] = powerManager->sleepWhenIdle;
+                BootProfiler::report(json["boot"].to<JsonObject>());
+
+                CrashManager::handleCrashReport(json);
+            },
+            Retention::NoRetain, QoS::AtLeastOnce, 5s);
+    }
 
     states->kernelReady.set();
 
@@ -507,6 +714,14 @@ extern "C" void app_main() {
         wifi->getSsid().value_or("<no-ssid>").c_str(),
         duration_cast<seconds>(system_clock::now().time_since_epoch()).count());
 
+    if (dutyCycle != nullptr) {
+        // Publish a single batch of telemetry, then sleep until the next cycle is due
+        deviceTelemetryPublisher->publishTelemetry();
+        peripheralManager->publishTelemetry();
+        mdns->flushCache();
+        dutyCycle->sleep();
+    }
+
 #ifdef CONFIG_HEAP_TASK_TRACKING
     Task::loop("task-heaps", 4096, [](Task& task) {
         dumpPerTaskHeapInfo();
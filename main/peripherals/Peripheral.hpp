@@ -3,13 +3,17 @@
 #include <map>
 #include <memory>
 
+#include <AdcManager.hpp>
 #include <BootClock.hpp>
 #include <Configuration.hpp>
 #include <I2CManager.hpp>
+#include <JsonArena.hpp>
 #include <Named.hpp>
 #include <PcntManager.hpp>
 #include <PulseCounter.hpp>
 #include <PwmManager.hpp>
+#include <Scheduler.hpp>
+#include <State.hpp>
 #include <Telemetry.hpp>
 #include <drivers/SwitchManager.hpp>
 #include <mqtt/MqttRoot.hpp>
@@ -40,7 +44,8 @@ public:
     virtual ~PeripheralBase() = default;
 
     void publishTelemetry() {
-        JsonDocument telemetryDoc;
+        JsonArena arena(mqttRoot->getMemoryTag());
+        JsonDocument telemetryDoc(arena.allocator());
         JsonObject telemetryJson = telemetryDoc.to<JsonObject>();
         populateTelemetry(telemetryJson);
         if (telemetryJson.begin() == telemetryJson.end()) {
@@ -61,6 +66,13 @@ public:
     virtual void shutdown(const ShutdownParameters parameters) {
     }
 
+    /**
+     * @brief Called once the wall clock is in sync, if the peripheral's factory `requiresWallClock()`
+     * and the clock was not in sync when the peripheral was created.
+     */
+    virtual void clockInSync() {
+    }
+
 protected:
     std::shared_ptr<MqttRoot> mqttRoot;
 
@@ -98,11 +110,15 @@ public:
 };
 
 struct PeripheralServices {
+    const std::shared_ptr<AdcManager> adc;
     const std::shared_ptr<I2CManager> i2c;
     const std::shared_ptr<PcntManager> pcntManager;
     const std::shared_ptr<PulseCounterManager> pulseCounterManager;
     const std::shared_ptr<PwmManager> pwmManager;
     const std::shared_ptr<SwitchManager> switches;
+    const std::shared_ptr<Scheduler> scheduler;
+    // Peripherals are started before the wall clock is in sync; those that need it should wait for this
+    const State rtcInSync;
 };
 
 class PeripheralFactoryBase {
@@ -114,6 +130,16 @@ public:
 
     virtual std::unique_ptr<PeripheralBase> createPeripheral(const std::string& name, const std::string& jsonConfig, std::shared_ptr<MqttRoot> mqttRoot, std::shared_ptr<FileSystem> fs, const PeripheralServices& services, JsonObject& initConfigJson) = 0;
 
+    /**
+     * @brief Whether peripherals created by this factory need the wall clock, e.g. to follow a schedule.
+     *
+     * Such peripherals must start in a safe default state, and only act on the wall clock once
+     * `PeripheralServices::rtcInSync` is set; `PeripheralBase::clockInSync()` is called when that happens.
+     */
+    virtual bool requiresWallClock() const {
+        return false;
+    }
+
     const std::string factoryType;
     const std::string peripheralType;
 };
@@ -270,8 +296,42 @@ private:
             throw PeripheralCreationException("Factory not found: '" + factoryType + "'");
         }
         const std::string& peripheralType = it->second.get()->peripheralType;
-        std::shared_ptr<MqttRoot> mqttRoot = mqttDeviceRoot->forSuffix("peripherals/" + peripheralType + "/" + name);
-        return it->second.get()->createPeripheral(name, configJson, mqttRoot, fs, services, initConfigJson);
+        // Checked before creating the peripheral, so it either sees the clock in sync, or gets notified
+        bool waitForClock = it->second->requiresWallClock() && !services.rtcInSync.isSet();
+        std::shared_ptr<MqttRoot> mqttRoot = mqttDeviceRoot->forSuffix("peripherals/" + peripheralType + "/" + name, MemoryTag::get("peripherals/" + name));
+        auto peripheral = it->second.get()->createPeripheral(name, configJson, mqttRoot, fs, services, initConfigJson);
+        if (waitForClock) {
+            LOGI("Peripheral '%s' starts in its default state until the clock is in sync",
+                name.c_str());
+            waitingForClock.push_back(peripheral.get());
+            notifyWhenClockInSync();
+        }
+        return peripheral;
+    }
+
+    /**
+     * @brief Check for the clock periodically on the shared scheduler instead of keeping a task waiting for it.
+     *
+     * Must be called with `stateMutex` held.
+     */
+    void notifyWhenClockInSync() {
+        if (clockJob != nullptr) {
+            return;
+        }
+        clockJob = services.scheduler->schedule("peripherals:clock", CLOCK_CHECK_INTERVAL, CLOCK_CHECK_INTERVAL, [this]() {
+            if (!services.rtcInSync.isSet()) {
+                return;
+            }
+            Lock lock(stateMutex);
+            if (state == State::Running) {
+                LOGI("Clock in sync, notifying %u peripherals", waitingForClock.size());
+                for (auto* peripheral : waitingForClock) {
+                    peripheral->clockInSync();
+                }
+            }
+            waitingForClock.clear();
+            clockJob->cancel();
+        });
     }
 
     enum class State {
@@ -288,6 +348,11 @@ private:
     Mutex stateMutex;
     State state = State::Running;
     std::list<std::unique_ptr<PeripheralBase>> peripherals;
+
+    // With a tolerance as long as the interval, the check mostly piggybacks on other jobs' wakeups
+    static constexpr seconds CLOCK_CHECK_INTERVAL = 5s;
+    std::list<PeripheralBase*> waitingForClock;
+    JobHandle clockJob;
 };
 
 }    // namespace farmhub::peripherals
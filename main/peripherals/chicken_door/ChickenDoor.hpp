@@ -4,8 +4,10 @@
 #include <concepts>
 #include <limits>
 #include <list>
+#include <type_traits>
 #include <variant>
 
+#include <BootClock.hpp>
 #include <Component.hpp>
 #include <Concurrent.hpp>
 #include <Task.hpp>
@@ -45,7 +47,8 @@ void convertFromJson(JsonVariantConst src, DoorState& dst) {
 
 enum class OperationState {
     RUNNING,
-    WATCHDOG_TIMEOUT
+    WATCHDOG_TIMEOUT,
+    STALLED
 };
 
 bool convertToJson(const OperationState& src, JsonVariant dst) {
@@ -62,6 +65,21 @@ public:
     Property<std::string> i2c { this, "i2c" };
     Property<seconds> measurementFrequency { this, "measurementFrequency", 1s };
     Property<seconds> latencyInterval { this, "latencyInterval", 5s };
+    ArrayProperty<FilterSpec> filters { this, "filters" };
+
+    /**
+     * @brief Longest time between samples while the light level is far from both the open and close levels.
+     *
+     * @details Set it to `measurementFrequency` to always sample at the same rate.
+     */
+    Property<seconds> maxMeasurementInterval { this, "maxMeasurementInterval", 5min };
+
+    /**
+     * @brief Pin the sensor's threshold interrupt is wired to, if any; only supported by the TSL2591.
+     *
+     * @details When present, the light sensor is not sampled at all until the light level crosses the open or close level.
+     */
+    Property<InternalPinPtr> interruptPin { this, "interruptPin" };
 };
 
 class ChickenDoorDeviceConfig
@@ -92,6 +110,18 @@ public:
      */
     Property<seconds> movementTimeout { this, "movementTimeout", seconds(60) };
 
+    /**
+     * @brief How long to soft-start the motor over; zero starts it at full speed right away.
+     */
+    Property<milliseconds> rampTime { this, "rampTime", 0ms };
+
+    /**
+     * @brief Stop the motor when its current rises to this multiple of the running current; zero disables stall detection.
+     *
+     * @details Catches a stuck door long before the movement timeout. Requires a motor driver with current sensing.
+     */
+    Property<double> stallRatio { this, "stallRatio", 0 };
+
     /**
      * @brief Light sensor configuration.
      */
@@ -126,9 +156,13 @@ public:
         InternalPinPtr closedPin,
         bool invertSwitches,
         ticks movementTimeout,
+        milliseconds rampTime,
+        double stallRatio,
         std::function<void()> publishTelemetry)
         : Component(name, mqttRoot)
         , motor(motor)
+        , rampTime(rampTime)
+        , stallRatio(stallRatio)
         , lightSensor(lightSensor)
         , openSwitch(switches->registerHandler(
               name + ":open",
@@ -156,6 +190,10 @@ public:
 
         motor->stop();
 
+        lightSensor.onLevelUpdated([this](double) {
+            updateState();
+        });
+
         mqttRoot->registerCommand("override", [this](const JsonObject& request, JsonObject& response) {
             DoorState overrideState = request["state"].as<DoorState>();
             if (overrideState == DoorState::NONE) {
@@ -215,23 +253,25 @@ private:
                     static_cast<int>(currentState), static_cast<int>(targetState), lightSensor.getCurrentLevel());
                 watchdog.restart();
             }
-            switch (targetState) {
-                case DoorState::OPEN:
-                    motor->drive(MotorPhase::FORWARD, 1);
-                    break;
-                case DoorState::CLOSED:
-                    motor->drive(MotorPhase::REVERSE, 1);
-                    break;
-                default:
-                    motor->stop();
-                    break;
+            if (targetState != movingTowards) {
+                switch (targetState) {
+                    case DoorState::OPEN:
+                        startMoving(MotorPhase::FORWARD, targetState);
+                        break;
+                    case DoorState::CLOSED:
+                        startMoving(MotorPhase::REVERSE, targetState);
+                        break;
+                    default:
+                        stopMoving();
+                        break;
+                }
             }
         } else {
             if (currentState != lastState) {
                 LOGV("Reached state %d (light level %.2f)",
                     static_cast<int>(currentState), lightSensor.getCurrentLevel());
                 watchdog.cancel();
-                motor->stop();
+                stopMoving();
                 mqttRoot->publish("events/state", [=](JsonObject& json) { json["state"] = currentState; }, Retention::NoRetain, QoS::AtLeastOnce);
             }
         }
@@ -253,7 +293,11 @@ private:
         auto overrideWaitTime = overrideUntil < now
             ? ticks::max()
             : duration_cast<ticks>(overrideUntil - now);
-        auto waitTime = std::min(overrideWaitTime, duration_cast<ticks>(lightSensor.getMeasurementFrequency()));
+        // The light sensor notifies us about new samples, so only wake up on our own to end an override
+        auto waitTime = overrideWaitTime;
+        if (stallDetector.has_value()) {
+            waitTime = std::min(waitTime, duration_cast<ticks>(STALL_SAMPLE_INTERVAL));
+        }
         updateQueue.pollIn(waitTime, [this](auto& change) {
             std::visit(
                 [this](auto&& arg) {
@@ -276,12 +320,57 @@ private:
                     } else if constexpr (std::is_same_v<T, WatchdogTimeout>) {
                         LOGE("Watchdog timed out, stopping operation");
                         operationState = OperationState::WATCHDOG_TIMEOUT;
-                        motor->stop();
+                        stopMoving();
                         this->publishTelemetry();
                     }
                 },
                 change);
         });
+
+        checkForStall();
+    }
+
+    void startMoving(MotorPhase phase, DoorState targetState) {
+        motor->ramp(phase, 1, rampTime);
+        movingTowards = targetState;
+        movementStarted = boot_clock::now();
+        if (stallRatio > 0) {
+            stallDetector.emplace(stallRatio, rampTime + INRUSH_BLANKING);
+        }
+    }
+
+    void stopMoving() {
+        motor->stop();
+        movingTowards = DoorState::NONE;
+        stallDetector.reset();
+    }
+
+    void checkForStall() {
+        if (!stallDetector.has_value()) {
+            return;
+        }
+        auto current = motor->readCurrent();
+        if (!current.has_value()) {
+            LOGD("Motor cannot sense current, disabling stall detection");
+            stallDetector.reset();
+            return;
+        }
+        auto elapsed = duration_cast<milliseconds>(boot_clock::now() - movementStarted);
+        if (!stallDetector->update(elapsed, *current)) {
+            return;
+        }
+
+        auto targetState = movingTowards;
+        stopMoving();
+        if (determineCurrentState() == targetState) {
+            // Hit the end-stop just as the switch engaged, the next loop will register the new state
+            return;
+        }
+        LOGE("Motor stalled after %lld ms before reaching state %d, stopping operation",
+            elapsed.count(), static_cast<int>(targetState));
+        watchdog.cancel();
+        operationState = OperationState::STALLED;
+        publishTelemetry();
     }
 
     void handleWatchdogEvent(WatchdogState state) {
@@ -344,6 +433,8 @@ private:
     }
 
     const std::shared_ptr<PwmMotorDriver> motor;
+    const milliseconds rampTime;
+    const double stallRatio;
     TLightSensorComponent& lightSensor;
 
     double openLevel = std::numeric_limits<double>::max();
@@ -377,6 +468,13 @@ private:
     time_point<system_clock> overrideUntil = time_point<system_clock>::min();
 
     std::optional<PowerManagementLockGuard> sleepLock;
+
+    static constexpr milliseconds INRUSH_BLANKING = 250ms;
+    static constexpr milliseconds STALL_SAMPLE_INTERVAL = 50ms;
+
+    DoorState movingTowards = DoorState::NONE;
+    boot_clock::time_point movementStarted;
+    std::optional<StallDetector> stallDetector;
 };
 
 template <std::derived_from<LightSensorComponent> TLightSensorComponent>
@@ -387,6 +485,7 @@ public:
         const std::string& name,
         std::shared_ptr<MqttRoot> mqttRoot,
         std::shared_ptr<I2CManager> i2c,
+        std::shared_ptr<Scheduler> scheduler,
         uint8_t lightSensorAddress,
         std::shared_ptr<SwitchManager> switches,
         const std::shared_ptr<PwmMotorDriver> motor,
@@ -396,9 +495,11 @@ public:
               name + ":light",
               mqttRoot,
               i2c,
+              scheduler,
               config->lightSensor.get()->parse(lightSensorAddress),
               config->lightSensor.get()->measurementFrequency.get(),
-              config->lightSensor.get()->latencyInterval.get())
+              config->lightSensor.get()->latencyInterval.get(),
+              config->lightSensor.get()->filters.get())
         , doorComponent(
               name,
               mqttRoot,
@@ -409,9 +510,21 @@ public:
               config->closedPin.get(),
               config->invertSwitches.get(),
               config->movementTimeout.get(),
+              config->rampTime.get(),
+              config->stallRatio.get(),
               [this]() {
                   publishTelemetry();
-              }) {
+              })
+        , maxMeasurementInterval(config->lightSensor.get()->maxMeasurementInterval.get()) {
+        auto interruptPin = config->lightSensor.get()->interruptPin.get();
+        if (interruptPin != nullptr) {
+            if constexpr (std::is_same_v<TLightSensorComponent, Tsl2591Component>) {
+                lightSensor.useThresholdInterrupt(switches, interruptPin);
+            } else {
+                LOGW("Light sensor of %s does not support threshold interrupts, ignoring interrupt pin %s",
+                    name.c_str(), interruptPin->getName().c_str());
+            }
+        }
     }
 
     void populateTelemetry(JsonObject& telemetryJson) override {
@@ -421,11 +534,13 @@ public:
 
     void configure(const std::shared_ptr<ChickenDoorConfig> config) override {
         doorComponent.configure(config);
+        lightSensor.setThresholds({ config->closeLevel.get(), config->openLevel.get() }, maxMeasurementInterval);
     }
 
 private:
     TLightSensorComponent lightSensor;
     ChickenDoorComponent<TLightSensorComponent> doorComponent;
+    const seconds maxMeasurementInterval;
 };
 
 class NoLightSensorComponent : public LightSensorComponent {
@@ -434,10 +549,12 @@ public:
         const std::string& name,
         std::shared_ptr<MqttRoot> mqttRoot,
         std::shared_ptr<I2CManager> i2c,
+        std::shared_ptr<Scheduler> scheduler,
         I2CConfig config,
         seconds measurementFrequency,
-        seconds latencyInterval)
-        : LightSensorComponent(name, mqttRoot, measurementFrequency, latencyInterval) {
+        seconds latencyInterval,
+        const std::list<FilterSpec>& filters)
+        : LightSensorComponent(name, mqttRoot, scheduler, measurementFrequency, latencyInterval, filters) {
         runLoop();
     }
 
@@ -461,9 +578,9 @@ public:
         auto lightSensorType = deviceConfig->lightSensor.get()->type.get();
         try {
             if (lightSensorType == "bh1750") {
-                return std::make_unique<ChickenDoor<Bh1750Component>>(name, mqttRoot, services.i2c, 0x23, services.switches, motor, deviceConfig);
+                return std::make_unique<ChickenDoor<Bh1750Component>>(name, mqttRoot, services.i2c, services.scheduler, 0x23, services.switches, motor, deviceConfig);
             } else if (lightSensorType == "tsl2591") {
-                return std::make_unique<ChickenDoor<Tsl2591Component>>(name, mqttRoot, services.i2c, TSL2591_ADDR, services.switches, motor, deviceConfig);
+                return std::make_unique<ChickenDoor<Tsl2591Component>>(name, mqttRoot, services.i2c, services.scheduler, TSL2591_ADDR, services.switches, motor, deviceConfig);
             } else {
                 throw PeripheralCreationException("Unknown light sensor type: " + lightSensorType);
             }
@@ -471,7 +588,7 @@ public:
             LOGE("Could not initialize light sensor because %s", e.what());
             LOGW("Initializing without a light sensor");
             // TODO Do not pass I2C parameters to NoLightSensorComponent
-            return std::make_unique<ChickenDoor<NoLightSensorComponent>>(name, mqttRoot, services.i2c, 0x00, services.switches, motor, deviceConfig);
+            return std::make_unique<ChickenDoor<NoLightSensorComponent>>(name, mqttRoot, services.i2c, services.scheduler, 0x00, services.switches, motor, deviceConfig);
         }
     }
 };
@@ -1,11 +1,14 @@
 #pragma once
 
+#include <chrono>
 #include <memory>
 
 #include <ds18x20.h>
 
 #include <Component.hpp>
 #include <Configuration.hpp>
+#include <IntervalTelemetry.hpp>
+#include <Scheduler.hpp>
 #include <peripherals/Peripheral.hpp>
 #include <peripherals/SinglePinDeviceConfig.hpp>
 
@@ -15,6 +18,13 @@ using namespace farmhub::peripherals;
 
 namespace farmhub::peripherals::environment {
 
+class Ds18B20SoilSensorDeviceConfig
+    : public SinglePinDeviceConfig {
+public:
+    // A measurement takes 750 ms, so we sample less often than other sensors
+    Property<seconds> sampleInterval { this, "sampleInterval", 15s };
+};
+
 /**
  * @brief Support for DS18B20 soil temperature sensor.
  *
@@ -52,14 +62,23 @@ public:
         }
     }
 
-    void populateTelemetry(JsonObject& json) override {
-        // TODO Get temperature in a task to avoid delaying reporting
+    void sample() {
         float temperature;
-        ESP_ERROR_CHECK(ds18x20_measure_and_read_multi(pin->getGpio(), &sensor, 1, &temperature));
-        json["temperature"] = temperature;
+        esp_err_t res = ds18x20_measure_and_read_multi(pin->getGpio(), &sensor, 1, &temperature);
+        if (res != ESP_OK) {
+            LOGD("Could not measure temperature: %s", esp_err_to_name(res));
+            return;
+        }
+        this->temperature.record(temperature);
+        recordSample();
+    }
+
+    void populateTelemetry(JsonObject& json) override {
+        temperature.report(json);
     }
 
 private:
+    IntervalMetric temperature { "temperature" };
     const InternalPinPtr pin;
     onewire_addr_t sensor;
 };
@@ -67,28 +86,37 @@ private:
 class Ds18B20SoilSensor
     : public Peripheral<EmptyConfiguration> {
 public:
-    Ds18B20SoilSensor(const std::string& name, std::shared_ptr<MqttRoot> mqttRoot, InternalPinPtr pin)
+    Ds18B20SoilSensor(const std::string& name, std::shared_ptr<MqttRoot> mqttRoot, InternalPinPtr pin, seconds sampleInterval)
         : Peripheral<EmptyConfiguration>(name, mqttRoot)
         , sensor(name, mqttRoot, pin) {
+        // Measurements block for 750 ms, so they should not hold up other jobs
+        Scheduler::scheduleDedicated(name, sampleInterval, 3072, [this]() {
+            sampler.sample();
+        });
     }
 
     void populateTelemetry(JsonObject& telemetryJson) override {
-        sensor.populateTelemetry(telemetryJson);
+        sampler.report([&]() {
+            sensor.populateTelemetry(telemetryJson);
+        });
     }
 
 private:
     Ds18B20SoilSensorComponent sensor;
+    IntervalSampler sampler { [this]() {
+        sensor.sample();
+    } };
 };
 
 class Ds18B20SoilSensorFactory
-    : public PeripheralFactory<SinglePinDeviceConfig, EmptyConfiguration> {
+    : public PeripheralFactory<Ds18B20SoilSensorDeviceConfig, EmptyConfiguration> {
 public:
     Ds18B20SoilSensorFactory()
-        : PeripheralFactory<SinglePinDeviceConfig, EmptyConfiguration>("environment:ds18b20", "environment") {
+        : PeripheralFactory<Ds18B20SoilSensorDeviceConfig, EmptyConfiguration>("environment:ds18b20", "environment") {
     }
 
-    std::unique_ptr<Peripheral<EmptyConfiguration>> createPeripheral(const std::string& name, const std::shared_ptr<SinglePinDeviceConfig> deviceConfig, std::shared_ptr<MqttRoot> mqttRoot, const PeripheralServices& services) override {
-        return std::make_unique<Ds18B20SoilSensor>(name, mqttRoot, deviceConfig->pin.get());
+    std::unique_ptr<Peripheral<EmptyConfiguration>> createPeripheral(const std::string& name, const std::shared_ptr<Ds18B20SoilSensorDeviceConfig> deviceConfig, std::shared_ptr<MqttRoot> mqttRoot, const PeripheralServices& services) override {
+        return std::make_unique<Ds18B20SoilSensor>(name, mqttRoot, deviceConfig->pin.get(), deviceConfig->sampleInterval.get());
     }
 };
 
@@ -1,10 +1,13 @@
 #pragma once
 
+#include <chrono>
 #include <concepts>
 #include <memory>
 
 #include <Configuration.hpp>
 #include <I2CManager.hpp>
+#include <IntervalTelemetry.hpp>
+#include <Scheduler.hpp>
 
 #include <peripherals/I2CConfig.hpp>
 #include <peripherals/Peripheral.hpp>
@@ -15,6 +18,13 @@ using namespace farmhub::peripherals;
 
 namespace farmhub::peripherals::environment {
 
+class EnvironmentDeviceConfig
+    : public I2CDeviceConfig {
+public:
+    // Samples are aggregated and reported at every telemetry publish
+    Property<seconds> sampleInterval { this, "sampleInterval", 5s };
+};
+
 template <std::derived_from<Component> TComponent>
 class Environment
     : public Peripheral<EmptyConfiguration> {
@@ -24,34 +34,44 @@ public:
         const std::string& sensorType,
         std::shared_ptr<MqttRoot> mqttRoot,
         std::shared_ptr<I2CManager> i2c,
-        I2CConfig config)
+        std::shared_ptr<Scheduler> scheduler,
+        I2CConfig config,
+        seconds sampleInterval)
         : Peripheral<EmptyConfiguration>(name, mqttRoot)
         , component(name, sensorType, mqttRoot, i2c, config) {
+        scheduler->schedule(name, sampleInterval, sampleInterval / 2, [this]() {
+            sampler.sample();
+        });
     }
 
     void populateTelemetry(JsonObject& telemetryJson) override {
-        component.populateTelemetry(telemetryJson);
+        sampler.report([&]() {
+            component.populateTelemetry(telemetryJson);
+        });
     }
 
 private:
     TComponent component;
+    IntervalSampler sampler { [this]() {
+        component.sample();
+    } };
 };
 
 template <std::derived_from<Component> TComponent>
 class I2CEnvironmentFactory
-    : public PeripheralFactory<I2CDeviceConfig, EmptyConfiguration> {
+    : public PeripheralFactory<EnvironmentDeviceConfig, EmptyConfiguration> {
 public:
     I2CEnvironmentFactory(const std::string& sensorType, uint8_t defaultAddress)
-        : PeripheralFactory<I2CDeviceConfig, EmptyConfiguration>("environment:" + sensorType, "environment")
+        : PeripheralFactory<EnvironmentDeviceConfig, EmptyConfiguration>("environment:" + sensorType, "environment")
         , sensorType(sensorType)
         , defaultAddress(defaultAddress) {
     }
 
-    std::unique_ptr<Peripheral<EmptyConfiguration>> createPeripheral(const std::string& name, const std::shared_ptr<I2CDeviceConfig> deviceConfig, std::shared_ptr<MqttRoot> mqttRoot, const PeripheralServices& services) override {
+    std::unique_ptr<Peripheral<EmptyConfiguration>> createPeripheral(const std::string& name, const std::shared_ptr<EnvironmentDeviceConfig> deviceConfig, std::shared_ptr<MqttRoot> mqttRoot, const PeripheralServices& services) override {
         auto i2cConfig = deviceConfig->parse(defaultAddress);
         LOGI("Creating %s sensor %s with %s",
             sensorType.c_str(), name.c_str(), i2cConfig.toString().c_str());
-        return std::make_unique<Environment<TComponent>>(name, sensorType, mqttRoot, services.i2c, i2cConfig);
+        return std::make_unique<Environment<TComponent>>(name, sensorType, mqttRoot, services.i2c, services.scheduler, i2cConfig, deviceConfig->sampleInterval.get());
     }
 
 private:
@@ -1,11 +1,10 @@
 #pragma once
 
-#include <limits>
-
 #include <si7021.h>
 
 #include <Component.hpp>
 #include <I2CManager.hpp>
+#include <IntervalTelemetry.hpp>
 #include <Telemetry.hpp>
 
 #include <peripherals/I2CConfig.hpp>
@@ -34,7 +33,6 @@ public:
 
         // TODO Add commands to soft/hard reset the sensor
         // TODO Add configuration for fast / slow measurement
-        // TODO Add a separate task to do measurements to unblock telemetry collection?
 
         LOGI("Initializing %s environment sensor with %s",
             sensorType.c_str(), config.toString().c_str());
@@ -42,34 +40,32 @@ public:
         ESP_ERROR_CHECK(si7021_init_desc(&sensor, bus->port, bus->sda->getGpio(), bus->scl->getGpio()));
     }
 
-    void populateTelemetry(JsonObject& json) override {
-        json["temperature"] = getTemperature();
-        json["humidity"] = getHumidity();
-    }
-
-private:
-    float getTemperature() {
+    void sample() {
         float value;
         esp_err_t res = si7021_measure_temperature(&sensor, &value);
-        if (res != ESP_OK) {
+        if (res == ESP_OK) {
+            temperature.record(value);
+        } else {
             LOGD("Could not measure temperature: %s", esp_err_to_name(res));
-            return std::numeric_limits<float>::quiet_NaN();
+        }
+        res = si7021_measure_humidity(&sensor, &value);
+        if (res == ESP_OK) {
+            humidity.record(value);
         } else {
-            return value;
+            LOGD("Could not measure humidity: %s", esp_err_to_name(res));
         }
+        recordSample();
     }
 
-    float getHumidity() {
-        float value;
-        esp_err_t res = si7021_measure_humidity(&sensor, &value);
-        if (res != ESP_OK) {
-            LOGD("Could not measure humidity: %s", esp_err_to_name(res));
-            return std::numeric_limits<float>::quiet_NaN();
-        } else {
-            return value;
-        }
+    void populateTelemetry(JsonObject& json) override {
+        temperature.report(json);
+        humidity.report(json);
     }
 
+private:
+    IntervalMetric temperature { "temperature" };
+    IntervalMetric humidity { "humidity" };
+
     std::shared_ptr<I2CBus> bus;
     i2c_dev_t sensor {};
 };
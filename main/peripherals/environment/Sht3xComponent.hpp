@@ -1,11 +1,10 @@
 #pragma once
 
-#include <limits>
-
 #include <sht3x.h>
 
 #include <Component.hpp>
 #include <I2CManager.hpp>
+#include <IntervalTelemetry.hpp>
 #include <Telemetry.hpp>
 
 #include <peripherals/I2CConfig.hpp>
@@ -31,7 +30,6 @@ public:
 
         // TODO Add commands to soft/hard reset the sensor
         // TODO Add configuration for fast / slow measurement
-        // TODO Add a separate task to do measurements to unblock telemetry collection?
 
         LOGI("Initializing %s environment sensor with %s",
             sensorType.c_str(), config.toString().c_str());
@@ -40,21 +38,28 @@ public:
         ESP_ERROR_CHECK(sht3x_init(&sensor));
     }
 
-    void populateTelemetry(JsonObject& json) override {
+    void sample() {
         float temperature;
         float humidity;
         esp_err_t res = sht3x_measure(&sensor, &temperature, &humidity);
         if (res != ESP_OK) {
             LOGD("Could not measure temperature: %s", esp_err_to_name(res));
-            temperature = std::numeric_limits<float>::quiet_NaN();
-            humidity = std::numeric_limits<float>::quiet_NaN();
+            return;
         }
+        this->temperature.record(temperature);
+        this->humidity.record(humidity);
+        recordSample();
+    }
 
-        json["temperature"] = temperature;
-        json["humidity"] = humidity;
+    void populateTelemetry(JsonObject& json) override {
+        temperature.report(json);
+        humidity.report(json);
     }
 
 private:
+    IntervalMetric temperature { "temperature" };
+    IntervalMetric humidity { "humidity" };
+
     std::shared_ptr<I2CBus> bus;
     sht3x_t sensor {};
 };
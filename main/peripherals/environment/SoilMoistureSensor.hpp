@@ -1,8 +1,12 @@
 #pragma once
 
+#include <chrono>
 #include <memory>
 
+#include <AdcManager.hpp>
 #include <Component.hpp>
+#include <IntervalTelemetry.hpp>
+#include <Scheduler.hpp>
 #include <Telemetry.hpp>
 
 #include <peripherals/Peripheral.hpp>
@@ -19,6 +23,11 @@ public:
     // These values need calibrating for each sensor
     Property<uint16_t> air { this, "air", 3000 };
     Property<uint16_t> water { this, "water", 1000 };
+    // Calibration in millivolts; when given, takes precedence over the raw values above
+    Property<uint16_t> airVoltage { this, "airVoltage" };
+    Property<uint16_t> waterVoltage { this, "waterVoltage" };
+    // Samples are aggregated and reported at every telemetry publish
+    Property<seconds> sampleInterval { this, "sampleInterval", 5s };
 };
 
 class SoilMoistureSensorComponent
@@ -28,53 +37,80 @@ public:
     SoilMoistureSensorComponent(
         const std::string& name,
         std::shared_ptr<MqttRoot> mqttRoot,
+        std::shared_ptr<AdcManager> adc,
         const std::shared_ptr<SoilMoistureSensorDeviceConfig> config)
         : Component(name, mqttRoot)
-        , airValue(config->air.get())
-        , waterValue(config->water.get())
-        , pin(config->pin.get()) {
-
-        LOGI("Initializing soil moisture sensor on pin %s; air value: %d; water value: %d",
-            pin.getName().c_str(), airValue, waterValue);
+        , calibratedInVoltage(config->airVoltage.hasValue() && config->waterVoltage.hasValue())
+        , airValue(calibratedInVoltage ? config->airVoltage.get() : config->air.get())
+        , waterValue(calibratedInVoltage ? config->waterVoltage.get() : config->water.get())
+        , adc(adc)
+        , channel(adc->registerChannel(config->pin.get())) {
+
+        LOGI("Initializing soil moisture sensor on pin %s; air value: %d%s; water value: %d%s",
+            channel->getName().c_str(),
+            airValue, calibratedInVoltage ? " mV" : "",
+            waterValue, calibratedInVoltage ? " mV" : "");
     }
 
-    void populateTelemetry(JsonObject& json) override {
-        std::optional<uint16_t> soilMoistureValue = pin.analogRead();
-        if (!soilMoistureValue.has_value()) {
+    void sample() {
+        auto reading = adc->read(channel);
+        if (!reading.has_value()) {
             LOGD("Failed to read soil moisture value");
             return;
         }
-        LOGV("Soil moisture value: %d",
-            soilMoistureValue.value());
+        LOGV("Soil moisture value: %.1f (%.1f mV)",
+            reading->raw, reading->millivolts);
 
+        const double value = calibratedInVoltage ? reading->millivolts : reading->raw;
         const double run = waterValue - airValue;
         const double rise = 100;
-        const double delta = soilMoistureValue.value() - airValue;
+        const double delta = value - airValue;
         double moisture = (delta * rise) / run;
 
-        json["moisture"] = moisture;
+        this->moisture.record(moisture);
+        this->voltage.record(reading->millivolts);
+        recordSample();
+    }
+
+    void populateTelemetry(JsonObject& json) override {
+        moisture.report(json);
+        voltage.report(json);
     }
 
 private:
+    IntervalMetric moisture { "moisture" };
+    // Measured in millivolts, to help calibrating the sensor
+    IntervalMetric voltage { "voltage" };
+    const bool calibratedInVoltage;
     const int airValue;
     const int waterValue;
-    AnalogPin pin;
+    const std::shared_ptr<AdcManager> adc;
+    const AnalogChannelPtr channel;
 };
 
 class SoilMoistureSensor
     : public Peripheral<EmptyConfiguration> {
 public:
-    SoilMoistureSensor(const std::string& name, std::shared_ptr<MqttRoot> mqttRoot, const std::shared_ptr<SoilMoistureSensorDeviceConfig> config)
+    SoilMoistureSensor(const std::string& name, std::shared_ptr<MqttRoot> mqttRoot, std::shared_ptr<Scheduler> scheduler, std::shared_ptr<AdcManager> adc, const std::shared_ptr<SoilMoistureSensorDeviceConfig> config)
         : Peripheral<EmptyConfiguration>(name, mqttRoot)
-        , sensor(name, mqttRoot, config) {
+        , sensor(name, mqttRoot, adc, config) {
+        auto sampleInterval = config->sampleInterval.get();
+        scheduler->schedule(name, sampleInterval, sampleInterval / 2, [this]() {
+            sampler.sample();
+        });
     }
 
     void populateTelemetry(JsonObject& telemetryJson) override {
-        sensor.populateTelemetry(telemetryJson);
+        sampler.report([&]() {
+            sensor.populateTelemetry(telemetryJson);
+        });
     }
 
 private:
     SoilMoistureSensorComponent sensor;
+    IntervalSampler sampler { [this]() {
+        sensor.sample();
+    } };
 };
 
 class SoilMoistureSensorFactory
@@ -85,7 +121,7 @@ public:
     }
 
     std::unique_ptr<Peripheral<EmptyConfiguration>> createPeripheral(const std::string& name, const std::shared_ptr<SoilMoistureSensorDeviceConfig> deviceConfig, std::shared_ptr<MqttRoot> mqttRoot, const PeripheralServices& services) override {
-        return std::make_unique<SoilMoistureSensor>(name, mqttRoot, deviceConfig);
+        return std::make_unique<SoilMoistureSensor>(name, mqttRoot, services.scheduler, services.adc, deviceConfig);
     }
 };
 
@@ -6,6 +6,7 @@
 #include <Component.hpp>
 #include <Concurrent.hpp>
 #include <PulseCounter.hpp>
+#include <Scheduler.hpp>
 #include <Telemetry.hpp>
 
 #include <peripherals/Peripheral.hpp>
@@ -46,6 +47,7 @@ public:
         const std::string& name,
         std::shared_ptr<MqttRoot> mqttRoot,
         std::shared_ptr<PulseCounterManager> pulseCounterManager,
+        std::shared_ptr<Scheduler> scheduler,
         const std::shared_ptr<ElectricFenceMonitorDeviceConfig> config)
         : Component(name, mqttRoot) {
 
@@ -63,7 +65,7 @@ public:
         }
 
         auto measurementFrequency = config->measurementFrequency.get();
-        Task::loop(name, 3172, [this, measurementFrequency](Task& task) {
+        scheduler->schedule(name, measurementFrequency, [this]() {
             uint16_t lastVoltage = 0;
             for (auto& pin : pins) {
                 uint32_t count = pin.counter->reset();
@@ -75,9 +77,9 @@ public:
                 }
             }
             this->lastVoltage = lastVoltage;
+            recordSample();
             LOGV("Last voltage: %d",
                 lastVoltage);
-            task.delayUntil(measurementFrequency);
         });
     }
 
@@ -103,9 +105,10 @@ public:
         const std::string& name,
         std::shared_ptr<MqttRoot> mqttRoot,
         std::shared_ptr<PulseCounterManager> pulseCounterManager,
+        std::shared_ptr<Scheduler> scheduler,
         const std::shared_ptr<ElectricFenceMonitorDeviceConfig> config)
         : Peripheral<EmptyConfiguration>(name, mqttRoot)
-        , monitor(name, mqttRoot, pulseCounterManager, config) {
+        , monitor(name, mqttRoot, pulseCounterManager, scheduler, config) {
     }
 
     void populateTelemetry(JsonObject& telemetryJson) override {
@@ -124,7 +127,7 @@ public:
     }
 
     std::unique_ptr<Peripheral<EmptyConfiguration>> createPeripheral(const std::string& name, const std::shared_ptr<ElectricFenceMonitorDeviceConfig> deviceConfig, std::shared_ptr<MqttRoot> mqttRoot, const PeripheralServices& services) override {
-        return std::make_unique<ElectricFenceMonitor>(name, mqttRoot, services.pulseCounterManager, deviceConfig);
+        return std::make_unique<ElectricFenceMonitor>(name, mqttRoot, services.pulseCounterManager, services.scheduler, deviceConfig);
     }
 };
 
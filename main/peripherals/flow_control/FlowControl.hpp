@@ -29,15 +29,19 @@ public:
         const std::string& name,
         std::shared_ptr<MqttRoot> mqttRoot,
         std::shared_ptr<PulseCounterManager> pulseCounterManager,
+        std::shared_ptr<Scheduler> scheduler,
+        const State& rtcInSync,
         std::unique_ptr<ValveControlStrategy> strategy,
         InternalPinPtr pin,
         double qFactor,
-        milliseconds measurementFrequency)
+        milliseconds measurementFrequency,
+        double checkpointVolume,
+        minutes checkpointInterval)
         : Peripheral<FlowControlConfig>(name, mqttRoot)
-        , valve(name, std::move(strategy), mqttRoot, [this]() {
+        , valve(name, std::move(strategy), mqttRoot, rtcInSync, [this]() {
             publishTelemetry();
         })
-        , flowMeter(name, mqttRoot, pulseCounterManager, pin, qFactor, measurementFrequency) {
+        , flowMeter(name, mqttRoot, pulseCounterManager, scheduler, pin, qFactor, measurementFrequency, checkpointVolume, checkpointInterval) {
     }
 
     void configure(const std::shared_ptr<FlowControlConfig> config) override {
@@ -51,6 +55,18 @@ public:
 
     void shutdown(const ShutdownParameters parameters) override {
         valve.closeBeforeShutdown();
+        flowMeter.checkpointTotal();
+    }
+
+    void clockInSync() override {
+        valve.clockInSync();
+    }
+
+    /**
+     * @brief Current flow rate in liters / min.
+     */
+    double getFlowRate() const {
+        return flowMeter.getFlowRate();
     }
 
 private:
@@ -89,12 +105,20 @@ public:
             name,
             mqttRoot,
             services.pulseCounterManager,
+            services.scheduler,
+            services.rtcInSync,
 
             std::move(strategy),
 
             flowMeterConfig->pin.get(),
             flowMeterConfig->qFactor.get(),
-            flowMeterConfig->measurementFrequency.get());
+            flowMeterConfig->measurementFrequency.get(),
+            flowMeterConfig->checkpointVolume.get(),
+            flowMeterConfig->checkpointInterval.get());
+    }
+
+    bool requiresWallClock() const override {
+        return true;
     }
 };
 
@@ -21,17 +21,24 @@ public:
         const std::string& name,
         std::shared_ptr<MqttRoot> mqttRoot,
         std::shared_ptr<PulseCounterManager> pulseCounterManager,
+        std::shared_ptr<Scheduler> scheduler,
         InternalPinPtr pin,
         double qFactor,
-        milliseconds measurementFrequency)
+        milliseconds measurementFrequency,
+        double checkpointVolume,
+        minutes checkpointInterval)
         : Peripheral<EmptyConfiguration>(name, mqttRoot)
-        , flowMeter(name, mqttRoot, pulseCounterManager, pin, qFactor, measurementFrequency) {
+        , flowMeter(name, mqttRoot, pulseCounterManager, scheduler, pin, qFactor, measurementFrequency, checkpointVolume, checkpointInterval) {
     }
 
     void populateTelemetry(JsonObject& telemetryJson) override {
         flowMeter.populateTelemetry(telemetryJson);
     }
 
+    void shutdown(const ShutdownParameters parameters) override {
+        flowMeter.checkpointTotal();
+    }
+
 private:
     FlowMeterComponent flowMeter;
 };
@@ -44,7 +51,7 @@ public:
     }
 
     std::unique_ptr<Peripheral<EmptyConfiguration>> createPeripheral(const std::string& name, const std::shared_ptr<FlowMeterDeviceConfig> deviceConfig, std::shared_ptr<MqttRoot> mqttRoot, const PeripheralServices& services) override {
-        return std::make_unique<FlowMeter>(name, mqttRoot, services.pulseCounterManager, deviceConfig->pin.get(), deviceConfig->qFactor.get(), deviceConfig->measurementFrequency.get());
+        return std::make_unique<FlowMeter>(name, mqttRoot, services.pulseCounterManager, services.scheduler, deviceConfig->pin.get(), deviceConfig->qFactor.get(), deviceConfig->measurementFrequency.get(), deviceConfig->checkpointVolume.get(), deviceConfig->checkpointInterval.get());
     }
 };
 
@@ -7,9 +7,12 @@
 #include <BootClock.hpp>
 #include <Component.hpp>
 #include <Concurrent.hpp>
+#include <NvsStore.hpp>
 #include <PulseCounter.hpp>
+#include <Scheduler.hpp>
 #include <Task.hpp>
 #include <Telemetry.hpp>
+#include <Totalizer.hpp>
 #include <mqtt/MqttDriver.hpp>
 
 using namespace farmhub::kernel::mqtt;
@@ -24,40 +27,49 @@ public:
         const std::string& name,
         std::shared_ptr<MqttRoot> mqttRoot,
         std::shared_ptr<PulseCounterManager> pulseCounterManager,
+        std::shared_ptr<Scheduler> scheduler,
         InternalPinPtr pin,
         double qFactor,
-        milliseconds measurementFrequency)
+        milliseconds measurementFrequency,
+        double checkpointVolume,
+        minutes checkpointInterval)
         : Component(name, mqttRoot)
-        , qFactor(qFactor) {
+        , qFactor(qFactor)
+        , nvs(name)
+        , totalizer(static_cast<uint64_t>(checkpointVolume * qFactor * 60), checkpointInterval) {
 
         LOGI("Initializing flow meter on pin %s with Q = %.2f",
             pin->getName().c_str(), qFactor);
 
+        restoreTotal();
+
         counter = pulseCounterManager->create(pin);
 
         auto now = boot_clock::now();
         lastMeasurement = now;
         lastSeenFlow = now;
-        lastPublished = now;
 
-        Task::loop(name, 3172, [this, measurementFrequency](Task& task) {
+        // We measure elapsed time, so it is fine to run late to share a wakeup with other jobs
+        scheduler->schedule(name, measurementFrequency, measurementFrequency / 2, [this]() {
             auto now = boot_clock::now();
             milliseconds elapsed = duration_cast<milliseconds>(now - lastMeasurement);
             if (elapsed.count() > 0) {
                 lastMeasurement = now;
 
                 uint32_t pulses = counter->reset();
+                recordSample();
 
+                Lock lock(updateMutex);
                 if (pulses > 0) {
-                    Lock lock(updateMutex);
                     double currentVolume = pulses / this->qFactor / 60.0f;
                     LOGV("Counted %lu pulses, %.2f l/min, %.2f l",
                         pulses, currentVolume / (elapsed.count() / 1000.0f / 60.0f), currentVolume);
                     volume += currentVolume;
+                    totalizer.add(pulses);
                     lastSeenFlow = now;
                 }
+                checkpointTotalUnderLock(false);
             }
-            task.delayUntil(measurementFrequency);
         });
     }
 
@@ -68,26 +80,80 @@ public:
         pupulateTelemetryUnderLock(json);
     }
 
+    /**
+     * @brief Save the total to flash, e.g. before shutting down.
+     *
+     * @param force save even if no checkpoint is due yet.
+     */
+    void checkpointTotal(bool force = true) {
+        Lock lock(updateMutex);
+        checkpointTotalUnderLock(force);
+    }
+
+    /**
+     * @brief Current flow rate in liters / min, based on the time between the last pulses.
+     */
+    double getFlowRate() const {
+        return counter->getInstantaneousFrequency() / qFactor;
+    }
+
 private:
     void inline pupulateTelemetryUnderLock(JsonObject& json) {
         auto currentVolume = volume;
         volume = 0;
         // Volume is measured in liters
         json["volume"] = currentVolume;
-        auto duration = duration_cast<microseconds>(lastMeasurement - lastPublished);
-        if (duration > microseconds::zero()) {
-            // Flow rate is measured in in liters / min
-            json["flowRate"] = currentVolume / duration.count() * 1000 * 1000 * 60;
+        // Totals only ever grow within a generation; a new generation starts after each reboot
+        json["totalPulses"] = totalizer.getTotal();
+        json["totalVolume"] = totalizer.getTotal() / qFactor / 60.0;
+        json["totalGeneration"] = totalizer.getGeneration();
+        // Flow rate is measured in in liters / min; with Q pulses per second for every liter / min
+        json["flowRate"] = counter->takeAverageFrequency() / qFactor;
+    }
+
+    void inline checkpointTotalUnderLock(bool force) {
+        // Saved under the update lock, so no total gets reported before it is checkpointed,
+        // and an older checkpoint cannot overwrite a newer one
+        auto now = boot_clock::now().time_since_epoch();
+        auto checkpoint = force
+            ? totalizer.checkpointNow(now)
+            : totalizer.checkpointIfDue(now);
+        if (checkpoint.has_value()) {
+            saveTotal(*checkpoint);
         }
-        lastPublished = lastMeasurement;
     }
 
+    void restoreTotal() {
+        Totalizer::Checkpoint saved;
+        std::optional<Totalizer::Checkpoint> restored;
+        if (nvs.getBinary(TOTAL_KEY, saved, TOTAL_VERSION)) {
+            restored = saved;
+        }
+        totalizer.restore(restored, boot_clock::now().time_since_epoch());
+        LOGI("Flow meter '%s' continues from %llu pulses, generation %lu",
+            name.c_str(), totalizer.getTotal(), totalizer.getGeneration());
+    }
+
+    void saveTotal(const Totalizer::Checkpoint& checkpoint) {
+        LOGV("Saving flow meter total of %llu pulses",
+            checkpoint.total);
+        if (!nvs.setBinary(TOTAL_KEY, checkpoint, TOTAL_VERSION)) {
+            LOGE("Failed to save total for flow meter '%s'",
+                name.c_str());
+        }
+    }
+
+    static constexpr const char* TOTAL_KEY = "total";
+    static constexpr uint16_t TOTAL_VERSION = 1;
+
     std::shared_ptr<PulseCounter> counter;
     const double qFactor;
 
+    NvsStore nvs;
+    Totalizer totalizer;
+
     time_point<boot_clock> lastMeasurement;
     time_point<boot_clock> lastSeenFlow;
-    time_point<boot_clock> lastPublished;
     double volume = 0.0;
 
     Mutex updateMutex;
@@ -16,6 +16,16 @@ public:
     Property<InternalPinPtr> pin { this, "pin" };
     Property<double> qFactor { this, "qFactor", 5.0 };
     Property<milliseconds> measurementFrequency { this, "measurementFrequency", 1s };
+
+    /**
+     * @brief Save the total volume to flash after this many liters have flown...
+     */
+    Property<double> checkpointVolume { this, "checkpointVolume", 100 };
+
+    /**
+     * @brief ...or after this much time has passed, if any water has flown at all.
+     */
+    Property<minutes> checkpointInterval { this, "checkpointInterval", 15min };
 };
 
 }
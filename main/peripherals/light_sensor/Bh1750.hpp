@@ -29,6 +29,7 @@ class Bh1750DeviceConfig
 public:
     Property<seconds> measurementFrequency { this, "measurementFrequency", 1s };
     Property<seconds> latencyInterval { this, "latencyInterval", 5s };
+    ArrayProperty<FilterSpec> filters { this, "filters" };
 };
 
 class Bh1750Component
@@ -38,10 +39,12 @@ public:
         const std::string& name,
         std::shared_ptr<MqttRoot> mqttRoot,
         std::shared_ptr<I2CManager> i2c,
+        std::shared_ptr<Scheduler> scheduler,
         I2CConfig config,
         seconds measurementFrequency,
-        seconds latencyInterval)
-        : LightSensorComponent(name, mqttRoot, measurementFrequency, latencyInterval) {
+        seconds latencyInterval,
+        const std::list<FilterSpec>& filters)
+        : LightSensorComponent(name, mqttRoot, scheduler, measurementFrequency, latencyInterval, filters) {
 
         LOGI("Initializing BH1750 light sensor with %s",
             config.toString().c_str());
@@ -74,11 +77,13 @@ public:
         const std::string& name,
         std::shared_ptr<MqttRoot> mqttRoot,
         std::shared_ptr<I2CManager> i2c,
+        std::shared_ptr<Scheduler> scheduler,
         const I2CConfig& config,
         seconds measurementFrequency,
-        seconds latencyInterval)
+        seconds latencyInterval,
+        const std::list<FilterSpec>& filters)
         : Peripheral<EmptyConfiguration>(name, mqttRoot)
-        , component(name, mqttRoot, i2c, config, measurementFrequency, latencyInterval) {
+        , component(name, mqttRoot, i2c, scheduler, config, measurementFrequency, latencyInterval, filters) {
     }
 
     void populateTelemetry(JsonObject& telemetryJson) override {
@@ -98,7 +103,7 @@ public:
 
     std::unique_ptr<Peripheral<EmptyConfiguration>> createPeripheral(const std::string& name, const std::shared_ptr<Bh1750DeviceConfig> deviceConfig, std::shared_ptr<MqttRoot> mqttRoot, const PeripheralServices& services) override {
         I2CConfig i2cConfig = deviceConfig->parse(0x23);
-        return std::make_unique<Bh1750>(name, mqttRoot, services.i2c, i2cConfig, deviceConfig->measurementFrequency.get(), deviceConfig->latencyInterval.get());
+        return std::make_unique<Bh1750>(name, mqttRoot, services.i2c, services.scheduler, i2cConfig, deviceConfig->measurementFrequency.get(), deviceConfig->latencyInterval.get(), deviceConfig->filters.get());
     }
 };
 
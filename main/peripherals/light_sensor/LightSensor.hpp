@@ -1,12 +1,22 @@
 #pragma once
 
+#include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <functional>
+#include <list>
 #include <memory>
+#include <optional>
+#include <vector>
 
+#include <AdaptiveSampler.hpp>
+#include <BootClock.hpp>
 #include <Component.hpp>
 #include <Configuration.hpp>
 #include <I2CManager.hpp>
-#include <MovingAverage.hpp>
+#include <Scheduler.hpp>
+#include <Statistics.hpp>
+#include <StatisticsConfig.hpp>
 #include <Telemetry.hpp>
 
 #include <peripherals/I2CConfig.hpp>
@@ -27,45 +37,169 @@ public:
     LightSensorComponent(
         const std::string& name,
         std::shared_ptr<MqttRoot> mqttRoot,
+        std::shared_ptr<Scheduler> scheduler,
         seconds measurementFrequency,
-        seconds latencyInterval)
+        seconds latencyInterval,
+        const std::list<FilterSpec>& filters)
         : Component(name, mqttRoot)
+        , scheduler(scheduler)
         , measurementFrequency(measurementFrequency)
+        , latencyInterval(latencyInterval)
+        , filters(filters)
         , level(latencyInterval.count() / measurementFrequency.count()) {
+        if (static_cast<size_t>(latencyInterval / measurementFrequency) > MAX_FILTER_WINDOW) {
+            LOGW("Light sensor '%s' can average at most %u samples, latency will be shorter than configured",
+                name.c_str(), MAX_FILTER_WINDOW);
+        }
     }
 
     double getCurrentLevel() {
         Lock lock(updateAverageMutex);
-        return level.getAverage();
+        return level.getMean();
     }
 
     seconds getMeasurementFrequency() {
         return measurementFrequency;
     }
 
+    /**
+     * @brief Only sample often when the light level is close to one of the thresholds.
+     *
+     * Far from all thresholds we sample less and less often, down to once every `maxInterval`.
+     * Sensors that can watch the thresholds themselves stop sampling altogether until the
+     * light level leaves the band between the thresholds around it.
+     */
+    void setThresholds(const std::vector<double>& thresholds, seconds maxInterval) {
+        {
+            Lock lock(samplingMutex);
+            sampler.emplace(measurementFrequency, maxInterval);
+            sampler->setThresholds(thresholds);
+        }
+        LOGD("Light sensor '%s' samples adaptively every %lld to %lld s",
+            name.c_str(), measurementFrequency.count(), maxInterval.count());
+        scheduleSampling(measurementFrequency);
+    }
+
+    /**
+     * @brief Called with the averaged light level after every sample.
+     */
+    void onLevelUpdated(std::function<void(double)> listener) {
+        Lock lock(samplingMutex);
+        levelListener = listener;
+    }
+
     void populateTelemetry(JsonObject& json) override {
         Lock lock(updateAverageMutex);
-        json["light"] = level.getAverage();
+        json["light"] = level.getMean();
     }
 
 protected:
     virtual double readLightLevel() = 0;
 
+    /**
+     * @brief Have the sensor raise an interrupt when the light level leaves `band`.
+     *
+     * Returns false if the sensor cannot do this, and needs to be sampled instead.
+     */
+    virtual bool armThresholdInterrupt([[maybe_unused]] AdaptiveSampler::Band band) {
+        return false;
+    }
+
+    /**
+     * @brief To be called when the threshold interrupt fires.
+     *
+     * Samples at the full rate for a latency interval to settle the average, then re-arms the interrupt.
+     */
+    void thresholdCrossed() {
+        LOGV("Light level for '%s' left the threshold band",
+            name.c_str());
+        {
+            Lock lock(samplingMutex);
+            burstUntil = boot_clock::now() + latencyInterval;
+        }
+        scheduleSampling(measurementFrequency);
+    }
+
     void runLoop() {
-        Task::loop(name, 3072, [this](Task& task) {
+        scheduleSampling(measurementFrequency);
+    }
+
+private:
+    void sample() {
+        double mean;
+        std::function<void(double)> listener;
+        {
+            Lock lock(samplingMutex);
             auto currentLevel = readLightLevel();
-            {
-                Lock lock(updateAverageMutex);
-                level.record(currentLevel);
+            recordSample();
+            Lock averageLock(updateAverageMutex);
+            level.record(filters.filter(currentLevel));
+            mean = level.getMean();
+            listener = levelListener;
+        }
+        if (listener) {
+            listener(mean);
+        }
+        planNextSample(mean);
+    }
+
+    void planNextSample(double mean) {
+        std::optional<AdaptiveSampler::Band> band;
+        microseconds interval;
+        {
+            Lock lock(samplingMutex);
+            if (!sampler.has_value() || std::isnan(mean) || boot_clock::now() < burstUntil) {
+                interval = measurementFrequency;
+            } else {
+                band = sampler->bandAround(mean);
+                interval = sampler->nextInterval(mean);
+            }
+        }
+        if (band.has_value() && armThresholdInterrupt(*band)) {
+            stopSampling();
+        } else {
+            scheduleSampling(interval);
+        }
+    }
+
+    void scheduleSampling(microseconds interval) {
+        Lock lock(jobMutex);
+        if (job != nullptr) {
+            if (job->period == interval) {
+                return;
             }
-            task.delayUntil(measurementFrequency);
+            job->cancel();
+        }
+        // Sampling a bit late is fine, we are averaging anyway
+        job = scheduler->schedule(name, interval, interval / 2, [this]() {
+            sample();
         });
     }
 
-private:
+    void stopSampling() {
+        Lock lock(jobMutex);
+        if (job != nullptr) {
+            job->cancel();
+            job = nullptr;
+        }
+    }
+
+    const std::shared_ptr<Scheduler> scheduler;
     const seconds measurementFrequency;
+    const seconds latencyInterval;
     Mutex updateAverageMutex;
-    MovingAverage<double> level;
+    // Configurable filters (e.g. to remove outliers) before averaging over the latency interval
+    FilterChain<double> filters;
+    MovingMean<double, MAX_FILTER_WINDOW> level;
+
+    // Held while sampling, so samples triggered by the interrupt and the scheduler don't mix
+    Mutex samplingMutex;
+    std::optional<AdaptiveSampler> sampler;
+    boot_clock::time_point burstUntil;
+    std::function<void(double)> levelListener;
+
+    Mutex jobMutex;
+    JobHandle job;
 };
 
 }    // namespace farmhub::peripherals::light_sensor
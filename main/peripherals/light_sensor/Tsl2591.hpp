@@ -1,14 +1,17 @@
 #pragma once
 
 #include <chrono>
+#include <limits>
 #include <memory>
 
 #include <tsl2591.h>
 
 #include <Component.hpp>
+#include <Concurrent.hpp>
 #include <Configuration.hpp>
 #include <I2CManager.hpp>
 #include <Telemetry.hpp>
+#include <drivers/SwitchManager.hpp>
 
 #include <peripherals/I2CConfig.hpp>
 #include <peripherals/Peripheral.hpp>
@@ -18,6 +21,7 @@ using namespace std::chrono;
 using namespace std::chrono_literals;
 
 using namespace farmhub::kernel;
+using namespace farmhub::kernel::drivers;
 using namespace farmhub::peripherals;
 
 namespace farmhub::peripherals::light_sensor {
@@ -29,6 +33,7 @@ class Tsl2591DeviceConfig
 public:
     Property<seconds> measurementFrequency { this, "measurementFrequency", 1s };
     Property<seconds> latencyInterval { this, "latencyInterval", 5s };
+    ArrayProperty<FilterSpec> filters { this, "filters" };
 };
 
 class Tsl2591Component
@@ -38,10 +43,12 @@ public:
         const std::string& name,
         std::shared_ptr<MqttRoot> mqttRoot,
         std::shared_ptr<I2CManager> i2c,
+        std::shared_ptr<Scheduler> scheduler,
         I2CConfig config,
         seconds measurementFrequency,
-        seconds latencyInterval)
-        : LightSensorComponent(name, mqttRoot, measurementFrequency, latencyInterval)
+        seconds latencyInterval,
+        const std::list<FilterSpec>& filters)
+        : LightSensorComponent(name, mqttRoot, scheduler, measurementFrequency, latencyInterval, filters)
         , bus(i2c->getBusFor(config)) {
 
         LOGI("Initializing TSL2591 light sensor with %s",
@@ -59,21 +66,82 @@ public:
         runLoop();
     }
 
+    /**
+     * @brief Have the sensor signal threshold crossings on its INT pin, instead of sampling it all the time.
+     *
+     * Only takes effect once thresholds are set via `setThresholds()`.
+     */
+    void useThresholdInterrupt(std::shared_ptr<SwitchManager> switches, InternalPinPtr interruptPin) {
+        LOGI("Using TSL2591 threshold interrupt on pin %s",
+            interruptPin->getName().c_str());
+        {
+            Lock lock(sensorMutex);
+            // Ignore short flickers, like a bird flying by: require 10 x 300 ms out of band
+            ESP_ERROR_CHECK(tsl2591_set_persistence_filter(&sensor, TSL2591_10_CYCLES));
+            ESP_ERROR_CHECK(tsl2591_set_interrupt(&sensor, TSL2591_INTERRUPT_NONE));
+            ESP_ERROR_CHECK(tsl2591_clear_als_intr(&sensor));
+        }
+        // INT is open-drain and active low
+        switches->onEngaged(name + ":threshold", interruptPin, SwitchMode::PullUp, [this](const Switch&) {
+            {
+                Lock lock(sensorMutex);
+                ESP_ERROR_CHECK(tsl2591_set_interrupt(&sensor, TSL2591_INTERRUPT_NONE));
+                ESP_ERROR_CHECK(tsl2591_clear_als_intr(&sensor));
+            }
+            thresholdCrossed();
+        });
+        interruptAvailable = true;
+    }
+
 protected:
     double readLightLevel() override {
+        Lock lock(sensorMutex);
         esp_err_t res;
+        uint16_t channel0;
+        uint16_t channel1;
         float lux;
-        if ((res = tsl2591_get_lux(&sensor, &lux)) != ESP_OK) {
+        if ((res = tsl2591_get_channel_data(&sensor, &channel0, &channel1)) != ESP_OK
+            || (res = tsl2591_calculate_lux(&sensor, channel0, channel1, &lux)) != ESP_OK) {
             LOGD("Could not read light level: %s", esp_err_to_name(res));
             return std::numeric_limits<double>::quiet_NaN();
-        } else {
-            return lux;
         }
+        if (lux > 0) {
+            countsPerLux = channel0 / lux;
+        }
+        return lux;
+    }
+
+    bool armThresholdInterrupt(AdaptiveSampler::Band band) override {
+        if (!interruptAvailable || countsPerLux <= 0) {
+            // We need to have seen some light to translate thresholds to raw counts
+            return false;
+        }
+        Lock lock(sensorMutex);
+        // Thresholds apply to the raw full-spectrum channel; we assume the ratio of IR stays similar to the last reading
+        ESP_ERROR_CHECK(tsl2591_set_als_low_thresh(&sensor, toCounts(band.low)));
+        ESP_ERROR_CHECK(tsl2591_set_als_high_thresh(&sensor, toCounts(band.high)));
+        ESP_ERROR_CHECK(tsl2591_clear_als_intr(&sensor));
+        ESP_ERROR_CHECK(tsl2591_set_interrupt(&sensor, TSL2591_ALS_INTR));
+        LOGV("Armed TSL2591 threshold interrupt for %.2f - %.2f lux",
+            band.low, band.high);
+        return true;
     }
 
 private:
+    uint16_t toCounts(double lux) const {
+        double counts = lux * countsPerLux;
+        return counts >= std::numeric_limits<uint16_t>::max()
+            ? std::numeric_limits<uint16_t>::max()
+            : static_cast<uint16_t>(counts);
+    }
+
     std::shared_ptr<I2CBus> bus;
     tsl2591_t sensor {};
+
+    // Sampling, re-arming and the interrupt handler all talk to the sensor
+    Mutex sensorMutex;
+    bool interruptAvailable = false;
+    double countsPerLux = 0;
 };
 
 class Tsl2591
@@ -84,11 +152,13 @@ public:
         const std::string& name,
         std::shared_ptr<MqttRoot> mqttRoot,
         std::shared_ptr<I2CManager> i2c,
+        std::shared_ptr<Scheduler> scheduler,
         const I2CConfig& config,
         seconds measurementFrequency,
-        seconds latencyInterval)
+        seconds latencyInterval,
+        const std::list<FilterSpec>& filters)
         : Peripheral<EmptyConfiguration>(name, mqttRoot)
-        , component(name, mqttRoot, i2c, config, measurementFrequency, latencyInterval) {
+        , component(name, mqttRoot, i2c, scheduler, config, measurementFrequency, latencyInterval, filters) {
     }
 
     void populateTelemetry(JsonObject& telemetryJson) override {
@@ -108,7 +178,7 @@ public:
 
     std::unique_ptr<Peripheral<EmptyConfiguration>> createPeripheral(const std::string& name, const std::shared_ptr<Tsl2591DeviceConfig> deviceConfig, std::shared_ptr<MqttRoot> mqttRoot, const PeripheralServices& services) override {
         I2CConfig i2cConfig = deviceConfig->parse(TSL2591_ADDR);
-        return std::make_unique<Tsl2591>(name, mqttRoot, services.i2c, i2cConfig, deviceConfig->measurementFrequency.get(), deviceConfig->latencyInterval.get());
+        return std::make_unique<Tsl2591>(name, mqttRoot, services.i2c, services.scheduler, i2cConfig, deviceConfig->measurementFrequency.get(), deviceConfig->latencyInterval.get(), deviceConfig->filters.get());
     }
 };
 
@@ -28,9 +28,10 @@ public:
     Valve(
         const std::string& name,
         std::unique_ptr<ValveControlStrategy> strategy,
-        std::shared_ptr<MqttRoot> mqttRoot)
+        std::shared_ptr<MqttRoot> mqttRoot,
+        const State& rtcInSync)
         : Peripheral<ValveConfig>(name, mqttRoot)
-        , valve(name, std::move(strategy), mqttRoot, [this]() {
+        , valve(name, std::move(strategy), mqttRoot, rtcInSync, [this]() {
             publishTelemetry();
         }) {
     }
@@ -47,6 +48,10 @@ public:
         valve.closeBeforeShutdown();
     }
 
+    void clockInSync() override {
+        valve.clockInSync();
+    }
+
 private:
     ValveComponent valve;
 };
@@ -64,7 +69,11 @@ public:
 
     std::unique_ptr<Peripheral<ValveConfig>> createPeripheral(const std::string& name, const std::shared_ptr<ValveDeviceConfig> deviceConfig, std::shared_ptr<MqttRoot> mqttRoot, const PeripheralServices& services) override {
         auto strategy = deviceConfig->createValveControlStrategy(this);
-        return std::make_unique<Valve>(name, std::move(strategy), mqttRoot);
+        return std::make_unique<Valve>(name, std::move(strategy), mqttRoot, services.rtcInSync);
+    }
+
+    bool requiresWallClock() const override {
+        return true;
     }
 };
 
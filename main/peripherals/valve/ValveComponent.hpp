@@ -11,6 +11,7 @@
 #include <Component.hpp>
 #include <Concurrent.hpp>
 #include <NvsStore.hpp>
+#include <State.hpp>
 #include <Task.hpp>
 #include <Telemetry.hpp>
 #include <Time.hpp>
@@ -37,21 +38,46 @@ public:
 class MotorValveControlStrategy
     : public ValveControlStrategy {
 public:
-    MotorValveControlStrategy(std::shared_ptr<PwmMotorDriver> controller)
-        : controller(controller) {
+    MotorValveControlStrategy(std::shared_ptr<PwmMotorDriver> controller, const MotorDriveProfile& profile)
+        : controller(controller)
+        , profile(profile) {
     }
 
 protected:
+    /**
+     * @brief Run the motor until the valve has switched, or the motor stalls at the end-stop; leaves it running.
+     */
+    void switchValve(MotorPhase phase) {
+        auto result = switchMotor(*controller, phase, profile, [](milliseconds delay) {
+            Task::delay(delay);
+        });
+        if (result.outcome == MotorSwitchOutcome::Stalled) {
+            LOGD("Valve reached end-stop after %lld ms (running current %.0f, peak %.0f)",
+                result.elapsed.count(), result.runningCurrent.value_or(0), result.peakCurrent.value_or(0));
+        }
+    }
+
+    std::string describeProfile() const {
+        std::string description = "switch duration " + std::to_string(profile.switchDuration.count()) + " ms";
+        if (profile.rampTime > 0ms) {
+            description += ", ramp " + std::to_string(profile.rampTime.count()) + " ms";
+        }
+        if (profile.stallRatio > 0) {
+            description += ", stall at " + std::to_string(profile.stallRatio) + "x running current";
+        }
+        return description;
+    }
+
     const std::shared_ptr<PwmMotorDriver> controller;
+    const MotorDriveProfile profile;
 };
 
 class HoldingMotorValveControlStrategy
     : public MotorValveControlStrategy {
 
 public:
-    HoldingMotorValveControlStrategy(std::shared_ptr<PwmMotorDriver> controller, milliseconds switchDuration, double holdDuty)
-        : MotorValveControlStrategy(controller)
-        , switchDuration(switchDuration)
+    HoldingMotorValveControlStrategy(std::shared_ptr<PwmMotorDriver> controller, const MotorDriveProfile& profile, double holdDuty)
+        : MotorValveControlStrategy(controller, profile)
         , holdDuty(holdDuty) {
     }
 
@@ -70,13 +96,11 @@ protected:
         }
     }
 
-    const milliseconds switchDuration;
     const double holdDuty;
 
 private:
     void driveAndHold(MotorPhase phase) {
-        controller->drive(phase, 1.0);
-        Task::delay(switchDuration);
+        switchValve(phase);
         controller->drive(phase, holdDuty);
     }
 };
@@ -84,8 +108,8 @@ private:
 class NormallyClosedMotorValveControlStrategy
     : public HoldingMotorValveControlStrategy {
 public:
-    NormallyClosedMotorValveControlStrategy(std::shared_ptr<PwmMotorDriver> controller, milliseconds switchDuration, double holdDuty)
-        : HoldingMotorValveControlStrategy(controller, switchDuration, holdDuty) {
+    NormallyClosedMotorValveControlStrategy(std::shared_ptr<PwmMotorDriver> controller, const MotorDriveProfile& profile, double holdDuty)
+        : HoldingMotorValveControlStrategy(controller, profile, holdDuty) {
     }
 
     void open() override {
@@ -101,15 +125,15 @@ public:
     }
 
     std::string describe() const override {
-        return "normally closed with switch duration " + std::to_string(switchDuration.count()) + " ms and hold duty " + std::to_string(holdDuty * 100) + "%";
+        return "normally closed with " + describeProfile() + " and hold duty " + std::to_string(holdDuty * 100) + "%";
     }
 };
 
 class NormallyOpenMotorValveControlStrategy
     : public HoldingMotorValveControlStrategy {
 public:
-    NormallyOpenMotorValveControlStrategy(std::shared_ptr<PwmMotorDriver> controller, milliseconds switchDuration, double holdDuty)
-        : HoldingMotorValveControlStrategy(controller, switchDuration, holdDuty) {
+    NormallyOpenMotorValveControlStrategy(std::shared_ptr<PwmMotorDriver> controller, const MotorDriveProfile& profile, double holdDuty)
+        : HoldingMotorValveControlStrategy(controller, profile, holdDuty) {
     }
 
     void open() override {
@@ -125,28 +149,24 @@ public:
     }
 
     std::string describe() const override {
-        return "normally open with switch duration " + std::to_string(switchDuration.count()) + " ms and hold duty " + std::to_string(holdDuty * 100) + "%";
+        return "normally open with " + describeProfile() + " and hold duty " + std::to_string(holdDuty * 100) + "%";
     }
 };
 
 class LatchingMotorValveControlStrategy
     : public MotorValveControlStrategy {
 public:
-    LatchingMotorValveControlStrategy(std::shared_ptr<PwmMotorDriver> controller, milliseconds switchDuration, double switchDuty = 1.0)
-        : MotorValveControlStrategy(controller)
-        , switchDuration(switchDuration)
-        , switchDuty(switchDuty) {
+    LatchingMotorValveControlStrategy(std::shared_ptr<PwmMotorDriver> controller, const MotorDriveProfile& profile)
+        : MotorValveControlStrategy(controller, profile) {
     }
 
     void open() override {
-        controller->drive(MotorPhase::FORWARD, switchDuty);
-        Task::delay(switchDuration);
+        switchValve(MotorPhase::FORWARD);
         controller->stop();
     }
 
     void close() override {
-        controller->drive(MotorPhase::REVERSE, switchDuty);
-        Task::delay(switchDuration);
+        switchValve(MotorPhase::REVERSE);
         controller->stop();
     }
 
@@ -155,12 +175,8 @@ public:
     }
 
     std::string describe() const override {
-        return "latching with switch duration " + std::to_string(switchDuration.count()) + " ms and switch duty " + std::to_string(switchDuty * 100) + "%";
+        return "latching with " + describeProfile() + " and switch duty " + std::to_string(profile.switchDuty * 100) + "%";
     }
-
-private:
-    const milliseconds switchDuration;
-    const double switchDuty;
 };
 
 class LatchingPinValveControlStrategy
@@ -197,10 +213,12 @@ public:
         const std::string& name,
         std::unique_ptr<ValveControlStrategy> _strategy,
         std::shared_ptr<MqttRoot> mqttRoot,
+        const State& rtcInSync,
         std::function<void()> publishTelemetry)
         : Component(name, mqttRoot)
         , nvs(name)
         , strategy(std::move(_strategy))
+        , rtcInSync(rtcInSync)
         , publishTelemetry(publishTelemetry) {
 
         LOGI("Creating valve '%s' with strategy %s",
@@ -221,7 +239,7 @@ public:
             default:
                 // Try to load from NVS
                 ValveState lastStoredState;
-                if (nvs.get("state", lastStoredState)) {
+                if (loadState(lastStoredState)) {
                     initState = lastStoredState;
                     LOGI("Restored state for valve '%s' from NVS: %d",
                         name.c_str(), static_cast<int>(state));
@@ -259,6 +277,12 @@ public:
             ValveStateUpdate update;
             if (overrideState != ValveState::NONE) {
                 update = { overrideState, overrideUntil.load() - now };
+            } else if (!rtcInSync.isSet()) {
+                // Stay in the safe default state until we know what time it is
+                update = { this->strategy->getDefaultState(), nanoseconds::max() };
+                if (update.state == ValveState::NONE) {
+                    update.state = ValveState::CLOSED;
+                }
             } else {
                 update = ValveScheduler::getStateUpdate(schedules, now, this->strategy->getDefaultState());
                 // If there are no schedules nor default state for the valve, close it
@@ -278,7 +302,7 @@ public:
                 ? duration_cast<ticks>(update.validFor)
                 : ticks::max();
             // TODO Account for time spent in transitionTo()
-            updateQueue.pollIn(validFor, [this](const std::variant<OverrideSpec, ScheduleSpec>& change) {
+            updateQueue.pollIn(validFor, [this](const std::variant<OverrideSpec, ScheduleSpec, ClockSyncedSpec>& change) {
                 std::visit(
                     [this](auto&& arg) {
                         using T = std::decay_t<decltype(arg)>;
@@ -287,6 +311,8 @@ public:
                             overrideUntil = arg.until;
                         } else if constexpr (std::is_same_v<T, ScheduleSpec>) {
                             schedules = std::list(arg.schedules);
+                        } else if constexpr (std::is_same_v<T, ClockSyncedSpec>) {
+                            // Nothing to update, just re-evaluate
                         }
                     },
                     change);
@@ -294,6 +320,15 @@ public:
         });
     }
 
+    /**
+     * @brief Schedules can only be followed with the wall clock in sync, re-evaluate once it is.
+     */
+    void clockInSync() {
+        LOGI("Clock in sync, re-evaluating schedules for valve '%s'", name.c_str());
+        // Called from the scheduler, so don't block; if there is an update pending already, that re-evaluates, too
+        updateQueue.offer(ClockSyncedSpec {});
+    }
+
     void setSchedules(const std::list<ValveSchedule>& schedules) {
         LOGD("Setting %d schedules for valve %s",
             schedules.size(), name.c_str());
@@ -376,16 +411,33 @@ private:
         }
     }
 
+    bool loadState(ValveState& state) {
+        if (nvs.getBinary(STATE_KEY, state, STATE_VERSION)) {
+            return true;
+        }
+        // Fall back to the state stored as JSON by earlier firmware
+        if (nvs.get(LEGACY_STATE_KEY, state)) {
+            nvs.remove(LEGACY_STATE_KEY);
+            return true;
+        }
+        return false;
+    }
+
     void setState(ValveState state) {
         this->state = state;
-        if (!nvs.set("state", state)) {
+        if (!nvs.setBinary(STATE_KEY, state, STATE_VERSION)) {
             LOGE("Failed to store state for valve '%s': %d",
                 name.c_str(), static_cast<int>(state));
         }
     }
 
+    static constexpr const char* STATE_KEY = "valve-state";
+    static constexpr uint16_t STATE_VERSION = 1;
+    static constexpr const char* LEGACY_STATE_KEY = "state";
+
     NvsStore nvs;
     const std::unique_ptr<ValveControlStrategy> strategy;
+    const State rtcInSync;
     std::function<void()> publishTelemetry;
 
     ValveState state = ValveState::NONE;
@@ -401,10 +453,12 @@ private:
         std::list<ValveSchedule> schedules;
     };
 
+    struct ClockSyncedSpec { };
+
     std::list<ValveSchedule> schedules = {};
     std::atomic<ValveState> overrideState = ValveState::NONE;
     std::atomic<time_point<system_clock>> overrideUntil = time_point<system_clock>();
-    Queue<std::variant<OverrideSpec, ScheduleSpec>> updateQueue { "eventQueue", 1 };
+    Queue<std::variant<OverrideSpec, ScheduleSpec, ClockSyncedSpec>> updateQueue { "eventQueue", 1 };
 };
 
 }    // namespace farmhub::peripherals::valve
@@ -71,6 +71,21 @@ public:
      */
     Property<milliseconds> switchDuration { this, "switchDuration", 500ms };
 
+    /**
+     * @brief Duration to soft-start the motor over when switching the motorized valve.
+     *
+     * @details This is in milliseconds, default is 0ms, meaning the motor starts at full duty right away.
+     */
+    Property<milliseconds> rampTime { this, "rampTime", 0ms };
+
+    /**
+     * @brief Stop switching early when the motor current rises to this multiple of the running current.
+     *
+     * @details This catches the valve reaching its end-stop before the switch duration is up.
+     * Requires a motor driver with current sensing, default is 0, meaning disabled.
+     */
+    Property<double> stallRatio { this, "stallRatio", 0 };
+
     std::unique_ptr<ValveControlStrategy> createValveControlStrategy(const Motorized* motorOwner) const {
         PinPtr pin = this->pin.get();
         if (pin != nullptr) {
@@ -79,16 +94,22 @@ public:
 
         std::shared_ptr<PwmMotorDriver> motor = motorOwner->findMotor(this->motor.get());
 
-        auto switchDuration = this->switchDuration.get();
         auto holdDuty = this->holdDuty.get() / 100.0;
+        MotorDriveProfile profile {
+            .switchDuration = switchDuration.get(),
+            .rampTime = rampTime.get(),
+            .stallRatio = stallRatio.get(),
+        };
 
         switch (this->strategy.get()) {
             case ValveControlStrategyType::NormallyOpen:
-                return std::make_unique<NormallyOpenMotorValveControlStrategy>(motor, switchDuration, holdDuty);
+                return std::make_unique<NormallyOpenMotorValveControlStrategy>(motor, profile, holdDuty);
             case ValveControlStrategyType::NormallyClosed:
-                return std::make_unique<NormallyClosedMotorValveControlStrategy>(motor, switchDuration, holdDuty);
+                return std::make_unique<NormallyClosedMotorValveControlStrategy>(motor, profile, holdDuty);
             case ValveControlStrategyType::Latching:
-                return std::make_unique<LatchingMotorValveControlStrategy>(motor, switchDuration, holdDuty);
+                // Latching valves are switched at the configured hold duty
+                profile.switchDuty = holdDuty;
+                return std::make_unique<LatchingMotorValveControlStrategy>(motor, profile);
             default:
                 throw PeripheralCreationException("unknown strategy");
         }
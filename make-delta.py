@@ -0,0 +1,105 @@
+#!/usr/bin/env python3
+
+# Creates a delta patch to update a device running `source` firmware to `target` firmware.
+# See DeltaPatch.hpp for the patch format.
+#
+# Usage: make-delta.py <source.bin> <target.bin> <patch.bin>
+#
+# Requires bsdiff4 (pip install bsdiff4).
+
+import hashlib
+import struct
+import sys
+import zlib
+
+import bsdiff4.core
+
+MAGIC = b"FHD2"
+
+# The device inflates into a circular buffer of this size, see Inflater.hpp
+WINDOW_BITS = 13
+
+# Zero runs shorter than this are cheaper to keep as literals
+MIN_ZERO_RUN = 4
+
+
+def encode_varint(value):
+    result = bytearray()
+    while True:
+        byte = value & 0x7F
+        value >>= 7
+        if value:
+            result.append(byte | 0x80)
+        else:
+            result.append(byte)
+            return bytes(result)
+
+
+def encode_diff(diff):
+    result = bytearray()
+    literal_start = 0
+    position = 0
+    while position < len(diff):
+        if diff[position] != 0:
+            position += 1
+            continue
+        run_end = position
+        while run_end < len(diff) and diff[run_end] == 0:
+            run_end += 1
+        if run_end - position >= MIN_ZERO_RUN:
+            if literal_start < position:
+                result += encode_varint(((position - literal_start) << 1) | 1)
+                result += diff[literal_start:position]
+            result += encode_varint((run_end - position) << 1)
+            literal_start = run_end
+        position = run_end
+    if literal_start < len(diff):
+        result += encode_varint(((len(diff) - literal_start) << 1) | 1)
+        result += diff[literal_start:]
+    return bytes(result)
+
+
+def make_delta(source, target):
+    control, diff, extra = bsdiff4.core.diff(source, target)
+    patch = bytearray()
+    patch += MAGIC
+    patch += struct.pack("<II", len(source), len(target))
+    patch += hashlib.sha256(source).digest()
+    patch += hashlib.sha256(target).digest()
+    records = bytearray()
+    diff_position = 0
+    extra_position = 0
+    for diff_length, extra_length, seek in control:
+        records += struct.pack("<IIi", diff_length, extra_length, seek)
+        records += encode_diff(diff[diff_position:diff_position + diff_length])
+        records += extra[extra_position:extra_position + extra_length]
+        diff_position += diff_length
+        extra_position += extra_length
+    patch += compress(records)
+    return bytes(patch)
+
+
+def compress(records):
+    compressor = zlib.compressobj(9, zlib.DEFLATED, WINDOW_BITS)
+    return compressor.compress(records) + compressor.flush()
+
+
+def main():
+    if len(sys.argv) != 4:
+        print(f"Usage: {sys.argv[0]} <source.bin> <target.bin> <patch.bin>", file=sys.stderr)
+        sys.exit(1)
+
+    with open(sys.argv[1], "rb") as f:
+        source = f.read()
+    with open(sys.argv[2], "rb") as f:
+        target = f.read()
+
+    patch = make_delta(source, target)
+    with open(sys.argv[3], "wb") as f:
+        f.write(patch)
+
+    print(f"Created patch of {len(patch)} bytes ({100 * len(patch) / len(target):.1f}% of {len(target)} bytes)")
+
+
+if __name__ == "__main__":
+    main()
@@ -2,6 +2,12 @@
 
 #include <stdio.h>
 
+#ifdef FARMHUB_SIMULATION
+#include <VirtualClock.hpp>
+
+FARMHUB_SIMULATION_HOOKS()
+#endif
+
 extern "C" void app_main(void)
 {
     int argc = 1;